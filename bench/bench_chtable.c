@@ -0,0 +1,146 @@
+// --------------------------------------------------------------------------
+///
+/// @file bench_chtable.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_chtable.h"
+
+#include "iw_hash.h"
+
+#include "benches.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------
+
+/// The largest number of threads to run the benchmark with.
+#define BENCH_MAX_THREADS   64
+
+/// The number of operations each thread performs.
+#define BENCH_THREAD_OPS    200000
+
+/// The number of keys each thread uses.
+#define BENCH_THREAD_KEYS   1024
+
+// --------------------------------------------------------------------------
+
+/// @brief The parameters for a benchmark thread.
+typedef struct _bench_chtable_param {
+    iw_htable        *table;    ///< The table protected by a global lock.
+    pthread_rwlock_t *lock;     ///< The global lock or NULL for \a ctable.
+    iw_chtable       *ctable;   ///< The concurrent table.
+    uintptr_t         base;     ///< The first key of the thread.
+} bench_chtable_param;
+
+// --------------------------------------------------------------------------
+
+/// @brief Run a registry-like workload from one thread.
+/// Every tenth operation replaces an element, the others look elements up.
+/// This resembles the thread and memory registries where lookups dominate.
+/// @param arg The benchmark thread parameters.
+/// @return Always NULL.
+static void *bench_chtable_thread(void *arg) {
+    bench_chtable_param *param = (bench_chtable_param *)arg;
+    unsigned int cnt;
+    for(cnt=0;cnt < BENCH_THREAD_OPS;cnt++) {
+        uintptr_t key = param->base + cnt % BENCH_THREAD_KEYS;
+        bool write = cnt % 10 == 0;
+        if(param->lock != NULL) {
+            if(write) {
+                pthread_rwlock_wrlock(param->lock);
+                iw_htable_remove(param->table, sizeof(key), &key);
+                iw_htable_insert(param->table, sizeof(key), &key, (void *)key);
+            } else {
+                pthread_rwlock_rdlock(param->lock);
+                iw_htable_get(param->table, sizeof(key), &key);
+            }
+            pthread_rwlock_unlock(param->lock);
+        } else if(write) {
+            iw_chtable_remove(param->ctable, sizeof(key), &key);
+            iw_chtable_insert(param->ctable, sizeof(key), &key, (void *)key);
+        } else {
+            iw_chtable_get(param->ctable, sizeof(key), &key);
+        }
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Run the workload with the given number of threads.
+/// @param variant The name of the variant.
+/// @param params The thread parameters, only the lock and tables are set.
+/// @param num_threads The number of threads to run.
+static void bench_chtable_run(
+    const char *variant,
+    bench_chtable_param *params,
+    unsigned int num_threads)
+{
+    pthread_t threads[BENCH_MAX_THREADS];
+    unsigned int cnt;
+
+    unsigned long long start = bench_now();
+    for(cnt=0;cnt < num_threads;cnt++) {
+        params[cnt].base = (uintptr_t)cnt * BENCH_THREAD_KEYS + 1;
+        pthread_create(&threads[cnt], NULL, bench_chtable_thread, &params[cnt]);
+    }
+    for(cnt=0;cnt < num_threads;cnt++) {
+        pthread_join(threads[cnt], NULL);
+    }
+    bench_report(variant, "mixed", num_threads * BENCH_THREAD_OPS,
+                 bench_now() - start);
+}
+
+// --------------------------------------------------------------------------
+
+void bench_chtable(unsigned int max_elems) {
+    bench_chtable_param params[BENCH_MAX_THREADS];
+    unsigned int max_threads, num_threads, cnt;
+    pthread_rwlock_t lock;
+    iw_htable table;
+    iw_chtable ctable;
+
+    (void)max_elems;
+    max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(max_threads > BENCH_MAX_THREADS) {
+        max_threads = BENCH_MAX_THREADS;
+    }
+    for(num_threads=1;num_threads <= max_threads;num_threads *= 2) {
+        printf("    Threads: %u\n", num_threads);
+
+        pthread_rwlock_init(&lock, NULL);
+        iw_htable_init(&table, num_threads * BENCH_THREAD_KEYS, false,
+                       iw_hash_int);
+        for(cnt=0;cnt < num_threads;cnt++) {
+            params[cnt].table = &table;
+            params[cnt].lock  = &lock;
+        }
+        bench_chtable_run("rwlock", params, num_threads);
+        iw_htable_destroy(&table, NULL);
+        pthread_rwlock_destroy(&lock);
+
+        iw_chtable_init(&ctable, 0, num_threads * BENCH_THREAD_KEYS, false,
+                        iw_hash_int, 0);
+        for(cnt=0;cnt < num_threads;cnt++) {
+            params[cnt].ctable = &ctable;
+            params[cnt].lock   = NULL;
+        }
+        bench_chtable_run("striped", params, num_threads);
+        iw_chtable_destroy(&ctable, NULL);
+
+        if(num_threads < max_threads && num_threads * 2 > max_threads) {
+            // Finish with all available processors.
+            num_threads = max_threads / 2;
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,235 @@
+// --------------------------------------------------------------------------
+///
+/// @file bench_hash.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_hash.h"
+
+#include "benches.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+
+/// The largest number of keys in each key set.
+#define BENCH_HASH_MAX_KEYS     1000000
+
+/// The size of each key slot in a key set.
+#define BENCH_HASH_KEY_SIZE     40
+
+/// The size of the buffer hashed to measure bulk throughput.
+#define BENCH_HASH_BULK_SIZE    (64 * 1024)
+
+/// The number of times to run each benchmark.
+#define BENCH_ROUNDS            3
+
+// --------------------------------------------------------------------------
+
+/// Keeps the compiler from optimizing away the hash calls.
+static volatile unsigned long s_sink;
+
+// --------------------------------------------------------------------------
+
+/// @brief A set of keys to hash.
+typedef struct _bench_key_set {
+    const char    *name;        ///< The name of the key set.
+    unsigned int   num;         ///< The number of keys.
+    unsigned char *keys;        ///< The keys, BENCH_HASH_KEY_SIZE bytes apart.
+    unsigned char *lens;        ///< The length of each key.
+    unsigned long  bytes;       ///< The total length of all keys.
+} bench_key_set;
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the next pseudo-random number.
+/// @param seed [in/out] The state of the generator.
+/// @return The next pseudo-random number.
+static uint64_t bench_hash_rand(uint64_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return *seed;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Fill in the keys of a key set.
+/// @param set The key set to fill in.
+/// @param type The type of keys, 0 for decimal IDs, 1 for heap pointers,
+/// 2 for IPv4 address strings and 3 for hex session IDs.
+/// @return True if the key set was created.
+static bool bench_hash_key_set(bench_key_set *set, unsigned int type) {
+    static const char *names[] = { "decimal", "pointer", "ipv4", "session" };
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    unsigned int cnt;
+
+    set->name  = names[type];
+    set->bytes = 0;
+    set->keys  = malloc((size_t)set->num * BENCH_HASH_KEY_SIZE);
+    set->lens  = malloc(set->num);
+    if(set->keys == NULL || set->lens == NULL) {
+        return false;
+    }
+    for(cnt=0;cnt < set->num;cnt++) {
+        char *key = (char *)set->keys + (size_t)cnt * BENCH_HASH_KEY_SIZE;
+        int len = 0;
+        switch(type) {
+        case 0:
+            len = snprintf(key, BENCH_HASH_KEY_SIZE, "%u", cnt);
+            break;
+        case 1: {
+            // Pointers as handed out by the allocator for small objects.
+            uintptr_t ptr = (uintptr_t)0x7F3A12000000ULL + (uintptr_t)cnt * 48;
+            memcpy(key, &ptr, sizeof(ptr));
+            len = sizeof(ptr);
+            break;
+        }
+        case 2: {
+            uint64_t val = bench_hash_rand(&seed);
+            len = snprintf(key, BENCH_HASH_KEY_SIZE, "10.%u.%u.%u",
+                           (unsigned)(val & 0xFF), (unsigned)((val >> 8) & 0xFF),
+                           (unsigned)((val >> 16) & 0xFF));
+            break;
+        }
+        default: {
+            uint64_t val1 = bench_hash_rand(&seed);
+            uint64_t val2 = bench_hash_rand(&seed);
+            len = snprintf(key, BENCH_HASH_KEY_SIZE, "%016llx%016llx",
+                           (unsigned long long)val1, (unsigned long long)val2);
+            break;
+        }
+        }
+        set->lens[cnt] = len;
+        set->bytes += len;
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Measure the speed and distribution of a hash on a key set.
+/// The distribution is measured on the low bits of the hash with one bucket
+/// per key. The chi-square value divided by the degrees of freedom is close
+/// to 1.0 for a hash that behaves like a random function, much larger values
+/// mean that some buckets get far more keys than others.
+/// @param set The key set to hash.
+/// @param alg The hash algorithm to use.
+/// @param buckets A bucket count array to use.
+/// @param num_buckets The number of buckets, a power of two.
+static void bench_hash_keys(
+    bench_key_set *set,
+    IW_HASH_ALG alg,
+    unsigned int *buckets,
+    unsigned int num_buckets)
+{
+    IW_HASH_FN fn = iw_hash_get_fn(alg);
+    unsigned long long best = ~0ULL;
+    unsigned long sum = 0;
+    unsigned int round, cnt;
+
+    for(round=0;round < BENCH_ROUNDS;round++) {
+        unsigned long long start = bench_now();
+        for(cnt=0;cnt < set->num;cnt++) {
+            sum += fn(set->lens[cnt], set->keys + (size_t)cnt * BENCH_HASH_KEY_SIZE);
+        }
+        unsigned long long elapsed = bench_now() - start;
+        best = elapsed < best ? elapsed : best;
+    }
+
+    memset(buckets, 0, num_buckets * sizeof(*buckets));
+    for(cnt=0;cnt < set->num;cnt++) {
+        unsigned long hash = fn(set->lens[cnt],
+                                set->keys + (size_t)cnt * BENCH_HASH_KEY_SIZE);
+        buckets[hash & (num_buckets - 1)]++;
+    }
+    double expected = (double)set->num / num_buckets;
+    double chi2 = 0.0;
+    unsigned int max_load = 0;
+    for(cnt=0;cnt < num_buckets;cnt++) {
+        double diff = buckets[cnt] - expected;
+        chi2 += diff * diff / expected;
+        max_load = buckets[cnt] > max_load ? buckets[cnt] : max_load;
+    }
+
+    s_sink = sum;
+    printf("    %-8s %-8s %8.2f ns/key %8.2f GB/s  chi2/df %8.2f  max %4u\n",
+           iw_hash_alg_name(alg), set->name,
+           (double)best / set->num, (double)set->bytes / best,
+           chi2 / (num_buckets - 1), max_load);
+}
+
+// --------------------------------------------------------------------------
+
+void bench_hash(unsigned int max_elems) {
+    unsigned int num = max_elems < BENCH_HASH_MAX_KEYS ? max_elems
+                                                       : BENCH_HASH_MAX_KEYS;
+    unsigned int num_buckets = 1;
+    IW_HASH_ALG alg;
+    unsigned int type;
+
+    while(num_buckets < num) {
+        num_buckets *= 2;
+    }
+    unsigned int *buckets = malloc(num_buckets * sizeof(*buckets));
+    unsigned char *bulk = malloc(BENCH_HASH_BULK_SIZE);
+    if(buckets == NULL || bulk == NULL) {
+        printf("    Failed to allocate buffers\n");
+        free(buckets);
+        free(bulk);
+        return;
+    }
+
+    printf("    Bulk throughput (%u byte buffer)\n", BENCH_HASH_BULK_SIZE);
+    uint64_t seed = 0x2545F4914F6CDD1DULL;
+    unsigned int cnt;
+    for(cnt=0;cnt < BENCH_HASH_BULK_SIZE;cnt++) {
+        bulk[cnt] = bench_hash_rand(&seed);
+    }
+    for(alg=0;alg < IW_HASH_ALG_NUM;alg++) {
+        IW_HASH_FN fn = iw_hash_get_fn(alg);
+        unsigned int iterations = 2000;
+        unsigned long long best = ~0ULL;
+        unsigned long sum = 0;
+        unsigned int round;
+        for(round=0;round < BENCH_ROUNDS;round++) {
+            unsigned long long start = bench_now();
+            for(cnt=0;cnt < iterations;cnt++) {
+                bulk[0] = cnt;
+                sum += fn(BENCH_HASH_BULK_SIZE, bulk);
+            }
+            unsigned long long elapsed = bench_now() - start;
+            best = elapsed < best ? elapsed : best;
+        }
+        s_sink = sum;
+        printf("    %-8s %8.2f GB/s\n", iw_hash_alg_name(alg),
+               (double)BENCH_HASH_BULK_SIZE * iterations / best);
+    }
+
+    printf("    Key sets (%u keys, %u buckets)\n", num, num_buckets);
+    for(type=0;type < 4;type++) {
+        bench_key_set set;
+        set.num = num;
+        if(!bench_hash_key_set(&set, type)) {
+            printf("    Failed to allocate keys for %u elements\n", num);
+        } else {
+            for(alg=0;alg < IW_HASH_ALG_NUM;alg++) {
+                bench_hash_keys(&set, alg, buckets, num_buckets);
+            }
+        }
+        free(set.keys);
+        free(set.lens);
+    }
+
+    free(buckets);
+    free(bulk);
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,172 @@
+// --------------------------------------------------------------------------
+///
+/// @file bench_htable.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_htable.h"
+
+#include "iw_hash.h"
+
+#include "benches.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// --------------------------------------------------------------------------
+
+/// The size of each key in the key array.
+#define BENCH_KEY_SIZE  12
+
+/// The number of times to run each benchmark.
+#define BENCH_ROUNDS    3
+
+// --------------------------------------------------------------------------
+
+/// @brief Run the insert/get/remove benchmark on one table layout.
+/// The chained table is given one bucket per element which is the best case
+/// for that layout. The open addressing table is created small and has to
+/// grow while the elements are inserted. The benchmark is run a number of
+/// rounds and the best time for each operation is reported so that the first
+/// layout run is not penalized for faulting in fresh heap memory.
+/// @param keys The keys to use.
+/// @param key_lens The length of each key.
+/// @param num The number of elements to insert.
+/// @param flags The flags to create the table with.
+static void bench_htable_layout(
+    char *keys,
+    unsigned char *key_lens,
+    unsigned int num,
+    unsigned int flags)
+{
+    char variant[32];
+    snprintf(variant, sizeof(variant), "%s%s%s",
+             flags & IW_HTABLE_FLAG_CHAINED ? "chained" : "open",
+             flags & IW_HTABLE_FLAG_KEYS ? "+keys" : "",
+             flags & IW_HTABLE_FLAG_POOL ? "+pool" : "");
+    unsigned long long best[3] = { ~0ULL, ~0ULL, ~0ULL };
+    unsigned long long start, elapsed;
+    unsigned int round, cnt, found;
+    iw_htable table;
+
+    for(round=0;round < BENCH_ROUNDS;round++) {
+        if(!iw_htable_init_ex(&table,
+                              flags & IW_HTABLE_FLAG_CHAINED ? num : 16,
+                              false, iw_hash_data, flags))
+        {
+            printf("    Failed to create %s hash table\n", variant);
+            return;
+        }
+
+        start = bench_now();
+        for(cnt=0;cnt < num;cnt++) {
+            iw_htable_insert(&table, key_lens[cnt], keys + cnt * BENCH_KEY_SIZE,
+                             (void *)(uintptr_t)(cnt + 1));
+        }
+        elapsed = bench_now() - start;
+        best[0] = elapsed < best[0] ? elapsed : best[0];
+
+        found = 0;
+        start = bench_now();
+        for(cnt=0;cnt < num;cnt++) {
+            if(iw_htable_get(&table, key_lens[cnt],
+                             keys + cnt * BENCH_KEY_SIZE) != NULL)
+            {
+                found++;
+            }
+        }
+        elapsed = bench_now() - start;
+        best[1] = elapsed < best[1] ? elapsed : best[1];
+
+        start = bench_now();
+        for(cnt=0;cnt < num;cnt++) {
+            if(iw_htable_remove(&table, key_lens[cnt],
+                                keys + cnt * BENCH_KEY_SIZE) != NULL)
+            {
+                found++;
+            }
+        }
+        elapsed = bench_now() - start;
+        best[2] = elapsed < best[2] ? elapsed : best[2];
+
+        if(found != num * 2) {
+            printf("    Only found %u of %u elements\n", found / 2, num);
+        }
+        iw_htable_destroy(&table, NULL);
+    }
+    bench_report(variant, "insert", num, best[0]);
+    bench_report(variant, "get", num, best[1]);
+    bench_report(variant, "remove", num, best[2]);
+}
+
+// --------------------------------------------------------------------------
+
+void bench_htable(unsigned int max_elems) {
+    unsigned int num, cnt;
+
+    // Tables that don't store keys identify elements by their hash, decimal
+    // string keys have no collisions with the default hash function.
+    char *keys = malloc((size_t)max_elems * BENCH_KEY_SIZE);
+    unsigned char *key_lens = malloc(max_elems);
+    if(keys == NULL || key_lens == NULL) {
+        printf("    Failed to allocate keys for %u elements\n", max_elems);
+        free(keys);
+        free(key_lens);
+        return;
+    }
+    // Shuffle the keys so that the elements are accessed in a random order
+    // rather than in the order the hash function happens to produce.
+    unsigned long long seed = 0x2545F4914F6CDD1DULL;
+    unsigned int *order = malloc(max_elems * sizeof(*order));
+    if(order == NULL) {
+        printf("    Failed to allocate keys for %u elements\n", max_elems);
+        free(keys);
+        free(key_lens);
+        return;
+    }
+    for(cnt=0;cnt < max_elems;cnt++) {
+        order[cnt] = cnt;
+    }
+    for(cnt=max_elems - 1;cnt > 0;cnt--) {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        unsigned int other = seed % (cnt + 1);
+        unsigned int tmp = order[cnt];
+        order[cnt] = order[other];
+        order[other] = tmp;
+    }
+    for(cnt=0;cnt < max_elems;cnt++) {
+        key_lens[cnt] = snprintf(keys + cnt * BENCH_KEY_SIZE, BENCH_KEY_SIZE,
+                                 "%u", order[cnt]);
+    }
+    free(order);
+
+    for(num=max_elems < 1000 ? max_elems : 1000;num <= max_elems;num *= 10) {
+        printf("    Elements: %u\n", num);
+        bench_htable_layout(keys, key_lens, num, 0);
+        bench_htable_layout(keys, key_lens, num, IW_HTABLE_FLAG_KEYS);
+        bench_htable_layout(keys, key_lens, num, IW_HTABLE_FLAG_CHAINED);
+        bench_htable_layout(keys, key_lens, num,
+                            IW_HTABLE_FLAG_CHAINED | IW_HTABLE_FLAG_KEYS);
+        bench_htable_layout(keys, key_lens, num,
+                            IW_HTABLE_FLAG_CHAINED | IW_HTABLE_FLAG_POOL);
+        bench_htable_layout(keys, key_lens, num,
+                            IW_HTABLE_FLAG_CHAINED | IW_HTABLE_FLAG_KEYS |
+                            IW_HTABLE_FLAG_POOL);
+        if(num > max_elems / 10 && num != max_elems) {
+            // Finish with the largest size requested.
+            num = max_elems / 10;
+        }
+    }
+
+    free(keys);
+    free(key_lens);
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,125 @@
+// --------------------------------------------------------------------------
+///
+/// @file bench_log.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_cfg.h"
+#include "iw_log.h"
+#include "iw_log_int.h"
+#include "iw_mutex_int.h"
+#include "iw_thread_int.h"
+
+#include "benches.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// --------------------------------------------------------------------------
+
+/// The largest number of threads to run the benchmark with.
+#define BENCH_MAX_THREADS   64
+
+/// The number of messages each thread logs.
+#define BENCH_THREAD_LOGS   100000
+
+/// The device text logs are written to.
+#define BENCH_LOG_DEV       "/dev/null"
+
+/// The size of the binary log buffer of each thread.
+#define BENCH_BIN_SIZE      (1024 * 1024)
+
+/// The messages per second the rate limited variant allows.
+#define BENCH_RATE          1000
+
+/// The burst size of the rate limited variant.
+#define BENCH_BURST         100
+
+// --------------------------------------------------------------------------
+
+/// @brief Log messages typical of the web server from one thread.
+/// @param arg Non-NULL if logging should be turned off for the thread.
+/// @return Always NULL.
+static void *bench_log_thread(void *arg) {
+    unsigned int cnt;
+    if(arg != NULL) {
+        iw_thread_set_log(0, false);
+    }
+    for(cnt=0;cnt < BENCH_THREAD_LOGS;cnt++) {
+        LOG(IW_LOG_WEB, "Request %u from %s, %d bytes in %.3f ms",
+            cnt, "192.168.0.1", (int)(cnt % 1500), cnt * 0.001);
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Run the workload with the given number of threads.
+/// @param variant The name of the variant.
+/// @param num_threads The number of threads to run.
+/// @param log_off True if the threads should turn off logging.
+static void bench_log_run(
+    const char *variant,
+    unsigned int num_threads,
+    bool log_off)
+{
+    pthread_t threads[BENCH_MAX_THREADS];
+    unsigned int cnt;
+
+    unsigned long long start = bench_now();
+    for(cnt=0;cnt < num_threads;cnt++) {
+        iw_thread_create_int(&threads[cnt], "Log Bench", bench_log_thread,
+                             false, log_off ? (void *)threads : NULL);
+    }
+    for(cnt=0;cnt < num_threads;cnt++) {
+        iw_thread_join_int(threads[cnt]);
+    }
+    bench_report(variant, "log", num_threads * BENCH_THREAD_LOGS,
+                 bench_now() - start);
+}
+
+// --------------------------------------------------------------------------
+
+void bench_log(unsigned int max_elems) {
+    unsigned int num_threads;
+
+    (void)max_elems;
+    iw_cfg_init();
+    iw_thread_init();
+    iw_thread_register_main();
+    iw_mutex_init();
+    iw_log_set_level(BENCH_LOG_DEV, IW_LOG_WEB);
+    // Logging threads mostly wait for each other, so the benchmark runs
+    // with more threads than processors.
+    for(num_threads=1;num_threads <= BENCH_MAX_THREADS;num_threads *= 2) {
+        printf("    Threads: %u\n", num_threads);
+
+        bench_log_run("text", num_threads, false);
+        bench_log_run("thread off", num_threads, true);
+
+        // The cost of a call site whose level is off, which is what
+        // building with IW_LOG_COMPILE_MASK saves.
+        iw_log_set_level(BENCH_LOG_DEV, IW_LOG_IW);
+        bench_log_run("level off", num_threads, false);
+        iw_log_set_level(BENCH_LOG_DEV, IW_LOG_WEB);
+
+        iw_log_limit(BENCH_RATE, BENCH_BURST, false);
+        bench_log_run("rate limited", num_threads, false);
+        iw_log_limit(0, 0, false);
+
+        iw_log_bin_start(BENCH_BIN_SIZE);
+        bench_log_run("binary", num_threads, false);
+        iw_log_bin_exit();
+    }
+    iw_log_set_level(NULL, 0);
+    iw_mutex_exit();
+    iw_thread_exit();
+    iw_cfg_exit();
+}
+
+// --------------------------------------------------------------------------
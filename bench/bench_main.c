@@ -0,0 +1,134 @@
+// --------------------------------------------------------------------------
+///
+/// @file bench_main.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "benches.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------
+
+/// The default largest number of elements to run the benchmarks with.
+#define BENCH_DEFAULT_MAX   10000000
+
+// --------------------------------------------------------------------------
+
+unsigned long long bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// --------------------------------------------------------------------------
+
+void bench_report(
+    const char *variant,
+    const char *op,
+    unsigned int count,
+    unsigned long long nsec)
+{
+    double secs = nsec / 1e9;
+    printf("    %-18s %-8s %10u ops : %10.2f ns/op %10.2f Mops/s\n",
+           variant, op, count,
+           count > 0 ? (double)nsec / count : 0.0,
+           secs > 0 ? count / secs / 1e6 : 0.0);
+}
+
+// --------------------------------------------------------------------------
+
+static void run_benches(const char *bench, unsigned int max_elems) {
+    int cnt;
+    bool did_run = false;
+    for(cnt=0;s_benches[cnt].fn != NULL;cnt++) {
+        if(bench == NULL || strcmp(bench, s_benches[cnt].name) == 0) {
+            did_run = true;
+            printf("  -- Running benchmark --------------------------\n");
+            printf("    Running benchmark \"%s: %s\"\n",
+                   s_benches[cnt].name, s_benches[cnt].desc);
+            (*s_benches[cnt].fn)(max_elems);
+            printf("  -- Done running benchmark ---------------------\n");
+            printf("\n");
+        }
+    }
+    if(bench != NULL && !did_run) {
+        printf(" No such benchmark \'%s\'\n", bench);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+static void print_benches() {
+    int cnt;
+    printf(" == Available Benchmarks ============================\n");
+    for(cnt=0;s_benches[cnt].fn != NULL;cnt++) {
+        printf(" %-10s : %s\n", s_benches[cnt].name, s_benches[cnt].desc);
+    }
+    printf("\n");
+}
+
+// --------------------------------------------------------------------------
+
+static void print_help() {
+    printf("Usage: bench [options] <cmd>\n"
+            "Options can be:\n"
+            "-n <num> : The largest number of elements to use (default %d).\n"
+            "\n"
+            "Command can be:\n"
+            "all      : Run all benchmarks.\n"
+            "show     : Show what benchmarks are available.\n"
+            "<bench>  : Run only this particular benchmark.\n"
+            "\n", BENCH_DEFAULT_MAX);
+    exit(0);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief The benchmark main entrypoint.
+/// @param argc The argument count.
+/// @param argv The arguments.
+int main(int argc, char **argv) {
+    unsigned int max_elems = BENCH_DEFAULT_MAX;
+
+    int opt;
+    while((opt = getopt(argc, argv, ":n:")) != -1) {
+        switch(opt) {
+        case 'n':
+            max_elems = strtoul(optarg, NULL, 10);
+            break;
+        default :
+            print_help();
+            return 0;
+        }
+    }
+    if(optind != argc - 1 || max_elems == 0) {
+        // Only one argument expected in addition to options.
+        print_help();
+        return 0;
+    }
+
+    char *bench = NULL;
+    if(strcmp(argv[optind], "show") == 0) {
+        print_benches();
+        return 0;
+    } else if(strcmp(argv[optind], "all") != 0) {
+        bench = argv[optind];
+    }
+
+    printf(" == Running benchmarks ==============================\n");
+    run_benches(bench, max_elems);
+    printf(" == Completed benchmarks ============================\n");
+    printf("\n");
+    return 0;
+}
+
+// --------------------------------------------------------------------------
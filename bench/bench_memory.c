@@ -0,0 +1,251 @@
+// --------------------------------------------------------------------------
+///
+/// @file bench_memory.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_buff.h"
+#include "iw_cfg.h"
+#include "iw_memory.h"
+#include "iw_memory_int.h"
+#include "iw_pool.h"
+
+#include "benches.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------
+
+/// The largest number of threads to run the benchmark with.
+#define BENCH_MAX_THREADS   64
+
+/// The number of allocations each thread makes.
+#define BENCH_THREAD_OPS    200000
+
+/// The number of allocations each thread keeps outstanding.
+#define BENCH_BATCH         64
+
+/// The size a buffer is grown to a few bytes at a time.
+#define BENCH_GROW_SIZE     (512 * 1024)
+
+/// The number of bytes added to the buffer at a time.
+#define BENCH_GROW_STEP     16
+
+/// The sampling interval used for the sampled variant.
+#define BENCH_SAMPLE        (512 * 1024)
+
+/// The size of the objects allocated by the pool benchmark.
+#define BENCH_OBJ_SIZE      48
+
+// --------------------------------------------------------------------------
+
+/// The pool used by the pool benchmark.
+static iw_pool s_pool;
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate and free memory in batches from one thread.
+/// @param arg Unused.
+/// @return Always NULL.
+static void *bench_memory_thread(void *arg) {
+    void *ptrs[BENCH_BATCH];
+    unsigned int cnt, batch;
+    (void)arg;
+    for(cnt=0;cnt < BENCH_THREAD_OPS;cnt += BENCH_BATCH) {
+        for(batch=0;batch < BENCH_BATCH;batch++) {
+            ptrs[batch] = iw_malloc(__FILE__, __LINE__, (batch * 24) % 512 + 8);
+        }
+        for(batch=0;batch < BENCH_BATCH;batch++) {
+            iw_free(ptrs[batch]);
+        }
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate and free fixed-size objects in batches from one thread.
+/// @param arg Unused.
+/// @return Always NULL.
+static void *bench_fixed_thread(void *arg) {
+    void *ptrs[BENCH_BATCH];
+    unsigned int cnt, batch;
+    (void)arg;
+    for(cnt=0;cnt < BENCH_THREAD_OPS;cnt += BENCH_BATCH) {
+        for(batch=0;batch < BENCH_BATCH;batch++) {
+            ptrs[batch] = iw_malloc(__FILE__, __LINE__, BENCH_OBJ_SIZE);
+        }
+        for(batch=0;batch < BENCH_BATCH;batch++) {
+            iw_free(ptrs[batch]);
+        }
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate and free pool objects in batches from one thread.
+/// @param arg Unused.
+/// @return Always NULL.
+static void *bench_pool_thread(void *arg) {
+    void *ptrs[BENCH_BATCH];
+    unsigned int cnt, batch;
+    (void)arg;
+    for(cnt=0;cnt < BENCH_THREAD_OPS;cnt += BENCH_BATCH) {
+        for(batch=0;batch < BENCH_BATCH;batch++) {
+            ptrs[batch] = iw_pool_alloc(&s_pool);
+        }
+        for(batch=0;batch < BENCH_BATCH;batch++) {
+            iw_pool_free(&s_pool, ptrs[batch]);
+        }
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Run the workload with the given number of threads.
+/// @param variant The name of the variant.
+/// @param fn The workload of each thread.
+/// @param num_threads The number of threads to run.
+static void bench_memory_run(
+    const char *variant,
+    void *(*fn)(void *),
+    unsigned int num_threads)
+{
+    pthread_t threads[BENCH_MAX_THREADS];
+    unsigned int cnt;
+
+    unsigned long long start = bench_now();
+    for(cnt=0;cnt < num_threads;cnt++) {
+        pthread_create(&threads[cnt], NULL, fn, NULL);
+    }
+    for(cnt=0;cnt < num_threads;cnt++) {
+        pthread_join(threads[cnt], NULL);
+    }
+    bench_report(variant, "alloc", num_threads * BENCH_THREAD_OPS,
+                 bench_now() - start);
+}
+
+// --------------------------------------------------------------------------
+
+void bench_memory(unsigned int max_elems) {
+    unsigned int max_threads, num_threads;
+
+    (void)max_elems;
+    iw_cfg_init();
+    max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(max_threads > BENCH_MAX_THREADS) {
+        max_threads = BENCH_MAX_THREADS;
+    }
+    for(num_threads=1;num_threads <= max_threads;num_threads *= 2) {
+        printf("    Threads: %u\n", num_threads);
+
+        iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 0, NULL, 0);
+        iw_memory_init();
+        bench_memory_run("untracked", bench_memory_thread, num_threads);
+        iw_memory_exit();
+
+        iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 1, NULL, 0);
+        iw_memory_init();
+        bench_memory_run("tracked", bench_memory_thread, num_threads);
+        iw_memory_exit();
+
+        iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_SAMPLE,
+                                BENCH_SAMPLE, NULL, 0);
+        iw_memory_init();
+        bench_memory_run("sampled", bench_memory_thread, num_threads);
+        iw_memory_exit();
+        iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_SAMPLE, 0, NULL, 0);
+
+        if(num_threads < max_threads && num_threads * 2 > max_threads) {
+            // Finish with all available processors.
+            num_threads = max_threads / 2;
+        }
+    }
+    iw_cfg_exit();
+}
+
+// --------------------------------------------------------------------------
+
+void bench_pool(unsigned int max_elems) {
+    unsigned int max_threads, num_threads;
+
+    (void)max_elems;
+    iw_cfg_init();
+    max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if(max_threads > BENCH_MAX_THREADS) {
+        max_threads = BENCH_MAX_THREADS;
+    }
+    for(num_threads=1;num_threads <= max_threads;num_threads *= 2) {
+        printf("    Threads: %u\n", num_threads);
+
+        iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 0, NULL, 0);
+        iw_memory_init();
+        bench_memory_run("malloc", bench_fixed_thread, num_threads);
+        iw_memory_exit();
+
+        iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 1, NULL, 0);
+        iw_memory_init();
+        bench_memory_run("tracked", bench_fixed_thread, num_threads);
+        iw_memory_exit();
+
+        iw_pool_init(&s_pool, "bench", BENCH_OBJ_SIZE, false);
+        bench_memory_run("pool", bench_pool_thread, num_threads);
+        iw_pool_destroy(&s_pool);
+
+        if(num_threads < max_threads && num_threads * 2 > max_threads) {
+            // Finish with all available processors.
+            num_threads = max_threads / 2;
+        }
+    }
+    iw_cfg_exit();
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Grow a buffer to its maximum size a few bytes at a time.
+/// @param variant The name of the variant.
+static void bench_buffgrow_run(const char *variant) {
+    char data[BENCH_GROW_STEP];
+    unsigned int cnt;
+    iw_buff buff;
+
+    memset(data, 'a', sizeof(data));
+    iw_buff_create(&buff, BENCH_GROW_STEP, BENCH_GROW_SIZE);
+    unsigned long long start = bench_now();
+    for(cnt=0;cnt < BENCH_GROW_SIZE / BENCH_GROW_STEP;cnt++) {
+        iw_buff_add_data(&buff, data, sizeof(data));
+    }
+    bench_report(variant, "grow", cnt, bench_now() - start);
+    iw_buff_destroy(&buff);
+}
+
+// --------------------------------------------------------------------------
+
+void bench_buffgrow(unsigned int max_elems) {
+    (void)max_elems;
+    iw_cfg_init();
+
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 0, NULL, 0);
+    iw_memory_init();
+    bench_buffgrow_run("untracked");
+    iw_memory_exit();
+
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 1, NULL, 0);
+    iw_memory_init();
+    bench_buffgrow_run("tracked");
+    iw_memory_exit();
+
+    iw_cfg_exit();
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,28 @@
+// --------------------------------------------------------------------------
+///
+/// @file benches.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "benches.h"
+
+#include <stdio.h>
+
+// --------------------------------------------------------------------------
+
+bench_info s_benches[] = {
+    { bench_htable,     "hash",     "Hash table insert/get/remove throughput" },
+    { bench_hash,       "hashfn",   "Hash function throughput and distribution" },
+    { bench_chtable,    "chash",    "Concurrent hash table contention" },
+    { bench_memory,     "memtrack", "Memory tracking overhead" },
+    { bench_buffgrow,   "buffgrow", "Incremental buffer growth through realloc" },
+    { bench_pool,       "pool",     "Fixed-size object pool against malloc" },
+    { bench_log,        "log",      "Text logging against the binary log" },
+    { NULL, NULL, NULL }
+};
+
+// --------------------------------------------------------------------------
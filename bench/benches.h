@@ -0,0 +1,126 @@
+// --------------------------------------------------------------------------
+///
+/// @file benches.h
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#ifndef _BENCHES_H_
+#define _BENCHES_H_
+#ifdef _cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+// --------------------------------------------------------------------------
+
+/// @brief The benchmark function definition.
+/// @param max_elems The largest number of elements to run the benchmark with.
+typedef void (*BENCH_FN)(unsigned int max_elems);
+
+// --------------------------------------------------------------------------
+
+/// @brief The benchmark information object.
+/// Contains information about the available benchmarks.
+typedef struct _bench_info {
+    BENCH_FN fn;    ///< A function pointer to the benchmark to run.
+    char *name;     ///< The name of the benchmark.
+    char *desc;     ///< A description of the benchmark.
+} bench_info;
+
+// --------------------------------------------------------------------------
+
+/// The array containing all the benchmarks.
+extern bench_info s_benches[];
+
+// --------------------------------------------------------------------------
+//
+// Helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Get a monotonic timestamp.
+/// @return The current time in nanoseconds.
+extern unsigned long long bench_now();
+
+// --------------------------------------------------------------------------
+
+/// @brief Display the result of a benchmark run.
+/// @param variant The variant being measured, e.g. the data structure.
+/// @param op The operation being measured.
+/// @param count The number of operations performed.
+/// @param nsec The time it took to perform the operations in nanoseconds.
+extern void bench_report(
+    const char *variant,
+    const char *op,
+    unsigned int count,
+    unsigned long long nsec);
+
+// --------------------------------------------------------------------------
+//
+// Benchmarks
+//
+// --------------------------------------------------------------------------
+
+/// @brief The hash table benchmark.
+/// Compares the open addressing and chained hash table layouts.
+/// @param max_elems The largest number of elements to insert.
+extern void bench_htable(unsigned int max_elems);
+
+// --------------------------------------------------------------------------
+
+/// @brief The hash function benchmark.
+/// Measures the throughput and bucket distribution of each hash algorithm.
+/// @param max_elems The largest number of keys to hash.
+extern void bench_hash(unsigned int max_elems);
+
+// --------------------------------------------------------------------------
+
+/// @brief The concurrent hash table benchmark.
+/// Compares a globally locked hash table with the lock-striped table as the
+/// number of threads grows.
+/// @param max_elems Unused, the workload size is fixed per thread.
+extern void bench_chtable(unsigned int max_elems);
+
+// --------------------------------------------------------------------------
+
+/// @brief The memory tracking benchmark.
+/// Compares tracked and untracked allocations as the number of threads grows.
+/// @param max_elems Unused, the workload size is fixed per thread.
+extern void bench_memory(unsigned int max_elems);
+
+// --------------------------------------------------------------------------
+
+/// @brief The buffer growth benchmark.
+/// Grows a buffer a few bytes at a time, exercising realloc() of a growing
+/// chunk with and without memory tracking.
+/// @param max_elems Unused, the buffer size is fixed.
+extern void bench_buffgrow(unsigned int max_elems);
+
+// --------------------------------------------------------------------------
+
+/// @brief The object pool benchmark.
+/// Compares fixed-size allocations from an object pool with malloc(), with
+/// and without memory tracking, as the number of threads grows.
+/// @param max_elems Unused, the workload size is fixed per thread.
+extern void bench_pool(unsigned int max_elems);
+
+// --------------------------------------------------------------------------
+
+/// @brief The logging benchmark.
+/// Compares text logging with the binary log as the number of threads grows.
+/// @param max_elems Unused, the workload size is fixed per thread.
+extern void bench_log(unsigned int max_elems);
+
+// --------------------------------------------------------------------------
+
+#ifdef _cplusplus
+}
+#endif
+#endif // _BENCHES_H_
+
+// --------------------------------------------------------------------------
@@ -22,6 +22,7 @@
 #include <iw_main.h>
 #include <iw_memory.h>
 #include <iw_mutex.h>
+#include <iw_pool.h>
 #include <iw_syslog.h>
 #include <iw_thread.h>
 #include <iw_util.h>
@@ -73,6 +74,7 @@ typedef struct _tcp_conn {
 static int      s_sock = -1;               ///< The server socket.
 static iw_list  s_list = IW_LIST_INIT_MEM; ///< The TCP socket list.
 static IW_MUTEX s_mutex;                   ///< The mutex to protect the sockets.
+static iw_pool  s_conn_pool;               ///< The pool of TCP connection objects.
 static unsigned short s_port = DEFAULT_PORT;///< The port number to use.
 static bool     s_keep_going = true;       ///< True as long as the program should execute.
 
@@ -84,9 +86,13 @@ static bool     s_keep_going = true;       ///< True as long as the program shou
 
 /// @brief Create a TCP connection object.
 /// @param fd The file descriptor for the TCP connection.
-/// @return The TCP connection object.
+/// @return The TCP connection object or NULL if out of memory.
 static tcp_conn *create_tcp_conn(int fd, struct sockaddr_storage *address) {
-    tcp_conn *conn = (tcp_conn *)IW_CALLOC(1, sizeof(tcp_conn));
+    tcp_conn *conn = (tcp_conn *)iw_pool_alloc(&s_conn_pool);
+    if(conn == NULL) {
+        return NULL;
+    }
+    memset(conn, 0, sizeof(*conn));
     conn->fd = fd;
     conn->address = *address;
     conn->do_log = true;
@@ -98,8 +104,7 @@ static tcp_conn *create_tcp_conn(int fd, struct sockaddr_storage *address) {
 /// @brief Delete a TCP connection object.
 /// @param node The TCP connection object to delete.
 static void delete_tcp_conn(iw_list_node *node) {
-    tcp_conn *conn = (tcp_conn *)node;
-    IW_FREE(conn);
+    iw_pool_free(&s_conn_pool, node);
 }
 
 // --------------------------------------------------------------------------
@@ -268,7 +273,11 @@ static void *serve_data(void *param) {
                 IW_SYSLOG(LOG_INFO, SIMPLE_LOG, "Accepted socket FD=%d from client %s",
                         sock, iw_ip_addr_to_str(&address, true, ipbuff, sizeof(ipbuff)));
                 conn = create_tcp_conn(sock, &address);
-                iw_list_add(&s_list, (iw_list_node *)conn);
+                if(conn != NULL) {
+                    iw_list_add(&s_list, (iw_list_node *)conn);
+                } else {
+                    close(sock);
+                }
             }
         }
 
@@ -394,8 +403,13 @@ bool main_callback(int argc, char **argv) {
             "Used to enable or disable logging for a given client by specifying\n"
             "the peer IP address and port, e.g. 'log client 1.1.1.1:" IW_STR(DEFAULT_PORT) " on'.\n");
 
-    // Create the mutex to protect the TCP connection list.
+    // Create the mutex to protect the TCP connection list and the pool that
+    // the connection objects are allocated from. The pool statistics can be
+    // displayed with the 'memory pools' command.
     s_mutex = iw_mutex_create("TCP Connections");
+    if(!iw_pool_init(&s_conn_pool, "connections", sizeof(tcp_conn), true)) {
+        return false;
+    }
 
     // Open the server socket
     LOG(SIMPLE_LOG, "Starting the simple server.");
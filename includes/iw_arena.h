@@ -0,0 +1,139 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_arena.h
+///
+/// An arena (region) allocator. Memory is handed out from larger blocks by
+/// bumping a pointer and is never freed individually. Instead all memory
+/// allocated from the arena is released at once when the arena is reset or
+/// destroyed. This suits data with a common lifetime, e.g. everything that
+/// is allocated while processing a single request.
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#ifndef _IW_ARENA_H_
+#define _IW_ARENA_H_
+#ifdef _cplusplus
+extern "C" {
+#endif
+
+#include "iw_list.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// --------------------------------------------------------------------------
+//
+// Typedefs
+//
+// --------------------------------------------------------------------------
+
+/// The default size of each block of the arena in bytes.
+#define IW_ARENA_BLOCK_SIZE 4096
+
+// --------------------------------------------------------------------------
+
+/// @brief A block of memory allocated by an arena.
+typedef struct _iw_arena_block {
+    struct _iw_arena_block *next;   ///< The next block of the arena.
+    size_t                  size;   ///< The usable size of the block.
+} iw_arena_block;
+
+// --------------------------------------------------------------------------
+
+/// @brief The arena data structure.
+/// An arena is not thread-safe, it is meant to be used by one thread at a
+/// time.
+typedef struct _iw_arena {
+    iw_list_node    node;       ///< The node in the list of all arenas.
+    const char     *name;       ///< The name shown in memory reports.
+    bool            iw_mem_alloc;///< True if the IW memory allocation is used.
+    size_t          block_size; ///< The size of each block.
+    size_t          cap;        ///< The most bytes reserved, zero for no limit.
+    iw_arena_block *blocks;     ///< The allocated blocks.
+    iw_arena_block *cur;        ///< The block currently allocated from.
+    unsigned char  *bump;       ///< The next unused byte in the current block.
+    size_t          bump_left;  ///< The number of unused bytes in the block.
+    unsigned int    num_blocks; ///< The number of allocated blocks.
+    size_t          reserved;   ///< The number of bytes in all blocks.
+    size_t          used;       ///< The number of bytes allocated.
+    size_t          high_water; ///< The largest number of bytes allocated.
+} iw_arena;
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+/// @brief Initialize an arena.
+/// The arena is registered so that it is included in the memory summary.
+/// No memory is allocated until the first allocation is made.
+/// @param arena The arena to initialize.
+/// @param name The name of the arena, must stay valid until destroyed.
+/// @param block_size The size of each block or zero for
+/// \a IW_ARENA_BLOCK_SIZE bytes. Larger allocations get a block of their own.
+/// @param cap The largest number of bytes the arena may reserve or zero
+/// for no limit.
+/// @param iw_mem_alloc True if the IW memory allocator should be used.
+extern void iw_arena_init(
+    iw_arena *arena,
+    const char *name,
+    size_t block_size,
+    size_t cap,
+    bool iw_mem_alloc);
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate memory from the arena.
+/// The memory is 16 byte aligned and is not initialized.
+/// @param arena The arena to allocate the memory from.
+/// @param size The number of bytes to allocate.
+/// @return The memory or NULL if no memory could be allocated or the arena
+/// would exceed its cap.
+extern void *iw_arena_alloc(iw_arena *arena, size_t size);
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate zeroed memory from the arena.
+/// @param arena The arena to allocate the memory from.
+/// @param size The number of bytes to allocate.
+/// @return The memory or NULL if no memory could be allocated or the arena
+/// would exceed its cap.
+extern void *iw_arena_calloc(iw_arena *arena, size_t size);
+
+// --------------------------------------------------------------------------
+
+/// @brief Release all memory allocated from the arena.
+/// The blocks are kept and reused by later allocations so resetting the
+/// arena takes constant time. All memory allocated from the arena becomes
+/// invalid.
+/// @param arena The arena to reset.
+extern void iw_arena_reset(iw_arena *arena);
+
+// --------------------------------------------------------------------------
+
+/// @brief Destroy an arena.
+/// All blocks are freed at once, all memory allocated from the arena
+/// becomes invalid.
+/// @param arena The arena to destroy.
+extern void iw_arena_destroy(iw_arena *arena);
+
+// --------------------------------------------------------------------------
+
+/// @brief Show the use of all arenas on the given file stream.
+/// @param out The file stream to write the response to.
+extern void iw_arena_show(FILE *out);
+
+// --------------------------------------------------------------------------
+
+#ifdef _cplusplus
+}
+#endif
+#endif // _IW_ARENA_H_
+
+// --------------------------------------------------------------------------
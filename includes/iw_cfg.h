@@ -63,6 +63,46 @@ extern "C" {
 #define IW_CFG_LOGLEVEL_OPT             IW_CFG_OPT ".loglvl"
 /// The default log-level command line option character.
 #define IW_DEF_LOGLEVEL_OPT             "l"
+/// The asynchronous logging flag. Log messages are queued and written by
+/// a separate writer thread if set.
+#define IW_CFG_LOG_ASYNC                IW_CFG ".log.async"
+/// The default asynchronous logging flag value.
+#define IW_DEF_LOG_ASYNC                0
+/// The number of messages the asynchronous log ring can hold, rounded up
+/// to a power of two.
+#define IW_CFG_LOG_RINGSIZE             IW_CFG ".log.ringsize"
+/// The default asynchronous log ring size.
+#define IW_DEF_LOG_RINGSIZE             1024
+/// What to do when the asynchronous log ring is full, either "drop" the
+/// message, "block" until there is room, or "count" the dropped messages
+/// in the log output.
+#define IW_CFG_LOG_OVERFLOW             IW_CFG ".log.overflow"
+/// The default asynchronous log overflow policy.
+#define IW_DEF_LOG_OVERFLOW             "count"
+/// The binary logging flag. Log messages are recorded unformatted in
+/// memory, to be shown with 'log dump', if set.
+#define IW_CFG_LOG_BINARY               IW_CFG ".log.binary"
+/// The default binary logging flag value.
+#define IW_DEF_LOG_BINARY               0
+/// The size in bytes of the binary log buffer of each thread.
+#define IW_CFG_LOG_BINSIZE              IW_CFG ".log.binsize"
+/// The default binary log buffer size.
+#define IW_DEF_LOG_BINSIZE              65536
+/// The number of text messages per second each log call site may write
+/// once its burst is used up. Zero disables rate limiting.
+#define IW_CFG_LOG_RATE                 IW_CFG ".log.rate"
+/// The default log rate limit.
+#define IW_DEF_LOG_RATE                 0
+/// The number of text messages each log call site may write at once
+/// before it is rate limited.
+#define IW_CFG_LOG_BURST                IW_CFG ".log.burst"
+/// The default log burst size.
+#define IW_DEF_LOG_BURST                20
+/// The duplicate suppression flag. A message that is identical to the
+/// last one logged from the same call site is only counted if set.
+#define IW_CFG_LOG_DUPLICATES           IW_CFG ".log.duplicates"
+/// The default duplicate suppression flag value.
+#define IW_DEF_LOG_DUPLICATES           0
 /// The allow-quit flag, true if the program should have a 'quit' command.
 #define IW_CFG_ALLOW_QUIT               IW_CFG ".allowquit"
 /// The default allow-quit flag value.
@@ -88,6 +128,21 @@ extern "C" {
 #define IW_CFG_MEMTRACK_SIZE            IW_CFG ".memtrack.size"
 /// The memory tracker default hash table size.
 #define IW_DEF_MEMTRACK_SIZE            10000
+/// The memory tracker sampling interval, the average number of bytes
+/// allocated between sampled allocations. Zero tracks every allocation.
+#define IW_CFG_MEMTRACK_SAMPLE          IW_CFG ".memtrack.sample"
+/// The memory tracker default sampling interval.
+#define IW_DEF_MEMTRACK_SAMPLE          0
+/// The number of call-stack frames to record for each tracked allocation.
+/// Zero only records the file and line of the allocation.
+#define IW_CFG_MEMTRACK_STACKDEPTH      IW_CFG ".memtrack.stackdepth"
+/// The memory tracker default call-stack depth.
+#define IW_DEF_MEMTRACK_STACKDEPTH      0
+/// The time in microseconds the health thread spends scanning tracked
+/// memory for guard corruption every second. Zero disables the scanner.
+#define IW_CFG_MEMTRACK_SCAN            IW_CFG ".memtrack.scan"
+/// The memory tracker default guard scan time.
+#define IW_DEF_MEMTRACK_SCAN            0
 /// The health check enable flag.
 #define IW_CFG_HEALTHCHECK_ENABLE       IW_CFG ".healthcheck.enable"
 /// The default health check enable flag value.
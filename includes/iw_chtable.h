@@ -0,0 +1,282 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_chtable.h
+///
+/// A concurrent hash table. The elements are spread over a number of
+/// stripes, each stripe is an \a iw_htable with its own read-write lock.
+/// Threads accessing elements in different stripes don't contend for the
+/// same lock. The API follows the \a iw_htable API with the locking done
+/// internally by each call.
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#ifndef _IW_CHTABLE_H_
+#define _IW_CHTABLE_H_
+#ifdef _cplusplus
+extern "C" {
+#endif
+
+#include "iw_htable.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// --------------------------------------------------------------------------
+//
+// Typedefs
+//
+// --------------------------------------------------------------------------
+
+/// The default number of stripes in a concurrent hash table.
+#define IW_CHTABLE_STRIPES  64
+
+// --------------------------------------------------------------------------
+
+/// @brief A stripe of a concurrent hash table.
+/// Aligned to a cache line so that the locks of neighbouring stripes don't
+/// share a cache line.
+typedef struct _iw_chtable_stripe {
+    pthread_rwlock_t lock;      ///< The lock for the elements in this stripe.
+    iw_htable        table;     ///< The elements in this stripe.
+} __attribute__((aligned(64))) iw_chtable_stripe;
+
+// --------------------------------------------------------------------------
+
+/// @brief The concurrent hash table data structure.
+typedef struct _iw_chtable {
+    IW_HASH_FN          fn;         ///< The hash function for this table.
+    bool                iw_mem_alloc;///< True if the IW memory allocation is used.
+    unsigned int        num_stripes;///< The number of stripes, a power of two.
+    iw_chtable_stripe  *stripes;    ///< The stripes.
+    void               *alloc;      ///< The allocated memory for the stripes.
+} iw_chtable;
+
+// --------------------------------------------------------------------------
+
+/// @brief A lock held on a stripe of a concurrent hash table.
+/// Returned by \a iw_chtable_get_locked() and released with
+/// \a iw_chtable_unlock().
+typedef struct _iw_chtable_lock {
+    iw_chtable_stripe *stripe;  ///< The locked stripe.
+} iw_chtable_lock;
+
+// --------------------------------------------------------------------------
+
+/// @brief The concurrent hash table iterator.
+/// Iterates through the stripes one at a time. The caller must hold all
+/// stripe locks through \a iw_chtable_rdlock_all() or
+/// \a iw_chtable_wrlock_all() while iterating.
+typedef struct _iw_chtable_iter {
+    iw_chtable    *table;       ///< The table being iterated.
+    unsigned int   stripe;      ///< The stripe being iterated.
+    iw_htable_iter iter;        ///< The iterator of the current stripe.
+} iw_chtable_iter;
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+/// @brief Initialize a concurrent hash table.
+/// @param table The hash table to initialize.
+/// @param num_stripes The number of stripes, rounded up to a power of two.
+/// Zero selects \a IW_CHTABLE_STRIPES.
+/// @param table_size The expected number of elements in the table.
+/// @param iw_mem_alloc True if the IW memory allocator should be used.
+/// @param hash_fn The hash function to use or NULL for the default.
+/// @param flags The IW_HTABLE_FLAG_* flags to use for each stripe.
+/// @return True if the hash table was successfully created.
+extern bool iw_chtable_init(
+    iw_chtable *table,
+    unsigned int num_stripes,
+    unsigned int table_size,
+    bool iw_mem_alloc,
+    IW_HASH_FN hash_fn,
+    unsigned int flags);
+
+// --------------------------------------------------------------------------
+
+/// @brief Insert or replace an element in the hash table.
+/// @param table The table to insert the element into.
+/// @param key_len The length of the key.
+/// @param key The hash key to use.
+/// @param data The data to insert.
+/// @param fn The hash data delete function to use if an element must be deleted.
+/// @return True if the element was successfully inserted.
+extern bool iw_chtable_replace(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key,
+    void *data,
+    IW_HASH_DEL_FN fn);
+
+// --------------------------------------------------------------------------
+
+/// @brief Insert an element into the hash table.
+/// If the table already contains a value with the given key this function
+/// will fail to insert the new value.
+/// @param table The table to insert the element into.
+/// @param key_len The length of the key.
+/// @param key The hash key to use.
+/// @param data The data to insert.
+/// @return True if the element was successfully inserted.
+extern bool iw_chtable_insert(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key,
+    void *data);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get an element from the hash table.
+/// The stripe is only locked during the lookup. The caller must make sure
+/// the element isn't removed and deleted by another thread while it is
+/// being used, otherwise use \a iw_chtable_get_locked().
+/// @param table The table to get the element from.
+/// @param key_len The length of the key.
+/// @param key The hash key to use.
+/// @return The data pointed to by the key or NULL if no match was found.
+extern void *iw_chtable_get(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get an element from the hash table and keep its stripe locked.
+/// The stripe is read locked, or write locked if \p write is true, and
+/// stays locked until \a iw_chtable_unlock() is called, also if no element
+/// was found. The element can't be removed while the stripe is locked.
+/// @param table The table to get the element from.
+/// @param key_len The length of the key.
+/// @param key The hash key to use.
+/// @param write True to write lock the stripe.
+/// @param lock [out] The lock to release with \a iw_chtable_unlock().
+/// @return The data pointed to by the key or NULL if no match was found.
+extern void *iw_chtable_get_locked(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key,
+    bool write,
+    iw_chtable_lock *lock);
+
+// --------------------------------------------------------------------------
+
+/// @brief Release a stripe lock taken by \a iw_chtable_get_locked().
+/// @param lock The lock to release.
+extern void iw_chtable_unlock(iw_chtable_lock *lock);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get an element from the hash table without locking.
+/// The caller must already hold the lock of the stripe, e.g. through
+/// \a iw_chtable_rdlock_all().
+/// @param table The table to get the element from.
+/// @param key_len The length of the key.
+/// @param key The hash key to use.
+/// @return The data pointed to by the key or NULL if no match was found.
+extern void *iw_chtable_find(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key);
+
+// --------------------------------------------------------------------------
+
+/// @brief Remove an element from the hash table.
+/// @param table The table to remove the element from.
+/// @param key_len The length of the key.
+/// @param key The hash key to use.
+/// @return The data pointed to by the key or NULL if no match was found.
+extern void *iw_chtable_remove(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key);
+
+// --------------------------------------------------------------------------
+
+/// @brief Delete an element from the hash table.
+/// @param table The table to delete the element from.
+/// @param key_len The length of the key.
+/// @param key The hash key to use.
+/// @param fn The entry deletion function to use or NULL if free() can be used.
+/// @return True if the entry was found and deleted.
+extern bool iw_chtable_delete(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key,
+    IW_HASH_DEL_FN fn);
+
+// --------------------------------------------------------------------------
+
+/// @brief Destroy a concurrent hash table.
+/// No other thread may access the table while it is destroyed.
+/// @param table The table to destroy.
+/// @param fn The hash table data deletion function.
+extern void iw_chtable_destroy(iw_chtable *table, IW_HASH_DEL_FN fn);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the number of elements in the hash table.
+/// The stripes are read one at a time so the number may be off if elements
+/// are inserted or removed concurrently.
+/// @param table The table to count the elements in.
+/// @return The number of elements.
+extern unsigned int iw_chtable_num_elems(iw_chtable *table);
+
+// --------------------------------------------------------------------------
+
+/// @brief Read lock all stripes of the hash table.
+/// Used to iterate through the table or to look up several elements
+/// consistently. The stripes are always locked in the same order.
+/// @param table The table to lock.
+extern void iw_chtable_rdlock_all(iw_chtable *table);
+
+// --------------------------------------------------------------------------
+
+/// @brief Write lock all stripes of the hash table.
+/// @param table The table to lock.
+extern void iw_chtable_wrlock_all(iw_chtable *table);
+
+// --------------------------------------------------------------------------
+
+/// @brief Release the locks taken on all stripes of the hash table.
+/// @param table The table to unlock.
+extern void iw_chtable_unlock_all(iw_chtable *table);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the first element of the hash table using an iterator.
+/// The caller must hold the locks of all stripes.
+/// @param table The hash table to get the first element from.
+/// @param iter [out] The iterator to initialize.
+/// @return The data in the first element in the hash table.
+extern void *iw_chtable_iter_first(iw_chtable *table, iw_chtable_iter *iter);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the next element of the hash table using an iterator.
+/// @param iter [in/out] The iterator to get the next element from.
+/// @return The data in the next element in the hash table or NULL at the end.
+extern void *iw_chtable_iter_next(iw_chtable_iter *iter);
+
+// --------------------------------------------------------------------------
+
+/// @brief Print a report on the given hash table.
+/// @param table The table to print the report on.
+/// @param out The file stream to print the report on.
+extern void iw_chtable_report(iw_chtable *table, FILE *out);
+
+// --------------------------------------------------------------------------
+
+#ifdef _cplusplus
+}
+#endif
+#endif // _IW_CHTABLE_H_
+
+// --------------------------------------------------------------------------
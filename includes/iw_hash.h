@@ -14,6 +14,9 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stdint.h>
+
 // --------------------------------------------------------------------------
 //
 // Typedefs
@@ -23,6 +26,17 @@ extern "C" {
 /// The function definition for hash functions.
 typedef unsigned long(*IW_HASH_FN)(unsigned int, const void *);
 
+// --------------------------------------------------------------------------
+
+/// @brief The available hash algorithms.
+typedef enum {
+    IW_HASH_ALG_WORD,   ///< Word-at-a-time hash for general data, the default.
+    IW_HASH_ALG_INT,    ///< Integer mixer for pointer and integer keys.
+    IW_HASH_ALG_SEEDED, ///< Seeded hash for untrusted keys.
+    IW_HASH_ALG_DJB2,   ///< The byte-at-a-time djb2 hash.
+    IW_HASH_ALG_NUM     ///< The number of hash algorithms.
+} IW_HASH_ALG;
+
 // --------------------------------------------------------------------------
 //
 // Function API
@@ -30,6 +44,8 @@ typedef unsigned long(*IW_HASH_FN)(unsigned int, const void *);
 // --------------------------------------------------------------------------
 
 /// @brief A hash function used to create keys from given data.
+/// This is the default hash function, currently the same as
+/// \a iw_hash_word().
 /// @param len The length of the data provided.
 /// @param data A pointer to the data used.
 /// @return The hash value for the given data.
@@ -37,6 +53,96 @@ extern unsigned long iw_hash_data(unsigned int len, const void *data);
 
 // --------------------------------------------------------------------------
 
+/// @brief A word-at-a-time hash function.
+/// Reads the data eight bytes at a time into four independent lanes so that
+/// long keys are hashed at close to memory speed. The result is fully mixed
+/// so both the high and low bits of the hash can be used as an index.
+/// @param len The length of the data provided.
+/// @param data A pointer to the data used.
+/// @return The hash value for the given data.
+extern unsigned long iw_hash_word(unsigned int len, const void *data);
+
+// --------------------------------------------------------------------------
+
+/// @brief A hash function for fixed-width integer keys.
+/// Meant for pointers, thread IDs and other keys of at most eight bytes. The
+/// key is read as one integer and mixed so that keys that only differ in a
+/// few bits, such as aligned pointers, are spread out. Longer keys are
+/// hashed with \a iw_hash_word().
+/// @param len The length of the data provided.
+/// @param data A pointer to the data used.
+/// @return The hash value for the given data.
+extern unsigned long iw_hash_int(unsigned int len, const void *data);
+
+// --------------------------------------------------------------------------
+
+/// @brief A seeded hash function for keys from untrusted sources.
+/// Uses SipHash-1-3 keyed with a random per-process seed so that an
+/// attacker can't create many keys with the same hash to flood a table,
+/// e.g. through web request parameters.
+/// @param len The length of the data provided.
+/// @param data A pointer to the data used.
+/// @return The hash value for the given data.
+extern unsigned long iw_hash_seeded(unsigned int len, const void *data);
+
+// --------------------------------------------------------------------------
+
+/// @brief A keyed hash function.
+/// Computes SipHash-1-3 of the data with the given key. This is the hash
+/// used by \a iw_hash_seeded() with the per-process seed as the key.
+/// @param k0 The first half of the key.
+/// @param k1 The second half of the key.
+/// @param len The length of the data provided.
+/// @param data A pointer to the data used.
+/// @return The hash value for the given data.
+extern unsigned long iw_hash_keyed(
+    uint64_t k0,
+    uint64_t k1,
+    unsigned int len,
+    const void *data);
+
+// --------------------------------------------------------------------------
+
+/// @brief The byte-at-a-time hash function written by Dan Bernstein.
+/// @param len The length of the data provided.
+/// @param data A pointer to the data used.
+/// @return The hash value for the given data.
+extern unsigned long iw_hash_djb2(unsigned int len, const void *data);
+
+// --------------------------------------------------------------------------
+
+/// @brief Set the seed used by \a iw_hash_seeded().
+/// By default the seed is read from the system random source the first time
+/// the seeded hash is used. Setting the seed makes the hash reproducible and
+/// must be done before any table using the seeded hash is created.
+/// @param k0 The first half of the seed.
+/// @param k1 The second half of the seed.
+extern void iw_hash_set_seed(uint64_t k0, uint64_t k1);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the hash function for the given algorithm.
+/// @param alg The hash algorithm.
+/// @return The hash function or NULL if the algorithm is unknown.
+extern IW_HASH_FN iw_hash_get_fn(IW_HASH_ALG alg);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the hash algorithm with the given name.
+/// @param name The name of the hash algorithm.
+/// @param alg [out] The hash algorithm.
+/// @return True if the name matched a hash algorithm.
+extern bool iw_hash_get_alg(const char *name, IW_HASH_ALG *alg);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the name of the given hash algorithm.
+/// @param alg The hash algorithm.
+/// @return The name of the algorithm or "unknown".
+extern const char *iw_hash_alg_name(IW_HASH_ALG alg);
+
+// --------------------------------------------------------------------------
+
 #ifdef _cplusplus
 }
 #endif
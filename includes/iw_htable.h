@@ -32,6 +32,7 @@ typedef void (*IW_HASH_DEL_FN)(void *);
 // --------------------------------------------------------------------------
 
 /// @brief The hash table node data structure
+/// Used by tables created with the \a IW_HTABLE_FLAG_CHAINED flag.
 typedef struct _iw_hash_node {
     struct _iw_hash_node *next; ///< The pointer to the next node.
     unsigned long hash;         ///< The hash key for this value.
@@ -40,16 +41,97 @@ typedef struct _iw_hash_node {
 
 // --------------------------------------------------------------------------
 
+/// @brief The open addressing hash table slot data structure.
+/// The hash is stored inline with the data so that a probe sequence only
+/// touches the slot array. A hash value of \a IW_HASH_SLOT_EMPTY marks an
+/// unused slot and \a IW_HASH_SLOT_DELETED marks a removed element.
+typedef struct _iw_hash_slot {
+    unsigned long hash;         ///< The hash key for this value.
+    void         *data;         ///< The data stored for this key.
+} iw_hash_slot;
+
+// --------------------------------------------------------------------------
+
+/// The longest key that is stored inline in a key-storing hash table.
+#define IW_HASH_KEY_INLINE      16
+
+/// @brief A key stored by a key-storing hash table.
+/// Keys up to \a IW_HASH_KEY_INLINE bytes long are stored inline, longer
+/// keys are copied into an allocated buffer.
+typedef struct _iw_hash_key {
+    unsigned int len;           ///< The length of the key.
+    union {
+        unsigned char buff[IW_HASH_KEY_INLINE]; ///< The inline key.
+        void         *ptr;      ///< The allocated copy of a longer key.
+    } k;                        ///< The key storage.
+} iw_hash_key;
+
+// --------------------------------------------------------------------------
+
+/// Hash table flag, use separate chaining with one allocated node per element
+/// and a fixed number of buckets instead of the default open addressing.
+#define IW_HTABLE_FLAG_CHAINED  0x1
+
+/// Hash table flag, store a copy of the key of each element. Elements are
+/// then identified by the key rather than by the hash of the key so two keys
+/// with the same hash can both be stored in the table.
+#define IW_HTABLE_FLAG_KEYS     0x2
+
+/// Hash table flag, allocate the nodes of a chained table from a slab owned
+/// by the table instead of allocating each node separately. The nodes are
+/// all freed at once when the table is destroyed. Open addressing tables
+/// store their elements in the slot array and ignore this flag.
+#define IW_HTABLE_FLAG_POOL     0x4
+
+// --------------------------------------------------------------------------
+
+/// @brief The hash table iterator.
+/// Keeps the position of an iteration through a hash table so that each
+/// step of the iteration is done in constant time. The element last returned
+/// may be removed from the table without invalidating the iterator.
+typedef struct _iw_htable_iter {
+    struct _iw_hash_table *table;   ///< The table being iterated.
+    unsigned int   index;   ///< The bucket or slot index of the next element.
+    bool           in_old;  ///< True if iterating the old slot array.
+    iw_hash_node  *next;    ///< The next node in the current bucket (if any).
+} iw_htable_iter;
+
+// --------------------------------------------------------------------------
+
 /// @brief The hash table data structure
 typedef struct _iw_hash_table {
     IW_HASH_FN     fn;          ///< The hash function to use for this table.
+    unsigned int   flags;       ///< The IW_HTABLE_FLAG_* flags for this table.
     unsigned int   size;        ///< The size of the hash table.
     bool           iw_mem_alloc;///< True if the IW memory allocation should be used.
     unsigned int   num_elems;   ///< The current number of elements.
     unsigned int   collisions;  ///< The number of collisions in the table.
     iw_hash_node **table;       ///< The allocated array of buckets.
+    iw_hash_slot  *slots;       ///< The open addressing slot array.
+    iw_hash_key   *keys;        ///< The keys of \a slots (if storing keys).
+    unsigned int   deleted;     ///< The number of deleted slots in \a slots.
+    iw_hash_slot  *old_slots;   ///< The slot array being rehashed (if any).
+    iw_hash_key   *old_keys;    ///< The keys of \a old_slots (if any).
+    unsigned int   old_size;    ///< The size of the slot array being rehashed.
+    unsigned int   old_elems;   ///< The number of elements left to rehash.
+    unsigned int   migrated;    ///< The next slot index to rehash.
+    iw_hash_slot  *sorted;      ///< The cached sorted index (if any).
+    int (*sorted_fn)(const void *, const void *); ///< The sorted index order.
+    struct _iw_slab *slab;      ///< The node slab (if pooling nodes).
 } iw_htable;
 
+// --------------------------------------------------------------------------
+
+/// @brief A sorted snapshot of the elements in a hash table.
+/// The elements are copied into an array once and sorted so that iterating
+/// through the view does not touch the hash table.
+typedef struct _iw_htable_view {
+    iw_hash_slot  *elems;       ///< The sorted array of elements.
+    unsigned int   num_elems;   ///< The number of elements in the view.
+    unsigned int   index;       ///< The index of the next element to return.
+    bool           iw_mem_alloc;///< True if the IW memory allocation is used.
+} iw_htable_view;
+
 // --------------------------------------------------------------------------
 //
 // Function API
@@ -57,13 +139,14 @@ typedef struct _iw_hash_table {
 // --------------------------------------------------------------------------
 
 /// @brief Initialize a hash table.
-/// The size of the hash table refers to the number of buckets that will be
-/// used. The table can contain more elements than the size specifies but
-/// these extra elements will be stored in a list in the same buckets. This
-/// will degrade the performance of the hash table so that it degrades to
-/// a linear list.
+/// The table uses open addressing and grows automatically. The size of the
+/// hash table is the number of elements the table is expected to hold, the
+/// slot array is sized so that this number of elements fits without a
+/// rehash. When the load factor is exceeded, the elements are moved to a
+/// larger slot array a few at a time on each insert so no single call has
+/// to rehash the whole table.
 /// @param table The hash table to initialize.
-/// @param table_size The size of the hash table.
+/// @param table_size The expected number of elements in the table.
 /// @param iw_mem_alloc True if the IW memory allocator should be used.
 /// @param hash_fn The hash function to use or NULL for the default.
 /// @return True if the hash table was successfully created.
@@ -75,6 +158,36 @@ extern bool iw_htable_init(
 
 // --------------------------------------------------------------------------
 
+/// @brief Initialize a hash table with the given flags.
+/// If the \a IW_HTABLE_FLAG_CHAINED flag is given, the size of the hash table
+/// refers to the number of buckets that will be used. The table can contain
+/// more elements than the size specifies but these extra elements will be
+/// stored in a list in the same buckets. This will degrade the performance
+/// of the hash table so that it degrades to a linear list. Without the flag
+/// the table uses open addressing as described for \a iw_htable_init().
+/// If the \a IW_HTABLE_FLAG_KEYS flag is given, the table keeps a copy of
+/// the key of each element together with its hash. Lookups first compare
+/// the cached hash and then the key so elements whose keys hash to the same
+/// value are kept apart. Without the flag, only the hash is stored and two
+/// keys with the same hash are treated as the same key.
+/// If the \a IW_HTABLE_FLAG_POOL flag is given together with
+/// \a IW_HTABLE_FLAG_CHAINED, the nodes are allocated from a slab that
+/// is reported by the "memory slabs" command.
+/// @param table The hash table to initialize.
+/// @param table_size The size of the hash table.
+/// @param iw_mem_alloc True if the IW memory allocator should be used.
+/// @param hash_fn The hash function to use or NULL for the default.
+/// @param flags The IW_HTABLE_FLAG_* flags to use for the table.
+/// @return True if the hash table was successfully created.
+extern bool iw_htable_init_ex(
+    iw_htable *table,
+    unsigned int table_size,
+    bool iw_mem_alloc,
+    IW_HASH_FN hash_fn,
+    unsigned int flags);
+
+// --------------------------------------------------------------------------
+
 /// @brief Insert or replace an element in the hash table.
 /// If the table already contains a value with the given key this function will
 /// delete the old element before inserting the new value.
@@ -160,11 +273,17 @@ extern void iw_htable_destroy(iw_htable *table, IW_HASH_DEL_FN fn);
 /// @brief Get the first element of the hash table.
 /// Starts an iteration of the elements in the hash table. The elements
 /// are returned in the order they are found in the internal hash table
-/// implementation. The \p hash parameter is used to return the hash of
+/// implementation. The \p hash parameter is used to return a token for
 /// the element returned. This parameter will then be passed to the
-/// \a iw_htable_get_next() function.
+/// \a iw_htable_get_next() function. The token is the hash of the element
+/// for chained tables and the position of the element for open addressing
+/// tables. Chained tables storing keys can therefore not continue an
+/// iteration past elements whose hashes are identical, use
+/// \a iw_htable_iter_first() for those.
+/// Elements may be removed during the iteration but inserting elements may
+/// cause the elements to move and should not be done.
 /// @param table The hash table to get the first element from.
-/// @param hash [out] A variable to store the hash of the found element.
+/// @param hash [out] A variable to store the token of the found element.
 /// @return The data in the first element in the hash table.
 extern void *iw_htable_get_first(iw_htable *table, unsigned long *hash);
 
@@ -174,26 +293,55 @@ extern void *iw_htable_get_first(iw_htable *table, unsigned long *hash);
 /// Should be used after \a iw_htable_get_first() to get the subsequent
 /// elements in the table.
 /// @param table The hash table to get the next element from.
-/// @param hash [in/out] A variable to store the hash of the found element.
+/// @param hash [in/out] A variable to store the token of the found element.
 /// @return The data in the next element in the hash table or NULL at the end.
 extern void *iw_htable_get_next(iw_htable *table, unsigned long *hash);
 
 // --------------------------------------------------------------------------
 
+/// @brief Get the first element of the hash table using an iterator.
+/// Starts an iteration of the elements in the hash table. The elements
+/// are returned in the order they are found in the internal hash table
+/// implementation. Unlike \a iw_htable_get_next(), each call to
+/// \a iw_htable_iter_next() continues from the stored position so walking
+/// the whole table is linear in the size of the table.
+/// The element last returned may be removed during the iteration but
+/// inserting elements may cause the elements to move and should not be done.
+/// @param table The hash table to get the first element from.
+/// @param iter [out] The iterator to initialize.
+/// @return The data in the first element in the hash table.
+extern void *iw_htable_iter_first(iw_htable *table, iw_htable_iter *iter);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the next element of the hash table using an iterator.
+/// Should be used after \a iw_htable_iter_first() to get the subsequent
+/// elements in the table.
+/// @param iter [in/out] The iterator to get the next element from.
+/// @return The data in the next element in the hash table or NULL at the end.
+extern void *iw_htable_iter_next(iw_htable_iter *iter);
+
+// --------------------------------------------------------------------------
+
 /// @brief Get the first element of the table according to the given order.
 /// Starts an iteration of the elements in the hash table. The elements
 /// are returned according to the order of the given comparison function.
-/// The \p hash parameter is used to return the hash of the element returned.
-/// This parameter will then be passed to the \a iw_htable_get_next_ordered()
+/// The \p hash parameter is used to return a token for the element returned
+/// as for \a iw_htable_get_first(). This parameter will then be passed to the \a iw_htable_get_next_ordered()
 /// function.
 /// The comparison function is called to compare two elements in the table.
 /// The function should return less than zero if the first element is less
 /// than the second element, zero if the elements are equal, and greater than
 /// zero if the first element is larger than the second element.
-/// This iteration may be quite time-consuming for large tables.
+/// The elements are sorted once into an index that is cached in the table
+/// and reused by subsequent ordered iterations using the same comparison
+/// function until an element is inserted or removed. Since the index is
+/// built on demand, these functions modify the table and must not be called
+/// concurrently with other accesses to the table. Use
+/// \a iw_htable_view_init() to iterate under a read lock.
 /// @param table The hash table to get the first element from.
 /// @param compare A comparison function to use to sort the elements.
-/// @param hash [out] A variable to store the hash of the found element.
+/// @param hash [out] A variable to store the token of the found element.
 /// @return The data in the first element in the hash table.
 extern void *iw_htable_get_first_ordered(
     iw_htable *table,
@@ -205,7 +353,7 @@ extern void *iw_htable_get_first_ordered(
 /// @brief Get the next element of the hash table.
 /// @param table The hash table to get the next element from.
 /// @param compare A comparison function to use to sort the elements.
-/// @param hash [in/out] A variable to store the hash of the found element.
+/// @param hash [in/out] A variable to store the token of the found element.
 /// @return The data in the next element in the hash table or NULL at the end.
 extern void *iw_htable_get_next_ordered(
     iw_htable *table,
@@ -214,6 +362,44 @@ extern void *iw_htable_get_next_ordered(
 
 // --------------------------------------------------------------------------
 
+/// @brief Create a sorted view of the elements in the hash table.
+/// Takes a snapshot of the elements in the table into an array and sorts
+/// it with the given comparison function. The table is only read so this
+/// can be done while holding a read lock, the view can then be iterated
+/// without the table. The view must be destroyed with
+/// \a iw_htable_view_destroy().
+/// @param view The view to initialize.
+/// @param table The hash table to create the view of.
+/// @param compare A comparison function to use to sort the elements.
+/// @return True if the view was successfully created.
+extern bool iw_htable_view_init(
+    iw_htable_view *view,
+    iw_htable *table,
+    int (*compare)(const void *, const void *));
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the first element of the sorted view.
+/// @param view The view to get the first element from.
+/// @return The data in the first element or NULL if the view is empty.
+extern void *iw_htable_view_first(iw_htable_view *view);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the next element of the sorted view.
+/// @param view The view to get the next element from.
+/// @return The data in the next element or NULL at the end of the view.
+extern void *iw_htable_view_next(iw_htable_view *view);
+
+// --------------------------------------------------------------------------
+
+/// @brief Destroy a sorted view.
+/// Only the view is freed, the elements are still owned by the table.
+/// @param view The view to destroy.
+extern void iw_htable_view_destroy(iw_htable_view *view);
+
+// --------------------------------------------------------------------------
+
 /// @brief Print a report on the given hash table.
 /// @param table The table to print the report on.
 /// @param out The file stream to print the report on.
@@ -22,11 +22,11 @@ extern "C" {
 
 /// @brief Initialize a list structure.
 /// Do not use memory tracking for this list.
-#define IW_LIST_INIT { 0, 0, 0, 0 };
+#define IW_LIST_INIT { 0, 0, 0, 0, 0 };
 
 /// @brief Initialize a list structure.
 /// Use memory tracking for this list.
-#define IW_LIST_INIT_MEM { 0, 0, 0, 1 };
+#define IW_LIST_INIT_MEM { 0, 0, 1, 0, 0 };
 
 // --------------------------------------------------------------------------
 
@@ -48,12 +48,19 @@ typedef struct _iw_list_gen_node {
 
 // --------------------------------------------------------------------------
 
+/// List flag, allocate the generic nodes added by the *_data() functions
+/// from a slab owned by the list instead of allocating each node separately.
+#define IW_LIST_FLAG_POOL   0x1
+
+// --------------------------------------------------------------------------
+
 /// @brief The list structure.
 typedef struct _iw_list {
     iw_list_node *head; ///< A pointer to the head of the list.
     iw_list_node *tail; ///< A pointer to the tail of the list.
     bool iw_mem_alloc;  ///< True if the IW memory allocation should be used.
     unsigned int num_elems; ///< The number of elements in the list.
+    struct _iw_slab *slab;  ///< The generic node slab (if pooling nodes).
 } iw_list;
 
 // --------------------------------------------------------------------------
@@ -78,6 +85,20 @@ extern void iw_list_init(iw_list *list, bool iw_mem_alloc);
 
 // --------------------------------------------------------------------------
 
+/// @brief Initialize a list structure with the given flags.
+/// If the \a IW_LIST_FLAG_POOL flag is given, the generic nodes are
+/// allocated from a slab that is freed all at once when the list is
+/// destroyed. Such a list must only contain nodes added through the *_data()
+/// functions, and a delete function given to \a iw_list_delete() or
+/// \a iw_list_destroy() must only free the data, not the node itself.
+/// @param list The list to initialize.
+/// @param iw_mem_alloc True if the IW memory allocator should be used.
+/// @param flags The IW_LIST_FLAG_* flags to use for the list.
+/// @return True if the list was successfully initialized.
+extern bool iw_list_init_ex(iw_list *list, bool iw_mem_alloc, unsigned int flags);
+
+// --------------------------------------------------------------------------
+
 /// @brief Return the number of elements in the list.
 /// @param list The list to query for the number of elements.
 /// @return The number of elements in the list.
@@ -15,6 +15,7 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
 // --------------------------------------------------------------------------
@@ -28,22 +29,90 @@ extern "C" {
 
 // --------------------------------------------------------------------------
 
+#ifndef IW_LOG_COMPILE_MASK
+/// The log levels compiled into the program. LOG, LOG_EX and DO_LOG with a
+/// constant level outside the mask fold to nothing, so the call site, its
+/// format string and its arguments are removed from the binary. Define it
+/// on the command line, e.g. -DIW_LOG_COMPILE_MASK=0 for a release build.
+#define IW_LOG_COMPILE_MASK 0xFFFFFFFFU
+#endif
+
+/// @brief Check whether a given log level is compiled into the program.
+#define IW_LOG_COMPILED(LVL)    ((LVL) & IW_LOG_COMPILE_MASK)
+
 /// @brief Check whether a given log level should be logged.
-#define DO_LOG(LVL)         (LVL & s_log_level)
+#define DO_LOG(LVL)         (IW_LOG_COMPILED(LVL) & s_log_level)
+
+// --------------------------------------------------------------------------
+
+/// @brief The descriptor of a log call site.
+/// Each LOG and LOG_EX call site has a static descriptor. The descriptors
+/// are placed in their own section so that all call sites can be listed and
+/// enabled or disabled with the 'log site' command. The binary log
+/// registers the site, with its format string, the first time the site is
+/// logged and only records the ID of the site for each message. The
+/// remaining fields hold the rate limiting and duplicate suppression state
+/// of the site's text output.
+typedef struct _iw_log_site {
+    const char    *file;        ///< The file of the call site.
+    const char    *func;        ///< The function of the call site.
+    unsigned int   line;        ///< The line of the call site.
+    unsigned int   id;          ///< The binary log ID, zero until registered.
+    unsigned int   mask;        ///< All ones if the site is enabled, zero
+                                ///< if not.
+    unsigned int   suppressed;  ///< The messages suppressed by the rate
+                                ///< limit since the last one logged.
+    uint64_t       next;        ///< The time in ns when the site's token
+                                ///< bucket next gains a token.
+    unsigned long  fingerprint; ///< The hash of the last message logged.
+    unsigned int   repeats;     ///< The times the last message has been
+                                ///< repeated since it was logged.
+} iw_log_site;
+
+// --------------------------------------------------------------------------
+
+/// @brief A filter selecting log call sites.
+typedef struct _iw_log_site_filter {
+    const char   *file;      ///< A glob matched against the path or the
+                             ///< name of the file, or NULL for any file.
+    const char   *func;      ///< A glob matched against the function name,
+                             ///< or NULL for any function.
+    unsigned int  line_from; ///< The first line, or zero for no limit.
+    unsigned int  line_to;   ///< The last line, or zero for no limit.
+} iw_log_site_filter;
+
+// --------------------------------------------------------------------------
+
+/// @brief Declare the static descriptor of a log call site.
+/// The descriptor is explicitly aligned so that the compiler doesn't pad
+/// the descriptors in the section. It isn't marked as used so that an
+/// optimizing build drops the descriptor of a call site that is compiled
+/// out.
+/// @param NAME The name of the descriptor variable.
+#define IW_LOG_SITE(NAME)   static iw_log_site NAME \
+        __attribute__((section("iw_log_sites"), aligned(8))) = \
+        { .file = __FILE__, .func = __func__, .line = __LINE__, .mask = ~0U }
 
 // --------------------------------------------------------------------------
 
 /// @brief A logging macro to call when outputting a log message.
+/// The log level and the call site are checked with a single branch. The
+/// whole call site is removed if the level isn't in IW_LOG_COMPILE_MASK.
 /// @param LVL The log level to use.
 /// @param MSG The message to output.
-#define LOG(LVL, MSG...)   { if(DO_LOG(LVL)) { iw_log(__FILE__, __LINE__, MSG); } }
+#define LOG(LVL, MSG...)   { if(IW_LOG_COMPILED(LVL)) { \
+        IW_LOG_SITE(_iw_log_site); \
+        if(DO_LOG(LVL) & _iw_log_site.mask) { \
+            iw_log_at(&_iw_log_site, MSG); } } }
 
 // --------------------------------------------------------------------------
 
 /// @brief A logging macro to call when outputting a log message.
 /// @param LVL The log level to use.
 /// @param MSG The message to output.
-#define LOG_EX(LVL, MSG...)    iw_log_ex(LVL, __FILE__, __LINE__, MSG)
+#define LOG_EX(LVL, MSG...)    ({ if(IW_LOG_COMPILED(LVL)) { \
+        IW_LOG_SITE(_iw_log_site); \
+        iw_log_ex_at(LVL, &_iw_log_site, MSG); } })
 
 // --------------------------------------------------------------------------
 
@@ -85,6 +154,18 @@ extern bool iw_log_add_level(
 /// @param out The file descriptor to display the log levels on.
 extern void iw_log_list(FILE *out);
 
+// --------------------------------------------------------------------------
+
+/// @brief Enable or disable the log call sites selected by a filter.
+/// Messages from a disabled call site aren't logged whatever the log level.
+/// All call sites are enabled by default.
+/// @param filter The filter selecting the call sites.
+/// @param enable True to enable the call sites, false to disable them.
+/// @return The number of call sites selected by the filter.
+extern unsigned int iw_log_site_enable(
+    const iw_log_site_filter *filter,
+    bool enable);
+
 // --------------------------------------------------------------------------
 //
 // Private API - should not be called directly. Use macros above instead.
@@ -122,6 +203,27 @@ extern void iw_log_ex(
 
 // --------------------------------------------------------------------------
 
+/// @brief The log function for outputting log messages from a call site.
+/// This function should not be used directly. Instead call the LOG macro.
+/// @param site The descriptor of the call site.
+/// @param msg The message to output.
+extern void iw_log_at(iw_log_site *site, const char *msg, ...);
+
+// --------------------------------------------------------------------------
+
+/// @brief The log function for outputting log messages from a call site.
+/// This function should not be used directly. Instead call the LOG_EX macro.
+/// Like iw_log_ex(), the log level check is performed in the function call.
+/// @param lvl The log level to use.
+/// @param site The descriptor of the call site.
+/// @param msg The message to output.
+extern void iw_log_ex_at(
+    unsigned int lvl,
+    iw_log_site *site,
+    const char *msg, ...);
+
+// --------------------------------------------------------------------------
+
 #ifdef _cplusplus
 }
 #endif
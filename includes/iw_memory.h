@@ -69,6 +69,31 @@ extern "C" {
 #define IW_MEM_FREE(ptr)            iw_free(ptr)
 #endif
 
+// --------------------------------------------------------------------------
+//
+// Memory tags
+//
+// --------------------------------------------------------------------------
+
+/// The tag of memory allocated while no tag is set.
+#define IW_MEM_TAG_NONE     0
+
+/// The maximum number of memory tags, including \a IW_MEM_TAG_NONE.
+#define IW_MEM_TAGS         64
+
+/// @brief Set the memory tag of the calling thread until the end of the
+/// enclosing block. The previous tag is restored when the block is left,
+/// also through a return or a break.
+/// @param tag The tag to set.
+#define IW_MEM_TAG_SCOPE(tag)       IW_MEM_TAG_SCOPE_(tag, __LINE__)
+/// Helper macro to expand the line number of \a IW_MEM_TAG_SCOPE.
+#define IW_MEM_TAG_SCOPE_(tag,line) IW_MEM_TAG_SCOPE__(tag, line)
+/// Helper macro to declare the variable holding the previous tag.
+#define IW_MEM_TAG_SCOPE__(tag,line) \
+    unsigned int _iw_mem_tag_ ## line \
+        __attribute__((cleanup(iw_memory_tag_restore), unused)) = \
+        iw_memory_tag_set(tag)
+
 // --------------------------------------------------------------------------
 //
 // Function API
@@ -134,6 +159,36 @@ extern void iw_free(
 
 // --------------------------------------------------------------------------
 
+/// @brief Register a memory tag.
+/// Memory allocated while a tag is set is accounted to the tag so that the
+/// current and peak memory use of a thread pool or a component can be
+/// displayed. Registering a name that is already registered returns the
+/// existing tag.
+/// @param name The name of the tag.
+/// @return The tag or \a IW_MEM_TAG_NONE if too many tags are registered.
+extern unsigned int iw_memory_tag_register(const char *name);
+
+// --------------------------------------------------------------------------
+
+/// @brief Set the memory tag of the calling thread.
+/// @param tag The tag to set or \a IW_MEM_TAG_NONE to clear the tag.
+/// @return The previous tag of the calling thread.
+extern unsigned int iw_memory_tag_set(unsigned int tag);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the memory tag of the calling thread.
+/// @return The current tag of the calling thread.
+extern unsigned int iw_memory_tag_get();
+
+// --------------------------------------------------------------------------
+
+/// @brief Restore a previous memory tag, used by \a IW_MEM_TAG_SCOPE.
+/// @param tag A pointer to the tag to restore.
+extern void iw_memory_tag_restore(unsigned int *tag);
+
+// --------------------------------------------------------------------------
+
 /// @brief Utility function to display memory amount in a readable format.
 /// For example, 10240 bytes would be displayed as 10 MBytes, 10 bytes would
 /// be displayed as 10 Bytes.
@@ -144,7 +199,7 @@ extern void iw_free(
 extern char *iw_memory_display_str(
     unsigned int len,
     char *buff,
-    unsigned int bytes);
+    unsigned long bytes);
 
 // --------------------------------------------------------------------------
 
@@ -0,0 +1,162 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_pool.h
+///
+/// A pool allocator for fixed-size objects shared between threads. Each
+/// thread keeps a small cache (magazine) of free objects per pool so that
+/// most allocations and frees don't touch any shared state. When a cache
+/// runs empty it is refilled with a batch of objects from the global depot
+/// of the pool, and when it is full half of it is returned to the depot.
+/// The depot is a lock-free stack of batches, the pool lock is only taken
+/// when the pool needs to carve objects out of a new block.
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#ifndef _IW_POOL_H_
+#define _IW_POOL_H_
+#ifdef _cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// --------------------------------------------------------------------------
+//
+// Typedefs
+//
+// --------------------------------------------------------------------------
+
+/// The largest number of pools that can exist at the same time.
+#define IW_POOL_MAX         32
+
+/// The number of objects each thread can cache per pool.
+#define IW_POOL_MAG_SIZE    32
+
+/// The number of objects moved between a thread cache and the depot at once.
+#define IW_POOL_BATCH       (IW_POOL_MAG_SIZE / 2)
+
+/// The default size of each block of objects in bytes.
+#define IW_POOL_BLOCK_SIZE  16384
+
+// --------------------------------------------------------------------------
+
+/// @brief The top of the depot stack of a pool.
+/// The pointer and the counter are updated together with a double-width
+/// compare-and-swap.
+typedef struct _iw_pool_top {
+    void      *batch;   ///< The first batch of the depot.
+    uintptr_t  tag;     ///< Incremented on each update of the depot.
+} __attribute__((aligned(2 * sizeof(void *)))) iw_pool_top;
+
+// --------------------------------------------------------------------------
+
+/// @brief The pool data structure.
+typedef struct _iw_pool {
+    const char     *name;       ///< The name shown in pool reports.
+    bool            iw_mem_alloc;///< True if the IW memory allocation is used.
+    unsigned int    id;         ///< The index of the pool in the thread caches.
+    unsigned int    gen;        ///< The generation of the pool.
+    unsigned int    obj_size;   ///< The size of each object.
+    unsigned int    per_block;  ///< The number of objects in each block.
+    iw_pool_top     depot;      ///< The tagged top of the depot stack.
+    pthread_mutex_t lock;       ///< The lock protecting the blocks.
+    void           *blocks;     ///< The allocated blocks.
+    unsigned char  *bump;       ///< The next unused object in the newest block.
+    unsigned int    bump_left;  ///< The number of unused objects in the block.
+    unsigned int    num_blocks; ///< The number of allocated blocks.
+    unsigned long   depot_objs; ///< The number of objects in the depot.
+    unsigned long   refills;    ///< The number of thread cache refills.
+    unsigned long   flushes;    ///< The number of thread cache flushes.
+    unsigned long   allocs;     ///< The allocations of exited threads.
+    unsigned long   frees;      ///< The frees of exited threads.
+} iw_pool;
+
+// --------------------------------------------------------------------------
+
+/// @brief The statistics of a pool.
+typedef struct _iw_pool_stats {
+    unsigned int  num_blocks;   ///< The number of allocated blocks.
+    unsigned long objects;      ///< The number of objects carved from blocks.
+    unsigned long allocs;       ///< The number of allocations made so far.
+    unsigned long frees;        ///< The number of frees made so far.
+    unsigned long cached;       ///< The number of objects in thread caches.
+    unsigned long depot;        ///< The number of objects in the depot.
+    unsigned long refills;      ///< The number of thread cache refills.
+    unsigned long flushes;      ///< The number of thread cache flushes.
+} iw_pool_stats;
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+/// @brief Initialize a pool.
+/// The pool is registered so that it is included in \a iw_pool_show().
+/// No memory is allocated until the first object is allocated.
+/// @param pool The pool to initialize.
+/// @param name The name of the pool, must stay valid until destroyed.
+/// @param obj_size The size of each object.
+/// @param iw_mem_alloc True if the IW memory allocator should be used.
+/// @return True if the pool was initialized, false if there are already
+/// \a IW_POOL_MAX pools.
+extern bool iw_pool_init(
+    iw_pool *pool,
+    const char *name,
+    unsigned int obj_size,
+    bool iw_mem_alloc);
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate an object from the pool.
+/// The object is 16 byte aligned and is not initialized.
+/// @param pool The pool to allocate the object from.
+/// @return The object or NULL if no memory could be allocated.
+extern void *iw_pool_alloc(iw_pool *pool);
+
+// --------------------------------------------------------------------------
+
+/// @brief Return an object to the pool.
+/// The object can be freed by any thread, not only the allocating thread.
+/// @param pool The pool the object was allocated from.
+/// @param ptr The object to free.
+extern void iw_pool_free(iw_pool *pool, void *ptr);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the statistics of a pool.
+/// The counters of the thread caches are read while they are in use so the
+/// statistics may be slightly off if the pool is used concurrently.
+/// @param pool The pool to get the statistics of.
+/// @param stats [out] The statistics of the pool.
+extern void iw_pool_stats_get(iw_pool *pool, iw_pool_stats *stats);
+
+// --------------------------------------------------------------------------
+
+/// @brief Destroy a pool.
+/// All blocks are freed at once, any objects still in use become invalid.
+/// The pool must not be used by any other thread while it is destroyed.
+/// @param pool The pool to destroy.
+extern void iw_pool_destroy(iw_pool *pool);
+
+// --------------------------------------------------------------------------
+
+/// @brief Show the statistics of all pools on the given file stream.
+/// @param out The file stream to write the response to.
+extern void iw_pool_show(FILE *out);
+
+// --------------------------------------------------------------------------
+
+#ifdef _cplusplus
+}
+#endif
+#endif // _IW_POOL_H_
+
+// --------------------------------------------------------------------------
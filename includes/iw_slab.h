@@ -0,0 +1,120 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_slab.h
+///
+/// A slab allocator for fixed-size nodes. Nodes are carved out of larger
+/// blocks so that containers with many small nodes don't need one heap
+/// allocation per node. Freed nodes are kept on a free list for reuse and
+/// all blocks are released at once when the slab is destroyed.
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#ifndef _IW_SLAB_H_
+#define _IW_SLAB_H_
+#ifdef _cplusplus
+extern "C" {
+#endif
+
+#include "iw_list.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// --------------------------------------------------------------------------
+//
+// Typedefs
+//
+// --------------------------------------------------------------------------
+
+/// The default size of each block of nodes in bytes.
+#define IW_SLAB_BLOCK_SIZE  4096
+
+/// The smallest number of nodes in each block.
+#define IW_SLAB_MIN_NODES   8
+
+// --------------------------------------------------------------------------
+
+/// @brief A block of nodes allocated by a slab.
+typedef struct _iw_slab_block {
+    struct _iw_slab_block *next;    ///< The next block of the slab.
+} iw_slab_block;
+
+// --------------------------------------------------------------------------
+
+/// @brief The slab data structure.
+typedef struct _iw_slab {
+    iw_list_node    node;       ///< The node in the list of all slabs.
+    const char     *name;       ///< The name shown in slab reports.
+    bool            iw_mem_alloc;///< True if the IW memory allocation is used.
+    unsigned int    node_size;  ///< The size of each node.
+    unsigned int    per_block;  ///< The number of nodes in each block.
+    iw_slab_block  *blocks;     ///< The allocated blocks.
+    void           *free;       ///< The list of freed nodes.
+    unsigned char  *bump;       ///< The next unused node in the newest block.
+    unsigned int    bump_left;  ///< The number of unused nodes in the newest block.
+    unsigned int    num_blocks; ///< The number of allocated blocks.
+    unsigned int    in_use;     ///< The number of nodes in use.
+    unsigned int    high_water; ///< The largest number of nodes in use.
+} iw_slab;
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+/// @brief Initialize a slab.
+/// The slab is registered so that it is included in \a iw_slab_show().
+/// No memory is allocated until the first node is allocated.
+/// @param slab The slab to initialize.
+/// @param name The name of the slab, must stay valid until destroyed.
+/// @param node_size The size of each node.
+/// @param per_block The number of nodes in each block or zero to fit the
+/// nodes in \a IW_SLAB_BLOCK_SIZE bytes.
+/// @param iw_mem_alloc True if the IW memory allocator should be used.
+extern void iw_slab_init(
+    iw_slab *slab,
+    const char *name,
+    unsigned int node_size,
+    unsigned int per_block,
+    bool iw_mem_alloc);
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate a zeroed node from the slab.
+/// @param slab The slab to allocate the node from.
+/// @return The node or NULL if no memory could be allocated.
+extern void *iw_slab_alloc(iw_slab *slab);
+
+// --------------------------------------------------------------------------
+
+/// @brief Return a node to the slab.
+/// @param slab The slab the node was allocated from.
+/// @param ptr The node to free.
+extern void iw_slab_free(iw_slab *slab, void *ptr);
+
+// --------------------------------------------------------------------------
+
+/// @brief Destroy a slab.
+/// All blocks are freed at once, any nodes still in use become invalid.
+/// @param slab The slab to destroy.
+extern void iw_slab_destroy(iw_slab *slab);
+
+// --------------------------------------------------------------------------
+
+/// @brief Show the occupancy of all slabs on the given file stream.
+/// @param out The file stream to write the response to.
+extern void iw_slab_show(FILE *out);
+
+// --------------------------------------------------------------------------
+
+#ifdef _cplusplus
+}
+#endif
+#endif // _IW_SLAB_H_
+
+// --------------------------------------------------------------------------
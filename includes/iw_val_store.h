@@ -331,6 +331,45 @@ extern void *iw_val_store_get_first(iw_val_store *store, unsigned long *token);
 /// @return The value of the next element in the value store or NULL at the end.
 extern void *iw_val_store_get_next(iw_val_store *store, unsigned long *token);
 
+// --------------------------------------------------------------------------
+
+/// @brief Get the first element of the value store using an iterator.
+/// Starts an iteration of the elements in the value store. Each step of the
+/// iteration continues from the position stored in the iterator.
+/// @param store The value store to get the first element from.
+/// @param iter [out] The iterator to initialize.
+/// @return The value of the first element in the value store or NULL at the end.
+extern void *iw_val_store_iter_first(iw_val_store *store, iw_htable_iter *iter);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the next element of the value store using an iterator.
+/// @param iter [in/out] The iterator to get the next element from.
+/// @return The value of the next element in the value store or NULL at the end.
+extern void *iw_val_store_iter_next(iw_htable_iter *iter);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the first element of the value store ordered by name.
+/// The value names are sorted once and the sorted order is reused by
+/// subsequent ordered iterations until a value is added or removed.
+/// @param store The value store to get the first element from.
+/// @param token [out] A variable to store the token of the found element.
+/// @return The value of the first element in the value store or NULL at the end.
+extern void *iw_val_store_get_first_ordered(
+    iw_val_store *store,
+    unsigned long *token);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the next element of the value store ordered by name.
+/// @param store The value store to get the next element from.
+/// @param token [in/out] A variable to store the token of the found element.
+/// @return The value of the next element in the value store or NULL at the end.
+extern void *iw_val_store_get_next_ordered(
+    iw_val_store *store,
+    unsigned long *token);
+
 // --------------------------------------------------------------------------
 //
 // Functions for adding pre-defined names to controlled value store.
@@ -16,6 +16,7 @@
 extern "C" {
 #endif
 
+#include "iw_arena.h"
 #include "iw_buff.h"
 #include "iw_ip.h"
 #include "iw_list.h"
@@ -44,6 +45,15 @@ typedef enum {
 
 // --------------------------------------------------------------------------
 
+/// The size of each block of the request arena.
+#define IW_WEB_REQ_ARENA_BLOCK  2048
+
+/// The most memory a request may allocate for its headers and parameters.
+/// Requests with more headers or parameters than fit fail to parse.
+#define IW_WEB_REQ_ARENA_CAP    (64 * 1024)
+
+// --------------------------------------------------------------------------
+
 /// The parse return value
 typedef enum _IW_WEB_PARSE {
     IW_WEB_PARSE_COMPLETE,
@@ -134,6 +144,10 @@ typedef struct _iw_web_req {
     /// The content of the request (if any).
     iw_parse_index content;
 
+    /// The arena that the headers and parameters are allocated from, they
+    /// are all released at once when the request is freed.
+    iw_arena arena;
+
 } iw_web_req;
 
 // --------------------------------------------------------------------------
@@ -167,6 +181,8 @@ extern bool iw_web_req_sanitize(const char *value, char *buff, int buff_len);
 // --------------------------------------------------------------------------
 
 /// @brief Initialize a web request object.
+/// The request must be freed with \a iw_web_req_free() to release the
+/// memory allocated while parsing it.
 /// @param req The request to initialize.
 extern void iw_web_req_init(iw_web_req *req);
 
@@ -191,8 +207,9 @@ extern iw_web_req_header *iw_web_req_add_header(
 // --------------------------------------------------------------------------
 
 /// @brief Delete a header object.
-/// This deletes the header object memory allocated to represent the header.
-/// It does not delete the memory pointed to by the header object.
+/// The header object is allocated from the arena of the request and is
+/// released when the request is freed, so this does nothing. It is kept for
+/// callers that destroy the header list with it.
 /// @param node The header node to delete.
 extern void iw_web_req_delete_header(iw_list_node *node);
 
@@ -217,8 +234,9 @@ extern iw_web_req_parameter *iw_web_req_add_parameter(
 // --------------------------------------------------------------------------
 
 /// @brief Delete a parameter object.
-/// This deletes the parameter object memory allocated to represent the parameter.
-/// It does not delete the memory pointed to by the parameter object.
+/// The parameter object and its name and value are allocated from the arena
+/// of the request and are released when the request is freed, so this does
+/// nothing. It is kept for callers that destroy the parameter list with it.
 /// @param node The parameter node to delete.
 extern void iw_web_req_delete_parameter(iw_list_node *node);
 
@@ -234,7 +252,8 @@ extern IW_WEB_PARSE iw_web_req_parse(iw_web_req *req);
 
 /// @brief Free all memory allocated by a web request.
 /// This does not free the request pointer itself, only the memory allocated
-/// as part of parsing the request.
+/// as part of parsing the request. The headers and parameters are released
+/// at once by destroying the arena of the request.
 /// @param req The request to free.
 extern void iw_web_req_free(iw_web_req *req);
 
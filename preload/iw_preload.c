@@ -0,0 +1,366 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_preload.c
+///
+/// The malloc interposer. This is built into a shared object that can be
+/// preloaded into a program using InstaWorks, e.g.
+///  $ LD_PRELOAD=lib/libinstaworks_preload.so <program>
+///
+/// The interposer replaces malloc(), free() and the other allocation
+/// functions of the process. Until the memory module registers its hooks,
+/// all calls are passed on to the real allocator. Once memory tracking is
+/// initialized, the hooks are called instead so that the allocations made
+/// by all libraries of the process are tracked in the same tables as the
+/// allocations made with IW_MALLOC().
+///
+/// The real allocation functions are looked up with dlsym() the first time
+/// they are needed. Since dlsym() may itself allocate memory, allocations
+/// made while the functions are looked up are served from a small static
+/// bootstrap buffer that is never freed.
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#define _GNU_SOURCE
+
+#include "iw_memory_int.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------
+//
+// Defines
+//
+// --------------------------------------------------------------------------
+
+/// The size of the bootstrap buffer.
+#define IW_PRELOAD_BOOTSTRAP_SIZE   (64 * 1024)
+
+/// The alignment of bootstrap allocations and the size of their header.
+#define IW_PRELOAD_ALIGN            16
+
+// --------------------------------------------------------------------------
+//
+// Internal variables
+//
+// --------------------------------------------------------------------------
+
+/// The real allocator of the process.
+static iw_memory_allocator s_real;
+
+/// True once the real allocator has been looked up.
+static bool s_ready = false;
+
+/// True while the real allocator is being looked up.
+static bool s_resolving = false;
+
+/// The hooks of the memory module, NULL until they are registered.
+static const iw_memory_allocator *s_hooks = NULL;
+
+/// The bootstrap buffer.
+static unsigned char s_bootstrap[IW_PRELOAD_BOOTSTRAP_SIZE]
+                                            __attribute__((aligned(16)));
+
+/// The number of bytes used in the bootstrap buffer.
+static size_t s_bootstrap_used = 0;
+
+// --------------------------------------------------------------------------
+//
+// Helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Write an error message and abort the process.
+/// Used when the process can't continue without an allocator. The message
+/// is written directly since stdio may allocate memory.
+/// @param msg The error message.
+static void iw_preload_abort(const char *msg) {
+    ssize_t res = write(STDERR_FILENO, msg, strlen(msg));
+    (void)res;
+    abort();
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Look up the real allocator of the process.
+/// @return True if the real allocator can be used, false if it is still
+/// being looked up.
+static bool iw_preload_init() {
+    if(s_ready) {
+        return true;
+    }
+    if(s_resolving) {
+        return false;
+    }
+    s_resolving = true;
+    iw_memory_allocator real;
+    real.malloc      = (void *(*)(size_t))dlsym(RTLD_NEXT, "malloc");
+    real.calloc      = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "calloc");
+    real.realloc     = (void *(*)(void *, size_t))dlsym(RTLD_NEXT, "realloc");
+    real.memalign    = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "memalign");
+    real.free        = (void (*)(void *))dlsym(RTLD_NEXT, "free");
+    real.usable_size = (size_t (*)(void *))dlsym(RTLD_NEXT,
+                                                 "malloc_usable_size");
+    if(real.malloc == NULL || real.calloc == NULL || real.realloc == NULL ||
+       real.memalign == NULL || real.free == NULL || real.usable_size == NULL)
+    {
+        iw_preload_abort("iw_preload: failed to find the real allocator\n");
+    }
+    s_real = real;
+    __atomic_store_n(&s_ready, true, __ATOMIC_RELEASE);
+    s_resolving = false;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the allocator that allocations are passed on to.
+/// @return The hooks of the memory module once registered, otherwise the
+/// real allocator.
+static inline __attribute__((always_inline))
+const iw_memory_allocator *iw_preload_allocator() {
+    const iw_memory_allocator *hooks = __atomic_load_n(&s_hooks,
+                                                       __ATOMIC_ACQUIRE);
+    return hooks != NULL ? hooks : &s_real;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate memory from the bootstrap buffer.
+/// The size of the allocation is kept in front of the memory. The buffer
+/// is zero-initialized so the memory can also be used for calloc().
+/// @param alignment The alignment, a power of two.
+/// @param size The size of the memory.
+/// @return The memory or NULL if the bootstrap buffer is used up.
+static void *iw_preload_bootstrap_alloc(size_t alignment, size_t size) {
+    if(alignment < IW_PRELOAD_ALIGN) {
+        alignment = IW_PRELOAD_ALIGN;
+    }
+    if(size > IW_PRELOAD_BOOTSTRAP_SIZE ||
+       alignment > IW_PRELOAD_BOOTSTRAP_SIZE)
+    {
+        return NULL;
+    }
+    size_t len = alignment + ((size + IW_PRELOAD_ALIGN - 1) &
+                              ~(size_t)(IW_PRELOAD_ALIGN - 1));
+    size_t start = __atomic_fetch_add(&s_bootstrap_used, len,
+                                      __ATOMIC_RELAXED);
+    if(start + len > IW_PRELOAD_BOOTSTRAP_SIZE) {
+        return NULL;
+    }
+    uintptr_t addr = (uintptr_t)(s_bootstrap + start) + IW_PRELOAD_ALIGN;
+    addr = (addr + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    ((size_t *)addr)[-1] = size;
+    return (void *)addr;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Check if memory was allocated from the bootstrap buffer.
+/// @param ptr The memory.
+/// @return True if the memory is in the bootstrap buffer.
+static inline __attribute__((always_inline))
+bool iw_preload_is_bootstrap(const void *ptr) {
+    return (const unsigned char *)ptr >= s_bootstrap &&
+           (const unsigned char *)ptr < s_bootstrap + IW_PRELOAD_BOOTSTRAP_SIZE;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Reallocate memory, shared by realloc() and reallocarray().
+/// Inlined so that the tracked call-stacks have the same number of
+/// interposer frames whichever function was called.
+/// @param ptr The memory to reallocate or NULL.
+/// @param size The new size of the memory.
+/// @return The memory or NULL if no memory could be allocated.
+static inline __attribute__((always_inline))
+void *iw_preload_realloc(void *ptr, size_t size) {
+    if(iw_preload_is_bootstrap(ptr)) {
+        // Bootstrap memory is never freed, move it to the real allocator.
+        size_t old_size = ((size_t *)ptr)[-1];
+        void *new_ptr = malloc(size);
+        if(new_ptr != NULL) {
+            memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+        }
+        return new_ptr;
+    }
+    if(!iw_preload_init()) {
+        // Only bootstrap memory exists while the real allocator is looked up.
+        return ptr == NULL ? iw_preload_bootstrap_alloc(IW_PRELOAD_ALIGN, size)
+                           : NULL;
+    }
+    return iw_preload_allocator()->realloc(ptr, size);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate aligned memory, shared by all aligned allocation functions.
+/// @param alignment The alignment, a power of two.
+/// @param size The size of the memory.
+/// @return The memory or NULL if no memory could be allocated.
+static inline __attribute__((always_inline))
+void *iw_preload_memalign(size_t alignment, size_t size) {
+    if(!iw_preload_init()) {
+        return iw_preload_bootstrap_alloc(alignment, size);
+    }
+    void *ptr = iw_preload_allocator()->memalign(alignment, size);
+    if(ptr == NULL) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+void iw_preload_register(
+    const iw_memory_allocator *hooks,
+    iw_memory_allocator *real)
+{
+    iw_preload_init();
+    *real = s_real;
+    __atomic_store_n(&s_hooks, hooks, __ATOMIC_RELEASE);
+}
+
+// --------------------------------------------------------------------------
+//
+// Interposed allocation functions
+//
+// --------------------------------------------------------------------------
+
+void *malloc(size_t size) {
+    if(!iw_preload_init()) {
+        return iw_preload_bootstrap_alloc(IW_PRELOAD_ALIGN, size);
+    }
+    void *ptr = iw_preload_allocator()->malloc(size);
+    if(ptr == NULL) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+void *calloc(size_t elems, size_t size) {
+    if(!iw_preload_init()) {
+        size_t total;
+        if(__builtin_mul_overflow(elems, size, &total)) {
+            return NULL;
+        }
+        return iw_preload_bootstrap_alloc(IW_PRELOAD_ALIGN, total);
+    }
+    void *ptr = iw_preload_allocator()->calloc(elems, size);
+    if(ptr == NULL) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+void *realloc(void *ptr, size_t size) {
+    return iw_preload_realloc(ptr, size);
+}
+
+// --------------------------------------------------------------------------
+
+void *reallocarray(void *ptr, size_t elems, size_t size) {
+    size_t total;
+    if(__builtin_mul_overflow(elems, size, &total)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return iw_preload_realloc(ptr, total);
+}
+
+// --------------------------------------------------------------------------
+
+void free(void *ptr) {
+    if(ptr == NULL || iw_preload_is_bootstrap(ptr) || !iw_preload_init()) {
+        return;
+    }
+    iw_preload_allocator()->free(ptr);
+}
+
+// --------------------------------------------------------------------------
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0 ||
+       alignment % sizeof(void *) != 0)
+    {
+        return EINVAL;
+    }
+    void *ptr = iw_preload_memalign(alignment, size);
+    if(ptr == NULL) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+// --------------------------------------------------------------------------
+
+void *memalign(size_t alignment, size_t size) {
+    // Like glibc, round an alignment that isn't a power of two up.
+    size_t align = IW_PRELOAD_ALIGN;
+    while(align < alignment) {
+        align <<= 1;
+    }
+    return iw_preload_memalign(align, size);
+}
+
+// --------------------------------------------------------------------------
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return iw_preload_memalign(alignment, size);
+}
+
+// --------------------------------------------------------------------------
+
+void *valloc(size_t size) {
+    return iw_preload_memalign(sysconf(_SC_PAGESIZE), size);
+}
+
+// --------------------------------------------------------------------------
+
+void *pvalloc(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    if(size > SIZE_MAX - page) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return iw_preload_memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+// --------------------------------------------------------------------------
+
+size_t malloc_usable_size(void *ptr) {
+    if(ptr == NULL) {
+        return 0;
+    }
+    if(iw_preload_is_bootstrap(ptr)) {
+        return ((size_t *)ptr)[-1];
+    }
+    if(!iw_preload_init()) {
+        return 0;
+    }
+    return iw_preload_allocator()->usable_size(ptr);
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,133 @@
+// --------------------------------------------------------------------------
+///
+/// @file test_arena.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_arena.h"
+#include "iw_cfg.h"
+#include "iw_memory.h"
+#include "iw_memory_int.h"
+
+#include "tests.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+
+/// The number of allocations to make, spans several blocks.
+#define TEST_ALLOCS 100
+
+/// The size of each allocation.
+#define TEST_SIZE   20
+
+// --------------------------------------------------------------------------
+
+void test_arena(test_result *result) {
+    unsigned char *ptrs[TEST_ALLOCS];
+    unsigned int cnt;
+    iw_arena arena;
+    bool ok;
+
+    test_display("Initializing arena");
+    iw_arena_init(&arena, "test", 256, 0, false);
+    test(result, arena.num_blocks == 0, "No blocks allocated before first allocation");
+
+    test_display("Allocating %d times %d bytes", TEST_ALLOCS, TEST_SIZE);
+    ok = true;
+    for(cnt=0;cnt < TEST_ALLOCS;cnt++) {
+        ptrs[cnt] = (unsigned char *)iw_arena_alloc(&arena, TEST_SIZE);
+        ok = ok && ptrs[cnt] != NULL && ((uintptr_t)ptrs[cnt] & 15) == 0;
+        if(ptrs[cnt] != NULL) {
+            memset(ptrs[cnt], cnt, TEST_SIZE);
+        }
+    }
+    test(result, ok, "Allocated aligned memory");
+    ok = true;
+    for(cnt=0;ok && cnt < TEST_ALLOCS;cnt++) {
+        ok = ptrs[cnt][0] == (unsigned char)cnt &&
+             ptrs[cnt][TEST_SIZE - 1] == (unsigned char)cnt;
+    }
+    test(result, ok, "Allocations don't overlap");
+    test(result, arena.num_blocks == (TEST_ALLOCS + 7) / 8,
+         "Allocated %d blocks? (actual=%d)", (TEST_ALLOCS + 7) / 8,
+         arena.num_blocks);
+    test(result, arena.used == TEST_ALLOCS * 32 && arena.high_water == arena.used,
+         "High-water mark follows use");
+
+    test_display("Allocating more than a block");
+    unsigned char *large = (unsigned char *)iw_arena_calloc(&arena, 1000);
+    ok = large != NULL;
+    for(cnt=0;ok && cnt < 1000;cnt++) {
+        ok = large[cnt] == 0;
+    }
+    test(result, ok && arena.reserved == (TEST_ALLOCS + 7) / 8 * 256 + 1008,
+         "Large allocation got a zeroed block of its own");
+
+    test_display("Resetting arena");
+    unsigned int blocks = arena.num_blocks;
+    size_t high_water = arena.high_water;
+    iw_arena_reset(&arena);
+    test(result, arena.used == 0 && arena.high_water == high_water,
+         "Reset released memory and kept the high-water mark");
+    void *ptr = iw_arena_alloc(&arena, TEST_SIZE);
+    test(result, ptr == ptrs[0], "First block reused after reset");
+    for(cnt=1;cnt < TEST_ALLOCS;cnt++) {
+        iw_arena_alloc(&arena, TEST_SIZE);
+    }
+    test(result, iw_arena_alloc(&arena, 1000) == large &&
+         arena.num_blocks == blocks, "Reuse did not allocate a block");
+
+    test_display("Reporting arena use");
+    char buff[4096];
+    FILE *out = fmemopen(buff, sizeof(buff), "w");
+    iw_arena_show(out);
+    fclose(out);
+    test(result, strstr(buff, "test") != NULL, "Arena included in report");
+
+    iw_arena_destroy(&arena);
+    test(result, arena.blocks == NULL && arena.reserved == 0,
+         "Destroyed arena freed all blocks");
+    out = fmemopen(buff, sizeof(buff), "w");
+    iw_arena_show(out);
+    fclose(out);
+    test(result, strstr(buff, "test") == NULL, "Arena removed from report");
+
+    test_display("Capping arena");
+    iw_arena_init(&arena, "capped", 256, 512, false);
+    ok = iw_arena_alloc(&arena, 200) != NULL && iw_arena_alloc(&arena, 200) != NULL;
+    test(result, ok && iw_arena_alloc(&arena, 200) == NULL,
+         "Allocation beyond the cap failed");
+    iw_arena_destroy(&arena);
+
+    test_display("Tracking arena in memory summary");
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 1, NULL, 0);
+    iw_memory_init();
+    iw_arena_init(&arena, "tracked", 0, 0, true);
+    iw_arena_alloc(&arena, 100);
+    char report[4096];
+    out = fmemopen(report, sizeof(report), "w");
+    iw_memory_summary(out);
+    fclose(out);
+    test(result, strstr(report, "Outstanding allocations: 1\n") != NULL &&
+         strstr(report, "== Arenas ==\n") != NULL &&
+         strstr(report, "\ntracked ") != NULL,
+         "Arena tracked as one allocation and listed");
+    iw_arena_destroy(&arena);
+    out = fmemopen(report, sizeof(report), "w");
+    iw_memory_summary(out);
+    fclose(out);
+    test(result, strstr(report, "Outstanding allocations: 0\n") != NULL,
+         "Destroyed arena freed tracked memory");
+    iw_memory_exit();
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 0, NULL, 0);
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,135 @@
+// --------------------------------------------------------------------------
+///
+/// @file test_chtable.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_chtable.h"
+
+#include "iw_hash.h"
+
+#include "tests.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// --------------------------------------------------------------------------
+
+/// The number of threads accessing the table concurrently.
+#define TEST_THREADS    4
+
+/// The number of elements each thread inserts.
+#define TEST_ELEMS      5000
+
+// --------------------------------------------------------------------------
+
+/// @brief The parameters for a test thread.
+typedef struct _test_chtable_param {
+    iw_chtable  *table;     ///< The table to access.
+    unsigned int base;      ///< The first key of the thread.
+    bool         ok;        ///< True if all accesses were successful.
+} test_chtable_param;
+
+// --------------------------------------------------------------------------
+
+/// @brief Insert, look up and remove elements from one thread.
+/// Each thread uses its own keys so all accesses should succeed.
+/// @param arg The test thread parameters.
+/// @return Always NULL.
+static void *test_chtable_thread(void *arg) {
+    test_chtable_param *param = (test_chtable_param *)arg;
+    unsigned int cnt;
+    param->ok = true;
+    for(cnt=param->base;cnt < param->base + TEST_ELEMS;cnt++) {
+        uintptr_t key = cnt;
+        param->ok = param->ok &&
+                    iw_chtable_insert(param->table, sizeof(key), &key,
+                                      (void *)(key + 1));
+    }
+    for(cnt=param->base;cnt < param->base + TEST_ELEMS;cnt++) {
+        uintptr_t key = cnt;
+        param->ok = param->ok &&
+                    iw_chtable_get(param->table, sizeof(key), &key) ==
+                        (void *)(key + 1);
+    }
+    // Remove every other element.
+    for(cnt=param->base;cnt < param->base + TEST_ELEMS;cnt += 2) {
+        uintptr_t key = cnt;
+        param->ok = param->ok &&
+                    iw_chtable_remove(param->table, sizeof(key), &key) ==
+                        (void *)(key + 1);
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+void test_chtable(test_result *result) {
+    iw_chtable table;
+    test_chtable_param params[TEST_THREADS];
+    pthread_t threads[TEST_THREADS];
+    unsigned int cnt;
+    bool ok;
+
+    test_display("Initializing concurrent hash table");
+    test(result, iw_chtable_init(&table, 5, 16, false, iw_hash_int, 0),
+         "Initialized concurrent hash table");
+    test(result, table.num_stripes == 8, "Stripes rounded up to %d? (actual=%d)",
+         8, table.num_stripes);
+    test(result, ((uintptr_t)table.stripes & 63) == 0,
+         "Stripes aligned to cache lines");
+
+    test_display("Accessing table from %d threads", TEST_THREADS);
+    for(cnt=0;cnt < TEST_THREADS;cnt++) {
+        params[cnt].table = &table;
+        params[cnt].base  = cnt * TEST_ELEMS;
+        pthread_create(&threads[cnt], NULL, test_chtable_thread, &params[cnt]);
+    }
+    ok = true;
+    for(cnt=0;cnt < TEST_THREADS;cnt++) {
+        pthread_join(threads[cnt], NULL);
+        ok = ok && params[cnt].ok;
+    }
+    test(result, ok, "All threads inserted, found and removed their elements");
+    test(result, iw_chtable_num_elems(&table) == TEST_THREADS * TEST_ELEMS / 2,
+         "Table contains %d elements? (actual=%d)",
+         TEST_THREADS * TEST_ELEMS / 2, iw_chtable_num_elems(&table));
+
+    test_display("Iterating table with all stripes locked");
+    iw_chtable_iter iter;
+    unsigned int found = 0;
+    ok = true;
+    iw_chtable_rdlock_all(&table);
+    void *data = iw_chtable_iter_first(&table, &iter);
+    while(data != NULL) {
+        uintptr_t key = (uintptr_t)data - 1;
+        ok = ok && key % 2 == 1 &&
+             iw_chtable_find(&table, sizeof(key), &key) == data;
+        found++;
+        data = iw_chtable_iter_next(&iter);
+    }
+    iw_chtable_unlock_all(&table);
+    test(result, ok && found == TEST_THREADS * TEST_ELEMS / 2,
+         "Iterated %d remaining elements? (actual=%d)",
+         TEST_THREADS * TEST_ELEMS / 2, found);
+
+    test_display("Looking up element with stripe locked");
+    iw_chtable_lock lock;
+    uintptr_t key = 1;
+    data = iw_chtable_get_locked(&table, sizeof(key), &key, true, &lock);
+    test(result, data == (void *)2 && lock.stripe != NULL,
+         "Found element with stripe locked");
+    iw_chtable_unlock(&lock);
+    test(result, lock.stripe == NULL, "Released stripe lock");
+
+    iw_chtable_destroy(&table, NULL);
+    test(result, table.stripes == NULL, "Destroyed concurrent hash table");
+}
+
+// --------------------------------------------------------------------------
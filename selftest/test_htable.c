@@ -14,6 +14,8 @@
 
 #include "tests.h"
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -25,12 +27,14 @@ static void test_hash_node_delete(void *data) {
 
 // --------------------------------------------------------------------------
 
-void test_hash_table(test_result *result) {
+static void test_hash_table_layout(test_result *result, unsigned int flags) {
     iw_htable table;
     char *data;
 
-    test_display("Initializing hash table");
-    iw_htable_init(&table, 4, false, iw_hash_data);
+    test_display("Initializing %s hash table",
+                 flags & IW_HTABLE_FLAG_POOL ? "pooled chained" :
+                 flags & IW_HTABLE_FLAG_CHAINED ? "chained" : "open addressing");
+    iw_htable_init_ex(&table, 4, false, iw_hash_data, flags);
     test(result, table.num_elems == 0, "Initalized table has zero elements");
     iw_htable_delete(&table, 4, "abcd", test_hash_node_delete);
     test(result, table.num_elems == 0, "Removing element from empty table");
@@ -99,6 +103,37 @@ void test_hash_table(test_result *result) {
     }
     test(result, cnt == max, "Found %d elements? (actual=%d)", max, cnt);
 
+    test_display("Iterating sorted view of table");
+    iw_htable_view view;
+    iw_htable_view_init(&view, &table, (int (*)(const void *, const void *))strcmp);
+    cnt = 0;
+    data = (char *)iw_htable_view_first(&view);
+    for(cnt=0;data != NULL && cnt < max;cnt++) {
+        test(result, strcmp(should[cnt], data) == 0, "Is element [%d]=%s? (actual=%s)", cnt, should[cnt], data);
+        data = (char *)iw_htable_view_next(&view);
+    }
+    test(result, cnt == max, "Found %d elements? (actual=%d)", max, cnt);
+    iw_htable_view_destroy(&view);
+
+    test_display("Iterating table using hash tokens");
+    cnt = 0;
+    data = (char *)iw_htable_get_first(&table, &hash);
+    while(data != NULL) {
+        cnt++;
+        data = (char *)iw_htable_get_next(&table, &hash);
+    }
+    test(result, cnt == max, "Found %d elements? (actual=%d)", max, cnt);
+
+    test_display("Iterating table using iterator");
+    iw_htable_iter iter;
+    cnt = 0;
+    data = (char *)iw_htable_iter_first(&table, &iter);
+    while(data != NULL) {
+        cnt++;
+        data = (char *)iw_htable_iter_next(&iter);
+    }
+    test(result, cnt == max, "Found %d elements? (actual=%d)", max, cnt);
+
     test_display("Removing elements");
     iw_htable_delete(&table, 4, "efgh", test_hash_node_delete);
     test(result, table.num_elems == 4, "Deleted 2nd element from table (efgh)");
@@ -112,6 +147,22 @@ void test_hash_table(test_result *result) {
     test(result, data == NULL, "Fail to access removed element (mnop)");
     test_display("Number of collisions: %d", table.collisions);
 
+    test_display("Iterating table in order after removing elements");
+    char *should_left[] = { "1001", "1003", "1005" };
+    max = sizeof(should_left)/sizeof(should_left[0]);
+    data = (char *)iw_htable_get_first_ordered(
+                            &table,
+                            (int (*)(const void *, const void *))strcmp,
+                             &hash);
+    for(cnt=0;data != NULL && cnt < max;cnt++) {
+        test(result, strcmp(should_left[cnt], data) == 0, "Is element [%d]=%s? (actual=%s)", cnt, should_left[cnt], data);
+        data = (char *)iw_htable_get_next_ordered(
+                                &table,
+                                (int (*)(const void *, const void *))strcmp,
+                                &hash);
+    }
+    test(result, cnt == max, "Found %d elements? (actual=%d)", max, cnt);
+
     // Replacing existing value
     test_display("Replacing value (ijkl->1003) to (ijkl->2003)");
     iw_htable_replace(&table, 4, "ijkl", strdup("2003"), test_hash_node_delete);
@@ -124,3 +175,277 @@ void test_hash_table(test_result *result) {
 }
 
 // --------------------------------------------------------------------------
+
+/// Create a string key from a number. The elements are identified by the
+/// hash alone so decimal strings are used to avoid hash collisions.
+#define TEST_KEY(num) \
+    snprintf(key_buff, sizeof(key_buff), "%u", num), key_buff
+
+static void test_hash_table_growth(test_result *result) {
+    iw_htable table;
+    unsigned int cnt;
+    unsigned int num = 10000;
+    char key_buff[16];
+    bool ok;
+
+    test_display("Growing open addressing hash table to %d elements", num);
+    iw_htable_init(&table, 4, false, iw_hash_data);
+    unsigned int init_size = table.size;
+    ok = true;
+    for(cnt=0;cnt < num;cnt++) {
+        unsigned int *value = malloc(sizeof(*value));
+        *value = cnt;
+        ok = ok && iw_htable_insert(&table, TEST_KEY(cnt), value);
+    }
+    test(result, ok && table.num_elems == num, "Added %d elements to table", num);
+    test(result, table.size > init_size, "Table grew from %d slots? (actual=%d)",
+         init_size, table.size);
+    test(result, table.num_elems * 4 <= table.size * 3,
+         "Load factor is at most 3/4 (%d/%d)", table.num_elems, table.size);
+
+    ok = true;
+    for(cnt=0;cnt < num;cnt++) {
+        unsigned int *value = iw_htable_get(&table, TEST_KEY(cnt));
+        ok = ok && value != NULL && *value == cnt;
+    }
+    test(result, ok, "Accessing all %d elements", num);
+
+    test_display("Removing every other element");
+    ok = true;
+    for(cnt=0;cnt < num;cnt += 2) {
+        ok = ok && iw_htable_delete(&table, TEST_KEY(cnt), test_hash_node_delete);
+    }
+    test(result, ok && table.num_elems == num / 2, "Removed %d elements", num / 2);
+    ok = true;
+    for(cnt=0;cnt < num;cnt++) {
+        unsigned int *value = iw_htable_get(&table, TEST_KEY(cnt));
+        ok = ok && ((cnt % 2 == 0 && value == NULL) ||
+                    (cnt % 2 == 1 && value != NULL && *value == cnt));
+    }
+    test(result, ok, "Accessing remaining elements");
+
+    test_display("Iterating table while removing elements");
+    unsigned long hash;
+    unsigned int found = 0;
+    unsigned int *value = iw_htable_get_first(&table, &hash);
+    while(value != NULL) {
+        unsigned int key = *value;
+        found++;
+        value = iw_htable_get_next(&table, &hash);
+        if(key % 4 == 1) {
+            iw_htable_delete(&table, TEST_KEY(key), test_hash_node_delete);
+        }
+    }
+    test(result, found == num / 2, "Iterated %d elements? (actual=%d)", num / 2, found);
+    test(result, table.num_elems == num / 4, "Removed %d elements while iterating",
+         num / 4);
+
+    test_display("Iterating table with iterator while removing elements");
+    iw_htable_iter iter;
+    found = 0;
+    value = iw_htable_iter_first(&table, &iter);
+    while(value != NULL) {
+        unsigned int key = *value;
+        found++;
+        if(key % 8 == 3) {
+            iw_htable_delete(&table, TEST_KEY(key), test_hash_node_delete);
+        }
+        value = iw_htable_iter_next(&iter);
+    }
+    test(result, found == num / 4, "Iterated %d elements? (actual=%d)", num / 4, found);
+    test(result, table.num_elems == num / 8, "Removed %d elements while iterating",
+         num / 8);
+
+    test_display("Re-adding removed elements");
+    ok = true;
+    for(cnt=0;cnt < num;cnt++) {
+        if(cnt % 8 != 7) {
+            unsigned int *value = malloc(sizeof(*value));
+            *value = cnt;
+            ok = ok && iw_htable_insert(&table, TEST_KEY(cnt), value);
+        }
+    }
+    test(result, ok && table.num_elems == num, "Table contains %d elements", num);
+    ok = true;
+    for(cnt=0;cnt < num;cnt++) {
+        unsigned int *value = iw_htable_get(&table, TEST_KEY(cnt));
+        ok = ok && value != NULL && *value == cnt;
+    }
+    test(result, ok, "Accessing all %d elements", num);
+
+    iw_htable_destroy(&table, test_hash_node_delete);
+    test(result, table.num_elems == 0, "Destroyed table has zero elements");
+}
+
+// --------------------------------------------------------------------------
+
+/// A hash function that only returns a few different values so that almost
+/// every key collides with other keys.
+static unsigned long test_hash_colliding(unsigned int key_len, const void *key) {
+    return key_len > 0 ? ((const unsigned char *)key)[0] % 4 : 0;
+}
+
+// --------------------------------------------------------------------------
+
+static void test_hash_table_keys(test_result *result, unsigned int flags) {
+    iw_htable table;
+    unsigned int cnt;
+    unsigned int num = 1000;
+    unsigned char long_key[IW_HASH_KEY_INLINE * 2];
+    bool ok;
+
+    test_display("Storing keys in %s hash table",
+                 flags & IW_HTABLE_FLAG_POOL ? "pooled chained" :
+                 flags & IW_HTABLE_FLAG_CHAINED ? "chained" : "open addressing");
+    iw_htable_init_ex(&table, 16, false, test_hash_colliding, flags);
+    unsigned int value = 1;
+    test(result, iw_htable_insert(&table, 4, "abcd", &value) &&
+                 !iw_htable_insert(&table, 4, "efgh", &value),
+         "Custom hash function used when inserting without stored keys");
+    iw_htable_destroy(&table, NULL);
+
+    iw_htable_init_ex(&table, 16, false, test_hash_colliding,
+                      flags | IW_HTABLE_FLAG_KEYS);
+    ok = true;
+    memset(long_key, 'x', sizeof(long_key));
+    for(cnt=0;cnt < num;cnt++) {
+        unsigned int *value = malloc(sizeof(*value));
+        *value = cnt;
+        if(cnt % 2 == 0) {
+            // Binary keys stored inline.
+            ok = ok && iw_htable_insert(&table, sizeof(cnt), &cnt, value);
+        } else {
+            // Long keys stored in an allocated copy.
+            memcpy(long_key + sizeof(long_key) - sizeof(cnt), &cnt, sizeof(cnt));
+            ok = ok && iw_htable_insert(&table, sizeof(long_key), long_key, value);
+        }
+    }
+    test(result, ok && table.num_elems == num,
+         "Added %d elements with colliding hashes", num);
+    unsigned int missing = num * 2;
+    test(result, iw_htable_get(&table, sizeof(missing), &missing) == NULL,
+         "Lookup of missing key with matching hash fails");
+
+    ok = true;
+    for(cnt=0;cnt < num;cnt++) {
+        unsigned int *value;
+        if(cnt % 2 == 0) {
+            value = iw_htable_get(&table, sizeof(cnt), &cnt);
+        } else {
+            memcpy(long_key + sizeof(long_key) - sizeof(cnt), &cnt, sizeof(cnt));
+            value = iw_htable_get(&table, sizeof(long_key), long_key);
+        }
+        ok = ok && value != NULL && *value == cnt;
+    }
+    test(result, ok, "Accessing all %d elements by key", num);
+
+    test_display("Removing elements with colliding hashes");
+    ok = true;
+    for(cnt=0;cnt < num;cnt += 4) {
+        ok = ok && iw_htable_delete(&table, sizeof(cnt), &cnt,
+                                    test_hash_node_delete);
+    }
+    test(result, ok && table.num_elems == num - num / 4, "Removed %d elements",
+         num / 4);
+    ok = true;
+    for(cnt=0;cnt < num;cnt += 2) {
+        unsigned int *value = iw_htable_get(&table, sizeof(cnt), &cnt);
+        ok = ok && ((cnt % 4 == 0 && value == NULL) ||
+                    (cnt % 4 == 2 && value != NULL && *value == cnt));
+    }
+    test(result, ok, "Accessing remaining elements by key");
+
+    iw_htable_iter iter;
+    unsigned int found = 0;
+    unsigned int *data = iw_htable_iter_first(&table, &iter);
+    while(data != NULL) {
+        found++;
+        data = iw_htable_iter_next(&iter);
+    }
+    test(result, found == table.num_elems, "Iterated %d elements? (actual=%d)",
+         table.num_elems, found);
+    if(!(flags & IW_HTABLE_FLAG_CHAINED)) {
+        unsigned long token;
+        found = 0;
+        data = iw_htable_get_first(&table, &token);
+        while(data != NULL) {
+            found++;
+            data = iw_htable_get_next(&table, &token);
+        }
+        test(result, found == table.num_elems,
+             "Iterated %d elements using tokens? (actual=%d)",
+             table.num_elems, found);
+    }
+
+    iw_htable_destroy(&table, test_hash_node_delete);
+    test(result, table.num_elems == 0, "Destroyed table has zero elements");
+}
+
+// --------------------------------------------------------------------------
+
+static void test_hash_functions(test_result *result) {
+    unsigned char buff[64];
+    unsigned int cnt;
+    bool ok;
+
+    test_display("Testing hash functions");
+    test(result, iw_hash_word(0, "") == 0xEF46DB3751D8E999UL &&
+                 iw_hash_word(3, "abc") == 0x44BC2CF5AD770999UL,
+         "Word hash matches xxHash64 test vectors");
+    for(cnt=0;cnt < sizeof(buff);cnt++) {
+        buff[cnt] = cnt;
+    }
+    test(result, iw_hash_keyed(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL,
+                               0, buff) == 0xABAC0158050FC4DCUL,
+         "Keyed hash matches SipHash-1-3 test vector");
+
+    // Every prefix of the buffer should hash differently, covering the
+    // lane, word and byte paths of each hash.
+    IW_HASH_ALG alg;
+    for(alg=0;alg < IW_HASH_ALG_NUM;alg++) {
+        IW_HASH_FN fn = iw_hash_get_fn(alg);
+        unsigned long hashes[sizeof(buff)];
+        unsigned int other;
+        ok = true;
+        for(cnt=0;cnt < sizeof(buff);cnt++) {
+            hashes[cnt] = fn(cnt + 1, buff);
+            for(other=0;other < cnt;other++) {
+                ok = ok && hashes[other] != hashes[cnt];
+            }
+        }
+        IW_HASH_ALG found;
+        test(result, ok && fn(0, NULL) == 0 &&
+                     iw_hash_get_alg(iw_hash_alg_name(alg), &found) &&
+                     found == alg,
+             "Hash algorithm \"%s\" hashes all prefixes uniquely",
+             iw_hash_alg_name(alg));
+    }
+
+    // Aligned pointers only differ in the middle bits, the low bits of the
+    // integer hash should still spread them out.
+    unsigned int buckets[16] = { 0 };
+    for(cnt=0;cnt < 1024;cnt++) {
+        uintptr_t ptr = 0x7F0000001000 + cnt * 64;
+        buckets[iw_hash_int(sizeof(ptr), &ptr) & 15]++;
+    }
+    ok = true;
+    for(cnt=0;cnt < 16;cnt++) {
+        ok = ok && buckets[cnt] > 32 && buckets[cnt] < 96;
+    }
+    test(result, ok, "Integer hash spreads aligned pointers over buckets");
+}
+
+// --------------------------------------------------------------------------
+
+void test_hash_table(test_result *result) {
+    test_hash_functions(result);
+    test_hash_table_layout(result, 0);
+    test_hash_table_layout(result, IW_HTABLE_FLAG_CHAINED);
+    test_hash_table_layout(result, IW_HTABLE_FLAG_CHAINED | IW_HTABLE_FLAG_POOL);
+    test_hash_table_growth(result);
+    test_hash_table_keys(result, 0);
+    test_hash_table_keys(result, IW_HTABLE_FLAG_CHAINED);
+    test_hash_table_keys(result, IW_HTABLE_FLAG_CHAINED | IW_HTABLE_FLAG_POOL);
+}
+
+// --------------------------------------------------------------------------
@@ -136,6 +136,21 @@ void test_list(test_result *result) {
 
     iw_list_destroy(&list, NULL);
     test(result, list.num_elems == 0, "Destroyed list is empty");
+
+    test_display("Pooled list nodes");
+    test(result, iw_list_init_ex(&list, false, IW_LIST_FLAG_POOL) &&
+         list.slab != NULL, "Initialized pooled list");
+    node1 = iw_list_add_data(&list, (void *)1);
+    node2 = iw_list_add_data(&list, (void *)2);
+    node3 = iw_list_add_data(&list, (void *)3);
+    iw_list_delete(&list, node2, NULL);
+    node4 = iw_list_insert_after_data(&list, node1, (void *)4);
+    test(result, node4 == node2, "Deleted node reused for new element");
+    unsigned int val_list7[] = { 1, 4, 3 };
+    validate_list(result, &list, IW_ARR_LEN(val_list7), val_list7);
+    iw_list_destroy(&list, NULL);
+    test(result, list.num_elems == 0 && list.head == NULL && list.slab == NULL,
+         "Destroyed pooled list is empty");
 }
 
 // --------------------------------------------------------------------------
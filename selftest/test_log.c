@@ -0,0 +1,567 @@
+// --------------------------------------------------------------------------
+///
+/// @file test_log.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_cfg.h"
+#include "iw_log.h"
+#include "iw_log_int.h"
+#include "iw_thread_int.h"
+
+#include "tests.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------
+
+/// The file the test logs are written to.
+#define TEST_LOG_FILE       "/tmp/iw_test_log.txt"
+
+/// The number of threads logging concurrently.
+#define TEST_THREADS        4
+
+/// The number of messages each thread logs.
+#define TEST_MESSAGES       500
+
+/// The ring size used to provoke dropped messages.
+#define TEST_SMALL_RING     8
+
+/// The file the binary log is saved to.
+#define TEST_BIN_FILE       "/tmp/iw_test_log.bin"
+
+/// The binary log buffer size used to provoke overwritten messages.
+#define TEST_BIN_SIZE       4096
+
+// --------------------------------------------------------------------------
+
+/// @brief Log a sequence of numbered messages.
+/// @param arg The index of the thread.
+/// @return Always NULL.
+static void *test_log_thread(void *arg) {
+    unsigned int index = (unsigned int)(uintptr_t)arg;
+    unsigned int cnt;
+    for(cnt=0;cnt < TEST_MESSAGES;cnt++) {
+        LOG(IW_LOG_IW, "Test thread %u message %u", index, cnt);
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Log with logging turned off and then on for the thread, and wait
+/// for the main thread to log in between.
+/// @param arg The flags to set and wait for.
+/// @return Always NULL.
+static void *test_log_flag_thread(void *arg) {
+    bool *logged = (bool *)arg;
+    iw_thread_set_log(0, false);
+    LOG(IW_LOG_IW, "Test flag off");
+    __atomic_store_n(&logged[0], true, __ATOMIC_RELEASE);
+    while(!__atomic_load_n(&logged[1], __ATOMIC_ACQUIRE)) {
+        usleep(1000);
+    }
+    iw_thread_set_log(0, true);
+    LOG(IW_LOG_IW, "Test flag on");
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// The first and last lines of the call sites in test_log_site_msgs().
+static unsigned int s_site_lines[2];
+
+/// @brief Log one message from each of three call sites.
+static void test_log_site_msgs() {
+    s_site_lines[0] = __LINE__;
+    LOG(IW_LOG_IW, "Test site first");
+    LOG(IW_LOG_IW, "Test site second");
+    s_site_lines[1] = __LINE__;
+    LOG(IW_LOG_IW, "Test site third");
+}
+
+// --------------------------------------------------------------------------
+
+// Compile the next function as if the program was built with only the
+// IW_LOG_IW level compiled in.
+#undef IW_LOG_COMPILE_MASK
+#define IW_LOG_COMPILE_MASK IW_LOG_IW
+
+/// @brief Log one message at a level that is compiled in and one at a level
+/// that is compiled out.
+static void test_log_compiled_msgs() {
+    LOG(IW_LOG_IW, "Test site compiled in");
+    LOG(IW_LOG_WEB, "Test site compiled out");
+}
+
+#undef IW_LOG_COMPILE_MASK
+#define IW_LOG_COMPILE_MASK 0xFFFFFFFFU
+
+// --------------------------------------------------------------------------
+
+/// @brief Log a number of messages from a single call site.
+/// @param cnt The number of messages.
+/// @param same True if all messages should be identical.
+static void test_log_flood(unsigned int cnt, bool same) {
+    unsigned int idx;
+    for(idx=0;idx < cnt;idx++) {
+        LOG(IW_LOG_IW, "Test site flood %u", same ? 0 : idx);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Count the lines of the test log file that contain a string.
+/// @param str The string to look for.
+/// @return The number of lines.
+static unsigned int test_log_count(const char *str) {
+    unsigned int lines = 0;
+    char line[256];
+    FILE *fd = fopen(TEST_LOG_FILE, "r");
+    while(fd != NULL && fgets(line, sizeof(line), fd) != NULL) {
+        if(strstr(line, str) != NULL) {
+            lines++;
+        }
+    }
+    if(fd != NULL) {
+        fclose(fd);
+    }
+    return lines;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Start asynchronous logging to the test log file.
+/// @param size The size of the log ring.
+/// @param overflow The overflow policy.
+/// @return True if the log writer was started.
+static bool test_log_start(int size, const char *overflow) {
+    iw_val_store_set_number(&iw_cfg, IW_CFG_LOG_ASYNC, 1, NULL, 0);
+    iw_val_store_set_number(&iw_cfg, IW_CFG_LOG_RINGSIZE, size, NULL, 0);
+    iw_val_store_set_string(&iw_cfg, IW_CFG_LOG_OVERFLOW, overflow, NULL, 0);
+    iw_log_set_level(NULL, 0);
+    iw_log_set_level(TEST_LOG_FILE, IW_LOG_IW);
+    return iw_log_start();
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test that messages from several threads all make it to the log in
+/// the order each thread logged them.
+/// @param result The test result.
+static void test_log_threads(test_result *result) {
+    test(result, test_log_start(64, "block"),
+         "Starting log writer with a blocking ring");
+
+    pthread_t threads[TEST_THREADS];
+    uintptr_t cnt;
+    for(cnt=0;cnt < TEST_THREADS;cnt++) {
+        iw_thread_create_int(&threads[cnt], "Log Test", test_log_thread,
+                             false, (void *)cnt);
+    }
+    for(cnt=0;cnt < TEST_THREADS;cnt++) {
+        iw_thread_join_int(threads[cnt]);
+    }
+    char long_msg[1024];
+    memset(long_msg, 'x', sizeof(long_msg) - 1);
+    long_msg[sizeof(long_msg) - 1] = '\0';
+    LOG(IW_LOG_IW, "%s", long_msg);
+    iw_log_flush();
+
+    iw_log_stats stats;
+    bool running = iw_log_stats_get(&stats);
+    iw_log_stop();
+    iw_log_set_level(NULL, 0);
+    test(result, running && stats.written >= TEST_THREADS * TEST_MESSAGES,
+         "All messages written (%lu)", stats.written);
+    test(result, stats.dropped == 0, "No messages dropped");
+    test(result, stats.truncated == 1, "Long message truncated");
+    test(result, stats.batches > 0 && stats.batches <= stats.written,
+         "Messages written in %lu batches", stats.batches);
+
+    unsigned int next[TEST_THREADS] = { 0 };
+    unsigned int lines = 0;
+    bool ordered = true;
+    bool truncated = false;
+    char line[2048];
+    FILE *fd = fopen(TEST_LOG_FILE, "r");
+    while(fd != NULL && fgets(line, sizeof(line), fd) != NULL) {
+        unsigned int index, msg;
+        char *ptr = strstr(line, "Test thread ");
+        if(ptr != NULL && sscanf(ptr, "Test thread %u message %u",
+                                 &index, &msg) == 2 && index < TEST_THREADS)
+        {
+            ordered = ordered && msg == next[index];
+            next[index] = msg + 1;
+            lines++;
+        } else if(strstr(line, "xxx...\n") != NULL) {
+            truncated = true;
+        }
+    }
+    if(fd != NULL) {
+        fclose(fd);
+    }
+    test(result, lines == TEST_THREADS * TEST_MESSAGES,
+         "All messages in the log file (%u)", lines);
+    test(result, ordered, "Messages of each thread in order");
+    test(result, truncated, "Truncated message ends with \"...\"");
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test that messages dropped from a full ring are counted in the
+/// log output.
+/// @param result The test result.
+static void test_log_dropped(test_result *result) {
+    test(result, test_log_start(TEST_SMALL_RING, "count"),
+         "Starting log writer with a small ring");
+
+    unsigned int cnt;
+    for(cnt=0;cnt < TEST_MESSAGES;cnt++) {
+        LOG(IW_LOG_IW, "Test drop message %u", cnt);
+    }
+    iw_log_stats stats;
+    iw_log_stop();
+    iw_log_stats_get(&stats);
+    LOG(IW_LOG_IW, "Test direct message");
+    iw_log_set_level(NULL, 0);
+    test(result, stats.ring_size == TEST_SMALL_RING,
+         "Ring size is %lu", stats.ring_size);
+    test_display("%lu messages dropped", stats.dropped);
+
+    unsigned int lines = 0;
+    unsigned long noted = 0;
+    bool direct = false;
+    char line[256];
+    FILE *fd = fopen(TEST_LOG_FILE, "r");
+    while(fd != NULL && fgets(line, sizeof(line), fd) != NULL) {
+        unsigned long dropped;
+        if(strstr(line, "Test drop message ") != NULL) {
+            lines++;
+        } else if(sscanf(line, "[Dropped %lu log messages]", &dropped) == 1) {
+            noted += dropped;
+        } else if(strstr(line, "Test direct message") != NULL) {
+            direct = true;
+        }
+    }
+    if(fd != NULL) {
+        fclose(fd);
+    }
+    test(result, lines + stats.dropped == TEST_MESSAGES,
+         "Written and dropped messages add up");
+    test(result, noted == stats.dropped, "Dropped messages noted in log");
+    test(result, direct, "Messages written directly once stopped");
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test that the cached log flags of the threads follow the 'log
+/// thread' settings.
+/// @param result The test result.
+static void test_log_thread_flag(test_result *result) {
+    iw_log_set_level(NULL, 0);
+    iw_log_set_level(TEST_LOG_FILE, IW_LOG_IW);
+
+    // The main thread logs while another thread has logging turned off.
+    bool logged[2] = { false, false };
+    pthread_t thread;
+    iw_thread_create_int(&thread, "Log Test", test_log_flag_thread,
+                         false, logged);
+    while(!__atomic_load_n(&logged[0], __ATOMIC_ACQUIRE)) {
+        usleep(1000);
+    }
+    test(result, s_thread_log_off == 1, "One thread with logging off");
+    LOG(IW_LOG_IW, "Test flag main");
+    __atomic_store_n(&logged[1], true, __ATOMIC_RELEASE);
+    iw_thread_join_int(thread);
+
+    iw_thread_set_log_all(false);
+    LOG(IW_LOG_IW, "Test flag all off");
+    iw_thread_set_log_all(true);
+    LOG(IW_LOG_IW, "Test flag all on");
+    test(result, s_thread_log_off == 0, "No thread with logging off");
+    iw_log_set_level(NULL, 0);
+
+    static const char *expected[] = {
+        "Test flag main", "Test flag on", "Test flag all on"
+    };
+    unsigned int lines = 0;
+    bool ordered = true;
+    char line[256];
+    FILE *fd = fopen(TEST_LOG_FILE, "r");
+    while(fd != NULL && fgets(line, sizeof(line), fd) != NULL) {
+        char *ptr = strstr(line, "Test flag ");
+        if(ptr != NULL) {
+            ptr[strcspn(ptr, "\n")] = '\0';
+            ordered = ordered && lines < 3 && strcmp(ptr, expected[lines]) == 0;
+            lines++;
+        }
+    }
+    if(fd != NULL) {
+        fclose(fd);
+    }
+    test(result, lines == 3 && ordered,
+         "Only messages of threads with logging on (%u)", lines);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test that call sites can be disabled and enabled by file,
+/// function and line.
+/// @param result The test result.
+static void test_log_sites(test_result *result) {
+    iw_log_site_filter all = { NULL, NULL, 0, 0 };
+    iw_log_site_filter file = { "test_log.c", NULL, 0, 0 };
+    iw_log_site_filter path = { "*/test_log.c", NULL, 0, 0 };
+    iw_log_site_filter func = { NULL, "test_log_site_*", 0, 0 };
+    iw_log_site_filter lines = { "test_l?g.c", NULL, 0, 0 };
+    iw_log_site_filter none = { "no_such_file.c", NULL, 0, 0 };
+
+    unsigned int total = iw_log_site_enable(&all, true);
+    test(result, total > 3, "Call sites found (%u)", total);
+    test(result, iw_log_site_enable(&none, false) == 0,
+         "No call sites in unknown file");
+    test(result, iw_log_site_enable(&func, false) == 3,
+         "Disabled call sites by function");
+    iw_log_set_level(NULL, 0);
+    iw_log_set_level(TEST_LOG_FILE, IW_LOG_IW);
+    test_log_site_msgs();
+    iw_log_set_level(NULL, 0);
+    test(result, test_log_count("Test site ") == 0, "Disabled call sites not logged");
+
+    lines.line_from = s_site_lines[0];
+    lines.line_to   = s_site_lines[1];
+    unsigned int in_lines = iw_log_site_enable(&lines, true);
+    test(result, in_lines == 2,
+         "Enabled call sites by line range (%u)", in_lines);
+    iw_log_set_level(TEST_LOG_FILE, IW_LOG_IW);
+    test_log_site_msgs();
+    iw_log_set_level(NULL, 0);
+    test(result, test_log_count("Test site ") == 2, "Enabled call sites logged");
+
+    unsigned int in_file = iw_log_site_enable(&file, true);
+    test(result, in_file > 3 && iw_log_site_enable(&path, true) == in_file,
+         "Call sites by file name and path (%u)", in_file);
+    iw_log_set_level(TEST_LOG_FILE, IW_LOG_IW);
+    test_log_site_msgs();
+    iw_log_set_level(NULL, 0);
+    test(result, test_log_count("Test site ") == 3, "All call sites logged");
+
+    char list[1024] = "";
+    FILE *fd = fmemopen(list, sizeof(list) - 1, "w");
+    if(fd != NULL) {
+        iw_log_site_list(fd, &func);
+        fclose(fd);
+    }
+    test(result, strstr(list, "3 call sites, 3 enabled") != NULL,
+         "Call sites listed");
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test that call sites at levels outside IW_LOG_COMPILE_MASK are
+/// removed.
+/// @param result The test result.
+static void test_log_compiled(test_result *result) {
+    iw_log_set_level(TEST_LOG_FILE, IW_LOG_IW | IW_LOG_WEB);
+    test_log_compiled_msgs();
+    iw_log_set_level(NULL, 0);
+    test(result, test_log_count("Test site ") == 1,
+         "Compiled out site not logged");
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test rate limiting and duplicate suppression of call sites.
+/// @param result The test result.
+static void test_log_limits(test_result *result) {
+    // One message per second after a burst of three.
+    iw_log_limit(1, 3, false);
+    iw_log_set_level(TEST_LOG_FILE, IW_LOG_IW);
+    test_log_flood(10, false);
+    iw_log_set_level(NULL, 0);
+    test(result, test_log_count("Test site flood") == 3,
+         "Burst of messages logged");
+    test(result, test_log_count("Suppressed 7 messages") == 1,
+         "Suppressed messages summarized");
+
+    iw_log_limit(0, 0, true);
+    iw_log_set_level(TEST_LOG_FILE, IW_LOG_IW);
+    test_log_flood(5, true);
+    test_log_flood(2, false);
+    iw_log_set_level(NULL, 0);
+    test(result, test_log_count("Test site flood 0") == 1,
+         "Duplicate messages counted");
+    test(result, test_log_count("Last message repeated 5 times") == 1,
+         "Duplicate messages summarized");
+    test(result, test_log_count("Test site flood 1") == 1,
+         "Different message logged");
+    iw_log_limit(0, 0, false);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Read the messages of a formatted binary log.
+/// @param file The file with the formatted log.
+/// @param msgs [out] The messages, without the time, thread and call site.
+/// @param max The largest number of messages to read.
+/// @return The number of messages read.
+static unsigned int test_log_read_bin(
+    const char *file,
+    char msgs[][128],
+    unsigned int max)
+{
+    unsigned int cnt = 0;
+    char line[2048];
+    FILE *fd = fopen(file, "r");
+    while(fd != NULL && cnt < max && fgets(line, sizeof(line), fd) != NULL) {
+        char *ptr = strstr(line, "): ");
+        if(ptr != NULL) {
+            ptr[strcspn(ptr, "\n")] = '\0';
+            snprintf(msgs[cnt++], sizeof(msgs[0]), "%s", ptr + 3);
+        }
+    }
+    if(fd != NULL) {
+        fclose(fd);
+    }
+    return cnt;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test that messages recorded in the binary log are formatted the
+/// same way as text logs, both by 'log dump' and by the offline decoder.
+/// @param result The test result.
+static void test_log_binary(test_result *result) {
+    iw_log_bin_exit();
+    iw_log_set_level(NULL, 0);
+    iw_log_set_level(TEST_LOG_FILE, IW_LOG_IW);
+    test(result, iw_log_bin_start(TEST_BIN_SIZE), "Starting binary log");
+
+    char long_str[2048];
+    memset(long_str, 'y', sizeof(long_str) - 1);
+    long_str[sizeof(long_str) - 1] = '\0';
+    // The second format of a site is recorded as text.
+    static const char *fmts[] = { "Non-literal %d", "Other format %d" };
+    static const char *expected[] = {
+        "Plain message",
+        "Int -42 unsigned 42 hex 2a char c",
+        "Long 1234567890123 size 17 ptrdiff -3",
+        "Double  3.14 long double 2.5e+00",
+        "String \"abc\" precision \"abcd\" star \"ab\" null (null)",
+        "Width [   7] star [  -8] percent 100%",
+        "Non-literal 0",
+        "Other format 1"
+    };
+    LOG(IW_LOG_IW, "Plain message");
+    LOG(IW_LOG_IW, "Int %d unsigned %u hex %x char %c", -42, 42, 42, 'c');
+    LOG(IW_LOG_IW, "Long %lld size %zu ptrdiff %td",
+        1234567890123LL, (size_t)17, (ptrdiff_t)-3);
+    LOG(IW_LOG_IW, "Double %5.2f long double %.1Le", 3.14159, 2.5L);
+    LOG(IW_LOG_IW, "String \"%s\" precision \"%.4s\" star \"%.*s\" null %s",
+        "abc", "abcdefgh", 2, "abcdef", (char *)NULL);
+    LOG(IW_LOG_IW, "Width [%4d] star [%*d] percent 100%%", 7, 4, -8);
+    unsigned int cnt;
+    for(cnt=0;cnt < 2;cnt++) {
+        LOG(IW_LOG_IW, fmts[cnt], cnt);
+    }
+    LOG(IW_LOG_IW, "Long string %s", long_str);
+
+    iw_log_bin_stats stats;
+    iw_log_bin_stats_get(&stats);
+    test(result, stats.logged == 9 && stats.text == 1,
+         "Messages recorded (%lu, %lu as text)", stats.logged, stats.text);
+
+    FILE *fd = fopen(TEST_LOG_FILE, "w");
+    if(fd != NULL) {
+        iw_log_bin_dump(fd);
+        fclose(fd);
+    }
+    char msgs[TEST_MESSAGES][128];
+    unsigned int num = test_log_read_bin(TEST_LOG_FILE, msgs, TEST_MESSAGES);
+    test(result, num == 9, "All messages dumped (%u)", num);
+    for(cnt=0;cnt < sizeof(expected) / sizeof(expected[0]);cnt++) {
+        test(result, cnt < num && strcmp(msgs[cnt], expected[cnt]) == 0,
+             "Dumped \"%s\"", expected[cnt]);
+    }
+    test(result, num == 9 && strncmp(msgs[8], "Long string yyy", 15) == 0,
+         "Long string truncated");
+
+    // The saved binary log decodes to the same messages.
+    char decoded[TEST_MESSAGES][128];
+    bool saved = iw_log_bin_save(TEST_BIN_FILE);
+    FILE *in = fopen(TEST_BIN_FILE, "r");
+    fd = fopen(TEST_LOG_FILE, "w");
+    bool valid = in != NULL && fd != NULL && iw_log_bin_decode(in, fd);
+    if(in != NULL) {
+        fclose(in);
+    }
+    if(fd != NULL) {
+        fclose(fd);
+    }
+    unsigned int num_decoded = test_log_read_bin(TEST_LOG_FILE, decoded,
+                                                 TEST_MESSAGES);
+    bool same = num_decoded == num;
+    for(cnt=0;same && cnt < num;cnt++) {
+        same = strcmp(msgs[cnt], decoded[cnt]) == 0;
+    }
+    test(result, saved && valid, "Binary log saved and decoded");
+    test(result, same, "Decoded messages same as dumped messages");
+
+    // Old messages are overwritten when the buffer is full.
+    for(cnt=0;cnt < TEST_MESSAGES;cnt++) {
+        LOG(IW_LOG_IW, "Test binary message %u", cnt);
+    }
+    iw_log_bin_stats_get(&stats);
+    test(result, stats.overwritten > 0,
+         "Old messages overwritten (%lu)", stats.overwritten);
+    fd = fopen(TEST_LOG_FILE, "w");
+    if(fd != NULL) {
+        iw_log_bin_dump(fd);
+        fclose(fd);
+    }
+    num = test_log_read_bin(TEST_LOG_FILE, msgs, TEST_MESSAGES);
+    bool ordered = num == stats.records;
+    for(cnt=0;ordered && cnt < num;cnt++) {
+        unsigned int msg;
+        ordered = sscanf(msgs[cnt], "Test binary message %u", &msg) == 1 &&
+                  msg == TEST_MESSAGES - num + cnt;
+    }
+    test(result, ordered, "Newest %u messages dumped in order", num);
+
+    iw_log_bin_exit();
+    iw_log_set_level(NULL, 0);
+    unlink(TEST_BIN_FILE);
+}
+
+// --------------------------------------------------------------------------
+
+void test_log(test_result *result) {
+    unsigned int level = s_log_level;
+
+    test_log_threads(result);
+    test_log_dropped(result);
+    test_log_thread_flag(result);
+    test_log_sites(result);
+    test_log_compiled(result);
+    test_log_limits(result);
+    test_log_binary(result);
+
+    iw_val_store_set_number(&iw_cfg, IW_CFG_LOG_ASYNC, 0, NULL, 0);
+    if(level != 0) {
+        iw_log_set_level("stdout", level);
+    }
+    unlink(TEST_LOG_FILE);
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,571 @@
+// --------------------------------------------------------------------------
+///
+/// @file test_memory.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_cfg.h"
+#include "iw_memory.h"
+#include "iw_memory_int.h"
+
+#include "tests.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------
+
+/// The number of threads allocating memory concurrently.
+#define TEST_THREADS    4
+
+/// The number of allocations made by each thread.
+#define TEST_ALLOCS     1000
+
+/// The sampling interval used by the sampling test.
+#define TEST_SAMPLE     4096
+
+/// The number of allocations made by the sampling test.
+#define TEST_SAMPLES    10000
+
+/// The size of each allocation made by the sampling test.
+#define TEST_SAMPLE_SIZE 100
+
+/// The call-stack depth used by the call-stack test.
+#define TEST_STACK_DEPTH 8
+
+/// The number of allocations checked by the guard scan test, more than
+/// are checked at a time.
+#define TEST_SCAN_CHUNKS 200
+
+/// The number of allocations made by the size class histogram test.
+#define TEST_HIST_ALLOCS 100
+
+// --------------------------------------------------------------------------
+
+/// The allocations made by each thread.
+static void *s_allocs[TEST_THREADS][TEST_ALLOCS];
+
+/// The buffer to write memory reports to.
+static char s_report[16384];
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate memory from a test thread.
+/// @param arg The index of the thread.
+/// @return Always NULL.
+static void *test_memory_alloc_thread(void *arg) {
+    uintptr_t index = (uintptr_t)arg;
+    unsigned int cnt;
+    for(cnt=0;cnt < TEST_ALLOCS;cnt++) {
+        s_allocs[index][cnt] = IW_MALLOC(cnt % 64 + 1);
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Free the memory allocated by the next test thread.
+/// @param arg The index of the thread.
+/// @return Always NULL.
+static void *test_memory_free_thread(void *arg) {
+    uintptr_t index = ((uintptr_t)arg + 1) % TEST_THREADS;
+    unsigned int cnt;
+    for(cnt=0;cnt < TEST_ALLOCS;cnt++) {
+        IW_FREE(s_allocs[index][cnt]);
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Run the given function in all test threads.
+/// @param fn The thread function to run.
+static void test_memory_run(void *(*fn)(void *)) {
+    pthread_t threads[TEST_THREADS];
+    uintptr_t cnt;
+    for(cnt=0;cnt < TEST_THREADS;cnt++) {
+        pthread_create(&threads[cnt], NULL, fn, (void *)cnt);
+    }
+    for(cnt=0;cnt < TEST_THREADS;cnt++) {
+        pthread_join(threads[cnt], NULL);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Write the memory summary to the report buffer.
+/// @return The report buffer.
+static const char *test_memory_report() {
+    FILE *out = fmemopen(s_report, sizeof(s_report), "w");
+    iw_memory_summary(out);
+    fclose(out);
+    return s_report;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief A shared allocation helper, all allocations get the same location.
+/// @param size The size to allocate.
+/// @return The allocated memory.
+static __attribute__((noinline)) void *test_memory_helper(size_t size) {
+    return IW_MALLOC(size);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate memory through the shared helper.
+/// @return The allocated memory.
+static __attribute__((noinline)) void *test_memory_caller1() {
+    return test_memory_helper(32);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate memory through the shared helper from another caller.
+/// @return The allocated memory.
+static __attribute__((noinline)) void *test_memory_caller2() {
+    return test_memory_helper(32);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate memory with a memory tag set from a test thread.
+/// @param arg A pointer to store the allocated memory in.
+/// @return Always NULL.
+static void *test_memory_tag_thread(void *arg) {
+    iw_memory_tag_set(iw_memory_tag_register("thread"));
+    *(void **)arg = IW_MALLOC(64);
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test the memory tags of the memory tracking.
+/// @param result The result of the test.
+static void test_memory_tags(test_result *result) {
+    void *allocs[10];
+    void *thread_alloc = NULL;
+    iw_memory_tag_info info;
+    unsigned int cnt;
+
+    test_display("Registering memory tags");
+    iw_memory_init();
+    unsigned int tag = iw_memory_tag_register("worker");
+    test(result, tag != IW_MEM_TAG_NONE && iw_memory_tag_register("worker") == tag,
+         "Registered tag once");
+
+    test_display("Allocating with a scoped memory tag");
+    {
+        IW_MEM_TAG_SCOPE(tag);
+        for(cnt=0;cnt < 10;cnt++) {
+            allocs[cnt] = IW_MALLOC(100);
+        }
+    }
+    test(result, iw_memory_tag_get() == IW_MEM_TAG_NONE,
+         "Tag restored at the end of the scope");
+    test(result, iw_memory_tag_info_get(tag, &info) && info.allocs == 10 &&
+         info.cur_bytes == 1000 && info.peak_bytes == 1000,
+         "Allocations accounted to tag");
+    for(cnt=0;cnt < 5;cnt++) {
+        IW_FREE(allocs[cnt]);
+    }
+    test(result, iw_memory_tag_info_get(tag, &info) && info.allocs == 5 &&
+         info.cur_bytes == 500 && info.peak_bytes == 1000,
+         "Frees accounted to tag, peak kept");
+    allocs[5] = IW_REALLOC(allocs[5], 300);
+    test(result, iw_memory_tag_info_get(tag, &info) && info.allocs == 5 &&
+         info.cur_bytes == 700 && info.peak_bytes == 1000,
+         "Realloc outside the tag scope kept the tag");
+    allocs[5] = IW_REALLOC(allocs[5], 100);
+    test(result, iw_memory_tag_info_get(tag, &info) && info.allocs == 5 &&
+         info.cur_bytes == 500,
+         "Realloc accounted the change in size only");
+    void *untagged = IW_MALLOC(10);
+    test(result, iw_memory_tag_info_get(IW_MEM_TAG_NONE, &info) &&
+         info.allocs == 1 && info.cur_bytes == 10,
+         "Untagged allocation not accounted to tag");
+
+    test_display("Freeing memory tagged by another thread");
+    pthread_t thread;
+    pthread_create(&thread, NULL, test_memory_tag_thread, &thread_alloc);
+    pthread_join(thread, NULL);
+    IW_FREE(thread_alloc);
+    unsigned int thread_tag = iw_memory_tag_register("thread");
+    test(result, iw_memory_tag_info_get(thread_tag, &info) &&
+         info.allocs == 0 && info.cur_bytes == 0 && info.peak_bytes == 64,
+         "Free accounted to the allocating tag");
+
+    FILE *out = fmemopen(s_report, sizeof(s_report), "w");
+    iw_memory_tags(out);
+    fclose(out);
+    test(result, strstr(s_report, "\nworker ") != NULL &&
+         strstr(s_report, "\nthread ") != NULL,
+         "Tags listed");
+
+    test_display("Exporting pprof heap profile without call-stacks");
+    out = fmemopen(s_report, sizeof(s_report), "w");
+    iw_memory_pprof(out);
+    fclose(out);
+    char *tagged = strstr(s_report, "\n     5:      500 [     5:      500] @ 0x");
+    char *single = strstr(s_report, "\n     1:       10 [     1:       10] @ 0x");
+    test(result, tagged != NULL && single != NULL &&
+         strstr(s_report, "@\n") == NULL &&
+         strncmp(tagged + 41, single + 41, 8) != 0,
+         "Profile lists one frame per allocation site");
+
+    for(cnt=5;cnt < 10;cnt++) {
+        IW_FREE(allocs[cnt]);
+    }
+    IW_FREE(untagged);
+    iw_memory_exit();
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Write the heap growth between two snapshots to the report buffer.
+/// @param from The name of the earlier snapshot.
+/// @param to The name of the later snapshot or NULL for the live heap.
+/// @return The report buffer or NULL if the snapshots could not be compared.
+static const char *test_memory_diff(const char *from, const char *to) {
+    FILE *out = fmemopen(s_report, sizeof(s_report), "w");
+    bool ok = iw_memory_diff(out, from, to);
+    fclose(out);
+    return ok ? s_report : NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test the heap snapshots of the memory tracking.
+/// @param result The result of the test.
+static void test_memory_snapshots(test_result *result) {
+    void *allocs[5];
+    unsigned int cnt;
+
+    test_display("Taking heap snapshots");
+    test(result, iw_memory_snapshot("before"), "Took snapshot 'before'");
+    for(cnt=0;cnt < 5;cnt++) {
+        allocs[cnt] = test_memory_caller1();
+    }
+    test(result, iw_memory_snapshot("after"), "Took snapshot 'after'");
+    FILE *out = fmemopen(s_report, sizeof(s_report), "w");
+    iw_memory_snapshots(out);
+    fclose(out);
+    test(result, strstr(s_report, "Snapshot: before (") != NULL &&
+         strstr(s_report, "Snapshot: after (") != NULL,
+         "Snapshots listed");
+
+    test_display("Comparing heap snapshots");
+    const char *report = test_memory_diff("before", "after");
+    test(result, report != NULL &&
+         strstr(report, "Sites grown:             1\n") != NULL &&
+         strstr(report, "Growth of grown sites:   160 Bytes\n") != NULL &&
+         strstr(report, "(+5 allocations => +160 Bytes, now 160 Bytes) Stack #") != NULL,
+         "Growth of one site reported");
+    report = test_memory_diff("after", "before");
+    test(result, report != NULL &&
+         strstr(report, "Sites grown:             0\n") != NULL,
+         "No growth reported in reverse");
+    for(cnt=0;cnt < 5;cnt++) {
+        IW_FREE(allocs[cnt]);
+    }
+    report = test_memory_diff("before", NULL);
+    test(result, report != NULL &&
+         strstr(report, "Sites grown:             0\n") != NULL,
+         "No growth against the live heap after freeing");
+    test(result, test_memory_diff("missing", NULL) == NULL,
+         "Missing snapshot rejected");
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test the call-stack tracking of the memory tracking.
+/// @param result The result of the test.
+static void test_memory_stacks(test_result *result) {
+    void *allocs[30];
+    unsigned int cnt;
+
+    test_display("Recording %d call-stack frames", TEST_STACK_DEPTH);
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_STACKDEPTH,
+                            TEST_STACK_DEPTH, NULL, 0);
+    iw_memory_init();
+    for(cnt=0;cnt < 30;cnt++) {
+        allocs[cnt] = cnt < 10 ? test_memory_caller1() : test_memory_caller2();
+    }
+    const char *report = test_memory_report();
+    test(result, strstr(report, "(10 * 32 Bytes => Total 320 Bytes) Stack #") != NULL &&
+         strstr(report, "(20 * 32 Bytes => Total 640 Bytes) Stack #") != NULL,
+         "Allocations from different callers listed separately");
+    test(result, strstr(report, "Stack #2\n") != NULL &&
+         strstr(report, "Stack #3\n") == NULL,
+         "Call-stacks interned");
+    test(result, strstr(report, "    #0  ") != NULL &&
+         strstr(report, "    #7  ") != NULL &&
+         strstr(report, "    #8  ") == NULL,
+         "Call-stacks symbolized to %d frames", TEST_STACK_DEPTH);
+
+    test_display("Exporting pprof heap profile");
+    FILE *out = fmemopen(s_report, sizeof(s_report), "w");
+    iw_memory_pprof(out);
+    fclose(out);
+    test(result, strstr(s_report, "heap profile:     30:      960 "
+                                  "[    30:      960] @ heapprofile\n") == s_report,
+         "Profile header lists the live heap");
+    test(result, strstr(s_report, "\n    10:      320 [    10:      320] @ 0x") != NULL &&
+         strstr(s_report, "\n    20:      640 [    20:      640] @ 0x") != NULL,
+         "Profile lists one record per call-stack");
+    test(result, strstr(s_report, "\nMAPPED_LIBRARIES:\n") != NULL,
+         "Profile includes the memory map");
+
+    test_memory_snapshots(result);
+
+    for(cnt=0;cnt < 30;cnt++) {
+        IW_FREE(allocs[cnt]);
+    }
+    iw_memory_exit();
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_STACKDEPTH, 0, NULL, 0);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get a value from the heap profile.
+/// @param name The name of the value, including the colon.
+/// @param unit [out] The unit of the value (if any).
+/// @return The value or zero if not found.
+static unsigned long test_memory_profile(const char *name, char *unit) {
+    unsigned long value = 0;
+    FILE *out = fmemopen(s_report, sizeof(s_report), "w");
+    iw_memory_profile(out);
+    fclose(out);
+    const char *str = strstr(s_report, name);
+    if(str != NULL) {
+        unit[0] = '\0';
+        sscanf(str + strlen(name), "%lu %15s", &value, unit);
+    }
+    return value;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test the sampling mode of the memory tracking.
+/// @param result The result of the test.
+static void test_memory_sampling(test_result *result) {
+    static void *allocs[TEST_SAMPLES];
+    unsigned int cnt;
+    char unit[16];
+
+    test_display("Sampling one allocation per %d bytes", TEST_SAMPLE);
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_SAMPLE, TEST_SAMPLE, NULL, 0);
+    iw_memory_init();
+    for(cnt=0;cnt < TEST_SAMPLES;cnt++) {
+        allocs[cnt] = IW_MALLOC(TEST_SAMPLE_SIZE);
+    }
+    unsigned long samples = test_memory_profile("Sampled allocations:", unit);
+    unsigned long expected = TEST_SAMPLES * TEST_SAMPLE_SIZE / TEST_SAMPLE;
+    test(result, samples > expected / 2 && samples < expected * 2,
+         "Sampled about %lu allocations? (actual=%lu)", expected, samples);
+    unsigned long estimate = test_memory_profile("Estimated live heap:", unit);
+    expected = TEST_SAMPLES * TEST_SAMPLE_SIZE / 1024;
+    test(result, strcmp(unit, "KBytes") == 0 &&
+         estimate > expected * 3 / 4 && estimate < expected * 5 / 4,
+         "Estimated live heap close to %lu KBytes? (actual=%lu %s)",
+         expected, estimate, unit);
+    test(result, strstr(s_report, "test_memory.c") != NULL &&
+         strstr(s_report, "#0") != NULL,
+         "Heap site reported with backtrace");
+
+    for(cnt=0;cnt < TEST_SAMPLES;cnt++) {
+        IW_FREE(allocs[cnt]);
+    }
+    test(result, test_memory_profile("Sampled allocations:", unit) == 0 &&
+         test_memory_profile("Outstanding allocations:", unit) == 0,
+         "All sampled allocations freed");
+
+    iw_memory_exit();
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_SAMPLE, 0, NULL, 0);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Test the size class histogram of the memory tracking.
+/// @param result The result of the test.
+static void test_memory_histogram(test_result *result) {
+    static void *allocs[TEST_HIST_ALLOCS];
+    iw_memory_hist_info info;
+    unsigned int cnt;
+
+    test_display("Counting allocations by size class");
+    iw_memory_init();
+    for(cnt=0;cnt < TEST_HIST_ALLOCS;cnt++) {
+        allocs[cnt] = IW_MALLOC(cnt % 2 == 0 ? 16 : 100);
+    }
+    for(cnt=0;cnt < TEST_HIST_ALLOCS;cnt += 4) {
+        IW_FREE(allocs[cnt]);
+        allocs[cnt] = NULL;
+    }
+    test(result, iw_memory_hist_get(0, &info) && info.max_size == 16 &&
+         info.allocs == TEST_HIST_ALLOCS / 2 &&
+         info.frees == TEST_HIST_ALLOCS / 4 &&
+         info.live == TEST_HIST_ALLOCS / 4 &&
+         info.live_bytes == TEST_HIST_ALLOCS / 4 * 16,
+         "Allocations and frees of up to 16 bytes counted");
+    test(result, iw_memory_hist_get(3, &info) && info.min_size == 65 &&
+         info.max_size == 128 && info.live == TEST_HIST_ALLOCS / 2 &&
+         info.frees == 0 && info.lifetime == 0.0,
+         "Allocations of 100 bytes counted in the 65-128 class");
+    allocs[1] = IW_REALLOC(allocs[1], 1000);
+    test(result, iw_memory_hist_get(3, &info) &&
+         info.allocs == TEST_HIST_ALLOCS / 2 && info.frees == 0 &&
+         info.live_bytes == TEST_HIST_ALLOCS / 2 * 100 + 900,
+         "Realloc kept the chunk in its size class");
+    test(result, iw_memory_hist_get(IW_MEM_HIST_CLASSES - 1, &info) &&
+         info.max_size == 0 &&
+         !iw_memory_hist_get(IW_MEM_HIST_CLASSES, &info),
+         "Last size class holds all larger sizes");
+
+    test_display("Measuring allocation rates");
+    usleep(100000);
+    iw_memory_hist_tick();
+    test(result, iw_memory_hist_get(3, &info) && info.alloc_rate > 0.0 &&
+         info.free_rate == 0.0 && info.peak_rate == info.alloc_rate,
+         "Allocation rate measured at tick");
+    FILE *out = fmemopen(s_report, sizeof(s_report), "w");
+    iw_memory_histogram(out);
+    fclose(out);
+    test(result, strstr(s_report, "\n<=16 ") != NULL &&
+         strstr(s_report, "\n<=128 ") != NULL &&
+         strstr(s_report, "\n<=32 ") == NULL &&
+         strstr(s_report, "\nTotal ") != NULL,
+         "Histogram lists the used size classes");
+
+    for(cnt=0;cnt < TEST_HIST_ALLOCS;cnt++) {
+        IW_FREE(allocs[cnt]);
+    }
+    test(result, iw_memory_hist_get(3, &info) && info.live == 0 &&
+         info.live_bytes == 0 && info.frees == TEST_HIST_ALLOCS / 2,
+         "All allocations freed");
+    iw_memory_exit();
+    test(result, !iw_memory_hist_get(0, &info),
+         "No histogram without memory tracking");
+}
+
+// --------------------------------------------------------------------------
+
+void test_memory(test_result *result) {
+    unsigned int cnt;
+    bool ok;
+
+    test_display("Enabling memory tracking");
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 1, NULL, 0);
+    iw_memory_init();
+
+    test_display("Allocating from %d threads", TEST_THREADS);
+    test_memory_run(test_memory_alloc_thread);
+    ok = true;
+    for(cnt=0;cnt < TEST_THREADS * TEST_ALLOCS;cnt++) {
+        void *ptr = s_allocs[cnt / TEST_ALLOCS][cnt % TEST_ALLOCS];
+        ok = ok && ptr != NULL && ((uintptr_t)ptr & 15) == 0;
+    }
+    test(result, ok, "All allocations 16 byte aligned");
+    test(result, strstr(test_memory_report(),
+                        "Outstanding allocations: 4000\n") != NULL,
+         "Allocations from all threads tracked");
+
+    test_display("Freeing memory allocated by other threads");
+    test_memory_run(test_memory_free_thread);
+    const char *report = test_memory_report();
+    test(result, strstr(report, "Number frees:            4000\n") != NULL &&
+         strstr(report, "Outstanding allocations: 0\n") != NULL &&
+         strstr(report, "Outstanding allocations: 0 Bytes\n") != NULL,
+         "Frees from other threads tracked");
+
+    test_display("Checking allocation wrappers");
+    unsigned char *buff = (unsigned char *)IW_CALLOC(16, 4);
+    ok = buff != NULL;
+    for(cnt=0;ok && cnt < 64;cnt++) {
+        ok = buff[cnt] == 0;
+    }
+    test(result, ok, "Calloc cleared all elements");
+    memset(buff, 'a', 64);
+    buff = (unsigned char *)IW_REALLOC(buff, 8);
+    test(result, buff != NULL && buff[7] == 'a', "Realloc kept contents");
+    buff = (unsigned char *)IW_REALLOC(buff, 10000);
+    memset(buff + 8, 'b', 10000 - 8);
+    report = test_memory_report();
+    test(result, buff != NULL && buff[7] == 'a' &&
+         strstr(report, "Outstanding allocations: 1\n") != NULL &&
+         strstr(report, "Outstanding allocations: 9 KBytes\n") != NULL,
+         "Realloc grew tracked chunk");
+    IW_FREE(buff);
+    buff = (unsigned char *)IW_REALLOC(NULL, 16);
+    test(result, buff != NULL && IW_REALLOC(buff, 0) == NULL &&
+         strstr(test_memory_report(), "Outstanding allocations: 0\n") != NULL,
+         "Realloc of NULL allocates and realloc to zero frees");
+    char *str = IW_STRDUP("abcd");
+    test(result, str != NULL && strcmp(str, "abcd") == 0, "Duplicated string");
+    IW_FREE(str);
+    test(result, strstr(test_memory_report(),
+                        "Post-guard corruptions:  0\n") != NULL,
+         "No guard corruption detected");
+
+    test_display("Detecting post-guard corruption");
+    buff = (unsigned char *)IW_MALLOC(8);
+    buff[8] = 0;
+    IW_FREE(buff);
+    test(result, strstr(test_memory_report(),
+                        "Post-guard corruptions:  1\n") != NULL,
+         "Post-guard corruption detected");
+
+    test_display("Scanning for guard corruption");
+    unsigned char *chunks[TEST_SCAN_CHUNKS];
+    for(cnt=0;cnt < TEST_SCAN_CHUNKS;cnt++) {
+        chunks[cnt] = (unsigned char *)IW_MALLOC(cnt + 1);
+    }
+    chunks[TEST_SCAN_CHUNKS / 2][TEST_SCAN_CHUNKS / 2 + 1] = 0;
+    unsigned int found = 0;
+    for(cnt=0;cnt < TEST_SCAN_CHUNKS;cnt += 2) {
+        // Free chunks while the scan is in progress.
+        found += iw_memory_scan(0);
+        if(cnt != TEST_SCAN_CHUNKS / 2) {
+            IW_FREE(chunks[cnt]);
+            chunks[cnt] = NULL;
+        }
+    }
+    found += iw_memory_scan(1000000);
+    found += iw_memory_scan(1000000);
+    report = test_memory_report();
+    test(result, found == 1 &&
+         strstr(report, "Post-guard corruptions:  2\n") != NULL &&
+         strstr(report, "Guard scans completed:   ") != NULL,
+         "Scan detected corruption of live chunk once");
+    for(cnt=0;cnt < TEST_SCAN_CHUNKS;cnt++) {
+        IW_FREE(chunks[cnt]);
+    }
+    report = test_memory_report();
+    test(result, strstr(report, "Post-guard corruptions:  2\n") != NULL &&
+         strstr(report, "Outstanding allocations: 0\n") != NULL,
+         "Scanned corruption not counted again when freed");
+
+    iw_memory_exit();
+    test_memory_tags(result);
+    test_memory_stacks(result);
+    test_memory_sampling(result);
+    test_memory_histogram(result);
+    iw_val_store_set_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE, 0, NULL, 0);
+
+    test_display("Exporting pprof heap profile with tracking disabled");
+    iw_memory_init();
+    memset(s_report, 0, sizeof(s_report));
+    FILE *out = fmemopen(s_report, sizeof(s_report), "w");
+    ok = iw_memory_pprof(out);
+    fclose(out);
+    test(result, !ok && s_report[0] == '\0', "No profile written");
+}
+
+// --------------------------------------------------------------------------
@@ -93,7 +93,7 @@ static bool proc_opt(int *cnt, int argc, char **argv, iw_opt *opt __attribute__(
     for(*cnt=0;*cnt < s_num && *cnt < 3;(*cnt)++) {
         s_arg[*cnt] = argv[*cnt];
     }
-    for(;*cnt < 3;cnt++) {
+    for(;*cnt < 3;(*cnt)++) {
         s_arg[*cnt] = NULL;
     }
     return true;
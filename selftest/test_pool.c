@@ -0,0 +1,189 @@
+// --------------------------------------------------------------------------
+///
+/// @file test_pool.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_pool.h"
+
+#include "tests.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+
+/// The number of objects to allocate, more than a thread caches.
+#define TEST_OBJECTS    100
+
+/// The number of threads using the pool concurrently.
+#define TEST_THREADS    4
+
+/// The number of objects each thread allocates at a time.
+#define TEST_BATCH      50
+
+/// The number of rounds of allocations each thread makes.
+#define TEST_ROUNDS     1000
+
+// --------------------------------------------------------------------------
+
+/// The pool used by the test threads.
+static iw_pool s_pool;
+
+/// The objects allocated by each thread, freed by the next thread.
+static void *s_objs[TEST_THREADS][TEST_BATCH];
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate and free objects, half of them allocated by another
+/// thread.
+/// @param arg The index of the thread.
+/// @return NULL if all objects were allocated and intact.
+static void *test_pool_thread(void *arg) {
+    uintptr_t index = (uintptr_t)arg;
+    unsigned int round, cnt;
+    void *failed = NULL;
+    for(round=0;round < TEST_ROUNDS;round++) {
+        void *objs[TEST_BATCH];
+        for(cnt=0;cnt < TEST_BATCH;cnt++) {
+            objs[cnt] = iw_pool_alloc(&s_pool);
+            if(objs[cnt] == NULL) {
+                return arg;
+            }
+            memset(objs[cnt], (int)index, 32);
+        }
+        for(cnt=0;cnt < TEST_BATCH;cnt++) {
+            unsigned char *obj = (unsigned char *)objs[cnt];
+            if(obj[0] != index || obj[31] != index) {
+                failed = arg;
+            }
+            iw_pool_free(&s_pool, obj);
+        }
+    }
+    return failed;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Free the objects allocated by the main thread for this thread.
+/// @param arg The index of the thread.
+/// @return Always NULL.
+static void *test_pool_free_thread(void *arg) {
+    uintptr_t index = (uintptr_t)arg;
+    unsigned int cnt;
+    for(cnt=0;cnt < TEST_BATCH;cnt++) {
+        iw_pool_free(&s_pool, s_objs[index][cnt]);
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Run the given function in all test threads.
+/// @param fn The thread function to run.
+/// @return True if all threads returned NULL.
+static bool test_pool_run(void *(*fn)(void *)) {
+    pthread_t threads[TEST_THREADS];
+    uintptr_t cnt;
+    bool ok = true;
+    for(cnt=0;cnt < TEST_THREADS;cnt++) {
+        pthread_create(&threads[cnt], NULL, fn, (void *)cnt);
+    }
+    for(cnt=0;cnt < TEST_THREADS;cnt++) {
+        void *retval;
+        pthread_join(threads[cnt], &retval);
+        ok = ok && retval == NULL;
+    }
+    return ok;
+}
+
+// --------------------------------------------------------------------------
+
+void test_pool(test_result *result) {
+    void *objs[TEST_OBJECTS];
+    iw_pool_stats stats;
+    unsigned int cnt;
+    bool ok;
+
+    test_display("Initializing pool");
+    test(result, iw_pool_init(&s_pool, "test", 20, false), "Pool initialized");
+    test(result, s_pool.obj_size == 32, "Object size rounded up to %d? (actual=%d)",
+         32, s_pool.obj_size);
+    iw_pool_stats_get(&s_pool, &stats);
+    test(result, stats.num_blocks == 0, "No blocks allocated before first object");
+
+    test_display("Allocating %d objects", TEST_OBJECTS);
+    ok = true;
+    for(cnt=0;cnt < TEST_OBJECTS;cnt++) {
+        objs[cnt] = iw_pool_alloc(&s_pool);
+        ok = ok && objs[cnt] != NULL && ((uintptr_t)objs[cnt] & 15) == 0;
+        if(objs[cnt] != NULL) {
+            memset(objs[cnt], 0xFF, s_pool.obj_size);
+        }
+    }
+    test(result, ok, "Allocated aligned objects");
+    iw_pool_stats_get(&s_pool, &stats);
+    test(result, stats.allocs == TEST_OBJECTS && stats.frees == 0 &&
+         stats.num_blocks == 1, "Allocations counted");
+
+    test_display("Freeing objects");
+    for(cnt=0;cnt < TEST_OBJECTS;cnt++) {
+        iw_pool_free(&s_pool, objs[cnt]);
+    }
+    iw_pool_stats_get(&s_pool, &stats);
+    test(result, stats.frees == TEST_OBJECTS && stats.flushes > 0 &&
+         stats.cached <= IW_POOL_MAG_SIZE &&
+         stats.cached + stats.depot == stats.objects,
+         "Full thread cache flushed to depot (cached=%lu, depot=%lu)",
+         stats.cached, stats.depot);
+    unsigned long objects = stats.objects;
+    for(cnt=0;cnt < TEST_OBJECTS;cnt++) {
+        objs[cnt] = iw_pool_alloc(&s_pool);
+    }
+    iw_pool_stats_get(&s_pool, &stats);
+    test(result, stats.objects == objects && stats.refills > 0,
+         "Objects reused from thread cache and depot");
+    for(cnt=0;cnt < TEST_OBJECTS;cnt++) {
+        iw_pool_free(&s_pool, objs[cnt]);
+    }
+
+    test_display("Allocating from %d threads", TEST_THREADS);
+    test(result, test_pool_run(test_pool_thread), "Objects allocated and intact");
+    for(cnt=0;cnt < TEST_THREADS * TEST_BATCH;cnt++) {
+        s_objs[cnt / TEST_BATCH][cnt % TEST_BATCH] = iw_pool_alloc(&s_pool);
+    }
+    test_pool_run(test_pool_free_thread);
+    iw_pool_stats_get(&s_pool, &stats);
+    test(result, stats.allocs == stats.frees &&
+         stats.cached + stats.depot == stats.objects,
+         "Caches of exited threads returned to depot");
+
+    test_display("Reporting pools");
+    char buff[4096];
+    FILE *out = fmemopen(buff, sizeof(buff), "w");
+    iw_pool_show(out);
+    fclose(out);
+    test(result, strstr(buff, "\ntest ") != NULL, "Pool included in report");
+
+    test_display("Reusing pool index");
+    iw_pool_destroy(&s_pool);
+    test(result, iw_pool_init(&s_pool, "reused", 64, false), "Pool initialized");
+    void *obj = iw_pool_alloc(&s_pool);
+    iw_pool_stats_get(&s_pool, &stats);
+    test(result, obj != NULL && stats.allocs == 1 && stats.num_blocks == 1,
+         "Stale thread cache discarded");
+    iw_pool_free(&s_pool, obj);
+    iw_pool_destroy(&s_pool);
+    out = fmemopen(buff, sizeof(buff), "w");
+    iw_pool_show(out);
+    fclose(out);
+    test(result, strstr(buff, "reused") == NULL, "Pool removed from report");
+}
+
+// --------------------------------------------------------------------------
@@ -0,0 +1,84 @@
+// --------------------------------------------------------------------------
+///
+/// @file test_slab.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_slab.h"
+
+#include "tests.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+
+/// The number of nodes to allocate, spans several blocks.
+#define TEST_NODES  100
+
+// --------------------------------------------------------------------------
+
+void test_slab(test_result *result) {
+    void *nodes[TEST_NODES];
+    unsigned int cnt;
+    iw_slab slab;
+    bool ok;
+
+    test_display("Initializing slab");
+    iw_slab_init(&slab, "test", 20, 16, false);
+    test(result, slab.node_size == 24, "Node size rounded up to %d? (actual=%d)",
+         24, slab.node_size);
+    test(result, slab.num_blocks == 0, "No blocks allocated before first node");
+
+    test_display("Allocating %d nodes", TEST_NODES);
+    ok = true;
+    for(cnt=0;cnt < TEST_NODES;cnt++) {
+        nodes[cnt] = iw_slab_alloc(&slab);
+        ok = ok && nodes[cnt] != NULL && ((uintptr_t)nodes[cnt] & 7) == 0 &&
+             *(unsigned char *)nodes[cnt] == 0;
+        if(nodes[cnt] != NULL) {
+            memset(nodes[cnt], 0xFF, slab.node_size);
+        }
+    }
+    test(result, ok, "Allocated aligned zeroed nodes");
+    test(result, slab.num_blocks == (TEST_NODES + 15) / 16,
+         "Allocated %d blocks? (actual=%d)", (TEST_NODES + 15) / 16,
+         slab.num_blocks);
+    test(result, slab.in_use == TEST_NODES, "%d nodes in use? (actual=%d)",
+         TEST_NODES, slab.in_use);
+
+    test_display("Freeing and reallocating nodes");
+    iw_slab_free(&slab, nodes[10]);
+    iw_slab_free(&slab, nodes[20]);
+    test(result, slab.in_use == TEST_NODES - 2, "Freed 2 nodes");
+    void *node = iw_slab_alloc(&slab);
+    test(result, node == nodes[20] && *(unsigned char *)node == 0,
+         "Last freed node reused and zeroed");
+    node = iw_slab_alloc(&slab);
+    test(result, node == nodes[10], "First freed node reused");
+    test(result, slab.num_blocks == (TEST_NODES + 15) / 16 &&
+         slab.high_water == TEST_NODES, "Reuse did not allocate a block");
+
+    test_display("Reporting slab occupancy");
+    char buff[4096];
+    FILE *out = fmemopen(buff, sizeof(buff), "w");
+    iw_slab_show(out);
+    fclose(out);
+    test(result, strstr(buff, "test") != NULL, "Slab included in report");
+
+    iw_slab_destroy(&slab);
+    test(result, slab.blocks == NULL && slab.in_use == 0,
+         "Destroyed slab freed all blocks");
+    out = fmemopen(buff, sizeof(buff), "w");
+    iw_slab_show(out);
+    fclose(out);
+    test(result, strstr(buff, "test") == NULL, "Slab removed from report");
+}
+
+// --------------------------------------------------------------------------
@@ -14,6 +14,8 @@
 
 #include "tests.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 // --------------------------------------------------------------------------
@@ -457,6 +459,39 @@ void test_complete_req_buff(
 
 // --------------------------------------------------------------------------
 
+/// @brief Test that a request with more parameters than fit in the request
+/// arena fails to parse rather than losing parameters.
+/// @param result The test result structure.
+static void test_req_too_many_params(test_result *result) {
+    static const char prefix[] = "GET /?";
+    static const char suffix[] = " HTTP/1.1\r\n\r\n";
+    unsigned int params = IW_WEB_REQ_ARENA_CAP / 32;
+    size_t size = sizeof(prefix) + params * 4 + sizeof(suffix);
+    char *buff = (char *)malloc(size);
+    if(buff == NULL) {
+        test(result, false, "Allocated request buffer");
+        return;
+    }
+    char *ptr = buff + sprintf(buff, "%s", prefix);
+    unsigned int cnt;
+    for(cnt=0;cnt < params;cnt++) {
+        ptr += sprintf(ptr, "%sa=1", cnt > 0 ? "&" : "");
+    }
+    sprintf(ptr, "%s", suffix);
+
+    iw_web_req req;
+    iw_web_req_init(&req);
+    test_display("Parsing request with too many parameters");
+    req.buff = buff;
+    req.len  = strlen(buff);
+    test(result, iw_web_req_parse(&req) == IW_WEB_PARSE_ERROR,
+         "Parse failed for %u parameters", params);
+    iw_web_req_free(&req);
+    free(buff);
+}
+
+// --------------------------------------------------------------------------
+
 void test_web_srv(test_result *result) {
     test_req_buff(result, "Parsing URI 1", &req_uri_1);
     test_req_buff(result, "Parsing basic request", &req_basic);
@@ -464,6 +499,7 @@ void test_web_srv(test_result *result) {
     test_req_buff(result, "Parsing get form request", &req_get_form);
     test_req_buff(result, "Parsing post form request", &req_post_form);
     test_req_buff(result, "Parsing mixed post request", &req_post_mix);
+    test_req_too_many_params(result);
 }
 
 // --------------------------------------------------------------------------
@@ -15,11 +15,17 @@
 // --------------------------------------------------------------------------
 
 test_info s_tests[] = {
+    { test_arena,       "arena",    "Arena allocator test" },
     { test_buff,        "buffer",   "Buffer test" },
+    { test_chtable,     "chash",    "Concurrent hash table test" },
     { test_hash_table,  "hash",     "Hash table test" },
     { test_ip,          "ip",       "IP address utility test" },
     { test_list,        "list",     "List test" },
+    { test_log,         "log",      "Log pipeline test" },
+    { test_memory,      "memory",   "Memory tracking test" },
     { test_opts,        "cli",      "Command-line option parsing test" },
+    { test_pool,        "pool",     "Object pool test" },
+    { test_slab,        "slab",     "Slab allocator test" },
     { test_syslog,      "syslog",   "Syslog ring buffer test" },
     { test_util,        "util",     "Utility function test" },
     { test_value_store, "store",    "Value store test" },
@@ -27,10 +27,18 @@ extern test_info s_tests[];
 //
 // --------------------------------------------------------------------------
 
+/// @brief The arena allocator test suite.
+/// @param result The result of the test.
+extern void test_arena(test_result *result);
+
 /// @brief The buffer test suite.
 /// @param result The result of the test.
 extern void test_buff(test_result *result);
 
+/// @brief The concurrent hash table test suite.
+/// @param result The result of the test.
+extern void test_chtable(test_result *result);
+
 /// @brief The hash table test suite.
 /// @param result The result of the test.
 extern void test_hash_table(test_result *result);
@@ -43,10 +51,26 @@ extern void test_ip(test_result *result);
 /// @param result The result of the test.
 extern void test_list(test_result *result);
 
+/// @brief The log pipeline test suite.
+/// @param result The result of the test.
+extern void test_log(test_result *result);
+
+/// @brief The memory tracking test suite.
+/// @param result The result of the test.
+extern void test_memory(test_result *result);
+
 /// @brief The command-line options test suite.
 /// @param result The result of the test.
 extern void test_opts(test_result *result);
 
+/// @brief The object pool test suite.
+/// @param result The result of the test.
+extern void test_pool(test_result *result);
+
+/// @brief The slab allocator test suite.
+/// @param result The result of the test.
+extern void test_slab(test_result *result);
+
 /// @brief The syslog test suite.
 /// @param result The result of the test.
 extern void test_syslog(test_result *result);
@@ -0,0 +1,233 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_arena.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_arena.h"
+
+#include "iw_log.h"
+#include "iw_memory.h"
+#include "iw_memory_int.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+
+/// The size of the block header, keeps the memory 16 byte aligned.
+#define IW_ARENA_HDR_SIZE   16
+
+/// The alignment of the allocated memory.
+#define IW_ARENA_ALIGN      16
+
+// --------------------------------------------------------------------------
+
+/// @brief A copy of the use of an arena, taken so that the arena can be
+/// shown without holding the lock of the list of arenas.
+typedef struct _iw_arena_info {
+    char          name[32];     ///< The name of the arena.
+    const void   *arena;        ///< The address of the arena.
+    unsigned int  num_blocks;   ///< The number of allocated blocks.
+    size_t        reserved;     ///< The number of bytes in all blocks.
+    size_t        used;         ///< The number of bytes allocated.
+    size_t        high_water;   ///< The largest number of bytes allocated.
+} iw_arena_info;
+
+// --------------------------------------------------------------------------
+
+/// All arenas, used to report the arena use.
+static iw_list s_arenas = IW_LIST_INIT;
+
+/// The lock protecting the list of arenas.
+static pthread_mutex_t s_arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// --------------------------------------------------------------------------
+//
+// Helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Move on to the next block with room for the given size.
+/// Blocks kept by a reset are reused before any new block is allocated.
+/// @param arena The arena to find a block for.
+/// @param size The number of bytes that must fit in the block.
+/// @return True if a block was found or allocated.
+static bool iw_arena_next_block(iw_arena *arena, size_t size) {
+    iw_arena_block *block = arena->cur != NULL ? arena->cur->next
+                                               : arena->blocks;
+    while(block != NULL && block->size < size) {
+        block = block->next;
+    }
+    if(block == NULL) {
+        size_t block_size = size > arena->block_size ? size : arena->block_size;
+        if(arena->cap != 0 && arena->reserved + block_size > arena->cap) {
+            LOG(IW_LOG_IW, "Arena %s exceeded its cap of %zu bytes",
+                arena->name, arena->cap);
+            return false;
+        }
+        unsigned char *mem;
+        INT_CALLOC(arena->iw_mem_alloc, mem, IW_ARENA_HDR_SIZE + block_size,
+                   unsigned char);
+        if(mem == NULL) {
+            LOG(IW_LOG_IW, "Failed to allocate block for arena %s", arena->name);
+            return false;
+        }
+        // Link the new block in after the current block so that the blocks
+        // are reused in the same order after a reset.
+        block = (iw_arena_block *)mem;
+        block->size = block_size;
+        if(arena->cur != NULL) {
+            block->next      = arena->cur->next;
+            arena->cur->next = block;
+        } else {
+            block->next   = arena->blocks;
+            arena->blocks = block;
+        }
+        // The counters are read by iw_arena_show() from other threads.
+        __atomic_store_n(&arena->num_blocks, arena->num_blocks + 1,
+                         __ATOMIC_RELAXED);
+        __atomic_store_n(&arena->reserved, arena->reserved + block_size,
+                         __ATOMIC_RELAXED);
+    }
+    arena->cur       = block;
+    arena->bump      = (unsigned char *)block + IW_ARENA_HDR_SIZE;
+    arena->bump_left = block->size;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+void iw_arena_init(
+    iw_arena *arena,
+    const char *name,
+    size_t block_size,
+    size_t cap,
+    bool iw_mem_alloc)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->name         = name;
+    arena->iw_mem_alloc = iw_mem_alloc;
+    arena->block_size   = block_size == 0 ? IW_ARENA_BLOCK_SIZE : block_size;
+    arena->block_size   = (arena->block_size + IW_ARENA_ALIGN - 1) &
+                          ~(IW_ARENA_ALIGN - 1);
+    arena->cap          = cap;
+
+    pthread_mutex_lock(&s_arena_lock);
+    iw_list_add(&s_arenas, &arena->node);
+    pthread_mutex_unlock(&s_arena_lock);
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_arena_alloc(iw_arena *arena, size_t size) {
+    size = size == 0 ? IW_ARENA_ALIGN
+                     : (size + IW_ARENA_ALIGN - 1) & ~(IW_ARENA_ALIGN - 1);
+    if(size > arena->bump_left && !iw_arena_next_block(arena, size)) {
+        return NULL;
+    }
+    void *ptr = arena->bump;
+    arena->bump      += size;
+    arena->bump_left -= size;
+    // Only this thread writes the counters, the stores are atomic since
+    // iw_arena_show() reads them from other threads.
+    size_t used = arena->used + size;
+    __atomic_store_n(&arena->used, used, __ATOMIC_RELAXED);
+    if(used > arena->high_water) {
+        __atomic_store_n(&arena->high_water, used, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_arena_calloc(iw_arena *arena, size_t size) {
+    void *ptr = iw_arena_alloc(arena, size);
+    if(ptr != NULL) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_arena_reset(iw_arena *arena) {
+    arena->cur       = NULL;
+    arena->bump      = NULL;
+    arena->bump_left = 0;
+    __atomic_store_n(&arena->used, 0, __ATOMIC_RELAXED);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_arena_destroy(iw_arena *arena) {
+    pthread_mutex_lock(&s_arena_lock);
+    iw_list_remove(&s_arenas, &arena->node);
+    pthread_mutex_unlock(&s_arena_lock);
+
+    iw_arena_block *block = arena->blocks;
+    while(block != NULL) {
+        iw_arena_block *next = block->next;
+        INT_FREE(arena->iw_mem_alloc, block);
+        block = next;
+    }
+    arena->blocks     = NULL;
+    arena->num_blocks = 0;
+    arena->reserved   = 0;
+    iw_arena_reset(arena);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_arena_show(FILE *out) {
+    unsigned long reserved = 0, used = 0;
+    unsigned int num = 0, idx;
+
+    // Copy the arenas so that they are printed with the list unlocked, a
+    // slow client mustn't stall the threads creating arenas.
+    pthread_mutex_lock(&s_arena_lock);
+    unsigned int num_arenas = s_arenas.num_elems;
+    iw_arena_info *infos = NULL;
+    if(num_arenas > 0) {
+        infos = (iw_arena_info *)calloc(num_arenas, sizeof(iw_arena_info));
+    }
+    iw_list_node *node;
+    for(node=s_arenas.head;infos != NULL && node != NULL;node=node->next) {
+        iw_arena *arena = (iw_arena *)node;
+        iw_arena_info *info = &infos[num++];
+        snprintf(info->name, sizeof(info->name), "%s", arena->name);
+        info->arena      = arena;
+        info->num_blocks = __atomic_load_n(&arena->num_blocks,
+                                           __ATOMIC_RELAXED);
+        info->reserved   = __atomic_load_n(&arena->reserved, __ATOMIC_RELAXED);
+        info->used       = __atomic_load_n(&arena->used, __ATOMIC_RELAXED);
+        info->high_water = __atomic_load_n(&arena->high_water,
+                                           __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&s_arena_lock);
+
+    fprintf(out, "%-12s %-18s %8s %10s %10s %10s\n",
+            "Name", "Arena", "Blocks", "Reserved", "In use", "Peak");
+    for(idx=0;idx < num;idx++) {
+        iw_arena_info *info = &infos[idx];
+        fprintf(out, "%-12s %-18p %8u %10zu %10zu %10zu\n",
+                info->name, info->arena, info->num_blocks,
+                info->reserved, info->used, info->high_water);
+        reserved += info->reserved;
+        used     += info->used;
+    }
+    fprintf(out, "Arenas: %u, reserved %lu bytes, in use %lu bytes\n",
+            num_arenas, reserved, used);
+    free(infos);
+}
+
+// --------------------------------------------------------------------------
@@ -143,11 +143,23 @@ void iw_cfg_init() {
     ADD_CHAR(DAEMONIZE_OPT, true);
     ADD_NUM(LOGLEVEL, true, NULL, NULL);
     ADD_CHAR(LOGLEVEL_OPT, true);
+    ADD_BOOL(LOG_ASYNC, true);
+    ADD_NUM(LOG_RINGSIZE, true, NULL, NULL);
+    ADD_STR(LOG_OVERFLOW, true, "Must be drop, block or count",
+            "^(drop|block|count)$");
+    ADD_BOOL(LOG_BINARY, true);
+    ADD_NUM(LOG_BINSIZE, true, NULL, NULL);
+    ADD_NUM(LOG_RATE, true, NULL, NULL);
+    ADD_NUM(LOG_BURST, true, NULL, NULL);
+    ADD_BOOL(LOG_DUPLICATES, true);
     ADD_BOOL(ALLOW_QUIT, true);
     ADD_BOOL(CRASHHANDLER_ENABLE, true);
     ADD_STR(CRASHHANDLER_FILE, true, NULL, NULL);
     ADD_BOOL(MEMTRACK_ENABLE, true);
     ADD_NUM(MEMTRACK_SIZE, true, NULL, NULL);
+    ADD_NUM(MEMTRACK_SAMPLE, true, NULL, NULL);
+    ADD_NUM(MEMTRACK_STACKDEPTH, true, NULL, NULL);
+    ADD_NUM(MEMTRACK_SCAN, true, NULL, NULL);
     ADD_BOOL(HEALTHCHECK_ENABLE, true);
     ADD_BOOL(WEBGUI_ENABLE, true);
     ADD_STR(WEBGUI_CSS_FILE, true, NULL, NULL);
@@ -288,8 +300,8 @@ bool iw_cfg_save(const char *file) {
         return false;
     }
 
-    unsigned long token;
-    iw_val *value = iw_val_store_get_first(&iw_cfg, &token);
+    iw_htable_iter iter;
+    iw_val *value = iw_val_store_iter_first(&iw_cfg, &iter);
     while(value != NULL) {
         // If we should not persist the value, then continue to the next.
         bool persist = iw_val_store_get_persist(&iw_cfg, value->name);
@@ -311,7 +323,7 @@ bool iw_cfg_save(const char *file) {
             }
         }
 
-        value = iw_val_store_get_next(&iw_cfg, &token);
+        value = iw_val_store_iter_next(&iter);
     }
 
     JSON_Status status = json_serialize_to_file_pretty(val, iw_cfg_file);
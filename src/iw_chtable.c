@@ -0,0 +1,310 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_chtable.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_chtable.h"
+
+#include "iw_log.h"
+#include "iw_memory.h"
+#include "iw_memory_int.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+//
+// Helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Get the stripe for the given key.
+/// The stripe is selected with a multiplicative hash that is independent of
+/// the slot index used inside each stripe so that the elements of a stripe
+/// still spread out over its slots.
+/// @param table The table to get the stripe from.
+/// @param key_len The length of the key.
+/// @param key The key.
+/// @return The stripe the key belongs to.
+static iw_chtable_stripe *iw_chtable_stripe_get(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key)
+{
+    uint64_t hash = table->fn(key_len, key);
+    hash = (hash ^ (hash >> 29)) * 0xD6E8FEB86659FD93ULL;
+    return &table->stripes[(hash >> 32) & (table->num_stripes - 1)];
+}
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+bool iw_chtable_init(
+    iw_chtable *table,
+    unsigned int num_stripes,
+    unsigned int table_size,
+    bool iw_mem_alloc,
+    IW_HASH_FN hash_fn,
+    unsigned int flags)
+{
+    memset(table, 0, sizeof(*table));
+    if(num_stripes == 0) {
+        num_stripes = IW_CHTABLE_STRIPES;
+    }
+    table->num_stripes = 1;
+    while(table->num_stripes < num_stripes) {
+        table->num_stripes *= 2;
+    }
+    table->iw_mem_alloc = iw_mem_alloc;
+    table->fn           = hash_fn == NULL ? iw_hash_data : hash_fn;
+
+    // Allocate one extra stripe so that the stripes can be aligned.
+    INT_CALLOC(iw_mem_alloc, table->alloc, table->num_stripes + 1,
+               iw_chtable_stripe);
+    if(table->alloc == NULL) {
+        LOG(IW_LOG_IW, "Failed to allocate memory for %u stripes",
+            table->num_stripes);
+        return false;
+    }
+    table->stripes = (iw_chtable_stripe *)(((uintptr_t)table->alloc + 63) &
+                                           ~(uintptr_t)63);
+
+    unsigned int per_stripe = table_size / table->num_stripes + 1;
+    unsigned int cnt;
+    for(cnt=0;cnt < table->num_stripes;cnt++) {
+        iw_chtable_stripe *stripe = &table->stripes[cnt];
+        if(!iw_htable_init_ex(&stripe->table, per_stripe, iw_mem_alloc,
+                              table->fn, flags))
+        {
+            while(cnt-- > 0) {
+                iw_htable_destroy(&table->stripes[cnt].table, NULL);
+                pthread_rwlock_destroy(&table->stripes[cnt].lock);
+            }
+            INT_FREE(iw_mem_alloc, table->alloc);
+            table->alloc   = NULL;
+            table->stripes = NULL;
+            return false;
+        }
+        pthread_rwlock_init(&stripe->lock, NULL);
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_chtable_replace(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key,
+    void *data,
+    IW_HASH_DEL_FN fn)
+{
+    iw_chtable_stripe *stripe = iw_chtable_stripe_get(table, key_len, key);
+    pthread_rwlock_wrlock(&stripe->lock);
+    bool retval = iw_htable_replace(&stripe->table, key_len, key, data, fn);
+    pthread_rwlock_unlock(&stripe->lock);
+    return retval;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_chtable_insert(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key,
+    void *data)
+{
+    return iw_chtable_replace(table, key_len, key, data, NULL);
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_chtable_get(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key)
+{
+    iw_chtable_lock lock;
+    void *data = iw_chtable_get_locked(table, key_len, key, false, &lock);
+    iw_chtable_unlock(&lock);
+    return data;
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_chtable_get_locked(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key,
+    bool write,
+    iw_chtable_lock *lock)
+{
+    iw_chtable_stripe *stripe = iw_chtable_stripe_get(table, key_len, key);
+    if(write) {
+        pthread_rwlock_wrlock(&stripe->lock);
+    } else {
+        pthread_rwlock_rdlock(&stripe->lock);
+    }
+    lock->stripe = stripe;
+    return iw_htable_get(&stripe->table, key_len, key);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_chtable_unlock(iw_chtable_lock *lock) {
+    if(lock->stripe != NULL) {
+        pthread_rwlock_unlock(&lock->stripe->lock);
+        lock->stripe = NULL;
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_chtable_find(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key)
+{
+    iw_chtable_stripe *stripe = iw_chtable_stripe_get(table, key_len, key);
+    return iw_htable_get(&stripe->table, key_len, key);
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_chtable_remove(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key)
+{
+    iw_chtable_stripe *stripe = iw_chtable_stripe_get(table, key_len, key);
+    pthread_rwlock_wrlock(&stripe->lock);
+    void *data = iw_htable_remove(&stripe->table, key_len, key);
+    pthread_rwlock_unlock(&stripe->lock);
+    return data;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_chtable_delete(
+    iw_chtable *table,
+    unsigned int key_len,
+    const void *key,
+    IW_HASH_DEL_FN fn)
+{
+    void *data = iw_chtable_remove(table, key_len, key);
+    if(data != NULL) {
+        if(fn != NULL) {
+            fn(data);
+        }
+        return true;
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_chtable_destroy(iw_chtable *table, IW_HASH_DEL_FN fn) {
+    if(table == NULL || table->stripes == NULL) {
+        return;
+    }
+    unsigned int cnt;
+    for(cnt=0;cnt < table->num_stripes;cnt++) {
+        iw_htable_destroy(&table->stripes[cnt].table, fn);
+        pthread_rwlock_destroy(&table->stripes[cnt].lock);
+    }
+    INT_FREE(table->iw_mem_alloc, table->alloc);
+    table->alloc   = NULL;
+    table->stripes = NULL;
+}
+
+// --------------------------------------------------------------------------
+
+unsigned int iw_chtable_num_elems(iw_chtable *table) {
+    unsigned int cnt, num = 0;
+    for(cnt=0;cnt < table->num_stripes;cnt++) {
+        pthread_rwlock_rdlock(&table->stripes[cnt].lock);
+        num += table->stripes[cnt].table.num_elems;
+        pthread_rwlock_unlock(&table->stripes[cnt].lock);
+    }
+    return num;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_chtable_rdlock_all(iw_chtable *table) {
+    unsigned int cnt;
+    for(cnt=0;cnt < table->num_stripes;cnt++) {
+        pthread_rwlock_rdlock(&table->stripes[cnt].lock);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void iw_chtable_wrlock_all(iw_chtable *table) {
+    unsigned int cnt;
+    for(cnt=0;cnt < table->num_stripes;cnt++) {
+        pthread_rwlock_wrlock(&table->stripes[cnt].lock);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void iw_chtable_unlock_all(iw_chtable *table) {
+    unsigned int cnt = table->num_stripes;
+    while(cnt-- > 0) {
+        pthread_rwlock_unlock(&table->stripes[cnt].lock);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_chtable_iter_first(iw_chtable *table, iw_chtable_iter *iter) {
+    iter->table  = table;
+    iter->stripe = 0;
+    void *data = iw_htable_iter_first(&table->stripes[0].table, &iter->iter);
+    if(data != NULL) {
+        return data;
+    }
+    return iw_chtable_iter_next(iter);
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_chtable_iter_next(iw_chtable_iter *iter) {
+    iw_chtable *table = iter->table;
+    void *data = iw_htable_iter_next(&iter->iter);
+    while(data == NULL && ++iter->stripe < table->num_stripes) {
+        data = iw_htable_iter_first(&table->stripes[iter->stripe].table,
+                                    &iter->iter);
+    }
+    return data;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_chtable_report(iw_chtable *table, FILE *out) {
+    unsigned int cnt, num = 0, min = ~0U, max = 0;
+    for(cnt=0;cnt < table->num_stripes;cnt++) {
+        pthread_rwlock_rdlock(&table->stripes[cnt].lock);
+        unsigned int elems = table->stripes[cnt].table.num_elems;
+        pthread_rwlock_unlock(&table->stripes[cnt].lock);
+        num += elems;
+        min = elems < min ? elems : min;
+        max = elems > max ? elems : max;
+    }
+    fprintf(out, " v-- Concurrent Hash Table 0x%p --v\n", table);
+    fprintf(out, "   Number of Elements:   %u\n", num);
+    fprintf(out, "   Number of Stripes:    %u\n", table->num_stripes);
+    fprintf(out, "   Stripe Elements:      %u-%u\n", min, max);
+    fprintf(out, " ^-- Concurrent Hash Table 0x%p --^\n", table);
+}
+
+// --------------------------------------------------------------------------
@@ -15,6 +15,7 @@
 #include "iw_common.h"
 #include "iw_ip.h"
 #include "iw_log.h"
+#include "iw_memory.h"
 #include "iw_thread_int.h"
 #include "iw_thread.h"
 
@@ -140,6 +141,7 @@ static void *iw_cmd_srv_thread(void *param) {
     UNUSED(param);
 
     int retval;
+    iw_memory_tag_set(iw_memory_tag_register("CMD Server"));
 
     // Entering command server loop.
     LOG(IW_LOG_IW, "Entering command server loop");
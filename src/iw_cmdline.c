@@ -150,12 +150,12 @@ IW_CMD_OPT_RET iw_cmdline_process(int *processed, int argc, char **argv) {
 
     // Start with clearing all option values. This may be needed if the
     // iw_cmdline_process() function is called multiple times.
-    unsigned long hash;
-    iw_opt_info *opt_info = (iw_opt_info *)iw_htable_get_first(&s_options, &hash);
+    iw_htable_iter iter;
+    iw_opt_info *opt_info = (iw_opt_info *)iw_htable_iter_first(&s_options, &iter);
     while(opt_info != NULL) {
         opt_info->opt->is_set = false;
         memset(&(opt_info->opt->val), 0, sizeof(opt_info->opt->val));
-        opt_info = (iw_opt_info *)iw_htable_get_next(&s_options, &hash);
+        opt_info = (iw_opt_info *)iw_htable_iter_next(&iter);
     }
 
     for(;*processed < argc;(*processed)++) {
@@ -234,12 +234,12 @@ IW_CMD_OPT_RET iw_cmdline_process(int *processed, int argc, char **argv) {
 
     // Check for mandatory options. Make sure that all mandatory options
     // actually were set.
-    opt_info = (iw_opt_info *)iw_htable_get_first(&s_options, &hash);
+    opt_info = (iw_opt_info *)iw_htable_iter_first(&s_options, &iter);
     while(opt_info != NULL) {
         if(opt_info->mandatory && !opt_info->opt->is_set) {
             return IW_CMD_OPT_INVALID;
         }
-        opt_info = (iw_opt_info *)iw_htable_get_next(&s_options, &hash);
+        opt_info = (iw_opt_info *)iw_htable_iter_next(&iter);
     }
 
 
@@ -293,9 +293,9 @@ void iw_cmdline_exit() {
 // --------------------------------------------------------------------------
 
 void iw_cmdline_print_help() {
-    unsigned long hash;
-    iw_opt_info *opt_info = (iw_opt_info *)iw_htable_get_first(&s_options,
-                                                               &hash);
+    iw_htable_iter iter;
+    iw_opt_info *opt_info = (iw_opt_info *)iw_htable_iter_first(&s_options,
+                                                                &iter);
     while(opt_info != NULL) {
         if(opt_info->help_fn != NULL) {
             opt_info->help_fn(opt_info->option);
@@ -306,7 +306,7 @@ void iw_cmdline_print_help() {
                    iw_cmdline_print_type(opt_info->opt->type),
                    opt_info->help);
         }
-        opt_info = (iw_opt_info *)iw_htable_get_next(&s_options, &hash);
+        opt_info = (iw_opt_info *)iw_htable_iter_next(&iter);
     }
 }
 
@@ -19,6 +19,8 @@
 #include "iw_main.h"
 #include "iw_memory_int.h"
 #include "iw_mutex_int.h"
+#include "iw_pool.h"
+#include "iw_slab.h"
 #include "iw_syslog.h"
 #include "iw_thread_int.h"
 #include "iw_util.h"
@@ -109,7 +111,7 @@ static void iw_cmds_help(FILE *out, iw_cmd_info *cinfo, const char *unknown) {
 /// @param parent The name of the parent command.
 /// @return The command info structure of the parent command.
 static iw_cmd_info *iw_cmd_find_parent(iw_htable *table, const char *parent) {
-    unsigned long hash;
+    iw_htable_iter iter;
 
     // First try to access the hash table to see if this node contains
     // the parent. If it does, we don't have to search further.
@@ -123,7 +125,7 @@ static iw_cmd_info *iw_cmd_find_parent(iw_htable *table, const char *parent) {
     // It didn't contain the parent. Now we need to traverse the
     // hierarchy from here. Iterate through all children to find the
     // parent node for this command.
-    cinfo = (iw_cmd_info *)iw_htable_get_first(table, &hash);
+    cinfo = (iw_cmd_info *)iw_htable_iter_first(table, &iter);
     while(cinfo != NULL) {
         // Search through the children as well.
         iw_cmd_info *retval = iw_cmd_find_parent(&cinfo->children, parent);
@@ -132,7 +134,7 @@ static iw_cmd_info *iw_cmd_find_parent(iw_htable *table, const char *parent) {
         }
 
         // Continue to check the next node in the hash table.
-        cinfo = (iw_cmd_info *)iw_htable_get_next(table, &hash);
+        cinfo = (iw_cmd_info *)iw_htable_iter_next(&iter);
     }
 
     // Failed to find the parent.
@@ -254,6 +256,112 @@ static bool cmd_memory_brief(FILE *out, const char *cmd, iw_cmd_parse_info *info
 
 // --------------------------------------------------------------------------
 
+static bool cmd_memory_profile(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+    UNUSED(info);
+
+    iw_memory_profile(out);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_memory_pprof(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+    UNUSED(info);
+
+    if(!iw_memory_pprof(out)) {
+        fprintf(out, "Memory tracking is disabled.\n");
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_memory_snapshot(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+
+    char *name = iw_cmd_get_token(info);
+    if(name == NULL) {
+        iw_memory_snapshots(out);
+        return true;
+    }
+    if(!iw_memory_snapshot(name)) {
+        fprintf(out, "Failed to take heap snapshot '%s'.\n", name);
+        return false;
+    }
+    fprintf(out, "Heap snapshot '%s' taken.\n", name);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_memory_diff(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+
+    char *from = iw_cmd_get_token(info);
+    char *to = iw_cmd_get_token(info);
+    if(from == NULL) {
+        fprintf(out, "\nMissing parameter\n");
+        return false;
+    }
+    return iw_memory_diff(out, from, to);
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_memory_tags(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+    UNUSED(info);
+
+    iw_memory_tags(out);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_memory_scan(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+    UNUSED(info);
+
+    // Allow the scan plenty of time to check all chunks.
+    unsigned int found = iw_memory_scan(1000000);
+    fprintf(out, "Found %u corrupted memory chunks.\n", found);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_memory_histogram(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+    UNUSED(info);
+
+    iw_memory_histogram(out);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_memory_pools(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+    UNUSED(info);
+
+    iw_pool_show(out);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_memory_slabs(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+    UNUSED(info);
+
+    iw_slab_show(out);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
 static bool cmd_syslog_dump(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
     UNUSED(cmd);
     UNUSED(info);
@@ -440,6 +548,108 @@ static bool cmd_log_thread(FILE *out, const char *cmd, iw_cmd_parse_info *info)
 
 // --------------------------------------------------------------------------
 
+static void cmd_log_site_help(FILE *out) {
+    fprintf(out,
+            "\n"
+            "Usage: log site <list|on|off> [file=<glob>] [func=<glob>] [line=<from>[-<to>]]\n"
+            " Lists, enables or disables the log call sites selected by the filters. A call site\n"
+            " is selected if it matches all filters given, or any site if no filter is given.\n"
+            " The file glob is matched against both the path and the name of the file. Messages\n"
+            " from a disabled call site aren't logged whatever the log level.\n"
+            "\n"
+            "Examples:\n"
+            " $ %s log site off\n"
+            "followed by\n"
+            " $ %s log site on file=iw_web_srv.c line=100-200\n"
+            "or\n"
+            " $ %s log site on func=iw_web_*\n"
+            "\n",
+            iw_val_store_get_string(&iw_cfg, IW_CFG_PRG_NAME),
+            iw_val_store_get_string(&iw_cfg, IW_CFG_PRG_NAME),
+            iw_val_store_get_string(&iw_cfg, IW_CFG_PRG_NAME));
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_log_site(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+
+    char *action = iw_cmd_get_token(info);
+    if(action == NULL ||
+       (strcmp(action, "list") != 0 && strcmp(action, "on") != 0 &&
+        strcmp(action, "off") != 0))
+    {
+        fprintf(out, "\nMissing or invalid parameter\n");
+        cmd_log_site_help(out);
+        return false;
+    }
+
+    iw_log_site_filter filter = { NULL, NULL, 0, 0 };
+    char *token;
+    while((token = iw_cmd_get_token(info)) != NULL) {
+        long long int from, to = 0;
+        char *dash;
+        if(strncmp(token, "file=", 5) == 0) {
+            filter.file = token + 5;
+        } else if(strncmp(token, "func=", 5) == 0) {
+            filter.func = token + 5;
+        } else if(strncmp(token, "line=", 5) == 0) {
+            dash = strchr(token + 5, '-');
+            if(dash != NULL) {
+                *dash = '\0';
+            }
+            if(!iw_util_strtoll(token + 5, &from, 10) || from <= 0 ||
+               (dash != NULL && (!iw_util_strtoll(dash + 1, &to, 10) ||
+                                 to < from)))
+            {
+                fprintf(out, "\nInvalid line range\n");
+                cmd_log_site_help(out);
+                return false;
+            }
+            filter.line_from = from;
+            filter.line_to   = dash != NULL ? to : from;
+        } else {
+            fprintf(out, "\nInvalid filter \"%s\"\n", token);
+            cmd_log_site_help(out);
+            return false;
+        }
+    }
+
+    if(strcmp(action, "list") == 0) {
+        iw_log_site_list(out, &filter);
+    } else {
+        unsigned int cnt = iw_log_site_enable(&filter, strcmp(action, "on") == 0);
+        fprintf(out, "%s %u call sites\n",
+                strcmp(action, "on") == 0 ? "Enabled" : "Disabled", cnt);
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_log_stats(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+    UNUSED(info);
+    iw_log_show_stats(out);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+static bool cmd_log_dump(FILE *out, const char *cmd, iw_cmd_parse_info *info) {
+    UNUSED(cmd);
+    char *file = iw_cmd_get_token(info);
+    if(file == NULL) {
+        iw_log_bin_dump(out);
+    } else if(!iw_log_bin_save(file)) {
+        fprintf(out, "\nFailed to save the binary log to \"%s\"\n", file);
+        return false;
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
 void iw_cmds_delete(void *cmd) {
     iw_cmd_info *cinfo = (iw_cmd_info *)cmd;
 
@@ -480,6 +690,18 @@ bool iw_cmd_init() {
             "Set the program log level", "Enables debug log output with the given log level.");
     iw_cmd_add("log", "thread", cmd_log_thread,
             "Enables or disables logging for threads", "Enables or disables logging for individual threads.");
+    iw_cmd_add("log", "site", cmd_log_site,
+            "Enables or disables log call sites",
+            "Lists, enables or disables individual log call sites by file, function and line.");
+    iw_cmd_add("log", "stats", cmd_log_stats,
+            "Display asynchronous logging statistics",
+            "Displays the number of log messages queued, written and dropped by the asynchronous\n"
+            "log writer, how they were batched, and how long messages waited to be written.");
+    iw_cmd_add("log", "dump", cmd_log_dump,
+            "Display or save the binary log",
+            "Usage: log dump [file]\n"
+            "Formats the messages recorded in the binary log, oldest first. If a file is given,\n"
+            "the binary log is saved to the file instead, to be formatted with iw_logdecode.");
     iw_cmd_add(NULL, "memory", NULL,
             "Display memory information", "Displays the memory allocated by the process.");
     iw_cmd_add("memory", "show", cmd_memory_show,
@@ -491,6 +713,48 @@ bool iw_cmd_init() {
     iw_cmd_add("memory", "brief", cmd_memory_brief,
             "Display a brief summary of allocations",
             "Displays the top number of places where memory was allocated by the process.");
+    iw_cmd_add("memory", "profile", cmd_memory_profile,
+            "Display the estimated live heap by allocation site",
+            "Displays the live heap by allocation site and backtrace. If allocations are\n"
+            "sampled, each sample is scaled up to estimate the allocations it represents.");
+    iw_cmd_add("memory", "pprof", cmd_memory_pprof,
+            "Write the live heap as a pprof heap profile",
+            "Writes the live heap by allocation site and call-stack in a format that pprof\n"
+            "can load, e.g. 'pprof --text <program> <file>'. Set cfg.memtrack.stackdepth\n"
+            "to record call-stacks. The profile is also served by the web GUI at /pprof/heap.");
+    iw_cmd_add("memory", "snapshot", cmd_memory_snapshot,
+            "Take a named snapshot of the live heap",
+            "Records the live allocations and bytes of each allocation site under the\n"
+            "given name, e.g. 'memory snapshot before'. Lists the snapshots taken if\n"
+            "no name is given.");
+    iw_cmd_add("memory", "diff", cmd_memory_diff,
+            "Display the heap growth between two snapshots",
+            "Displays the allocation sites whose live bytes grew between two snapshots,\n"
+            "largest growth first, e.g. 'memory diff before after'. The live heap is used\n"
+            "if no second snapshot is given.");
+    iw_cmd_add("memory", "tags", cmd_memory_tags,
+            "Display the memory use of each memory tag",
+            "Displays the outstanding allocations and the current and peak bytes of the\n"
+            "memory allocated while each memory tag was set.");
+    iw_cmd_add("memory", "scan", cmd_memory_scan,
+            "Scan memory for guard corruption",
+            "Checks the cookie and guards of the tracked memory chunks and logs the\n"
+            "allocation site of each newly corrupted chunk. The scan continues where the\n"
+            "background scan of the health thread stopped.");
+    iw_cmd_add("memory", "histogram", cmd_memory_histogram,
+            "Display allocations by size class",
+            "Displays the live allocations, allocation and free rates and the average\n"
+            "lifetime of freed memory for each power-of-two size class. The rates are\n"
+            "per second over the last health check interval, along with the peak rate.");
+    iw_cmd_add("memory", "pools", cmd_memory_pools,
+            "Display object pool statistics",
+            "Displays the blocks, objects, allocations, objects in use and objects cached\n"
+            "by threads or kept in the depot of each object pool, along with the number\n"
+            "of times the thread caches were refilled from or flushed to the depot.");
+    iw_cmd_add("memory", "slabs", cmd_memory_slabs,
+            "Display node slab occupancy",
+            "Displays the blocks and nodes used by the slabs of hash tables and lists\n"
+            "created with the node pool flag.");
     iw_cmd_add(NULL, "syslog", NULL,
             "Execute a syslog related command", "Commands related to syslogs.");
     iw_cmd_add("syslog", "show", cmd_syslog_dump,
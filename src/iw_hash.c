@@ -2,13 +2,161 @@
 ///
 /// @file iw_hash.c
 ///
-/// Using hash function written by Dan Bernstein.
+/// A family of hash functions. The word-at-a-time hash follows the structure
+/// of xxHash64 by Yann Collet, the integer mixer is the MurmurHash3 64-bit
+/// finalizer by Austin Appleby and the seeded hash is SipHash-1-3 by
+/// Jean-Philippe Aumasson and Daniel J. Bernstein. The djb2 hash was written
+/// by Dan Bernstein.
 ///
 // --------------------------------------------------------------------------
 
 #include "iw_hash.h"
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------
+//
+// Defines
+//
+// --------------------------------------------------------------------------
+
+/// The primes used by the word-at-a-time hash.
+#define IW_HASH_PRIME1  0x9E3779B185EBCA87ULL
+#define IW_HASH_PRIME2  0xC2B2AE3D27D4EB4FULL
+#define IW_HASH_PRIME3  0x165667B19E3779F9ULL
+#define IW_HASH_PRIME4  0x85EBCA77C2B2AE63ULL
+#define IW_HASH_PRIME5  0x27D4EB2F165667C5ULL
+
+/// Rotate a 64-bit value left.
+#define ROTL64(x,r)     (((x) << (r)) | ((x) >> (64 - (r))))
+
+// --------------------------------------------------------------------------
+//
+// Global variables
+//
+// --------------------------------------------------------------------------
+
+/// The seed of the seeded hash.
+static uint64_t s_seed[2];
+
+/// True if the seed has been set.
+static volatile bool s_seed_set = false;
+
+/// Makes sure the seed is only initialized once.
+static pthread_once_t s_seed_once = PTHREAD_ONCE_INIT;
+
+/// The names of the hash algorithms.
+static const char *s_alg_names[IW_HASH_ALG_NUM] = {
+    "word", "int", "seeded", "djb2"
+};
+
+/// The hash functions of the hash algorithms.
+static const IW_HASH_FN s_alg_fns[IW_HASH_ALG_NUM] = {
+    iw_hash_word, iw_hash_int, iw_hash_seeded, iw_hash_djb2
+};
+
+// --------------------------------------------------------------------------
+//
+// Helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Read an unaligned 64-bit word.
+/// @param ptr The data to read from.
+/// @return The word read.
+static inline uint64_t iw_hash_read64(const unsigned char *ptr) {
+    uint64_t val;
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Read an unaligned 32-bit word.
+/// @param ptr The data to read from.
+/// @return The word read.
+static inline uint32_t iw_hash_read32(const unsigned char *ptr) {
+    uint32_t val;
+    memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Mix one word into a lane of the word-at-a-time hash.
+/// @param acc The lane accumulator.
+/// @param input The word to mix in.
+/// @return The new lane accumulator.
+static inline uint64_t iw_hash_round(uint64_t acc, uint64_t input) {
+    acc += input * IW_HASH_PRIME2;
+    acc  = ROTL64(acc, 31);
+    return acc * IW_HASH_PRIME1;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Merge a lane into the word-at-a-time hash.
+/// @param hash The hash value.
+/// @param lane The lane accumulator.
+/// @return The new hash value.
+static inline uint64_t iw_hash_merge(uint64_t hash, uint64_t lane) {
+    hash ^= iw_hash_round(0, lane);
+    return hash * IW_HASH_PRIME1 + IW_HASH_PRIME4;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Mix all bits of a 64-bit value.
+/// @param val The value to mix.
+/// @return The mixed value.
+static inline uint64_t iw_hash_fmix64(uint64_t val) {
+    val ^= val >> 33;
+    val *= 0xFF51AFD7ED558CCDULL;
+    val ^= val >> 33;
+    val *= 0xC4CEB9FE1A85EC53ULL;
+    val ^= val >> 33;
+    return val;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Initialize the seed of the seeded hash from the random source.
+/// Falls back to the time, process ID and stack address if the random source
+/// can't be read.
+static void iw_hash_seed_init() {
+    if(s_seed_set) {
+        return;
+    }
+    bool seeded = false;
+    int fd = open("/dev/urandom", O_RDONLY);
+    if(fd >= 0) {
+        seeded = read(fd, s_seed, sizeof(s_seed)) == sizeof(s_seed);
+        close(fd);
+    }
+    if(!seeded) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        s_seed[0] = iw_hash_fmix64((uint64_t)ts.tv_sec ^ ((uint64_t)ts.tv_nsec << 32));
+        s_seed[1] = iw_hash_fmix64((uint64_t)getpid() ^ (uint64_t)(uintptr_t)&ts);
+    }
+    s_seed_set = true;
+}
+
+// --------------------------------------------------------------------------
+
+/// One SipHash round.
+#define SIPROUND(v0,v1,v2,v3) \
+    do { \
+        v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32); \
+        v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2; \
+        v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0; \
+        v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32); \
+    } while(0)
 
 // --------------------------------------------------------------------------
 //
@@ -17,6 +165,146 @@
 // --------------------------------------------------------------------------
 
 unsigned long iw_hash_data(unsigned int len, const void *data) {
+    return iw_hash_word(len, data);
+}
+
+// --------------------------------------------------------------------------
+
+unsigned long iw_hash_word(unsigned int len, const void *data) {
+    const unsigned char *ptr = data;
+    const unsigned char *end = ptr + len;
+    uint64_t hash;
+
+    if(data == NULL) {
+        return 0;
+    }
+
+    if(len >= 32) {
+        // Four independent lanes so the multiplications can overlap.
+        const unsigned char *limit = end - 32;
+        uint64_t v1 = IW_HASH_PRIME1 + IW_HASH_PRIME2;
+        uint64_t v2 = IW_HASH_PRIME2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -IW_HASH_PRIME1;
+        do {
+            v1 = iw_hash_round(v1, iw_hash_read64(ptr));
+            v2 = iw_hash_round(v2, iw_hash_read64(ptr + 8));
+            v3 = iw_hash_round(v3, iw_hash_read64(ptr + 16));
+            v4 = iw_hash_round(v4, iw_hash_read64(ptr + 24));
+            ptr += 32;
+        } while(ptr <= limit);
+        hash = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        hash = iw_hash_merge(hash, v1);
+        hash = iw_hash_merge(hash, v2);
+        hash = iw_hash_merge(hash, v3);
+        hash = iw_hash_merge(hash, v4);
+    } else {
+        hash = IW_HASH_PRIME5;
+    }
+    hash += len;
+
+    while(ptr + 8 <= end) {
+        hash ^= iw_hash_round(0, iw_hash_read64(ptr));
+        hash  = ROTL64(hash, 27) * IW_HASH_PRIME1 + IW_HASH_PRIME4;
+        ptr  += 8;
+    }
+    if(ptr + 4 <= end) {
+        hash ^= (uint64_t)iw_hash_read32(ptr) * IW_HASH_PRIME1;
+        hash  = ROTL64(hash, 23) * IW_HASH_PRIME2 + IW_HASH_PRIME3;
+        ptr  += 4;
+    }
+    while(ptr < end) {
+        hash ^= *ptr++ * IW_HASH_PRIME5;
+        hash  = ROTL64(hash, 11) * IW_HASH_PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= IW_HASH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= IW_HASH_PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// --------------------------------------------------------------------------
+
+unsigned long iw_hash_int(unsigned int len, const void *data) {
+    uint64_t val = 0;
+
+    if(data == NULL) {
+        return 0;
+    }
+    if(len > sizeof(val)) {
+        return iw_hash_word(len, data);
+    }
+    memcpy(&val, data, len);
+    return iw_hash_fmix64(val ^ ((uint64_t)len << 59));
+}
+
+// --------------------------------------------------------------------------
+
+unsigned long iw_hash_seeded(unsigned int len, const void *data) {
+    if(data == NULL) {
+        return 0;
+    }
+    pthread_once(&s_seed_once, iw_hash_seed_init);
+    return iw_hash_keyed(s_seed[0], s_seed[1], len, data);
+}
+
+// --------------------------------------------------------------------------
+
+unsigned long iw_hash_keyed(
+    uint64_t k0,
+    uint64_t k1,
+    unsigned int len,
+    const void *data)
+{
+    const unsigned char *ptr = data;
+    const unsigned char *end = ptr + (len & ~7U);
+    uint64_t v0, v1, v2, v3, word;
+
+    if(data == NULL) {
+        return 0;
+    }
+
+    v0 = k0 ^ 0x736F6D6570736575ULL;
+    v1 = k1 ^ 0x646F72616E646F6DULL;
+    v2 = k0 ^ 0x6C7967656E657261ULL;
+    v3 = k1 ^ 0x7465646279746573ULL;
+
+    for(;ptr != end;ptr += 8) {
+        word = iw_hash_read64(ptr);
+        v3 ^= word;
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= word;
+    }
+
+    // The last word holds the remaining bytes and the length.
+    word = (uint64_t)len << 56;
+    switch(len & 7) {
+    case 7: word |= (uint64_t)ptr[6] << 48; // fall through
+    case 6: word |= (uint64_t)ptr[5] << 40; // fall through
+    case 5: word |= (uint64_t)ptr[4] << 32; // fall through
+    case 4: word |= (uint64_t)ptr[3] << 24; // fall through
+    case 3: word |= (uint64_t)ptr[2] << 16; // fall through
+    case 2: word |= (uint64_t)ptr[1] << 8;  // fall through
+    case 1: word |= (uint64_t)ptr[0];       break;
+    default: break;
+    }
+    v3 ^= word;
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= word;
+
+    v2 ^= 0xFF;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// --------------------------------------------------------------------------
+
+unsigned long iw_hash_djb2(unsigned int len, const void *data) {
     unsigned long hash = 5381;
     unsigned int c, cnt;
     const unsigned char *ptr = data;
@@ -34,3 +322,42 @@ unsigned long iw_hash_data(unsigned int len, const void *data) {
 }
 
 // --------------------------------------------------------------------------
+
+void iw_hash_set_seed(uint64_t k0, uint64_t k1) {
+    s_seed[0]  = k0;
+    s_seed[1]  = k1;
+    s_seed_set = true;
+}
+
+// --------------------------------------------------------------------------
+
+IW_HASH_FN iw_hash_get_fn(IW_HASH_ALG alg) {
+    if(alg < 0 || alg >= IW_HASH_ALG_NUM) {
+        return NULL;
+    }
+    return s_alg_fns[alg];
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_hash_get_alg(const char *name, IW_HASH_ALG *alg) {
+    int cnt;
+    for(cnt=0;cnt < IW_HASH_ALG_NUM;cnt++) {
+        if(strcmp(name, s_alg_names[cnt]) == 0) {
+            *alg = (IW_HASH_ALG)cnt;
+            return true;
+        }
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------
+
+const char *iw_hash_alg_name(IW_HASH_ALG alg) {
+    if(alg < 0 || alg >= IW_HASH_ALG_NUM) {
+        return "unknown";
+    }
+    return s_alg_names[alg];
+}
+
+// --------------------------------------------------------------------------
@@ -13,6 +13,7 @@
 #include "iw_cfg.h"
 #include "iw_common.h"
 #include "iw_log.h"
+#include "iw_memory_int.h"
 #include "iw_thread_int.h"
 #include "iw_thread.h"
 
@@ -39,6 +40,8 @@ static bool s_health_go = true;
 
 static void *iw_health_thread(__attribute__((unused)) void *param) {
     UNUSED(param);
+    int *scan = iw_val_store_get_number(&iw_cfg, IW_CFG_MEMTRACK_SCAN);
+    unsigned long budget = scan != NULL && *scan > 0 ? *scan : 0;
 
     while(s_health_go) {
         if(iw_thread_deadlock_check(false)) {
@@ -47,6 +50,10 @@ static void *iw_health_thread(__attribute__((unused)) void *param) {
 
             return NULL;
         }
+        if(budget != 0) {
+            iw_memory_scan(budget);
+        }
+        iw_memory_hist_tick();
         sleep(1);
     }
     return NULL;
@@ -2,6 +2,21 @@
 ///
 /// @file iw_htable.c
 ///
+/// The hash table can be laid out in two ways. By default an open addressing
+/// table with linear probing is used. The hash and data of each element is
+/// stored inline in a slot array which grows when the load factor is
+/// exceeded. Growing the table does not rehash all elements at once, the old
+/// slot array is kept and a few slots are moved to the new array on every
+/// insert until the old array is empty.
+///
+/// If the IW_HTABLE_FLAG_CHAINED flag is given, a fixed number of buckets is
+/// used with a list of allocated nodes in each bucket.
+///
+/// If the IW_HTABLE_FLAG_KEYS flag is given, a copy of each key is kept next
+/// to the cached hash, in a key array parallel to the slot array or in the
+/// allocated node. The cached hash is compared first so the key only has to
+/// be compared when the hashes match.
+///
 /// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
 /// This source is distributed under the license in LICENSE.txt in the top
 /// InstaWorks directory.
@@ -13,6 +28,778 @@
 #include "iw_log.h"
 #include "iw_memory.h"
 #include "iw_memory_int.h"
+#include "iw_slab.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+//
+// Defines
+//
+// --------------------------------------------------------------------------
+
+/// The slot hash value for an unused slot.
+#define IW_HASH_SLOT_EMPTY      0
+
+/// The slot hash value for a slot whose element has been removed.
+#define IW_HASH_SLOT_DELETED    1
+
+/// The lowest slot hash value used for elements.
+#define IW_HASH_SLOT_USED       2
+
+/// The smallest slot array to allocate.
+#define IW_HTABLE_MIN_SLOTS     8
+
+/// The number of old slots to rehash for each insert during a rehash.
+#define IW_HTABLE_MIGRATE_STEP  8
+
+/// True if the given table uses separate chaining.
+#define IS_CHAINED(t)           ((t)->flags & IW_HTABLE_FLAG_CHAINED)
+
+/// True if the given table stores the keys of the elements.
+#define IS_KEYS(t)              ((t)->flags & IW_HTABLE_FLAG_KEYS)
+
+// --------------------------------------------------------------------------
+//
+// Typedefs
+//
+// --------------------------------------------------------------------------
+
+/// @brief A chained hash table node with a copy of the key.
+/// Allocated instead of a plain node by tables storing keys.
+typedef struct _iw_hash_key_node {
+    iw_hash_node node;          ///< The hash table node, must be first.
+    iw_hash_key  key;           ///< The key of the element.
+} iw_hash_key_node;
+
+// --------------------------------------------------------------------------
+//
+// Key helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Get the bytes of a stored key.
+/// @param hkey The stored key.
+/// @return A pointer to the key bytes.
+static const void *iw_htable_key_data(const iw_hash_key *hkey) {
+    return hkey->len > IW_HASH_KEY_INLINE ? hkey->k.ptr : hkey->k.buff;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Check whether a stored key is equal to the given key.
+/// @param hkey The stored key.
+/// @param key_len The length of the key to compare with.
+/// @param key The key to compare with.
+/// @return True if the keys are equal.
+static bool iw_htable_key_equal(
+    const iw_hash_key *hkey,
+    unsigned int key_len,
+    const void *key)
+{
+    return hkey->len == key_len &&
+           (key_len == 0 ||
+            memcmp(iw_htable_key_data(hkey), key, key_len) == 0);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Store a copy of a key.
+/// @param table The table the key is stored for.
+/// @param hkey [out] The stored key.
+/// @param key_len The length of the key.
+/// @param key The key to copy.
+/// @return True if the key was successfully stored.
+static bool iw_htable_key_set(
+    iw_htable *table,
+    iw_hash_key *hkey,
+    unsigned int key_len,
+    const void *key)
+{
+    hkey->len = key_len;
+    if(key_len <= IW_HASH_KEY_INLINE) {
+        if(key_len > 0) {
+            memcpy(hkey->k.buff, key, key_len);
+        }
+        return true;
+    }
+    unsigned char *copy;
+    INT_CALLOC(table->iw_mem_alloc, copy, key_len, unsigned char);
+    if(copy == NULL) {
+        LOG(IW_LOG_IW, "Failed to allocate memory for key length=%u", key_len);
+        hkey->len = 0;
+        return false;
+    }
+    memcpy(copy, key, key_len);
+    hkey->k.ptr = copy;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Free a stored key.
+/// @param table The table the key was stored for.
+/// @param hkey The stored key to free.
+static void iw_htable_key_free(iw_htable *table, iw_hash_key *hkey) {
+    if(hkey->len > IW_HASH_KEY_INLINE) {
+        INT_FREE(table->iw_mem_alloc, hkey->k.ptr);
+    }
+    hkey->len = 0;
+}
+
+// --------------------------------------------------------------------------
+//
+// Open addressing helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Convert a hash to the value stored in a slot.
+/// The two lowest values are reserved to mark empty and deleted slots.
+/// @param hash The hash to convert.
+/// @return The slot hash value.
+static unsigned long iw_htable_slot_hash(unsigned long hash) {
+    return hash < IW_HASH_SLOT_USED ? hash + IW_HASH_SLOT_USED : hash;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the home slot index for a hash.
+/// Uses Fibonacci hashing, the hash is multiplied with the golden ratio and
+/// the top bits are used so that hash functions with poor low-order bits
+/// still spread out over the power-of-two slot array.
+/// @param hash The slot hash value.
+/// @param size The size of the slot array, must be a power of two.
+/// @return The index of the first slot to probe.
+static unsigned int iw_htable_slot_index(unsigned long hash, unsigned int size) {
+    uint64_t mixed = (uint64_t)hash * 0x9E3779B97F4A7C15ULL;
+    return (unsigned int)(mixed >> (64 - __builtin_ctz(size)));
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Find the slot containing the given hash and key.
+/// @param slots The slot array to search.
+/// @param keys The key array of the slot array or NULL if keys aren't stored.
+/// @param size The size of the slot array.
+/// @param hash The slot hash value to find.
+/// @param key_len The length of the key to find.
+/// @param key The key to find, only compared if \p keys is given.
+/// @return The slot containing the hash or NULL if no match was found.
+static iw_hash_slot *iw_htable_slot_find(
+    iw_hash_slot *slots,
+    iw_hash_key *keys,
+    unsigned int size,
+    unsigned long hash,
+    unsigned int key_len,
+    const void *key)
+{
+    if(slots == NULL) {
+        return NULL;
+    }
+    unsigned int index = iw_htable_slot_index(hash, size);
+    unsigned int probes;
+    for(probes=0;probes < size;probes++) {
+        iw_hash_slot *slot = &slots[index];
+        if(slot->hash == hash &&
+           (keys == NULL || iw_htable_key_equal(&keys[index], key_len, key)))
+        {
+            return slot;
+        }
+        if(slot->hash == IW_HASH_SLOT_EMPTY) {
+            return NULL;
+        }
+        index = (index + 1) & (size - 1);
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Check whether the element in the given slot is out of place.
+/// @param slots The slot array the slot is in.
+/// @param size The size of the slot array.
+/// @param slot The slot to check.
+/// @return True if the element is not stored in its home slot.
+static bool iw_htable_slot_collided(
+    iw_hash_slot *slots,
+    unsigned int size,
+    iw_hash_slot *slot)
+{
+    return iw_htable_slot_index(slot->hash, size) != (unsigned int)(slot - slots);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Store an element in the current slot array.
+/// The element must not already be present in the table.
+/// @param table The table to store the element in.
+/// @param hash The slot hash value of the element.
+/// @param data The data of the element.
+/// @param hkey The stored key of the element if the table stores keys.
+static void iw_htable_slot_store(
+    iw_htable *table,
+    unsigned long hash,
+    void *data,
+    const iw_hash_key *hkey)
+{
+    unsigned int index = iw_htable_slot_index(hash, table->size);
+    unsigned int home  = index;
+    while(table->slots[index].hash >= IW_HASH_SLOT_USED) {
+        index = (index + 1) & (table->size - 1);
+    }
+    if(table->slots[index].hash == IW_HASH_SLOT_DELETED) {
+        table->deleted--;
+    }
+    table->slots[index].hash = hash;
+    table->slots[index].data = data;
+    if(table->keys != NULL) {
+        table->keys[index] = *hkey;
+    }
+    if(index != home) {
+        table->collisions++;
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Move elements from the old slot array to the current one.
+/// The old slot array is processed one cluster of used slots at a time,
+/// starting at an empty slot. Since a probe sequence never crosses an empty
+/// slot, a fully migrated cluster can be cleared without breaking the probe
+/// sequence of the elements that remain. This keeps lookups in the old slot
+/// array short while the rehash is in progress.
+/// @param table The table to rehash.
+/// @param count The number of old slots to process, the current cluster is
+/// always completed even if this count is exceeded.
+static void iw_htable_slot_migrate(iw_htable *table, unsigned int count) {
+    bool in_cluster = false;
+    while(table->old_slots != NULL && table->old_elems > 0 &&
+          (count > 0 || in_cluster))
+    {
+        iw_hash_slot *slot = &table->old_slots[table->migrated];
+        if(slot->hash >= IW_HASH_SLOT_USED) {
+            if(iw_htable_slot_collided(table->old_slots, table->old_size, slot)) {
+                table->collisions--;
+            }
+            iw_htable_slot_store(table, slot->hash, slot->data,
+                                 table->old_keys != NULL ?
+                                     &table->old_keys[table->migrated] : NULL);
+            if(table->old_keys != NULL) {
+                // The key now belongs to the current key array.
+                table->old_keys[table->migrated].len = 0;
+            }
+            table->old_elems--;
+        }
+        in_cluster = slot->hash != IW_HASH_SLOT_EMPTY;
+        slot->hash = IW_HASH_SLOT_EMPTY;
+        table->migrated = (table->migrated + 1) & (table->old_size - 1);
+        if(count > 0) {
+            count--;
+        }
+    }
+    if(table->old_slots != NULL && table->old_elems == 0) {
+        INT_FREE(table->iw_mem_alloc, table->old_slots);
+        if(table->old_keys != NULL) {
+            INT_FREE(table->iw_mem_alloc, table->old_keys);
+        }
+        table->old_slots = NULL;
+        table->old_keys  = NULL;
+        table->old_size  = 0;
+        table->migrated  = 0;
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Make sure there is room for one more element in the slot array.
+/// Starts a new rehash if the load factor would be exceeded. If a rehash is
+/// already in progress it is completed first.
+/// @param table The table to make room in.
+/// @return True if there is room for the element.
+static bool iw_htable_slot_reserve(iw_htable *table) {
+    // Elements still in the old slot array are counted as well since they
+    // will end up in the current array.
+    if((table->num_elems + table->deleted + 1) * 4 <= table->size * 3) {
+        return true;
+    }
+
+    // Finish any ongoing rehash before starting the next one.
+    if(table->old_slots != NULL) {
+        iw_htable_slot_migrate(table, table->old_size);
+    }
+
+    // Double the size if the table is more than half full with live
+    // elements, otherwise just rehash into the same size to clear out
+    // deleted slots.
+    unsigned int new_size = table->size;
+    if((table->num_elems + 1) * 2 > table->size) {
+        new_size = table->size * 2;
+    }
+    iw_hash_slot *slots;
+    iw_hash_key *keys = NULL;
+    INT_CALLOC(table->iw_mem_alloc, slots, new_size, iw_hash_slot);
+    if(slots != NULL && IS_KEYS(table)) {
+        INT_CALLOC(table->iw_mem_alloc, keys, new_size, iw_hash_key);
+        if(keys == NULL) {
+            INT_FREE(table->iw_mem_alloc, slots);
+            slots = NULL;
+        }
+    }
+    if(slots == NULL) {
+        LOG(IW_LOG_IW, "Failed to allocate memory for table size=%d", new_size);
+        return false;
+    }
+    table->old_slots  = table->slots;
+    table->old_keys   = table->keys;
+    table->old_size   = table->size;
+    table->old_elems  = table->num_elems;
+    table->migrated   = 0;
+
+    // Start the rehash at an empty slot so that the first cluster is
+    // migrated as a whole, the load factor guarantees there is one.
+    while(table->old_slots[table->migrated].hash != IW_HASH_SLOT_EMPTY) {
+        table->migrated++;
+    }
+    table->slots      = slots;
+    table->keys       = keys;
+    table->size       = new_size;
+    table->deleted    = 0;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Find the slot of an element in either slot array.
+/// @param table The table to search.
+/// @param hash The slot hash value to find.
+/// @param key_len The length of the key to find.
+/// @param key The key to find, only compared if the table stores keys.
+/// @param in_old [out] Set to true if the slot is in the old slot array.
+/// @return The slot containing the hash or NULL if no match was found.
+static iw_hash_slot *iw_htable_slot_lookup(
+    iw_htable *table,
+    unsigned long hash,
+    unsigned int key_len,
+    const void *key,
+    bool *in_old)
+{
+    iw_hash_slot *slot = iw_htable_slot_find(table->slots, table->keys,
+                                             table->size, hash, key_len, key);
+    *in_old = false;
+    if(slot == NULL && table->old_slots != NULL) {
+        slot = iw_htable_slot_find(table->old_slots, table->old_keys,
+                                   table->old_size, hash, key_len, key);
+        *in_old = true;
+    }
+    return slot;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the first used slot starting at the given position.
+/// The old slot array is iterated first, followed by the current array.
+/// @param table The table to iterate.
+/// @param in_old True to start in the old slot array.
+/// @param index The slot index to start at.
+/// @return The first used slot or NULL if no more slots are used.
+static iw_hash_slot *iw_htable_slot_next(
+    iw_htable *table,
+    bool in_old,
+    unsigned int index)
+{
+    if(in_old) {
+        for(;table->old_slots != NULL && index < table->old_size;index++) {
+            if(table->old_slots[index].hash >= IW_HASH_SLOT_USED) {
+                return &table->old_slots[index];
+            }
+        }
+        index = 0;
+    }
+    for(;index < table->size;index++) {
+        if(table->slots[index].hash >= IW_HASH_SLOT_USED) {
+            return &table->slots[index];
+        }
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the position of a slot in either slot array.
+/// @param table The table the slot is in.
+/// @param slot The slot to get the position of.
+/// @param in_old [out] Set to true if the slot is in the old slot array.
+/// @return The index of the slot in its slot array.
+static unsigned int iw_htable_slot_pos(
+    iw_htable *table,
+    iw_hash_slot *slot,
+    bool *in_old)
+{
+    *in_old = table->old_slots != NULL &&
+              slot >= table->old_slots &&
+              slot < table->old_slots + table->old_size;
+    return *in_old ? slot - table->old_slots : slot - table->slots;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the iteration token of a slot.
+/// The token is the position of the slot, the old slot array is numbered
+/// first followed by the current array. Unlike the hash, the position is
+/// unique even if several elements have the same hash.
+/// @param table The table the slot is in.
+/// @param slot The slot to get the token of.
+/// @return The token of the slot.
+static unsigned long iw_htable_slot_token(iw_htable *table, iw_hash_slot *slot)
+{
+    bool in_old;
+    unsigned int index = iw_htable_slot_pos(table, slot, &in_old);
+    return in_old ? index : (unsigned long)table->old_size + index;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the slot with the given iteration token.
+/// @param table The table to get the slot from.
+/// @param token The token of the slot.
+/// @param in_old [out] Set to true if the slot is in the old slot array.
+/// @param index [out] The index of the slot in its slot array.
+/// @return The slot or NULL if the token is out of range.
+static iw_hash_slot *iw_htable_slot_at(
+    iw_htable *table,
+    unsigned long token,
+    bool *in_old,
+    unsigned int *index)
+{
+    *in_old = token < table->old_size;
+    if(*in_old) {
+        *index = token;
+        return &table->old_slots[*index];
+    }
+    token -= table->old_size;
+    if(token >= table->size) {
+        return NULL;
+    }
+    *index = token;
+    return &table->slots[*index];
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Remove the element in the given slot.
+/// @param table The table to remove the element from.
+/// @param slot The slot of the element.
+/// @param in_old True if the slot is in the old slot array.
+static void iw_htable_slot_remove(
+    iw_htable *table,
+    iw_hash_slot *slot,
+    bool in_old)
+{
+    iw_hash_slot *slots = in_old ? table->old_slots : table->slots;
+    iw_hash_key *keys   = in_old ? table->old_keys : table->keys;
+    unsigned int size   = in_old ? table->old_size : table->size;
+    if(iw_htable_slot_collided(slots, size, slot)) {
+        table->collisions--;
+    }
+    if(keys != NULL) {
+        iw_htable_key_free(table, &keys[slot - slots]);
+    }
+    if(in_old) {
+        table->old_elems--;
+    } else {
+        table->deleted++;
+    }
+    slot->hash = IW_HASH_SLOT_DELETED;
+    table->num_elems--;
+}
+
+// --------------------------------------------------------------------------
+//
+// Chained helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Check whether a node matches the given hash and key.
+/// @param table The table the node is in.
+/// @param node The node to check.
+/// @param hash The hash of the key.
+/// @param key_len The length of the key.
+/// @param key The key, only compared if the table stores keys.
+/// @return True if the node matches.
+static bool iw_htable_node_match(
+    iw_htable *table,
+    iw_hash_node *node,
+    unsigned long hash,
+    unsigned int key_len,
+    const void *key)
+{
+    return node->hash == hash &&
+           (!IS_KEYS(table) ||
+            iw_htable_key_equal(&((iw_hash_key_node *)node)->key,
+                                key_len, key));
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Free a node and its stored key.
+/// @param table The table the node was in.
+/// @param node The node to free.
+static void iw_htable_node_free(iw_htable *table, iw_hash_node *node) {
+    if(IS_KEYS(table)) {
+        iw_htable_key_free(table, &((iw_hash_key_node *)node)->key);
+    }
+    if(table->slab != NULL) {
+        iw_slab_free(table->slab, node);
+    } else {
+        INT_FREE(table->iw_mem_alloc, node);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate a zeroed node.
+/// @param table The table to allocate the node for.
+/// @return The node or NULL if no memory could be allocated.
+static iw_hash_node *iw_htable_node_alloc(iw_htable *table) {
+    if(table->slab != NULL) {
+        return (iw_hash_node *)iw_slab_alloc(table->slab);
+    }
+    iw_hash_node *node;
+    if(IS_KEYS(table)) {
+        iw_hash_key_node *key_node;
+        INT_CALLOC(table->iw_mem_alloc, key_node, 1, iw_hash_key_node);
+        node = &key_node->node;
+    } else {
+        INT_CALLOC(table->iw_mem_alloc, node, 1, iw_hash_node);
+    }
+    return node;
+}
+
+// --------------------------------------------------------------------------
+//
+// Iteration helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Find the element with the given token.
+/// @param table The table to search.
+/// @param hash The token of the element to find.
+/// @return The data of the element or NULL if no match was found.
+static void *iw_htable_find_hash(iw_htable *table, unsigned long *hash)
+{
+    if(!IS_CHAINED(table)) {
+        bool in_old;
+        unsigned int index;
+        iw_hash_slot *slot = iw_htable_slot_at(table, *hash, &in_old, &index);
+        return slot != NULL && slot->hash >= IW_HASH_SLOT_USED ?
+               slot->data : NULL;
+    }
+    iw_hash_node *node = table->table[*hash % table->size];
+    while(node != NULL) {
+        if(node->hash == *hash) {
+            // Found the element with the given hash
+            return node->data;
+        }
+        node = node->next;
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the first element in the table.
+/// @param table The table to iterate.
+/// @param hash [out] The token of the element found.
+/// @return The data of the first element or NULL if the table is empty.
+static void *iw_htable_get_first_hash(iw_htable *table, unsigned long *hash) {
+    if(!IS_CHAINED(table)) {
+        iw_hash_slot *slot = iw_htable_slot_next(table, true, 0);
+        if(slot != NULL) {
+            *hash = iw_htable_slot_token(table, slot);
+            return slot->data;
+        }
+        return NULL;
+    }
+    int index, size = table->size;
+    for(index=0;index < size;index++) {
+        iw_hash_node *node = table->table[index];
+        if(node != NULL) {
+            *hash = node->hash;
+            return node->data;
+        }
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the element following the element with the given token.
+/// @param table The table to iterate.
+/// @param hash [in/out] The token of the previous and the found element.
+/// @return The data of the next element or NULL at the end of the table.
+static void *iw_htable_get_next_hash(iw_htable *table, unsigned long *hash) {
+    if(!IS_CHAINED(table)) {
+        // Continue from the position of the previous element.
+        bool in_old;
+        unsigned int index;
+        if(iw_htable_slot_at(table, *hash, &in_old, &index) == NULL) {
+            return NULL;
+        }
+        iw_hash_slot *slot = iw_htable_slot_next(table, in_old, index + 1);
+        if(slot != NULL) {
+            *hash = iw_htable_slot_token(table, slot);
+            return slot->data;
+        }
+        return NULL;
+    }
+    // Locate the previous element in its bucket and continue from there.
+    unsigned int index = *hash % table->size;
+    iw_hash_node *node = table->table[index];
+    while(node != NULL && node->hash != *hash) {
+        node = node->next;
+    }
+    if(node == NULL) {
+        // The previous element is no longer in the table.
+        return NULL;
+    }
+    node = node->next;
+    while(node == NULL && ++index < table->size) {
+        node = table->table[index];
+    }
+    if(node != NULL) {
+        *hash = node->hash;
+        return node->data;
+    }
+    // We did not find anything, this means we've gone through the whole table.
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+//
+// Ordered iteration helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Sort an array of elements using the given comparison function.
+/// A merge sort is used so that the sort is stable and the comparison
+/// function can be passed without any global state.
+/// @param elems The elements to sort.
+/// @param tmp A temporary array of at least the same size as \p elems.
+/// @param num The number of elements to sort.
+/// @param compare The comparison function to use on the element data.
+static void iw_htable_sort(
+    iw_hash_slot *elems,
+    iw_hash_slot *tmp,
+    unsigned int num,
+    int (*compare)(const void *, const void *))
+{
+    if(num < 2) {
+        return;
+    }
+    unsigned int half = num / 2;
+    iw_htable_sort(elems, tmp, half, compare);
+    iw_htable_sort(elems + half, tmp, num - half, compare);
+
+    // Merge the two sorted halves through the temporary array.
+    unsigned int left = 0, right = half, cnt = 0;
+    while(left < half && right < num) {
+        if((*compare)(elems[right].data, elems[left].data) < 0) {
+            tmp[cnt++] = elems[right++];
+        } else {
+            tmp[cnt++] = elems[left++];
+        }
+    }
+    while(left < half) {
+        tmp[cnt++] = elems[left++];
+    }
+    memcpy(elems, tmp, right * sizeof(iw_hash_slot));
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Create a sorted array of all the elements in the table.
+/// @param table The table to create the array from.
+/// @param compare The comparison function to sort the elements with.
+/// @param iw_mem_alloc True if the IW memory allocator should be used.
+/// @param elems [out] The allocated array, NULL if the table is empty.
+/// @return True if the array was successfully created.
+static bool iw_htable_sorted_create(
+    iw_htable *table,
+    int (*compare)(const void *, const void *),
+    bool iw_mem_alloc,
+    iw_hash_slot **elems)
+{
+    *elems = NULL;
+    if(table->num_elems == 0) {
+        return true;
+    }
+    iw_hash_slot *tmp;
+    INT_CALLOC(iw_mem_alloc, *elems, table->num_elems, iw_hash_slot);
+    INT_CALLOC(iw_mem_alloc, tmp, table->num_elems, iw_hash_slot);
+    if(*elems == NULL || tmp == NULL) {
+        LOG(IW_LOG_IW, "Failed to allocate memory for sorted elements");
+        if(*elems != NULL) {
+            INT_FREE(iw_mem_alloc, *elems);
+            *elems = NULL;
+        }
+        if(tmp != NULL) {
+            INT_FREE(iw_mem_alloc, tmp);
+        }
+        return false;
+    }
+
+    // The token of each element is kept with the data so that the position
+    // of an element can be returned as a hash token.
+    unsigned int cnt = 0;
+    unsigned long hash;
+    void *data = iw_htable_get_first_hash(table, &hash);
+    while(data != NULL && cnt < table->num_elems) {
+        (*elems)[cnt].hash = hash;
+        (*elems)[cnt].data = data;
+        cnt++;
+        data = iw_htable_get_next_hash(table, &hash);
+    }
+    iw_htable_sort(*elems, tmp, cnt, compare);
+    INT_FREE(iw_mem_alloc, tmp);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Clear the cached sorted index of the table.
+/// Called whenever the set of elements in the table changes.
+/// @param table The table to clear the sorted index for.
+static void iw_htable_sorted_clear(iw_htable *table) {
+    if(table->sorted != NULL) {
+        INT_FREE(table->iw_mem_alloc, table->sorted);
+        table->sorted = NULL;
+    }
+    table->sorted_fn = NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Make sure the cached sorted index is valid for the comparison.
+/// @param table The table to create the sorted index for.
+/// @param compare The comparison function to sort the elements with.
+/// @return True if the sorted index is valid.
+static bool iw_htable_sorted_update(
+    iw_htable *table,
+    int (*compare)(const void *, const void *))
+{
+    if(table->sorted_fn == compare) {
+        return true;
+    }
+    iw_htable_sorted_clear(table);
+    if(!iw_htable_sorted_create(table, compare, table->iw_mem_alloc,
+                                &table->sorted))
+    {
+        return false;
+    }
+    table->sorted_fn = compare;
+    return true;
+}
 
 // --------------------------------------------------------------------------
 //
@@ -26,13 +813,62 @@ bool iw_htable_init(
     bool iw_mem_alloc,
     IW_HASH_FN fn)
 {
-    INT_CALLOC(iw_mem_alloc, table->table, table_size, iw_hash_node *);
-    if(table->table == NULL) {
-        LOG(IW_LOG_IW, "Failed to allocate memory for table size=%d", table_size);
-        return false;
+    return iw_htable_init_ex(table, table_size, iw_mem_alloc, fn, 0);
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_htable_init_ex(
+    iw_htable *table,
+    unsigned int table_size,
+    bool iw_mem_alloc,
+    IW_HASH_FN fn,
+    unsigned int flags)
+{
+    memset(table, 0, sizeof(*table));
+    if(flags & IW_HTABLE_FLAG_CHAINED) {
+        INT_CALLOC(iw_mem_alloc, table->table, table_size, iw_hash_node *);
+        if(table->table == NULL) {
+            LOG(IW_LOG_IW, "Failed to allocate memory for table size=%d", table_size);
+            return false;
+        }
+        if(flags & IW_HTABLE_FLAG_POOL) {
+            INT_CALLOC(iw_mem_alloc, table->slab, 1, iw_slab);
+            if(table->slab == NULL) {
+                LOG(IW_LOG_IW, "Failed to allocate memory for node slab");
+                INT_FREE(iw_mem_alloc, table->table);
+                table->table = NULL;
+                return false;
+            }
+            iw_slab_init(table->slab, "hash table",
+                         flags & IW_HTABLE_FLAG_KEYS ? sizeof(iw_hash_key_node)
+                                                     : sizeof(iw_hash_node),
+                         0, iw_mem_alloc);
+        }
+    } else {
+        // Size the slot array to fit the expected number of elements
+        // without exceeding the load factor.
+        unsigned int slots = IW_HTABLE_MIN_SLOTS;
+        while(slots * 3 < table_size * 4) {
+            slots *= 2;
+        }
+        table_size = slots;
+        INT_CALLOC(iw_mem_alloc, table->slots, table_size, iw_hash_slot);
+        if(table->slots != NULL && (flags & IW_HTABLE_FLAG_KEYS)) {
+            INT_CALLOC(iw_mem_alloc, table->keys, table_size, iw_hash_key);
+            if(table->keys == NULL) {
+                INT_FREE(iw_mem_alloc, table->slots);
+                table->slots = NULL;
+            }
+        }
+        if(table->slots == NULL) {
+            LOG(IW_LOG_IW, "Failed to allocate memory for table size=%d", table_size);
+            return false;
+        }
     }
     table->iw_mem_alloc = iw_mem_alloc;
     table->fn           = fn == NULL ? iw_hash_data : fn;
+    table->flags        = flags;
     table->size         = table_size;
     table->num_elems    = 0;
     table->collisions   = 0;
@@ -48,7 +884,33 @@ bool iw_htable_replace(
     void *data,
     IW_HASH_DEL_FN fn)
 {
-    unsigned long hash = iw_hash_data(key_len, key);
+    unsigned long hash = table->fn(key_len, key);
+    iw_hash_key hkey;
+
+    if(!IS_CHAINED(table)) {
+        hash = iw_htable_slot_hash(hash);
+        if(fn != NULL) {
+            iw_htable_delete(table, key_len, key, fn);
+        } else {
+            bool in_old;
+            if(iw_htable_slot_lookup(table, hash, key_len, key, &in_old) != NULL) {
+                LOG(IW_LOG_IW, "Hash table already contains the value");
+                return false;
+            }
+        }
+        iw_htable_slot_migrate(table, IW_HTABLE_MIGRATE_STEP);
+        if(!iw_htable_slot_reserve(table)) {
+            return false;
+        }
+        if(IS_KEYS(table) && !iw_htable_key_set(table, &hkey, key_len, key)) {
+            return false;
+        }
+        iw_htable_slot_store(table, hash, data, &hkey);
+        table->num_elems++;
+        iw_htable_sorted_clear(table);
+        return true;
+    }
+
     unsigned int index = hash % table->size;
     iw_hash_node *node = table->table[index];
 
@@ -58,7 +920,7 @@ bool iw_htable_replace(
         // See if the bucket already contains the value
         if(node != NULL) {
             while(node != NULL) {
-                if(node->hash == hash) {
+                if(iw_htable_node_match(table, node, hash, key_len, key)) {
                     LOG(IW_LOG_IW, "Hash table already contains the value");
                     return false;
                 }
@@ -69,8 +931,14 @@ bool iw_htable_replace(
     }
 
     // Bucket did not contain the value, let's add it at the start of the list
-    iw_hash_node *new_node;
-    INT_CALLOC(table->iw_mem_alloc, new_node, 1, iw_hash_node);
+    iw_hash_node *new_node = iw_htable_node_alloc(table);
+    if(new_node != NULL && IS_KEYS(table) &&
+       !iw_htable_key_set(table, &((iw_hash_key_node *)new_node)->key,
+                          key_len, key))
+    {
+        iw_htable_node_free(table, new_node);
+        new_node = NULL;
+    }
     if(new_node == NULL) {
         LOG(IW_LOG_IW, "Failed to allocate memory for node");
         return false;
@@ -80,6 +948,7 @@ bool iw_htable_replace(
     new_node->hash = hash;
     new_node->data = data;
     table->num_elems++;
+    iw_htable_sorted_clear(table);
 
     return true;
 }
@@ -103,11 +972,20 @@ void *iw_htable_get(
     const void *key)
 {
     unsigned long hash = table->fn(key_len, key);
+
+    if(!IS_CHAINED(table)) {
+        bool in_old;
+        iw_hash_slot *slot = iw_htable_slot_lookup(table,
+                                                   iw_htable_slot_hash(hash),
+                                                   key_len, key, &in_old);
+        return slot != NULL ? slot->data : NULL;
+    }
+
     unsigned int index = hash % table->size;
     iw_hash_node *node = table->table[index];
 
     while(node != NULL) {
-        if(node->hash == hash) {
+        if(iw_htable_node_match(table, node, hash, key_len, key)) {
             return node->data;
         }
         node = node->next;
@@ -123,6 +1001,20 @@ void *iw_htable_remove(
     const void *key)
 {
     unsigned long hash = table->fn(key_len, key);
+
+    if(!IS_CHAINED(table)) {
+        bool in_old;
+        iw_hash_slot *slot = iw_htable_slot_lookup(table,
+                                                   iw_htable_slot_hash(hash),
+                                                   key_len, key, &in_old);
+        if(slot == NULL) {
+            return NULL;
+        }
+        iw_htable_slot_remove(table, slot, in_old);
+        iw_htable_sorted_clear(table);
+        return slot->data;
+    }
+
     unsigned int index = hash % table->size;
     iw_hash_node *node = table->table[index];
     iw_hash_node *prev;
@@ -131,25 +1023,27 @@ void *iw_htable_remove(
         return NULL;
     }
 
-    if(node->hash == hash) {
+    if(iw_htable_node_match(table, node, hash, key_len, key)) {
         table->table[index] = node->next;
         void *data = node->data;
         table->num_elems--;
+        iw_htable_sorted_clear(table);
         if(node->next != NULL) {
             table->collisions--;
         }
-        INT_FREE(table->iw_mem_alloc, node);
+        iw_htable_node_free(table, node);
         return data;
     }
 
     prev = node;
     node = node->next;
     while(node != NULL) {
-        if(node->hash == hash) {
+        if(iw_htable_node_match(table, node, hash, key_len, key)) {
             prev->next = node->next;
             void *data = node->data;
-            INT_FREE(table->iw_mem_alloc, node);
+            iw_htable_node_free(table, node);
             table->num_elems--;
+            iw_htable_sorted_clear(table);
             table->collisions--;
             return data;
         }
@@ -180,21 +1074,76 @@ bool iw_htable_delete(
 // --------------------------------------------------------------------------
 
 void iw_htable_destroy(iw_htable *table, IW_HASH_DEL_FN fn) {
-    if(table == NULL || table->table == NULL) {
+    if(table == NULL) {
+        return;
+    }
+    iw_htable_sorted_clear(table);
+    if(!IS_CHAINED(table)) {
+        if(table->slots == NULL) {
+            return;
+        }
+        if(fn != NULL) {
+            iw_htable_iter iter;
+            void *data = iw_htable_iter_first(table, &iter);
+            while(data != NULL) {
+                fn(data);
+                data = iw_htable_iter_next(&iter);
+            }
+        }
+        unsigned int cnt;
+        for(cnt=0;table->old_keys != NULL && cnt < table->old_size;cnt++) {
+            iw_htable_key_free(table, &table->old_keys[cnt]);
+        }
+        for(cnt=0;table->keys != NULL && cnt < table->size;cnt++) {
+            iw_htable_key_free(table, &table->keys[cnt]);
+        }
+        if(table->old_slots != NULL) {
+            INT_FREE(table->iw_mem_alloc, table->old_slots);
+        }
+        if(table->old_keys != NULL) {
+            INT_FREE(table->iw_mem_alloc, table->old_keys);
+        }
+        if(table->keys != NULL) {
+            INT_FREE(table->iw_mem_alloc, table->keys);
+        }
+        INT_FREE(table->iw_mem_alloc, table->slots);
+        table->slots     = NULL;
+        table->keys      = NULL;
+        table->old_slots = NULL;
+        table->old_keys  = NULL;
+        table->old_size  = 0;
+        table->old_elems = 0;
+        table->deleted   = 0;
+        table->num_elems = 0;
+        return;
+    }
+    if(table->table == NULL) {
         return;
     }
+    // Pooled nodes are freed all at once with the slab, the nodes only
+    // need to be visited to delete the data or free long keys.
+    bool walk = table->slab == NULL || fn != NULL || IS_KEYS(table);
     int index, size = table->size;
-    for(index=0;index < size;index++) {
+    for(index=0;walk && index < size;index++) {
         iw_hash_node *node = table->table[index];
         while(node != NULL) {
             iw_hash_node *tmp = node->next;
             if(fn != NULL) {
                 fn(node->data);
             }
-            INT_FREE(table->iw_mem_alloc, node);
+            if(table->slab == NULL) {
+                iw_htable_node_free(table, node);
+            } else if(IS_KEYS(table)) {
+                iw_htable_key_free(table, &((iw_hash_key_node *)node)->key);
+            }
             node = tmp;
         }
     }
+    if(table->slab != NULL) {
+        iw_slab_destroy(table->slab);
+        INT_FREE(table->iw_mem_alloc, table->slab);
+        table->slab = NULL;
+    }
     INT_FREE(table->iw_mem_alloc, table->table);
     table->table = NULL;
     table->num_elems = 0;
@@ -202,76 +1151,52 @@ void iw_htable_destroy(iw_htable *table, IW_HASH_DEL_FN fn) {
 
 // --------------------------------------------------------------------------
 
-static iw_hash_node *iw_htable_find_hash(iw_htable *table, unsigned long *hash)
-{
-    int index, size = table->size;
-    for(index=0;index < size;index++) {
-        iw_hash_node *node = table->table[index];
-        while(node != NULL) {
-            if(node->hash == *hash) {
-                // Found the element with the given hash
-                return node;
-            }
-            node = node->next;
-        }
-    }
-    // We did not find anything, this means we've gone through the whole table.
-    return NULL;
-}
-
-// --------------------------------------------------------------------------
-
-static iw_hash_node *iw_htable_get_first_hash(iw_htable *table, unsigned long *hash) {
-    int index, size = table->size;
-    for(index=0;index < size;index++) {
-        iw_hash_node *node = table->table[index];
-        if(node != NULL) {
-            *hash = node->hash;
-            return node;
-        }
-    }
-    return NULL;
+void *iw_htable_get_first(iw_htable *table, unsigned long *hash) {
+    return iw_htable_get_first_hash(table, hash);
 }
 
 // --------------------------------------------------------------------------
 
-static void *iw_htable_get_next_hash(iw_htable *table, unsigned long *hash) {
-    bool found_last = false;
-    int index, size = table->size;
-    for(index=0;index < size;index++) {
-        iw_hash_node *node = table->table[index];
-        while(node != NULL) {
-            if(found_last) {
-                // We already found the last hash element, now return this one.
-                *hash = node->hash;
-                return node;
-            }
-            if(node->hash == *hash) {
-                // Found the last element that was returned, now return the
-                // next element
-                found_last = true;
-            }
-            node = node->next;
-        }
-    }
-    // We did not find anything, this means we've gone through the whole table.
-    return NULL;
+void *iw_htable_get_next(iw_htable *table, unsigned long *hash) {
+    return iw_htable_get_next_hash(table, hash);
 }
 
 // --------------------------------------------------------------------------
 
-void *iw_htable_get_first(iw_htable *table, unsigned long *hash) {
-    iw_hash_node *node = iw_htable_get_first_hash(table, hash);
-
-    return node != NULL ? node->data : NULL;
+void *iw_htable_iter_first(iw_htable *table, iw_htable_iter *iter) {
+    iter->table  = table;
+    iter->index  = 0;
+    iter->in_old = true;
+    iter->next   = NULL;
+    return iw_htable_iter_next(iter);
 }
 
 // --------------------------------------------------------------------------
 
-void *iw_htable_get_next(iw_htable *table, unsigned long *hash) {
-    iw_hash_node *node = iw_htable_get_next_hash(table, hash);
+void *iw_htable_iter_next(iw_htable_iter *iter) {
+    iw_htable *table = iter->table;
+    if(!IS_CHAINED(table)) {
+        iw_hash_slot *slot = iw_htable_slot_next(table, iter->in_old, iter->index);
+        if(slot == NULL) {
+            iter->in_old = false;
+            iter->index  = table->size;
+            return NULL;
+        }
+        iter->index = iw_htable_slot_pos(table, slot, &iter->in_old) + 1;
+        return slot->data;
+    }
 
-    return node != NULL ? node->data : NULL;
+    // The next node is saved before the current node is returned so that
+    // the current node can be removed during the iteration.
+    iw_hash_node *node = iter->next;
+    while(node == NULL && iter->index < table->size) {
+        node = table->table[iter->index++];
+    }
+    if(node == NULL) {
+        return NULL;
+    }
+    iter->next = node->next;
+    return node->data;
 }
 
 // --------------------------------------------------------------------------
@@ -281,26 +1206,11 @@ void *iw_htable_get_first_ordered(
     int (*compare)(const void *, const void *),
     unsigned long *hash)
 {
-    // Find the lowest node using the given comparison function
-    unsigned long hash_cur = 0;
-    iw_hash_node *cur = iw_htable_get_first_hash(table, &hash_cur);
-    *hash = 0;
-    while(cur != NULL) {
-        iw_hash_node *next = iw_htable_get_next_hash(table, &hash_cur);
-        if(next == NULL) {
-            break;
-        }
-        if((*compare)(cur->data, next->data) > 0) {
-            cur = next;
-        }
-    }
-
-    // Now we've found the first element given the order to use
-    if(cur != NULL) {
-        *hash = cur->hash;
-        return cur->data;
+    if(!iw_htable_sorted_update(table, compare) || table->num_elems == 0) {
+        return NULL;
     }
-    return NULL;
+    *hash = table->sorted[0].hash;
+    return table->sorted[0].data;
 }
 
 // --------------------------------------------------------------------------
@@ -310,36 +1220,77 @@ void *iw_htable_get_next_ordered(
     int (*compare)(const void *, const void *),
     unsigned long *hash)
 {
-    unsigned long hash_cur;
-    iw_hash_node *prev = iw_htable_find_hash(table, hash);
-    iw_hash_node *cur  = NULL;
-    iw_hash_node *next = iw_htable_get_first_hash(table, &hash_cur);
-    if(prev == NULL || next == NULL) {
-        // The previous returned node is NULL or the whole table is empty,
-        // either way, we can't continue
+    void *prev = iw_htable_find_hash(table, hash);
+    if(prev == NULL || !iw_htable_sorted_update(table, compare)) {
+        // The previous returned element is gone, we can't continue.
         return NULL;
     }
 
-    // We're searching for the lowest value that is still higher than the
-    // previous value. We need to check if the next value is lower than
-    // current, but higher than previous. If so, this is the new current value.
-    while(next != NULL) {
-        if((*compare)(prev->data, next->data) < 0) {
-            // 'next' node is 'higher' than 'prev' node, also make sure it
-            // is lower than current node if any
-            if(cur == NULL || (*compare)(cur->data, next->data) > 0) {
-                // Either there were no old 'cur' value, or there was an old
-                // 'cur' value, but the 'next' value is lower, so now this is
-                // the new 'cur' value.
-                *hash = hash_cur;
-                cur = next;
-            }
+    // Binary search for the previous element in the sorted index. Elements
+    // that compare equal are told apart by their hash.
+    unsigned int low = 0, high = table->num_elems;
+    while(low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        if((*compare)(table->sorted[mid].data, prev) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
-        next = iw_htable_get_next_hash(table, &hash_cur);
     }
+    while(low < table->num_elems && table->sorted[low].hash != *hash) {
+        low++;
+    }
+    if(low + 1 >= table->num_elems) {
+        return NULL;
+    }
+    *hash = table->sorted[low + 1].hash;
+    return table->sorted[low + 1].data;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_htable_view_init(
+    iw_htable_view *view,
+    iw_htable *table,
+    int (*compare)(const void *, const void *))
+{
+    view->iw_mem_alloc = table->iw_mem_alloc;
+    view->num_elems    = table->num_elems;
+    view->index        = 0;
+    if(!iw_htable_sorted_create(table, compare, view->iw_mem_alloc,
+                                &view->elems))
+    {
+        view->num_elems = 0;
+        return false;
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
 
-    // Now we've found the first element given the order to use
-    return cur != NULL ? cur->data : NULL;
+void *iw_htable_view_first(iw_htable_view *view) {
+    view->index = 0;
+    return iw_htable_view_next(view);
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_htable_view_next(iw_htable_view *view) {
+    if(view->index >= view->num_elems) {
+        return NULL;
+    }
+    return view->elems[view->index++].data;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_htable_view_destroy(iw_htable_view *view) {
+    if(view->elems != NULL) {
+        INT_FREE(view->iw_mem_alloc, view->elems);
+        view->elems = NULL;
+    }
+    view->num_elems = 0;
+    view->index     = 0;
 }
 
 // --------------------------------------------------------------------------
@@ -349,6 +1300,32 @@ void iw_htable_report(iw_htable *table, FILE *out) {
     int tot_elems = 0;
     int tot_collisions = 0;
     fprintf(out, " v-- Hash Table 0x%p --v\n", table);
+    if(!IS_CHAINED(table)) {
+        for(index=0;index < size;index++) {
+            iw_hash_slot *slot = &table->slots[index];
+            if(slot->hash >= IW_HASH_SLOT_USED) {
+                fprintf(out, "  Slot %d: Key[%08lX] --> %p\n",
+                        index, slot->hash, slot->data);
+                tot_elems++;
+            }
+        }
+        for(index=0;index < (int)table->old_size;index++) {
+            iw_hash_slot *slot = &table->old_slots[index];
+            if(slot->hash >= IW_HASH_SLOT_USED) {
+                fprintf(out, "  Old Slot %d: Key[%08lX] --> %p\n",
+                        index, slot->hash, slot->data);
+                tot_elems++;
+            }
+        }
+        fprintf(out, "  -- Summary --\n");
+        fprintf(out, "   Number of Elements:   %d\n", tot_elems);
+        fprintf(out, "   Number of Slots:      %d\n", table->size);
+        fprintf(out, "   Deleted Slots:        %d\n", table->deleted);
+        fprintf(out, "   Slots to Rehash:      %d\n", table->old_elems);
+        fprintf(out, "   Number of Collisions: %d\n", table->collisions);
+        fprintf(out, " ^-- Hash Table 0x%p --^\n", table);
+        return;
+    }
     for(index=0;index < size;index++) {
         fprintf(out, "  Bucket %d:\n", index);
         iw_hash_node *node = table->table[index];
@@ -10,12 +10,32 @@
 
 #include "iw_list.h"
 
+#include "iw_log.h"
 #include "iw_memory.h"
 #include "iw_memory_int.h"
+#include "iw_slab.h"
 
 #include <stdlib.h>
 #include <string.h>
 
+// --------------------------------------------------------------------------
+//
+// Helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Allocate a zeroed generic node.
+/// @param list The list to allocate the node for.
+/// @return The node or NULL if no memory could be allocated.
+static iw_list_gen_node *iw_list_node_alloc(iw_list *list) {
+    if(list->slab != NULL) {
+        return (iw_list_gen_node *)iw_slab_alloc(list->slab);
+    }
+    iw_list_gen_node *node = NULL;
+    INT_CALLOC(list->iw_mem_alloc, node, 1, iw_list_gen_node);
+    return node;
+}
+
 // --------------------------------------------------------------------------
 //
 // Function API
@@ -29,13 +49,29 @@ void iw_list_init(iw_list *list, bool iw_mem_alloc) {
 
 // --------------------------------------------------------------------------
 
+bool iw_list_init_ex(iw_list *list, bool iw_mem_alloc, unsigned int flags) {
+    iw_list_init(list, iw_mem_alloc);
+    if(flags & IW_LIST_FLAG_POOL) {
+        INT_CALLOC(iw_mem_alloc, list->slab, 1, iw_slab);
+        if(list->slab == NULL) {
+            LOG(IW_LOG_IW, "Failed to allocate memory for node slab");
+            return false;
+        }
+        iw_slab_init(list->slab, "list", sizeof(iw_list_gen_node), 0,
+                     iw_mem_alloc);
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
 iw_list_node *iw_list_add(iw_list *list, iw_list_node *node) {
+    node->prev = list->tail;
+    node->next = NULL;
     if(list->tail == NULL) {
         list->head = list->tail = node;
     } else {
         list->tail->next = node;
-        node->prev = list->tail;
-        node->next = NULL;
         list->tail = node;
     }
     list->num_elems++;
@@ -45,8 +81,7 @@ iw_list_node *iw_list_add(iw_list *list, iw_list_node *node) {
 // --------------------------------------------------------------------------
 
 iw_list_node *iw_list_add_data(iw_list *list, void *data) {
-    iw_list_gen_node *node = NULL;
-    INT_CALLOC(list->iw_mem_alloc, node, 1, iw_list_gen_node);
+    iw_list_gen_node *node = iw_list_node_alloc(list);
     if(node == NULL) {
         return false;
     }
@@ -88,8 +123,7 @@ iw_list_node *iw_list_insert_before_data(
     iw_list_node *insert,
     void *data)
 {
-    iw_list_gen_node *node = NULL;
-    INT_CALLOC(list->iw_mem_alloc, node, 1, iw_list_gen_node);
+    iw_list_gen_node *node = iw_list_node_alloc(list);
     if(node == NULL) {
         return false;
     }
@@ -131,8 +165,7 @@ iw_list_node *iw_list_insert_after_data(
     iw_list_node *insert,
     void *data)
 {
-    iw_list_gen_node *node = NULL;
-    INT_CALLOC(list->iw_mem_alloc, node, 1, iw_list_gen_node);
+    iw_list_gen_node *node = iw_list_node_alloc(list);
     if(node == NULL) {
         return false;
     }
@@ -182,7 +215,10 @@ iw_list_node *iw_list_delete(
     iw_list_node *next = iw_list_remove(list, node);
     if(fn != NULL) {
         fn(node);
-    } else {
+    }
+    if(list->slab != NULL) {
+        iw_slab_free(list->slab, node);
+    } else if(fn == NULL) {
         INT_FREE(list->iw_mem_alloc, node);
     }
     return next;
@@ -191,16 +227,25 @@ iw_list_node *iw_list_delete(
 // --------------------------------------------------------------------------
 
 void iw_list_destroy(iw_list *list, IW_LIST_DEL_FN fn) {
-    iw_list_node *node = list->head;
+    // Pooled nodes are freed all at once with the slab, the nodes only
+    // need to be visited if the data must be deleted.
+    iw_list_node *node = list->slab == NULL || fn != NULL ? list->head : NULL;
     while(node != NULL) {
         iw_list_node *tmp = node->next;
         if(fn != NULL) {
             fn(node);
-        } else {
+        } else if(list->slab == NULL) {
             INT_FREE(list->iw_mem_alloc, node);
         }
         node = tmp;
     }
+    if(list->slab != NULL) {
+        iw_slab_destroy(list->slab);
+        INT_FREE(list->iw_mem_alloc, list->slab);
+        list->slab = NULL;
+    }
+    list->head      = NULL;
+    list->tail      = NULL;
     list->num_elems = 0;
 }
 
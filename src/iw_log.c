@@ -2,6 +2,29 @@
 ///
 /// @file iw_log.c
 ///
+/// Debug logs are either written directly to the log device by the thread
+/// issuing the log, or, in asynchronous mode, formatted into a ring of
+/// message slots that a dedicated writer thread drains in batches with
+/// writev(). In binary mode, the messages are instead recorded unformatted
+/// in memory by iw_log_bin.c.
+///
+/// Each call site has a static descriptor in the iw_log_sites section. The
+/// 'log site' command enables or disables call sites by clearing or setting
+/// a mask in the descriptor that the LOG macro combines with the log level.
+/// The descriptor also holds a token bucket that limits the rate of text
+/// messages from the call site, and the hash of the last message so that
+/// identical messages can be counted instead of written. Suppressed and
+/// repeated messages are summed up in a line of their own before the next
+/// message from the call site is written.
+///
+/// The ring is a bounded multi-producer, single-consumer queue. Each slot
+/// has a sequence number that tells whether the slot is free for the
+/// producer at a given position or holds a message for the writer at that
+/// position. A producer claims a position by advancing the head with a
+/// compare-and-swap, formats the message straight into the slot and then
+/// publishes it by updating the sequence number. No lock is taken unless
+/// the writer is idle and has to be woken up.
+///
 /// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
 /// This source is distributed under the license in LICENSE.txt in the top
 /// InstaWorks directory.
@@ -9,16 +32,46 @@
 // --------------------------------------------------------------------------
 
 #include "iw_log.h"
+#include "iw_log_int.h"
 
+#include "iw_cfg.h"
+#include "iw_common.h"
+#include "iw_hash.h"
 #include "iw_thread_int.h"
 #include "iw_util.h"
 
+#include <errno.h>
+#include <fnmatch.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+// --------------------------------------------------------------------------
+//
+// Defines
+//
+// --------------------------------------------------------------------------
+
+/// The size of a message slot in the asynchronous log ring.
+#define IW_LOG_SLOT_SIZE        512
+
+/// The largest number of messages written with a single writev() call.
+#define IW_LOG_BATCH            64
+
+/// The time in milliseconds an idle writer sleeps before checking the ring.
+#define IW_LOG_IDLE_WAIT        100
+
+/// The number of times a stopping writer yields to let producers publish
+/// the messages they have already claimed slots for.
+#define IW_LOG_STOP_TRIES       100
 
 // --------------------------------------------------------------------------
 //
@@ -38,32 +91,634 @@ static log_level s_levels[32] = { { NULL } };
 
 unsigned int s_log_level = 0;
 
+/// @brief A message slot in the asynchronous log ring.
+typedef struct _iw_log_slot {
+    unsigned long seq;      ///< The ring position the slot is ready for.
+    uint64_t      time;     ///< The time the message was queued in ns.
+    unsigned int  len;      ///< The length of the message.
+    char          data[IW_LOG_SLOT_SIZE - 2 * sizeof(unsigned long) -
+                       sizeof(unsigned int)];  ///< The message.
+} iw_log_slot;
+
+/// The asynchronous log ring.
+static iw_log_slot *s_ring = NULL;
+
+/// The number of slots in the ring, a power of two.
+static unsigned long s_ring_size = 0;
+
+/// The next ring position for producers to claim.
+static unsigned long s_head __attribute__((aligned(64))) = 0;
+
+/// The next ring position for the writer to write out.
+static unsigned long s_tail __attribute__((aligned(64))) = 0;
+
+/// True if log messages are queued for the writer thread.
+static bool s_async = false;
+
+/// The number of threads that may be queueing a message. The ring isn't
+/// touched by producers once asynchronous logging is off and this is zero.
+static unsigned int s_producers __attribute__((aligned(64))) = 0;
+
+/// True while the writer thread should keep running.
+static bool s_running = false;
+
+/// True while the writer thread is waiting for messages.
+static bool s_idle = false;
+
+/// The overflow policy of the ring.
+static IW_LOG_OVERFLOW s_overflow = IW_LOG_OVERFLOW_COUNT;
+
+/// The writer thread.
+static pthread_t s_writer_tid = 0;
+
+/// True for the writer thread, which always logs directly to the device.
+static __thread bool s_writer = false;
+
+/// Protects the log device while the writer is writing to it, as well as
+/// the writer statistics.
+static pthread_mutex_t s_dev_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Used to wake up an idle writer thread.
+static pthread_cond_t s_wake = PTHREAD_COND_INITIALIZER;
+
+/// The statistics of the asynchronous log pipeline.
+static iw_log_stats s_stats;
+
+/// The number of dropped messages that have been noted in the log output.
+static unsigned long s_dropped_noted = 0;
+
+/// The number of text messages per second allowed from each call site,
+/// zero if text messages aren't rate limited.
+static unsigned int s_rate = 0;
+
+/// The number of text messages each call site may write at once.
+static unsigned int s_burst = 0;
+
+/// The time in ns it takes for a call site to gain a token.
+static uint64_t s_rate_interval = 0;
+
+/// How far in ns a call site's bucket may be drawn ahead of the current
+/// time, the time it takes to gain all but one token of a full burst.
+static uint64_t s_rate_window = 0;
+
+/// True if messages identical to the last one from the call site are only
+/// counted.
+static bool s_duplicates = false;
+
+/// The number of messages suppressed by the rate limit.
+static unsigned long s_suppressed = 0;
+
+/// The number of messages counted as repeats of the previous message.
+static unsigned long s_repeated = 0;
+
+/// The first call site descriptor, defined by the linker.
+extern iw_log_site __start_iw_log_sites[] __attribute__((weak));
+
+/// The end of the call site descriptors, defined by the linker.
+extern iw_log_site __stop_iw_log_sites[] __attribute__((weak));
+
 // --------------------------------------------------------------------------
 //
 // Internal helpers
 //
 // --------------------------------------------------------------------------
 
-static void iw_vlog(
+/// @brief Get the current monotonic time.
+/// @return The current time in nanoseconds.
+static uint64_t iw_log_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Format a log message into a buffer.
+/// The message is truncated, and ends with "...", if it doesn't fit.
+/// @param buff The buffer to format the message into.
+/// @param size The size of the buffer.
+/// @param file The file that the message is output from.
+/// @param line The line that the message is output from.
+/// @param msg The message to output.
+/// @param argp The message arguments.
+/// @param truncated [out] Set to true if the message was truncated.
+/// @return The length of the message, including the terminating newline.
+static unsigned int iw_log_format(
+    char *buff,
+    size_t size,
+    const char *file,
+    unsigned int line,
+    const char *msg,
+    va_list argp,
+    bool *truncated)
+{
+    // Leave room for the newline.
+    size_t max = size - 1;
+    int res = snprintf(buff, max, "[%X]%s(%d): ",
+                       (unsigned int)pthread_self(), file, line);
+    size_t len = res < 0 ? 0 : (size_t)res;
+    *truncated = len >= max;
+    if(*truncated) {
+        len = max - 1;
+    } else {
+        res = vsnprintf(buff + len, max - len, msg, argp);
+        if(res > 0 && (size_t)res >= max - len) {
+            *truncated = true;
+            len = max - 1;
+        } else if(res > 0) {
+            len += res;
+        }
+    }
+    if(*truncated) {
+        memcpy(buff + len - 3, "...", 3);
+    }
+    buff[len++] = '\n';
+    return len;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Wake up the writer thread if it is waiting for messages.
+static void iw_log_wake() {
+    // Make sure a message published by the caller is visible before
+    // checking whether the writer has gone idle.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&s_idle, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&s_dev_lock);
+        pthread_cond_signal(&s_wake);
+        pthread_mutex_unlock(&s_dev_lock);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Check if the message at a ring position has been published.
+/// @param pos The ring position.
+/// @return The slot of the message or NULL if no message is published.
+static iw_log_slot *iw_log_published(unsigned long pos) {
+    iw_log_slot *slot = &s_ring[pos & (s_ring_size - 1)];
+    if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+        return NULL;
+    }
+    return slot;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Write all of the given buffers to a file descriptor.
+/// @param fd The file descriptor to write to.
+/// @param iov The buffers to write, modified if the write is partial.
+/// @param cnt The number of buffers.
+/// @return True if all buffers were written.
+static bool iw_log_writev(int fd, struct iovec *iov, int cnt) {
+    while(cnt > 0) {
+        ssize_t res = writev(fd, iov, cnt);
+        if(res < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while(cnt > 0 && (size_t)res >= iov->iov_len) {
+            res -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if(cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + res;
+            iov->iov_len -= res;
+        }
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Write out a batch of published messages from the tail of the ring.
+/// @return The number of messages written.
+static unsigned int iw_log_write_batch() {
+    struct iovec iov[IW_LOG_BATCH + 1];
+    iw_log_slot *slots[IW_LOG_BATCH];
+    char dropped[64];
+    unsigned long tail = s_tail;
+    unsigned int cnt = 0;
+    int vecs = 0;
+
+    // Note dropped messages where they were dropped in the log output.
+    unsigned long drops = __atomic_load_n(&s_stats.dropped, __ATOMIC_RELAXED);
+    if(s_overflow == IW_LOG_OVERFLOW_COUNT && drops != s_dropped_noted) {
+        iov[vecs].iov_base = dropped;
+        iov[vecs].iov_len  = snprintf(dropped, sizeof(dropped),
+                                      "[Dropped %lu log messages]\n",
+                                      drops - s_dropped_noted);
+        vecs++;
+        s_dropped_noted = drops;
+    }
+    for(cnt=0;cnt < IW_LOG_BATCH;cnt++) {
+        slots[cnt] = iw_log_published(tail + cnt);
+        if(slots[cnt] == NULL) {
+            break;
+        }
+        iov[vecs].iov_base = slots[cnt]->data;
+        iov[vecs].iov_len  = slots[cnt]->len;
+        vecs++;
+    }
+    if(vecs == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&s_dev_lock);
+    unsigned long bytes = 0;
+    int idx;
+    for(idx=0;idx < vecs;idx++) {
+        bytes += iov[idx].iov_len;
+    }
+    if(s_fd != NULL) {
+        // Anything written to the device through stdio goes first.
+        fflush(s_fd);
+        if(!iw_log_writev(fileno(s_fd), iov, vecs)) {
+            s_stats.errors++;
+        }
+    }
+    uint64_t now = iw_log_now_ns();
+    unsigned long used = __atomic_load_n(&s_head, __ATOMIC_RELAXED) - tail;
+    if(used > s_stats.peak_queued) {
+        s_stats.peak_queued = used;
+    }
+    for(idx=0;idx < (int)cnt;idx++) {
+        uint64_t latency = now - slots[idx]->time;
+        s_stats.latency_total += latency;
+        if(latency > s_stats.latency_max) {
+            s_stats.latency_max = latency;
+        }
+    }
+    s_stats.written += cnt;
+    s_stats.batches++;
+    s_stats.bytes += bytes;
+    pthread_mutex_unlock(&s_dev_lock);
+
+    // Hand the slots back to the producers.
+    for(idx=0;idx < (int)cnt;idx++) {
+        __atomic_store_n(&slots[idx]->seq, tail + idx + s_ring_size,
+                         __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&s_tail, tail + cnt, __ATOMIC_RELEASE);
+    return cnt;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief The log writer thread.
+/// @param param Not used.
+/// @return Not used.
+static void *iw_log_writer(void *param) {
+    UNUSED(param);
+    s_writer = true;
+    unsigned int tries = 0;
+    while(true) {
+        if(iw_log_write_batch() > 0) {
+            continue;
+        }
+        if(!__atomic_load_n(&s_running, __ATOMIC_ACQUIRE)) {
+            // Wait for messages that producers have claimed slots for.
+            if(__atomic_load_n(&s_head, __ATOMIC_ACQUIRE) == s_tail ||
+               ++tries > IW_LOG_STOP_TRIES)
+            {
+                break;
+            }
+            sched_yield();
+            continue;
+        }
+        pthread_mutex_lock(&s_dev_lock);
+        __atomic_store_n(&s_idle, true, __ATOMIC_SEQ_CST);
+        if(iw_log_published(s_tail) == NULL &&
+           __atomic_load_n(&s_running, __ATOMIC_ACQUIRE))
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += IW_LOG_IDLE_WAIT * 1000000L;
+            if(ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&s_wake, &s_dev_lock, &ts);
+        }
+        __atomic_store_n(&s_idle, false, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&s_dev_lock);
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Queue a log message for the writer thread.
+/// @param file The file that the message is output from.
+/// @param line The line that the message is output from.
+/// @param msg The message to output.
+/// @param argp The message arguments.
+/// @return True if the message was queued or dropped, false if the message
+/// should be written directly since asynchronous logging was stopped.
+static bool iw_log_queue(
+    const char *file,
+    unsigned int line,
+    const char *msg,
+    va_list argp)
+{
+    bool waited = false;
+    unsigned long pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+    iw_log_slot *slot;
+    while(true) {
+        slot = &s_ring[pos & (s_ring_size - 1)];
+        unsigned long seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        long diff = (long)(seq - pos);
+        if(diff == 0) {
+            if(__atomic_compare_exchange_n(&s_head, &pos, pos + 1, true,
+                                           __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        } else if(diff < 0) {
+            // The ring is full.
+            if(!__atomic_load_n(&s_async, __ATOMIC_ACQUIRE)) {
+                return false;
+            }
+            if(s_overflow != IW_LOG_OVERFLOW_BLOCK) {
+                __atomic_add_fetch(&s_stats.dropped, 1, __ATOMIC_RELAXED);
+                iw_log_wake();
+                return true;
+            }
+            if(!waited) {
+                __atomic_add_fetch(&s_stats.blocked, 1, __ATOMIC_RELAXED);
+                waited = true;
+            }
+            iw_log_wake();
+            sched_yield();
+            pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&s_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    bool truncated;
+    slot->time = iw_log_now_ns();
+    slot->len  = iw_log_format(slot->data, sizeof(slot->data),
+                               file, line, msg, argp, &truncated);
+    if(truncated) {
+        __atomic_add_fetch(&s_stats.truncated, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    iw_log_wake();
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Write the published messages left in the ring directly to the
+/// log device. Only async-signal-safe calls are made.
+static void iw_log_drain() {
+    if(s_ring == NULL || s_fd == NULL) {
+        return;
+    }
+    int fd = fileno(s_fd);
+    unsigned long pos = __atomic_load_n(&s_tail, __ATOMIC_ACQUIRE);
+    iw_log_slot *slot;
+    while((slot = iw_log_published(pos)) != NULL) {
+        struct iovec iov = { slot->data, slot->len };
+        iw_log_writev(fd, &iov, 1);
+        __atomic_store_n(&slot->seq, pos + s_ring_size, __ATOMIC_RELEASE);
+        pos++;
+        __atomic_store_n(&s_tail, pos, __ATOMIC_RELEASE);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Write a text message to the log device, or queue it for the
+/// writer thread in asynchronous mode.
+/// @param file The file that the message is output from.
+/// @param line The line that the message is output from.
+/// @param msg The message to output.
+/// @param argp The message arguments.
+static void iw_log_text(
     const char *file,
     unsigned int line,
     const char *msg,
     va_list argp)
 {
+    if(__atomic_load_n(&s_async, __ATOMIC_ACQUIRE) && !s_writer) {
+        // Announce the producer before checking the flag again so that
+        // iw_log_stop() can wait for it to leave the ring.
+        __atomic_add_fetch(&s_producers, 1, __ATOMIC_SEQ_CST);
+        bool queued = false;
+        if(__atomic_load_n(&s_async, __ATOMIC_SEQ_CST)) {
+            va_list ap;
+            va_copy(ap, argp);
+            queued = iw_log_queue(file, line, msg, ap);
+            va_end(ap);
+        }
+        __atomic_sub_fetch(&s_producers, 1, __ATOMIC_RELEASE);
+        if(queued) {
+            return;
+        }
+    }
+
+    // Lock the stream so that lines from different threads don't mix.
+    flockfile(s_fd);
+    fprintf(s_fd, "[%X]%s(%d): ", (unsigned int)pthread_self(), file, line);
+    vfprintf(s_fd, msg, argp);
+    fprintf(s_fd, "\n");
+    funlockfile(s_fd);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Write a text message to the log device.
+/// @param file The file that the message is output from.
+/// @param line The line that the message is output from.
+/// @param msg The message to output.
+static void iw_log_textf(
+    const char *file,
+    unsigned int line,
+    const char *msg, ...)
+{
+    va_list ap;
+    va_start(ap, msg);
+    iw_log_text(file, line, msg, ap);
+    va_end(ap);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Write out the number of messages suppressed or repeated at a
+/// call site since its last message.
+/// @param site The call site.
+/// @param repeats True to write out the number of repeated messages too.
+static void iw_log_summarize(iw_log_site *site, bool repeats) {
+    unsigned int cnt = __atomic_exchange_n(&site->suppressed, 0,
+                                           __ATOMIC_RELAXED);
+    if(cnt != 0) {
+        iw_log_textf(site->file, site->line, "Suppressed %u messages", cnt);
+    }
+    cnt = repeats ? __atomic_exchange_n(&site->repeats, 0, __ATOMIC_RELAXED)
+                  : 0;
+    if(cnt != 0) {
+        iw_log_textf(site->file, site->line,
+                     "Last message repeated %u times", cnt);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Write out the messages suppressed or repeated at all call sites.
+static void iw_log_summarize_all() {
+    iw_log_site *site;
     if(s_fd == NULL) {
         return;
     }
+    for(site=__start_iw_log_sites;site < __stop_iw_log_sites;site++) {
+        iw_log_summarize(site, true);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Take a token from the bucket of a call site.
+/// The bucket is kept as the time it next gains a token, which is moved
+/// forward by one token interval for each message. The call site is out of
+/// tokens when that time is more than a burst ahead of the current time.
+/// @param site The call site.
+/// @return True if the message should be written, false if it was
+/// suppressed.
+static bool iw_log_admit(iw_log_site *site) {
+    uint64_t now = iw_log_now_ns();
+    uint64_t next = __atomic_load_n(&site->next, __ATOMIC_RELAXED);
+    uint64_t start;
+    do {
+        start = next > now ? next : now;
+        if(start - now > s_rate_window) {
+            __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&s_suppressed, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while(!__atomic_compare_exchange_n(&site->next, &next,
+                                         start + s_rate_interval, true,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Check if a message is identical to the last message of a call
+/// site. Only a hash of the formatted message is kept.
+/// @param site The call site.
+/// @param text The formatted message.
+/// @param len The length of the formatted message.
+/// @return True if the message was counted as a repeat.
+static bool iw_log_repeat(iw_log_site *site, const char *text, size_t len) {
+    // Never zero, so that the first message of a site isn't a repeat.
+    unsigned long fingerprint = iw_hash_data(len, text) | 1;
+    if(__atomic_exchange_n(&site->fingerprint, fingerprint,
+                           __ATOMIC_RELAXED) == fingerprint)
+    {
+        __atomic_add_fetch(&site->repeats, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&s_repeated, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+    return false;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Check if a call site is selected by a filter.
+/// @param site The call site.
+/// @param filter The filter.
+/// @return True if the call site is selected.
+static bool iw_log_site_match(
+    const iw_log_site *site,
+    const iw_log_site_filter *filter)
+{
+    if(filter->file != NULL) {
+        const char *name = strrchr(site->file, '/');
+        name = name != NULL ? name + 1 : site->file;
+        if(fnmatch(filter->file, site->file, 0) != 0 &&
+           fnmatch(filter->file, name, 0) != 0)
+        {
+            return false;
+        }
+    }
+    if(filter->func != NULL && fnmatch(filter->func, site->func, 0) != 0) {
+        return false;
+    }
+    return (filter->line_from == 0 || site->line >= filter->line_from) &&
+           (filter->line_to == 0 || site->line <= filter->line_to);
+}
+
+// --------------------------------------------------------------------------
+
+static void iw_vlog(
+    iw_log_site *site,
+    const char *file,
+    unsigned int line,
+    const char *msg,
+    va_list argp)
+{
+    if(s_fd == NULL && !s_log_binary) {
+        return;
+    }
 
-    if(!iw_thread_get_log(0)) {
+    if(__atomic_load_n(&s_thread_log_off, __ATOMIC_RELAXED) != 0 &&
+       !iw_thread_log_on())
+    {
         // If we can get the thread specific info and logging is disabled
         // in the thread info, then just return rather than print the
-        // debug log.
+        // debug log. Only checked if logging is off for any thread.
         return;
     }
 
-    fprintf(s_fd, "[%X]%s(%d): ", (unsigned int)pthread_self(), file, line);
-    vfprintf(s_fd, msg, argp);
-    fprintf(s_fd, "\n");
+    if(site != NULL && __atomic_load_n(&s_log_binary, __ATOMIC_RELAXED)) {
+        va_list ap;
+        va_copy(ap, argp);
+        bool recorded = iw_log_bin_record(site, msg, ap);
+        va_end(ap);
+        if(recorded) {
+            return;
+        }
+    }
+    if(s_fd == NULL) {
+        return;
+    }
+
+    if(site != NULL) {
+        if(s_rate_interval != 0 && !iw_log_admit(site)) {
+            return;
+        }
+        if(!s_duplicates) {
+            iw_log_summarize(site, true);
+        } else {
+            // The message is formatted once, both for the repeat check and
+            // for the output.
+            char buff[IW_LOG_SLOT_SIZE];
+            va_list ap;
+            va_copy(ap, argp);
+            int len = vsnprintf(buff, sizeof(buff), msg, ap);
+            va_end(ap);
+            size_t used = len < 0 ? 0 : (size_t)len < sizeof(buff) ?
+                          (size_t)len : sizeof(buff) - 1;
+            bool repeat = len >= 0 && iw_log_repeat(site, buff, used);
+            iw_log_summarize(site, !repeat);
+            if(repeat) {
+                return;
+            }
+            // A message too long for the buffer is formatted again below
+            // so that it isn't cut short.
+            if(len >= 0 && used == (size_t)len) {
+                iw_log_textf(file, line, "%s", buff);
+                return;
+            }
+        }
+    }
+    iw_log_text(file, line, msg, argp);
 }
 
 // --------------------------------------------------------------------------
@@ -87,7 +742,14 @@ void iw_log_init() {
 // --------------------------------------------------------------------------
 
 void iw_log_exit() {
+    iw_log_summarize_all();
+    iw_log_stop();
+    iw_log_bin_exit();
+    free(s_ring);
+    s_ring = NULL;
+    s_ring_size = 0;
     free(s_dev);
+    s_dev = NULL;
     if(s_fd != NULL) {
         fclose(s_fd);
         s_fd = NULL;
@@ -147,17 +809,26 @@ void iw_log_set_level(const char *dev, unsigned int level) {
             // device before closing it.
             LOG(level, "Changed log level, new device=\"%s\", new level=\"%X\"",
                 dev != NULL ? dev : "<none>", level);
+            // Write out the pending summaries and the queued logs before
+            // the device is closed.
+            iw_log_summarize_all();
+            iw_log_flush();
+            pthread_mutex_lock(&s_dev_lock);
             if(s_dev != NULL && strcmp(s_dev, "stdout") != 0) {
                 fclose(s_fd);
             }
             s_fd = NULL;
             free(s_dev);
+            s_dev = NULL;
+            pthread_mutex_unlock(&s_dev_lock);
         }
 
         // Finally set the device and fd to the opened device and fd.
         if(level != 0 && tmp_fd != NULL) {
+            pthread_mutex_lock(&s_dev_lock);
             s_dev = strdup(dev);
             s_fd  = tmp_fd;
+            pthread_mutex_unlock(&s_dev_lock);
         }
     }
     s_log_level = level;
@@ -169,6 +840,41 @@ void iw_log_set_level(const char *dev, unsigned int level) {
 
 // --------------------------------------------------------------------------
 
+unsigned int iw_log_site_enable(
+    const iw_log_site_filter *filter,
+    bool enable)
+{
+    unsigned int cnt = 0;
+    iw_log_site *site;
+    for(site=__start_iw_log_sites;site < __stop_iw_log_sites;site++) {
+        if(iw_log_site_match(site, filter)) {
+            __atomic_store_n(&site->mask, enable ? ~0U : 0, __ATOMIC_RELAXED);
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_site_list(FILE *out, const iw_log_site_filter *filter) {
+    unsigned int cnt = 0;
+    unsigned int enabled = 0;
+    const iw_log_site *site;
+    for(site=__start_iw_log_sites;site < __stop_iw_log_sites;site++) {
+        if(iw_log_site_match(site, filter)) {
+            fprintf(out, "    %-3s %s(%d) %s()\n",
+                    site->mask != 0 ? "on" : "off",
+                    site->file, site->line, site->func);
+            cnt++;
+            enabled += site->mask != 0;
+        }
+    }
+    fprintf(out, "%u call sites, %u enabled\n", cnt, enabled);
+}
+
+// --------------------------------------------------------------------------
+
 bool iw_log_add_level(
     unsigned int level,
     const char *desc)
@@ -197,10 +903,211 @@ bool iw_log_add_level(
 
 // --------------------------------------------------------------------------
 
+void iw_log_limit(unsigned int rate, unsigned int burst, bool duplicates) {
+    s_rate  = rate;
+    s_burst = burst > 0 ? burst : 1;
+    s_rate_interval = rate > 0 ? 1000000000ULL / rate : 0;
+    s_rate_window   = s_rate_interval * (s_burst - 1);
+    s_duplicates = duplicates;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_log_start() {
+    int *rate = iw_val_store_get_number(&iw_cfg, IW_CFG_LOG_RATE);
+    int *burst = iw_val_store_get_number(&iw_cfg, IW_CFG_LOG_BURST);
+    int *duplicates = iw_val_store_get_number(&iw_cfg, IW_CFG_LOG_DUPLICATES);
+    iw_log_limit(rate != NULL && *rate > 0 ? *rate : 0,
+                 burst != NULL && *burst > 0 ? *burst : 0,
+                 duplicates != NULL && *duplicates);
+
+    int *binary = iw_val_store_get_number(&iw_cfg, IW_CFG_LOG_BINARY);
+    if(binary != NULL && *binary) {
+        int *binsize = iw_val_store_get_number(&iw_cfg, IW_CFG_LOG_BINSIZE);
+        iw_log_bin_start(binsize != NULL && *binsize > 0 ? *binsize : 0);
+    }
+    if(s_running) {
+        return true;
+    }
+    int *async = iw_val_store_get_number(&iw_cfg, IW_CFG_LOG_ASYNC);
+    if(async == NULL || !*async) {
+        return false;
+    }
+    int *size = iw_val_store_get_number(&iw_cfg, IW_CFG_LOG_RINGSIZE);
+    char *overflow = iw_val_store_get_string(&iw_cfg, IW_CFG_LOG_OVERFLOW);
+
+    // Round the ring size up to a power of two.
+    unsigned long ring_size = 2;
+    while(size != NULL && ring_size < (unsigned long)*size) {
+        ring_size <<= 1;
+    }
+    if(ring_size != s_ring_size) {
+        free(s_ring);
+        s_ring = (iw_log_slot *)calloc(ring_size, sizeof(iw_log_slot));
+        s_ring_size = s_ring != NULL ? ring_size : 0;
+        if(s_ring == NULL) {
+            LOG(IW_LOG_IW, "Failed to allocate the log ring");
+            return false;
+        }
+    }
+    unsigned long cnt;
+    for(cnt=0;cnt < s_ring_size;cnt++) {
+        s_ring[cnt].seq = cnt;
+    }
+    s_head = 0;
+    s_tail = 0;
+    s_dropped_noted = 0;
+    memset(&s_stats, 0, sizeof(s_stats));
+    if(overflow != NULL && strcmp(overflow, "drop") == 0) {
+        s_overflow = IW_LOG_OVERFLOW_DROP;
+    } else if(overflow != NULL && strcmp(overflow, "block") == 0) {
+        s_overflow = IW_LOG_OVERFLOW_BLOCK;
+    } else {
+        s_overflow = IW_LOG_OVERFLOW_COUNT;
+    }
+
+    __atomic_store_n(&s_running, true, __ATOMIC_RELEASE);
+    if(!iw_thread_create_int(&s_writer_tid, "Log Writer", iw_log_writer,
+                             false, NULL))
+    {
+        s_running = false;
+        LOG(IW_LOG_IW, "Failed to create log writer thread");
+        return false;
+    }
+    __atomic_store_n(&s_async, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_stop() {
+    if(!s_running) {
+        return;
+    }
+    // New messages are written directly from here on, the writer drains
+    // the messages already queued before it exits. Wait for the producers
+    // that are still queueing, so that every claimed slot gets published
+    // and nothing touches the ring once it can be freed.
+    __atomic_store_n(&s_async, false, __ATOMIC_SEQ_CST);
+    while(__atomic_load_n(&s_producers, __ATOMIC_ACQUIRE) != 0) {
+        sched_yield();
+    }
+    __atomic_store_n(&s_running, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&s_dev_lock);
+    pthread_cond_signal(&s_wake);
+    pthread_mutex_unlock(&s_dev_lock);
+    iw_thread_join_int(s_writer_tid);
+    s_writer_tid = 0;
+
+    pthread_mutex_lock(&s_dev_lock);
+    iw_log_drain();
+    pthread_mutex_unlock(&s_dev_lock);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_flush() {
+    if(!__atomic_load_n(&s_async, __ATOMIC_ACQUIRE) || s_writer) {
+        return;
+    }
+    unsigned long head = __atomic_load_n(&s_head, __ATOMIC_ACQUIRE);
+    while(__atomic_load_n(&s_running, __ATOMIC_ACQUIRE) &&
+          (long)(__atomic_load_n(&s_tail, __ATOMIC_ACQUIRE) - head) < 0)
+    {
+        pthread_mutex_lock(&s_dev_lock);
+        pthread_cond_signal(&s_wake);
+        pthread_mutex_unlock(&s_dev_lock);
+        usleep(1000);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_crash_flush() {
+    __atomic_store_n(&s_async, false, __ATOMIC_SEQ_CST);
+    iw_log_drain();
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_log_stats_get(iw_log_stats *stats) {
+    pthread_mutex_lock(&s_dev_lock);
+    *stats = s_stats;
+    pthread_mutex_unlock(&s_dev_lock);
+    stats->dropped   = __atomic_load_n(&s_stats.dropped, __ATOMIC_RELAXED);
+    stats->blocked   = __atomic_load_n(&s_stats.blocked, __ATOMIC_RELAXED);
+    stats->truncated = __atomic_load_n(&s_stats.truncated, __ATOMIC_RELAXED);
+    stats->queued    = __atomic_load_n(&s_head, __ATOMIC_RELAXED) -
+                       __atomic_load_n(&s_tail, __ATOMIC_RELAXED);
+    stats->ring_size = s_ring_size;
+    stats->overflow  = s_overflow;
+    return __atomic_load_n(&s_async, __ATOMIC_ACQUIRE);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_show_stats(FILE *out) {
+    static const char *policies[] = { "drop", "block", "count" };
+    iw_log_bin_stats bin_stats;
+    bool binary = iw_log_bin_stats_get(&bin_stats);
+    if(binary || bin_stats.buffers != 0) {
+        fprintf(out, "Binary log         : %s\n", binary ? "on" : "off");
+        fprintf(out, "Call sites         : %lu\n", bin_stats.sites);
+        fprintf(out, "Thread buffers     : %lu (%lu KB)\n",
+                bin_stats.buffers, bin_stats.bytes / 1024);
+        fprintf(out, "Records buffered   : %lu\n", bin_stats.records);
+        fprintf(out, "Records logged     : %lu (%lu as text)\n",
+                bin_stats.logged, bin_stats.text);
+        fprintf(out, "Records overwritten: %lu\n", bin_stats.overwritten);
+        fprintf(out, "\n");
+    }
+
+    if(s_rate_interval != 0 || s_duplicates) {
+        if(s_rate_interval != 0) {
+            fprintf(out, "Rate limit         : %u messages/s per call site, "
+                         "burst %u\n", s_rate, s_burst);
+        }
+        fprintf(out, "Duplicates         : %s\n",
+                s_duplicates ? "counted" : "logged");
+        fprintf(out, "Messages suppressed: %lu\n",
+                __atomic_load_n(&s_suppressed, __ATOMIC_RELAXED));
+        fprintf(out, "Messages repeated  : %lu\n",
+                __atomic_load_n(&s_repeated, __ATOMIC_RELAXED));
+        fprintf(out, "\n");
+    }
+
+    iw_log_stats stats;
+    if(!iw_log_stats_get(&stats)) {
+        fprintf(out, "Asynchronous logging is disabled.\n");
+        return;
+    }
+    fprintf(out, "Ring size          : %lu messages (%lu KB)\n",
+            stats.ring_size,
+            (unsigned long)(stats.ring_size * sizeof(iw_log_slot) / 1024));
+    fprintf(out, "Overflow policy    : %s\n", policies[stats.overflow]);
+    fprintf(out, "Messages queued    : %lu (peak %lu)\n",
+            stats.queued, stats.peak_queued);
+    fprintf(out, "Messages written   : %lu\n", stats.written);
+    fprintf(out, "Messages dropped   : %lu\n", stats.dropped);
+    fprintf(out, "Messages truncated : %lu\n", stats.truncated);
+    fprintf(out, "Blocked producers  : %lu\n", stats.blocked);
+    fprintf(out, "Write batches      : %lu (%.1f messages per batch)\n",
+            stats.batches,
+            stats.batches != 0 ? (double)stats.written / stats.batches : 0.0);
+    fprintf(out, "Bytes written      : %lu\n", stats.bytes);
+    fprintf(out, "Write errors       : %lu\n", stats.errors);
+    fprintf(out, "Latency            : %.1f us average, %.1f us max\n",
+            stats.written != 0 ?
+                (double)stats.latency_total / stats.written / 1000.0 : 0.0,
+            (double)stats.latency_max / 1000.0);
+}
+
+// --------------------------------------------------------------------------
+
 void iw_log(const char *file, unsigned int line, const char *msg, ...) {
     va_list ap;
     va_start(ap, msg);
-    iw_vlog(file, line, msg, ap);
+    iw_vlog(NULL, file, line, msg, ap);
     va_end(ap);
 }
 
@@ -212,10 +1119,35 @@ void iw_log_ex(
     unsigned int line,
     const char *msg, ...)
 {
-    if(DO_LOG(lvl)) {
+    // The caller's IW_LOG_COMPILE_MASK has already been applied.
+    if(lvl & s_log_level) {
+        va_list ap;
+        va_start(ap, msg);
+        iw_vlog(NULL, file, line, msg, ap);
+        va_end(ap);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_at(iw_log_site *site, const char *msg, ...) {
+    va_list ap;
+    va_start(ap, msg);
+    iw_vlog(site, site->file, site->line, msg, ap);
+    va_end(ap);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_ex_at(
+    unsigned int lvl,
+    iw_log_site *site,
+    const char *msg, ...)
+{
+    if((lvl & s_log_level) & site->mask) {
         va_list ap;
         va_start(ap, msg);
-        iw_vlog(file, line, msg, ap);
+        iw_vlog(site, site->file, site->line, msg, ap);
         va_end(ap);
     }
 }
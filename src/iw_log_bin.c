@@ -0,0 +1,1030 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_log_bin.c
+///
+/// The binary log records log messages without formatting them. The first
+/// time a call site logs a message, the site is registered in a table
+/// together with its format string, and the format is parsed to find the
+/// types of the arguments. After that, each message is recorded as the ID of
+/// the site, a timestamp, the thread ID and the raw bytes of the arguments.
+/// Strings are copied since the pointers won't be valid when the message is
+/// formatted. The messages are formatted when the log is dumped, either by
+/// the 'log dump' command or by decoding a saved binary log offline.
+///
+/// Each thread records its messages in a buffer of its own, overwriting the
+/// oldest messages when the buffer is full, so threads don't contend with
+/// each other. The buffer of a thread that exits is handed to the next
+/// thread that logs a message.
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_log.h"
+#include "iw_log_int.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// --------------------------------------------------------------------------
+//
+// Defines
+//
+// --------------------------------------------------------------------------
+
+/// The magic bytes at the start of a saved binary log.
+#define IW_LOG_BIN_MAGIC        "IWBINLOG"
+
+/// The version of the saved binary log format.
+#define IW_LOG_BIN_VERSION      1
+
+/// The number of call site entries in each chunk of the site table.
+#define IW_LOG_BIN_CHUNK        256
+
+/// The largest number of call sites, site IDs are 16 bits and the highest
+/// ID is used to mark the unused end of a buffer.
+#define IW_LOG_BIN_MAX_SITES    0xFFFE
+
+/// The site ID that marks the unused end of a buffer.
+#define IW_LOG_BIN_WRAP         0xFFFF
+
+/// The largest size of a record, longer strings are truncated.
+#define IW_LOG_BIN_MAX_RECORD   1024
+
+/// The smallest buffer size.
+#define IW_LOG_BIN_MIN_SIZE     (4 * IW_LOG_BIN_MAX_RECORD)
+
+/// The largest number of arguments of a call site that is recorded in
+/// binary form. Sites with more arguments are formatted when logged.
+#define IW_LOG_BIN_MAX_ARGS     32
+
+/// The flag in the record length that marks a message formatted when logged.
+#define IW_LOG_BIN_TEXT         0x8000
+
+/// @brief Round a record length up to the record alignment.
+/// @param LEN The length to round.
+#define IW_LOG_BIN_ALIGN(LEN)   (((LEN) + 7) & ~(size_t)7)
+
+// --------------------------------------------------------------------------
+//
+// Data structures
+//
+// --------------------------------------------------------------------------
+
+/// @brief The type of a recorded argument.
+typedef enum _IW_LOG_BIN_ARG {
+    IW_LOG_BIN_ARG_NONE,    ///< No argument, e.g. "%%".
+    IW_LOG_BIN_ARG_INT,     ///< An int, or a promoted char or short.
+    IW_LOG_BIN_ARG_LONG,    ///< A long.
+    IW_LOG_BIN_ARG_LLONG,   ///< A long long.
+    IW_LOG_BIN_ARG_INTMAX,  ///< An intmax_t.
+    IW_LOG_BIN_ARG_SIZE,    ///< A size_t.
+    IW_LOG_BIN_ARG_PTRDIFF, ///< A ptrdiff_t.
+    IW_LOG_BIN_ARG_DOUBLE,  ///< A double.
+    IW_LOG_BIN_ARG_LDOUBLE, ///< A long double.
+    IW_LOG_BIN_ARG_PTR,     ///< A pointer.
+    IW_LOG_BIN_ARG_STR      ///< A string, recorded as a 16 bit length and
+                            ///< the characters.
+} IW_LOG_BIN_ARG;
+
+/// @brief A parsed conversion specification of a format string.
+typedef struct _iw_log_bin_conv {
+    IW_LOG_BIN_ARG  type;       ///< The type of the converted argument.
+    bool            valid;      ///< False if the conversion isn't supported.
+    bool            star_width; ///< True if the width is an argument.
+    bool            star_prec;  ///< True if the precision is an argument.
+    int             prec;       ///< The precision, or -1 if not given.
+} iw_log_bin_conv;
+
+/// @brief A registered call site.
+typedef struct _iw_log_bin_site {
+    const char     *file;   ///< The file of the call site.
+    unsigned int    line;   ///< The line of the call site.
+    const char     *fmt;    ///< The format string of the call site.
+    bool            text;   ///< True if the format can't be deferred.
+    unsigned int    nargs;  ///< The number of arguments.
+    unsigned char   args[IW_LOG_BIN_MAX_ARGS];  ///< The argument types.
+    short           prec[IW_LOG_BIN_MAX_ARGS];  ///< The precision of string
+                                                ///< arguments, -1 if none
+                                                ///< and -2 if an argument.
+} iw_log_bin_site;
+
+/// @brief The header of a record.
+typedef struct _iw_log_bin_hdr {
+    uint16_t    site;   ///< The ID of the call site.
+    uint16_t    len;    ///< The length of the record including the header.
+    uint32_t    tid;    ///< The ID of the logging thread.
+    uint64_t    time;   ///< The time of the message in ns since the epoch.
+} iw_log_bin_hdr;
+
+/// @brief The record buffer of a thread.
+/// The positions are offsets from the start of the buffer that are never
+/// wrapped, the record at a position is at the position modulo the size.
+typedef struct _iw_log_bin_buff {
+    struct _iw_log_bin_buff *next;  ///< The next buffer.
+    pthread_mutex_t lock;           ///< Protects the buffer from dumps.
+    bool            owned;          ///< True if a thread uses the buffer.
+    size_t          size;           ///< The size of the data.
+    uint64_t        start;          ///< The position of the oldest record.
+    uint64_t        end;            ///< The position of the next record.
+    unsigned long   records;        ///< The number of records buffered.
+    unsigned long   logged;         ///< The number of records logged.
+    unsigned long   overwritten;    ///< The number of records overwritten.
+    unsigned long   text;           ///< The number of text records.
+    char            data[];         ///< The records.
+} iw_log_bin_buff;
+
+// --------------------------------------------------------------------------
+//
+// Variables
+//
+// --------------------------------------------------------------------------
+
+bool s_log_binary = false;
+
+/// Protects the site table and the list of buffers.
+static pthread_mutex_t s_bin_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// The site table, in chunks so that entries never move.
+static iw_log_bin_site *s_sites[(IW_LOG_BIN_MAX_SITES + 1) / IW_LOG_BIN_CHUNK + 1];
+
+/// The highest registered site ID.
+static unsigned int s_site_count = 0;
+
+/// The thread buffers.
+static iw_log_bin_buff *s_buffs = NULL;
+
+/// The size of new thread buffers.
+static size_t s_buff_size = 0;
+
+/// Incremented when the buffers are freed so threads drop their buffer.
+static unsigned int s_buff_gen = 1;
+
+/// The number of threads that may be recording a message. The buffers are
+/// only freed once binary logging is off and this is zero.
+static unsigned int s_recorders __attribute__((aligned(64))) = 0;
+
+/// Used to hand back the buffer of a thread when the thread exits.
+static pthread_key_t s_buff_key;
+
+/// True if the buffer key has been created.
+static bool s_buff_key_created = false;
+
+/// The buffer of the current thread.
+static __thread iw_log_bin_buff *s_buff = NULL;
+
+/// The generation of the buffer of the current thread.
+static __thread unsigned int s_buff_gen_used = 0;
+
+// --------------------------------------------------------------------------
+//
+// Format parsing
+//
+// --------------------------------------------------------------------------
+
+/// @brief Parse a conversion specification.
+/// @param fmt The format string at the '%' character.
+/// @param conv [out] The parsed conversion.
+/// @return The format string after the conversion specification.
+static const char *iw_log_bin_parse(const char *fmt, iw_log_bin_conv *conv) {
+    const char *ptr = fmt + 1;
+    char len = '\0';
+    conv->type       = IW_LOG_BIN_ARG_NONE;
+    conv->valid      = true;
+    conv->star_width = false;
+    conv->star_prec  = false;
+    conv->prec       = -1;
+    if(*ptr == '%') {
+        return ptr + 1;
+    }
+
+    // Flags and width. Positional arguments, "%1$d", aren't supported.
+    while(*ptr != '\0' && strchr("-+ #0'I", *ptr) != NULL) {
+        ptr++;
+    }
+    if(*ptr == '*') {
+        conv->star_width = true;
+        ptr++;
+    }
+    while(*ptr >= '0' && *ptr <= '9') {
+        ptr++;
+    }
+    if(*ptr == '$') {
+        conv->valid = false;
+        return ptr + 1;
+    }
+
+    // Precision
+    if(*ptr == '.') {
+        ptr++;
+        if(*ptr == '*') {
+            conv->star_prec = true;
+            ptr++;
+        } else {
+            conv->prec = 0;
+            while(*ptr >= '0' && *ptr <= '9') {
+                if(conv->prec < 10000) {
+                    conv->prec = conv->prec * 10 + (*ptr - '0');
+                }
+                ptr++;
+            }
+        }
+    }
+
+    // Length modifier, "hh" is treated as "h" and "ll" as "q".
+    switch(*ptr) {
+    case 'h' :
+        len = *ptr++;
+        if(*ptr == 'h') {
+            ptr++;
+        }
+        break;
+    case 'l' :
+        len = *ptr++;
+        if(*ptr == 'l') {
+            len = 'q';
+            ptr++;
+        }
+        break;
+    case 'q' :
+    case 'L' :
+    case 'j' :
+    case 'z' :
+    case 'Z' :
+    case 't' :
+        len = *ptr++;
+        break;
+    }
+
+    switch(*ptr) {
+    case 'd' :
+    case 'i' :
+    case 'o' :
+    case 'u' :
+    case 'x' :
+    case 'X' :
+        switch(len) {
+        case 'l' : conv->type = IW_LOG_BIN_ARG_LONG;    break;
+        case 'q' :
+        case 'L' : conv->type = IW_LOG_BIN_ARG_LLONG;   break;
+        case 'j' : conv->type = IW_LOG_BIN_ARG_INTMAX;  break;
+        case 'z' :
+        case 'Z' : conv->type = IW_LOG_BIN_ARG_SIZE;    break;
+        case 't' : conv->type = IW_LOG_BIN_ARG_PTRDIFF; break;
+        default  : conv->type = IW_LOG_BIN_ARG_INT;     break;
+        }
+        break;
+    case 'c' :
+        conv->type  = IW_LOG_BIN_ARG_INT;
+        conv->valid = len == '\0';
+        break;
+    case 'e' :
+    case 'E' :
+    case 'f' :
+    case 'F' :
+    case 'g' :
+    case 'G' :
+    case 'a' :
+    case 'A' :
+        conv->type = len == 'L' ? IW_LOG_BIN_ARG_LDOUBLE : IW_LOG_BIN_ARG_DOUBLE;
+        break;
+    case 's' :
+        conv->type  = IW_LOG_BIN_ARG_STR;
+        conv->valid = len == '\0';
+        break;
+    case 'p' :
+        conv->type = IW_LOG_BIN_ARG_PTR;
+        break;
+    case '\0' :
+        conv->valid = false;
+        return ptr;
+    default :
+        // Conversions such as "%n" and "%m" are formatted when logged.
+        conv->valid = false;
+        break;
+    }
+    return ptr + 1;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Parse the format string of a call site into its argument types.
+/// @param info The call site with the format string to parse.
+static void iw_log_bin_parse_site(iw_log_bin_site *info) {
+    const char *ptr = info->fmt;
+    info->nargs = 0;
+    info->text  = false;
+    while((ptr = strchr(ptr, '%')) != NULL) {
+        iw_log_bin_conv conv;
+        ptr = iw_log_bin_parse(ptr, &conv);
+        if(!conv.valid || info->nargs + 3 > IW_LOG_BIN_MAX_ARGS) {
+            info->text = true;
+            return;
+        }
+        if(conv.star_width) {
+            info->prec[info->nargs]   = -1;
+            info->args[info->nargs++] = IW_LOG_BIN_ARG_INT;
+        }
+        if(conv.star_prec) {
+            info->prec[info->nargs]   = -1;
+            info->args[info->nargs++] = IW_LOG_BIN_ARG_INT;
+        }
+        if(conv.type != IW_LOG_BIN_ARG_NONE) {
+            info->prec[info->nargs]   = conv.star_prec ? -2 : conv.prec;
+            info->args[info->nargs++] = conv.type;
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get a registered call site.
+/// @param id The ID of the call site.
+/// @return The call site.
+static iw_log_bin_site *iw_log_bin_get_site(unsigned int id) {
+    return &s_sites[id / IW_LOG_BIN_CHUNK][id % IW_LOG_BIN_CHUNK];
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Register a call site in the site table.
+/// @param site The descriptor of the call site.
+/// @param msg The format string of the call site.
+/// @return The ID of the call site, or zero if the table is full.
+static unsigned int iw_log_bin_register(iw_log_site *site, const char *msg) {
+    pthread_mutex_lock(&s_bin_lock);
+    unsigned int id = site->id;
+    if(id != 0) {
+        // Registered by another thread.
+        pthread_mutex_unlock(&s_bin_lock);
+        return id;
+    }
+    id = s_site_count + 1;
+    if(id > IW_LOG_BIN_MAX_SITES) {
+        pthread_mutex_unlock(&s_bin_lock);
+        return 0;
+    }
+    if(s_sites[id / IW_LOG_BIN_CHUNK] == NULL) {
+        s_sites[id / IW_LOG_BIN_CHUNK] =
+            (iw_log_bin_site *)calloc(IW_LOG_BIN_CHUNK, sizeof(iw_log_bin_site));
+        if(s_sites[id / IW_LOG_BIN_CHUNK] == NULL) {
+            pthread_mutex_unlock(&s_bin_lock);
+            return 0;
+        }
+    }
+    iw_log_bin_site *info = iw_log_bin_get_site(id);
+    info->file = site->file;
+    info->line = site->line;
+    info->fmt  = msg;
+    iw_log_bin_parse_site(info);
+    __atomic_store_n(&s_site_count, id, __ATOMIC_RELEASE);
+    __atomic_store_n(&site->id, id, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&s_bin_lock);
+    return id;
+}
+
+// --------------------------------------------------------------------------
+//
+// Recording
+//
+// --------------------------------------------------------------------------
+
+/// @brief Hand back the buffer of an exiting thread.
+/// @param arg The buffer of the thread.
+static void iw_log_bin_release(void *arg) {
+    iw_log_bin_buff *buff = (iw_log_bin_buff *)arg;
+    pthread_mutex_lock(&s_bin_lock);
+    buff->owned = false;
+    pthread_mutex_unlock(&s_bin_lock);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the buffer of the current thread.
+/// @return The buffer, or NULL if no buffer could be allocated.
+static iw_log_bin_buff *iw_log_bin_thread_buff() {
+    unsigned int gen = __atomic_load_n(&s_buff_gen, __ATOMIC_ACQUIRE);
+    if(s_buff != NULL && s_buff_gen_used == gen) {
+        return s_buff;
+    }
+
+    pthread_mutex_lock(&s_bin_lock);
+    iw_log_bin_buff *buff;
+    for(buff=s_buffs;buff != NULL && buff->owned;buff=buff->next) {
+    }
+    if(buff == NULL) {
+        buff = (iw_log_bin_buff *)calloc(1, sizeof(iw_log_bin_buff) +
+                                            s_buff_size);
+        if(buff == NULL) {
+            pthread_mutex_unlock(&s_bin_lock);
+            return NULL;
+        }
+        pthread_mutex_init(&buff->lock, NULL);
+        buff->size = s_buff_size;
+        buff->next = s_buffs;
+        s_buffs = buff;
+    }
+    buff->owned = true;
+    pthread_mutex_unlock(&s_bin_lock);
+
+    pthread_setspecific(s_buff_key, buff);
+    s_buff = buff;
+    s_buff_gen_used = gen;
+    return buff;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Add a record to a buffer, overwriting the oldest records if needed.
+/// The buffer must be locked.
+/// @param buff The buffer.
+/// @param rec The record.
+/// @param len The length of the record.
+static void iw_log_bin_put(iw_log_bin_buff *buff, const char *rec, size_t len) {
+    size_t alen = IW_LOG_BIN_ALIGN(len);
+    uint64_t pos = buff->end;
+    size_t off = pos % buff->size;
+
+    // Records don't wrap, start over at the beginning of the buffer if the
+    // record doesn't fit at the end.
+    uint64_t newpos = off + alen > buff->size ? pos + buff->size - off : pos;
+    while(buff->start != pos && newpos + alen - buff->start > buff->size) {
+        const iw_log_bin_hdr *old =
+            (const iw_log_bin_hdr *)(buff->data + buff->start % buff->size);
+        if(old->site == IW_LOG_BIN_WRAP) {
+            buff->start += buff->size - buff->start % buff->size;
+        } else {
+            buff->start += IW_LOG_BIN_ALIGN(old->len & ~IW_LOG_BIN_TEXT);
+            buff->records--;
+            buff->overwritten++;
+        }
+    }
+    if(buff->start == pos) {
+        buff->start = newpos;
+    }
+    if(newpos != pos) {
+        ((iw_log_bin_hdr *)(buff->data + off))->site = IW_LOG_BIN_WRAP;
+    }
+    memcpy(buff->data + newpos % buff->size, rec, len);
+    buff->end = newpos + alen;
+    buff->records++;
+    buff->logged++;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Copy the arguments of a message into a record.
+/// @param info The call site of the message.
+/// @param rec The record to copy the arguments to.
+/// @param len The length of the record so far.
+/// @param argp The message arguments.
+/// @return The length of the record.
+static size_t iw_log_bin_capture(
+    const iw_log_bin_site *info,
+    char *rec,
+    size_t len,
+    va_list argp)
+{
+// Copy an argument of the given type into the record.
+#define IW_LOG_BIN_COPY(TYPE) { \
+        TYPE val = va_arg(argp, TYPE); \
+        memcpy(rec + len, &val, sizeof(val)); \
+        len += sizeof(val); \
+    }
+    int last_int = 0;
+    unsigned int cnt;
+    for(cnt=0;cnt < info->nargs;cnt++) {
+        switch(info->args[cnt]) {
+        case IW_LOG_BIN_ARG_INT :
+            last_int = va_arg(argp, int);
+            memcpy(rec + len, &last_int, sizeof(last_int));
+            len += sizeof(last_int);
+            break;
+        case IW_LOG_BIN_ARG_LONG    : IW_LOG_BIN_COPY(long);            break;
+        case IW_LOG_BIN_ARG_LLONG   : IW_LOG_BIN_COPY(long long);       break;
+        case IW_LOG_BIN_ARG_INTMAX  : IW_LOG_BIN_COPY(intmax_t);        break;
+        case IW_LOG_BIN_ARG_SIZE    : IW_LOG_BIN_COPY(size_t);          break;
+        case IW_LOG_BIN_ARG_PTRDIFF : IW_LOG_BIN_COPY(ptrdiff_t);       break;
+        case IW_LOG_BIN_ARG_DOUBLE  : IW_LOG_BIN_COPY(double);          break;
+        case IW_LOG_BIN_ARG_LDOUBLE : IW_LOG_BIN_COPY(long double);     break;
+        case IW_LOG_BIN_ARG_PTR     : IW_LOG_BIN_COPY(void *);          break;
+        case IW_LOG_BIN_ARG_STR : {
+            const char *str = va_arg(argp, const char *);
+            if(str == NULL) {
+                str = "(null)";
+            }
+            // Only the characters that will be shown are copied, a string
+            // with a precision doesn't have to be terminated. Room is left
+            // for the arguments that follow.
+            size_t max = IW_LOG_BIN_MAX_RECORD - len - sizeof(uint16_t) -
+                         (info->nargs - cnt - 1) * sizeof(long double);
+            int prec = info->prec[cnt] == -2 ? last_int : info->prec[cnt];
+            if(prec >= 0 && (size_t)prec < max) {
+                max = prec;
+            }
+            uint16_t slen = strnlen(str, max);
+            memcpy(rec + len, &slen, sizeof(slen));
+            memcpy(rec + len + sizeof(slen), str, slen);
+            len += sizeof(slen) + slen;
+            } break;
+        default :
+            break;
+        }
+    }
+    return len;
+#undef IW_LOG_BIN_COPY
+}
+
+// --------------------------------------------------------------------------
+//
+// Formatting
+//
+// --------------------------------------------------------------------------
+
+/// @brief Format the arguments of a record according to a format string.
+/// @param out The file stream to write the message to.
+/// @param fmt The format string.
+/// @param args The recorded arguments.
+/// @param len The length of the arguments.
+static void iw_log_bin_format(
+    FILE *out,
+    const char *fmt,
+    const char *args,
+    size_t len)
+{
+// Get the next argument, or give up if the record is too short.
+#define IW_LOG_BIN_GET(TYPE, VAR) \
+        TYPE VAR; \
+        if(pos + sizeof(VAR) > len) { \
+            fputs("<?>", out); \
+            return; \
+        } \
+        memcpy(&VAR, args + pos, sizeof(VAR)); \
+        pos += sizeof(VAR);
+// Print an argument with the width and precision arguments, if any.
+#define IW_LOG_BIN_PRINT(VAL) \
+        (nstars == 0 ? fprintf(out, spec, VAL) : \
+         nstars == 1 ? fprintf(out, spec, stars[0], VAL) : \
+                       fprintf(out, spec, stars[0], stars[1], VAL))
+    size_t pos = 0;
+    const char *ptr = fmt;
+    const char *pct;
+    while((pct = strchr(ptr, '%')) != NULL) {
+        fwrite(ptr, 1, pct - ptr, out);
+        iw_log_bin_conv conv;
+        ptr = iw_log_bin_parse(pct, &conv);
+        if(conv.type == IW_LOG_BIN_ARG_NONE && conv.valid) {
+            fputc('%', out);
+            continue;
+        }
+        char spec[64];
+        size_t slen = ptr - pct;
+        if(!conv.valid || slen >= sizeof(spec)) {
+            fwrite(pct, 1, slen, out);
+            continue;
+        }
+        memcpy(spec, pct, slen);
+        spec[slen] = '\0';
+
+        int stars[2];
+        int nstars = 0;
+        if(conv.star_width) {
+            IW_LOG_BIN_GET(int, width);
+            stars[nstars++] = width;
+        }
+        if(conv.star_prec) {
+            IW_LOG_BIN_GET(int, prec);
+            stars[nstars++] = prec;
+        }
+        switch(conv.type) {
+        case IW_LOG_BIN_ARG_INT : {
+            IW_LOG_BIN_GET(int, val);
+            IW_LOG_BIN_PRINT(val);
+            } break;
+        case IW_LOG_BIN_ARG_LONG : {
+            IW_LOG_BIN_GET(long, val);
+            IW_LOG_BIN_PRINT(val);
+            } break;
+        case IW_LOG_BIN_ARG_LLONG : {
+            IW_LOG_BIN_GET(long long, val);
+            IW_LOG_BIN_PRINT(val);
+            } break;
+        case IW_LOG_BIN_ARG_INTMAX : {
+            IW_LOG_BIN_GET(intmax_t, val);
+            IW_LOG_BIN_PRINT(val);
+            } break;
+        case IW_LOG_BIN_ARG_SIZE : {
+            IW_LOG_BIN_GET(size_t, val);
+            IW_LOG_BIN_PRINT(val);
+            } break;
+        case IW_LOG_BIN_ARG_PTRDIFF : {
+            IW_LOG_BIN_GET(ptrdiff_t, val);
+            IW_LOG_BIN_PRINT(val);
+            } break;
+        case IW_LOG_BIN_ARG_DOUBLE : {
+            IW_LOG_BIN_GET(double, val);
+            IW_LOG_BIN_PRINT(val);
+            } break;
+        case IW_LOG_BIN_ARG_LDOUBLE : {
+            IW_LOG_BIN_GET(long double, val);
+            IW_LOG_BIN_PRINT(val);
+            } break;
+        case IW_LOG_BIN_ARG_PTR : {
+            IW_LOG_BIN_GET(void *, val);
+            IW_LOG_BIN_PRINT(val);
+            } break;
+        case IW_LOG_BIN_ARG_STR : {
+            IW_LOG_BIN_GET(uint16_t, slen);
+            char str[IW_LOG_BIN_MAX_RECORD];
+            if(pos + slen > len) {
+                fputs("<?>", out);
+                return;
+            }
+            memcpy(str, args + pos, slen);
+            str[slen] = '\0';
+            pos += slen;
+            IW_LOG_BIN_PRINT(str);
+            } break;
+        default :
+            break;
+        }
+    }
+    fputs(ptr, out);
+#undef IW_LOG_BIN_GET
+#undef IW_LOG_BIN_PRINT
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Format a record.
+/// @param out The file stream to write the message to.
+/// @param file The file of the call site.
+/// @param line The line of the call site.
+/// @param fmt The format string of the call site.
+/// @param hdr The record.
+static void iw_log_bin_render(
+    FILE *out,
+    const char *file,
+    unsigned int line,
+    const char *fmt,
+    const iw_log_bin_hdr *hdr)
+{
+    time_t secs = hdr->time / 1000000000ULL;
+    struct tm tm;
+    localtime_r(&secs, &tm);
+    fprintf(out, "%02d:%02d:%02d.%06u [%X]%s(%d): ",
+            tm.tm_hour, tm.tm_min, tm.tm_sec,
+            (unsigned int)(hdr->time % 1000000000ULL / 1000),
+            hdr->tid, file, line);
+    const char *args = (const char *)(hdr + 1);
+    size_t len = (hdr->len & ~IW_LOG_BIN_TEXT) - sizeof(*hdr);
+    if(hdr->len & IW_LOG_BIN_TEXT) {
+        fwrite(args, 1, len, out);
+    } else {
+        iw_log_bin_format(out, fmt, args, len);
+    }
+    fputc('\n', out);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Compare two records by time, and by their order in the buffer of
+/// a thread if the time is the same.
+/// @param a The first record.
+/// @param b The second record.
+/// @return Less than, equal to, or greater than zero if the first record is
+/// older than, the same as, or newer than the second record.
+static int iw_log_bin_compare(const void *a, const void *b) {
+    const iw_log_bin_hdr *rec_a = *(const iw_log_bin_hdr **)a;
+    const iw_log_bin_hdr *rec_b = *(const iw_log_bin_hdr **)b;
+    if(rec_a->time != rec_b->time) {
+        return rec_a->time < rec_b->time ? -1 : 1;
+    }
+    return rec_a < rec_b ? -1 : (rec_a > rec_b ? 1 : 0);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Copy the records of all buffers, sorted by time.
+/// @param recs [out] The sorted records, to be freed by the caller.
+/// @param count [out] The number of records.
+/// @return The copied record data to be freed by the caller, or NULL if
+/// there are no records.
+static char *iw_log_bin_collect(iw_log_bin_hdr ***recs, size_t *count) {
+    *recs  = NULL;
+    *count = 0;
+    pthread_mutex_lock(&s_bin_lock);
+    size_t total = 0;
+    iw_log_bin_buff *buff;
+    for(buff=s_buffs;buff != NULL;buff=buff->next) {
+        total += buff->size;
+    }
+    char *data = total != 0 ? (char *)malloc(total) : NULL;
+    iw_log_bin_hdr **index = total != 0 ?
+        (iw_log_bin_hdr **)malloc(total / sizeof(iw_log_bin_hdr) *
+                                  sizeof(iw_log_bin_hdr *)) : NULL;
+    if(data == NULL || index == NULL) {
+        pthread_mutex_unlock(&s_bin_lock);
+        free(data);
+        free(index);
+        return NULL;
+    }
+    size_t used = 0;
+    for(buff=s_buffs;buff != NULL;buff=buff->next) {
+        pthread_mutex_lock(&buff->lock);
+        uint64_t pos = buff->start;
+        while(pos != buff->end) {
+            const iw_log_bin_hdr *hdr =
+                (const iw_log_bin_hdr *)(buff->data + pos % buff->size);
+            if(hdr->site == IW_LOG_BIN_WRAP) {
+                pos += buff->size - pos % buff->size;
+                continue;
+            }
+            size_t alen = IW_LOG_BIN_ALIGN(hdr->len & ~IW_LOG_BIN_TEXT);
+            memcpy(data + used, hdr, alen);
+            index[(*count)++] = (iw_log_bin_hdr *)(data + used);
+            used += alen;
+            pos  += alen;
+        }
+        pthread_mutex_unlock(&buff->lock);
+    }
+    pthread_mutex_unlock(&s_bin_lock);
+
+    qsort(index, *count, sizeof(iw_log_bin_hdr *), iw_log_bin_compare);
+    *recs = index;
+    return data;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Record a log message in the buffer of the calling thread.
+/// @param site The descriptor of the call site.
+/// @param msg The message format.
+/// @param argp The message arguments.
+/// @return True if the message was recorded.
+static bool iw_log_bin_write(
+    iw_log_site *site,
+    const char *msg,
+    va_list argp)
+{
+    unsigned int id = __atomic_load_n(&site->id, __ATOMIC_ACQUIRE);
+    if(id == 0 && (id = iw_log_bin_register(site, msg)) == 0) {
+        return false;
+    }
+    iw_log_bin_buff *buff = iw_log_bin_thread_buff();
+    if(buff == NULL) {
+        return false;
+    }
+
+    uint64_t rec_data[IW_LOG_BIN_MAX_RECORD / sizeof(uint64_t)];
+    char *rec = (char *)rec_data;
+    iw_log_bin_hdr *hdr = (iw_log_bin_hdr *)rec;
+    size_t len = sizeof(iw_log_bin_hdr);
+    const iw_log_bin_site *info = iw_log_bin_get_site(id);
+    // A site may log a format string that isn't a literal, it is recorded
+    // as text unless it is the same one that was registered.
+    bool text = info->text || info->fmt != msg;
+    if(text) {
+        int res = vsnprintf(rec + len, IW_LOG_BIN_MAX_RECORD - len, msg, argp);
+        if(res > 0) {
+            len += (size_t)res < IW_LOG_BIN_MAX_RECORD - len ?
+                   (size_t)res : IW_LOG_BIN_MAX_RECORD - len - 1;
+        }
+    } else {
+        len = iw_log_bin_capture(info, rec, len, argp);
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    hdr->site = id;
+    hdr->len  = len | (text ? IW_LOG_BIN_TEXT : 0);
+    hdr->tid  = (uint32_t)pthread_self();
+    hdr->time = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+    pthread_mutex_lock(&buff->lock);
+    iw_log_bin_put(buff, rec, len);
+    if(text) {
+        buff->text++;
+    }
+    pthread_mutex_unlock(&buff->lock);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+bool iw_log_bin_start(size_t size) {
+    pthread_mutex_lock(&s_bin_lock);
+    if(!s_buff_key_created) {
+        if(pthread_key_create(&s_buff_key, iw_log_bin_release) != 0) {
+            pthread_mutex_unlock(&s_bin_lock);
+            return false;
+        }
+        s_buff_key_created = true;
+    }
+    // Buffers already allocated keep their size.
+    s_buff_size = IW_LOG_BIN_ALIGN(size < IW_LOG_BIN_MIN_SIZE ?
+                                   IW_LOG_BIN_MIN_SIZE : size);
+    pthread_mutex_unlock(&s_bin_lock);
+    __atomic_store_n(&s_log_binary, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_bin_stop() {
+    __atomic_store_n(&s_log_binary, false, __ATOMIC_SEQ_CST);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_bin_exit() {
+    iw_log_bin_stop();
+    // Threads that saw binary logging on may still be writing to their
+    // buffers.
+    while(__atomic_load_n(&s_recorders, __ATOMIC_ACQUIRE) != 0) {
+        sched_yield();
+    }
+    pthread_mutex_lock(&s_bin_lock);
+    while(s_buffs != NULL) {
+        iw_log_bin_buff *buff = s_buffs;
+        s_buffs = buff->next;
+        pthread_mutex_destroy(&buff->lock);
+        free(buff);
+    }
+    __atomic_add_fetch(&s_buff_gen, 1, __ATOMIC_RELEASE);
+    if(s_buff_key_created) {
+        pthread_key_delete(s_buff_key);
+        s_buff_key_created = false;
+    }
+    // The site table is kept since the call site descriptors keep their ID.
+    pthread_mutex_unlock(&s_bin_lock);
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_log_bin_record(
+    iw_log_site *site,
+    const char *msg,
+    va_list argp)
+{
+    if(!__atomic_load_n(&s_log_binary, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    // Announce the recorder before checking the flag again so that
+    // iw_log_bin_exit() can wait for it before freeing the buffers.
+    __atomic_add_fetch(&s_recorders, 1, __ATOMIC_SEQ_CST);
+    bool recorded = __atomic_load_n(&s_log_binary, __ATOMIC_SEQ_CST) &&
+                    iw_log_bin_write(site, msg, argp);
+    __atomic_sub_fetch(&s_recorders, 1, __ATOMIC_RELEASE);
+    return recorded;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_log_bin_stats_get(iw_log_bin_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&s_bin_lock);
+    stats->sites = s_site_count;
+    iw_log_bin_buff *buff;
+    for(buff=s_buffs;buff != NULL;buff=buff->next) {
+        pthread_mutex_lock(&buff->lock);
+        stats->buffers++;
+        stats->bytes       += buff->size;
+        stats->records     += buff->records;
+        stats->logged      += buff->logged;
+        stats->overwritten += buff->overwritten;
+        stats->text        += buff->text;
+        pthread_mutex_unlock(&buff->lock);
+    }
+    pthread_mutex_unlock(&s_bin_lock);
+    return __atomic_load_n(&s_log_binary, __ATOMIC_ACQUIRE);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_log_bin_dump(FILE *out) {
+    iw_log_bin_hdr **recs;
+    size_t count;
+    char *data = iw_log_bin_collect(&recs, &count);
+    size_t cnt;
+    for(cnt=0;cnt < count;cnt++) {
+        const iw_log_bin_site *info = iw_log_bin_get_site(recs[cnt]->site);
+        iw_log_bin_render(out, info->file, info->line, info->fmt, recs[cnt]);
+    }
+    free(recs);
+    free(data);
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_log_bin_save(const char *file) {
+    FILE *fd = fopen(file, "w");
+    if(fd == NULL) {
+        return false;
+    }
+    iw_log_bin_hdr **recs;
+    size_t count;
+    char *data = iw_log_bin_collect(&recs, &count);
+
+    // The header and the site table, followed by the records.
+    uint32_t version = IW_LOG_BIN_VERSION;
+    uint32_t sites = __atomic_load_n(&s_site_count, __ATOMIC_ACQUIRE);
+    bool ok = fwrite(IW_LOG_BIN_MAGIC, 8, 1, fd) == 1 &&
+              fwrite(&version, sizeof(version), 1, fd) == 1 &&
+              fwrite(&sites, sizeof(sites), 1, fd) == 1;
+    uint32_t id;
+    for(id=1;ok && id <= sites;id++) {
+        const iw_log_bin_site *info = iw_log_bin_get_site(id);
+        uint32_t line = info->line;
+        uint16_t file_len = strlen(info->file);
+        uint16_t fmt_len = strlen(info->fmt);
+        ok = fwrite(&line, sizeof(line), 1, fd) == 1 &&
+             fwrite(&file_len, sizeof(file_len), 1, fd) == 1 &&
+             fwrite(&fmt_len, sizeof(fmt_len), 1, fd) == 1 &&
+             fwrite(info->file, 1, file_len, fd) == file_len &&
+             fwrite(info->fmt, 1, fmt_len, fd) == fmt_len;
+    }
+    size_t cnt;
+    for(cnt=0;ok && cnt < count;cnt++) {
+        size_t len = recs[cnt]->len & ~IW_LOG_BIN_TEXT;
+        ok = fwrite(recs[cnt], 1, len, fd) == len;
+    }
+    free(recs);
+    free(data);
+    return fclose(fd) == 0 && ok;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_log_bin_decode(FILE *in, FILE *out) {
+    char magic[8];
+    uint32_t version, sites;
+    if(fread(magic, sizeof(magic), 1, in) != 1 ||
+       memcmp(magic, IW_LOG_BIN_MAGIC, sizeof(magic)) != 0 ||
+       fread(&version, sizeof(version), 1, in) != 1 ||
+       version != IW_LOG_BIN_VERSION ||
+       fread(&sites, sizeof(sites), 1, in) != 1 ||
+       sites > IW_LOG_BIN_MAX_SITES)
+    {
+        return false;
+    }
+
+    // Read the site table, the strings are kept in one allocation per site.
+    bool ok = true;
+    uint32_t *lines = (uint32_t *)calloc(sites + 1, sizeof(uint32_t));
+    char **strs = (char **)calloc(sites + 1, sizeof(char *));
+    uint32_t id;
+    for(id=1;ok && lines != NULL && strs != NULL && id <= sites;id++) {
+        uint16_t file_len, fmt_len;
+        ok = fread(&lines[id], sizeof(uint32_t), 1, in) == 1 &&
+             fread(&file_len, sizeof(file_len), 1, in) == 1 &&
+             fread(&fmt_len, sizeof(fmt_len), 1, in) == 1 &&
+             (strs[id] = (char *)malloc(file_len + fmt_len + 2)) != NULL &&
+             fread(strs[id], 1, file_len, in) == file_len &&
+             fread(strs[id] + file_len + 1, 1, fmt_len, in) == fmt_len;
+        if(ok) {
+            strs[id][file_len] = '\0';
+            strs[id][file_len + 1 + fmt_len] = '\0';
+        }
+    }
+    ok = ok && lines != NULL && strs != NULL;
+
+    // Format the records.
+    uint64_t rec_data[IW_LOG_BIN_MAX_RECORD / sizeof(uint64_t)];
+    iw_log_bin_hdr *hdr = (iw_log_bin_hdr *)rec_data;
+    while(ok && fread(hdr, sizeof(*hdr), 1, in) == 1) {
+        size_t len = hdr->len & ~IW_LOG_BIN_TEXT;
+        if(hdr->site == 0 || hdr->site > sites ||
+           len < sizeof(*hdr) || len > IW_LOG_BIN_MAX_RECORD ||
+           fread(hdr + 1, 1, len - sizeof(*hdr), in) != len - sizeof(*hdr))
+        {
+            ok = false;
+            break;
+        }
+        const char *file = strs[hdr->site];
+        iw_log_bin_render(out, file, lines[hdr->site],
+                          file + strlen(file) + 1, hdr);
+    }
+
+    for(id=1;strs != NULL && id <= sites;id++) {
+        free(strs[id]);
+    }
+    free(strs);
+    free(lines);
+    return ok;
+}
+
+// --------------------------------------------------------------------------
@@ -14,6 +14,66 @@
 extern "C" {
 #endif
 
+#include "iw_log.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// --------------------------------------------------------------------------
+//
+// Asynchronous logging
+//
+// --------------------------------------------------------------------------
+
+/// @brief What to do with a log message when the log ring is full.
+typedef enum _IW_LOG_OVERFLOW {
+    IW_LOG_OVERFLOW_DROP,   ///< Drop the message.
+    IW_LOG_OVERFLOW_BLOCK,  ///< Wait until the writer has made room.
+    IW_LOG_OVERFLOW_COUNT   ///< Drop the message and note the number of
+                            ///< dropped messages in the log output.
+} IW_LOG_OVERFLOW;
+
+// --------------------------------------------------------------------------
+
+/// @brief The statistics of the asynchronous log pipeline.
+typedef struct _iw_log_stats {
+    unsigned long   ring_size;      ///< The number of slots in the ring.
+    IW_LOG_OVERFLOW overflow;       ///< The overflow policy.
+    unsigned long   queued;         ///< The messages currently queued.
+    unsigned long   peak_queued;    ///< The most messages queued at once.
+    unsigned long   written;        ///< The messages written.
+    unsigned long   dropped;        ///< The messages dropped.
+    unsigned long   truncated;      ///< The messages truncated to fit a slot.
+    unsigned long   blocked;        ///< The messages that had to wait for
+                                    ///< room in the ring.
+    unsigned long   batches;        ///< The number of writev() calls.
+    unsigned long   bytes;          ///< The bytes written.
+    unsigned long   errors;         ///< The number of failed writes.
+    uint64_t        latency_total;  ///< The total queue latency in ns.
+    uint64_t        latency_max;    ///< The highest queue latency in ns.
+} iw_log_stats;
+
+/// @brief The statistics of the binary log.
+typedef struct _iw_log_bin_stats {
+    unsigned long   sites;          ///< The number of registered call sites.
+    unsigned long   buffers;        ///< The number of thread buffers.
+    unsigned long   bytes;          ///< The total size of the buffers.
+    unsigned long   records;        ///< The records currently buffered.
+    unsigned long   logged;         ///< The records logged.
+    unsigned long   overwritten;    ///< The records overwritten by newer ones.
+    unsigned long   text;           ///< The records formatted when logged,
+                                    ///< since their format couldn't be
+                                    ///< deferred.
+} iw_log_bin_stats;
+
+// --------------------------------------------------------------------------
+
+/// True if log messages are recorded in the binary log.
+extern bool s_log_binary;
+
 // --------------------------------------------------------------------------
 //
 // Function API
@@ -25,6 +85,130 @@ extern void iw_log_init();
 
 // --------------------------------------------------------------------------
 
+/// @brief List the log call sites selected by a filter.
+/// @param out The file stream to write the call sites to.
+/// @param filter The filter selecting the call sites.
+extern void iw_log_site_list(FILE *out, const iw_log_site_filter *filter);
+
+// --------------------------------------------------------------------------
+
+/// @brief Set the rate limit and duplicate suppression of text messages.
+/// Both apply to each call site separately.
+/// @param rate The messages per second allowed once the burst is used up,
+///        zero for no rate limit.
+/// @param burst The messages that may be written at once.
+/// @param duplicates True if messages identical to the previous message
+///        from the call site should only be counted.
+extern void iw_log_limit(unsigned int rate, unsigned int burst, bool duplicates);
+
+// --------------------------------------------------------------------------
+
+/// @brief Start the log writer thread if asynchronous logging is enabled.
+/// The thread module must be initialized.
+/// @return True if log messages are written by the writer thread.
+extern bool iw_log_start();
+
+// --------------------------------------------------------------------------
+
+/// @brief Stop the log writer thread.
+/// The queued messages are written out and later messages are written
+/// directly by the thread issuing them.
+extern void iw_log_stop();
+
+// --------------------------------------------------------------------------
+
+/// @brief Wait until the messages queued so far have been written.
+extern void iw_log_flush();
+
+// --------------------------------------------------------------------------
+
+/// @brief Write out the queued messages from a crash handler.
+/// The messages are written directly to the log device without waiting
+/// for the writer thread.
+extern void iw_log_crash_flush();
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the statistics of the asynchronous log pipeline.
+/// @param stats [out] The statistics.
+/// @return True if asynchronous logging is running.
+extern bool iw_log_stats_get(iw_log_stats *stats);
+
+// --------------------------------------------------------------------------
+
+/// @brief Show the statistics of the asynchronous log pipeline.
+/// @param out The file stream to write the response to.
+extern void iw_log_show_stats(FILE *out);
+
+// --------------------------------------------------------------------------
+//
+// Binary logging
+//
+// --------------------------------------------------------------------------
+
+/// @brief Start recording log messages in the binary log.
+/// @param size The size in bytes of the buffer of each thread.
+/// @return True if binary logging was started.
+extern bool iw_log_bin_start(size_t size);
+
+// --------------------------------------------------------------------------
+
+/// @brief Stop recording log messages in the binary log.
+/// The recorded messages are kept and can still be dumped.
+extern void iw_log_bin_stop();
+
+// --------------------------------------------------------------------------
+
+/// @brief Free the binary log buffers.
+extern void iw_log_bin_exit();
+
+// --------------------------------------------------------------------------
+
+/// @brief Record a log message in the binary log.
+/// Only the call site ID, the time, the thread ID and the raw arguments are
+/// recorded. The message is formatted when the log is dumped.
+/// @param site The descriptor of the call site.
+/// @param msg The message format.
+/// @param argp The message arguments.
+/// @return True if the message was recorded, false if it should be logged
+/// as text.
+extern bool iw_log_bin_record(
+    iw_log_site *site,
+    const char *msg,
+    va_list argp);
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the statistics of the binary log.
+/// @param stats [out] The statistics.
+/// @return True if binary logging is running.
+extern bool iw_log_bin_stats_get(iw_log_bin_stats *stats);
+
+// --------------------------------------------------------------------------
+
+/// @brief Format the recorded messages of all threads, oldest first.
+/// @param out The file stream to write the messages to.
+extern void iw_log_bin_dump(FILE *out);
+
+// --------------------------------------------------------------------------
+
+/// @brief Save the recorded messages, and the call sites, in binary form.
+/// The file can be formatted later with iw_log_bin_decode() on a machine
+/// with the same byte order and type sizes.
+/// @param file The file to save the binary log to.
+/// @return True if the binary log was saved.
+extern bool iw_log_bin_save(const char *file);
+
+// --------------------------------------------------------------------------
+
+/// @brief Format the messages of a saved binary log.
+/// @param in The file stream to read the binary log from.
+/// @param out The file stream to write the messages to.
+/// @return True if the binary log was valid.
+extern bool iw_log_bin_decode(FILE *in, FILE *out);
+
+// --------------------------------------------------------------------------
+
 #ifdef _cplusplus
 }
 #endif
@@ -74,6 +74,9 @@ void iw_init() {
         iw_thread_init();
         iw_thread_register_main();
 
+        // Once threads can be created, the log writer thread can be started.
+        iw_log_start();
+
         // After that we initialize the mutex and memory modules.
         iw_mutex_init();
         iw_memory_init();
@@ -103,6 +106,7 @@ void iw_exit() {
     iw_cmd_srv_exit();
     iw_cmd_exit();
     iw_syslog_exit();
+    iw_log_stop();
     iw_thread_exit();
     iw_mutex_exit();
     iw_memory_exit();
@@ -3,35 +3,95 @@
 /// @file iw_memory.c
 ///
 /// The memory chunks are laid out as follows:
-/// +----+----+----+---------------------+----+
-/// | C  | L  | Pr |  Memory             | Po |
-/// +----+----+----+---------------------+----+
+/// +----+----+----+----+----+----+----+----+----+---------------------+----+
+/// | N  | F  | L  | S  | B  | A  | T  | C  | Pr |  Memory             | Po |
+/// +----+----+----+----+----+----+----+----+----+---------------------+----+
 /// Where
+/// N = The list node linking the chunk into its shard
+/// F, L = File and line the memory was allocated at
+/// S = Size of the memory and the shard the chunk belongs to
+/// B = Interned call-stack of the allocation (if recorded)
+/// A = The time the memory was allocated
+/// T = The memory tag of the allocating thread and the chunk flags
 /// C = Cookie value
-/// L = Length of memory
 /// Pr = Pre-guard value
 /// Mem = Allocated memory
 /// Po = Post-guard value
 ///
+/// The header is a multiple of 16 bytes so the memory keeps the alignment
+/// of malloc(). Each thread adds its allocations to its own shard so that
+/// threads only contend when freeing memory allocated by another thread.
+/// The shard counters are summed up when a memory report is requested.
+///
+/// Every allocation is also counted in a power-of-two size class histogram
+/// along with its lifetime when freed. The histogram counters are kept per
+/// CPU rather than per shard since the allocation rate of each class is
+/// what matters, not which thread allocated. The health thread turns the
+/// counters into allocation and free rates once per tick.
+///
+/// In sampling mode only about one allocation per sampling interval bytes
+/// is added to a shard, with the sampling points drawn from a Poisson
+/// process like the tcmalloc heap profiler. Each sampled allocation then
+/// stands for 1 / (1 - e^(-size / interval)) allocations of its size so the
+/// live heap by allocation site can be estimated at a small cost.
+///
+/// Call-stacks are interned in a stack table so that all allocations made
+/// from the same call path share one copy of the stack. The return
+/// addresses are only turned into symbols when a report is printed.
+///
+/// Threads can set a memory tag, allocations made while a tag is set are
+/// accounted to the tag until they are freed, whichever thread frees them.
+/// Untagged allocations are not accounted to a tag so that they don't
+/// contend on a shared counter.
+///
+/// The health thread can scan the tracked chunks for guard corruption in
+/// the background. Each shard keeps the position of the scan in its list of
+/// chunks so that the scan can be resumed at the next tick, the position is
+/// moved along if the chunk it refers to is freed. Only a bounded number of
+/// chunks are checked while a shard is locked so that allocating threads
+/// are never held up for long.
+///
+/// When the process is started with the malloc interposer preloaded, the
+/// interposer calls the hooks of this module for every allocation of the
+/// process, so memory allocated by other libraries is tracked in the same
+/// shards. Such chunks are attributed to their call-stack. Allocations made
+/// by the memory module itself while tracking, e.g. for the stack table,
+/// are passed straight on to the real allocator so that tracking never
+/// recurses into itself. Chunks allocated with a larger alignment keep the
+/// offset of the header from the real allocation in the chunk flags.
+///
 /// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
 /// This source is distributed under the license in LICENSE.txt in the top
 /// InstaWorks directory.
 ///
 // --------------------------------------------------------------------------
 
+#define _GNU_SOURCE
+
 #include "iw_memory.h"
+#include "iw_memory_int.h"
 
+#include "iw_arena.h"
 #include "iw_cfg.h"
+#include "iw_chtable.h"
+#include "iw_hash.h"
 #include "iw_htable.h"
 #include "iw_list.h"
 #include "iw_log.h"
 #include "iw_util.h"
 
-#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <execinfo.h>
 #include <inttypes.h>
+#include <malloc.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
 
 // --------------------------------------------------------------------------
 //
@@ -42,24 +102,72 @@
 /// The magic cookie value to use for memory chunks
 #define COOKIE              0xABCDABCD
 
-/// The size of the magic cookie field
-#define COOKIE_SIZE         4
-
-/// The size of the length field
-#define LEN_SIZE            4
-
 /// The pre-memory chunk guard
 #define PRE_GUARD           0xFEFEFEFE
 
-/// The size of the pre-memory chunk guard field
-#define PRE_GUARD_SIZE      4
-
 /// The post-memory chunk guard
 #define POST_GUARD          0xFEFEFEFE
 
 /// The size of the post-memory chunk guard field
 #define POST_GUARD_SIZE     4
 
+/// The number of memory tracking shards
+#define IW_MEM_SHARDS       64
+
+/// The shard of a chunk that was not sampled
+#define IW_MEM_UNSAMPLED    0xFFFFFFFF
+
+/// The number of call-stack frames recorded for sampled allocations if no
+/// call-stack depth is configured
+#define IW_MEM_STACK_DEPTH  16
+
+/// The maximum number of call-stack frames recorded
+#define IW_MEM_STACK_MAX    32
+
+/// The bits of the synthetic heap profile frame of a site without a
+/// call-stack, kept within the user address range.
+#define IW_MEM_PPROF_SITE_MASK  0x7FFFFFFFFFFFUL
+
+/// The number of memory tracking frames to skip in a call-stack, the frames
+/// of iw_memory_stack_capture(), iw_memory_add_chunk() and iw_malloc()
+#define IW_MEM_STACK_SKIP   3
+
+/// The expected number of distinct call-stacks
+#define IW_MEM_STACK_TABLE  1024
+
+/// The maximum number of heap snapshots kept
+#define IW_MEM_SNAPSHOTS    16
+
+/// The maximum length of a heap snapshot name
+#define IW_MEM_SNAPSHOT_NAME 32
+
+/// The number of chunks checked by the guard scanner per shard lock
+#define IW_MEM_SCAN_BATCH   64
+
+/// The chunk flag set once a corruption of the chunk has been reported
+#define IW_MEM_FLAG_CORRUPT 0x1
+
+/// The shift of the header offset kept in the upper bits of the chunk flags
+#define IW_MEM_FLAG_OFFSET_SHIFT 8
+
+/// The number of CPUs with their own histogram counters, further CPUs share
+#define IW_MEM_HIST_CPUS    64
+
+/// The largest size of the smallest size class of the histogram
+#define IW_MEM_HIST_MIN     16
+
+/// The shortest interval in microseconds that histogram rates are measured
+/// over, shorter intervals are added to the next interval
+#define IW_MEM_HIST_INTERVAL 100000
+
+/// The number of frames between the caller and the tracking functions when
+/// called through the malloc interposer, the interposer and the hook
+#define IW_MEM_HOOK_FRAMES  2
+
+/// The file that allocations made through the malloc interposer are
+/// attributed to
+#define IW_MEM_PRELOAD_FILE "(preload)"
+
 // --------------------------------------------------------------------------
 
 /// The type of memory dump
@@ -70,22 +178,91 @@ typedef enum {
 } IW_MEM_DUMP;
 
 // --------------------------------------------------------------------------
-//
-// Internal variables
-//
+
+/// @brief An interned call-stack shared by all chunks allocated from it.
+typedef struct _iw_memory_stack {
+    unsigned int  id;       ///< The identifier of the stack in reports.
+    unsigned int  depth;    ///< The number of frames.
+    void         *frames[]; ///< The return addresses.
+} iw_memory_stack;
+
+// --------------------------------------------------------------------------
+
+/// @brief The header in front of each tracked memory chunk.
+typedef struct _iw_memory_hdr {
+    iw_list_node  node;     ///< The node in the list of chunks of the shard.
+    const char   *file;     ///< The file that the memory was allocated in.
+    unsigned int  line;     ///< The line that the memory was allocated in.
+    unsigned int  shard;    ///< The shard the chunk belongs to.
+    size_t        size;     ///< The size of the allocated memory.
+    iw_memory_stack *stack; ///< The call-stack of the allocation (if any).
+    uint64_t      born;     ///< The time of the allocation in microseconds.
+    unsigned int  tag;      ///< The memory tag of the allocation.
+    unsigned int  flags;    ///< The chunk flags.
+    unsigned int  cls;      ///< The histogram size class of the chunk.
+    unsigned int  unused;   ///< Keeps the pre-guard next to the memory.
+    unsigned int  cookie;   ///< The cookie value.
+    unsigned int  pre_guard;///< The pre-memory guard.
+} __attribute__((aligned(16))) iw_memory_hdr;
+
+// --------------------------------------------------------------------------
+
+/// @brief A memory tracking shard.
+/// Aligned to a cache line so that threads updating the counters of
+/// neighbouring shards don't share a cache line. The counters are updated
+/// atomically by the threads using the shard, the lock only protects the
+/// list of chunks and the scan position.
+typedef struct _iw_memory_shard {
+    pthread_mutex_t lock;       ///< The lock protecting the chunk list.
+    iw_list         chunks;     ///< The outstanding tracked chunks.
+    iw_list_node   *scan_next;  ///< The next chunk for the guard scanner.
+    unsigned long   allocs;     ///< The number of allocations made so far.
+    unsigned long   frees;      ///< The number of frees made so far.
+    unsigned long   cur_bytes;  ///< The number of outstanding bytes.
+    unsigned long   acc_bytes;  ///< The number of bytes allocated so far.
+} __attribute__((aligned(64))) iw_memory_shard;
+
+// --------------------------------------------------------------------------
+
+/// @brief The memory use of a memory tag.
+/// Aligned to a cache line so that threads using different tags don't share
+/// a cache line.
+typedef struct _iw_memory_tag {
+    char          name[32];     ///< The name of the tag.
+    unsigned long allocs;       ///< The number of outstanding allocations.
+    unsigned long cur_bytes;    ///< The number of outstanding bytes.
+    unsigned long peak_bytes;   ///< The highest number of outstanding bytes.
+} __attribute__((aligned(64))) iw_memory_tag;
+
 // --------------------------------------------------------------------------
 
-/// The number of allocations made so far.
-static unsigned int s_mem_allocs = 0;
+/// @brief The size class histogram counters of a CPU.
+/// Aligned to a cache line so that CPUs don't share a cache line.
+typedef struct _iw_memory_hist_cpu {
+    unsigned long allocs[IW_MEM_HIST_CLASSES];      ///< Allocations made.
+    unsigned long frees[IW_MEM_HIST_CLASSES];       ///< Frees made.
+    unsigned long alloc_bytes[IW_MEM_HIST_CLASSES]; ///< Bytes allocated.
+    unsigned long free_bytes[IW_MEM_HIST_CLASSES];  ///< Bytes freed.
+    unsigned long lifetime[IW_MEM_HIST_CLASSES];    ///< Lifetimes of freed
+                                                    ///< memory in us.
+} __attribute__((aligned(64))) iw_memory_hist_cpu;
 
-/// The number of frees made so far.
-static unsigned int s_mem_frees = 0;
+// --------------------------------------------------------------------------
 
-/// The number of current outstanding allocated bytes.
-static unsigned int s_mem_cur_bytes = 0;
+/// @brief The allocation and free rates of a size class.
+typedef struct _iw_memory_hist_rate {
+    unsigned long allocs;       ///< The allocations at the last tick.
+    unsigned long frees;        ///< The frees at the last tick.
+    double        alloc_rate;   ///< The allocations per second.
+    double        free_rate;    ///< The frees per second.
+    double        peak_rate;    ///< The highest allocations per second.
+} iw_memory_hist_rate;
 
-/// The number of total allocated bytes so far (including freed memory).
-static unsigned int s_mem_acc_bytes = 0;
+// --------------------------------------------------------------------------
+//
+// Internal variables
+//
+// --------------------------------------------------------------------------
 
 /// Number of memory corruption detected.
 static unsigned int s_mem_corrupt  = 0;
@@ -96,15 +273,107 @@ static unsigned int s_pre_corrupt  = 0;
 /// Number of post-memory guard corruptions detected.
 static unsigned int s_post_corrupt = 0;
 
-/// The global mutex hash.
-static iw_htable s_memory;
+/// The memory tracking shards.
+static iw_memory_shard s_shards[IW_MEM_SHARDS];
 
-/// The internal rwlock for access to the mutex hash.
-static pthread_rwlock_t s_memory_lock;
+/// The number of shards handed out to threads so far.
+static unsigned int s_next_shard = 0;
+
+/// The shard of the current thread plus one, zero if not yet assigned.
+static __thread unsigned int s_shard_id = 0;
 
 /// True if memory tracking is enabled.
 static bool iw_memory_tracking = false;
 
+/// The average number of bytes between sampled allocations, zero if all
+/// allocations are tracked.
+static unsigned long s_sample_interval = 0;
+
+/// The number of bytes the current thread can allocate until the next sample.
+static __thread unsigned long s_sample_left = 0;
+
+/// The random number generator state of the current thread.
+static __thread uint64_t s_sample_rand = 0;
+
+/// The number of call-stack frames to record, zero if none.
+static unsigned int s_stack_depth = 0;
+
+/// The interned call-stacks, keyed by their return addresses.
+static iw_chtable s_stacks;
+
+/// The number of call-stacks interned so far.
+static unsigned int s_num_stacks = 0;
+
+/// The heap snapshots, oldest first.
+static iw_list s_snapshots = IW_LIST_INIT;
+
+/// The lock protecting the heap snapshots.
+static pthread_mutex_t s_snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// The memory tags, the first tag is IW_MEM_TAG_NONE.
+static iw_memory_tag s_tags[IW_MEM_TAGS] = { { "untagged", 0, 0, 0 } };
+
+/// The number of memory tags registered, including IW_MEM_TAG_NONE.
+static unsigned int s_num_tags = 1;
+
+/// The lock serializing the registration of memory tags.
+static pthread_mutex_t s_tag_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// The lock serializing guard scans.
+static pthread_mutex_t s_scan_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// The shard currently being scanned for guard corruption.
+static unsigned int s_scan_shard = 0;
+
+/// True if the scan position of the current shard has been set.
+static bool s_scan_started = false;
+
+/// The number of complete guard scans of all shards.
+static unsigned long s_scan_passes = 0;
+
+/// The number of chunks checked by guard scans.
+static unsigned long s_scan_chunks = 0;
+
+/// The last chunk found with a corrupted header by a guard scan.
+static void *s_scan_bad = NULL;
+
+/// The memory tag of the current thread.
+static __thread unsigned int s_tag = IW_MEM_TAG_NONE;
+
+/// The size class histogram counters of each CPU.
+static iw_memory_hist_cpu s_hist[IW_MEM_HIST_CPUS];
+
+/// The allocation and free rates of each size class.
+static iw_memory_hist_rate s_hist_rates[IW_MEM_HIST_CLASSES];
+
+/// The lock protecting the rates of the size classes.
+static pthread_mutex_t s_hist_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// The time the histogram was started in microseconds.
+static unsigned long s_hist_start = 0;
+
+/// The time of the last histogram tick in microseconds, zero if none.
+static unsigned long s_hist_tick = 0;
+
+/// The real allocator used for the tracked chunks. Replaced by the
+/// allocator behind the malloc interposer if it is preloaded.
+static iw_memory_allocator s_alloc = {
+    malloc, calloc, realloc, memalign, free, malloc_usable_size
+};
+
+/// True if the malloc interposer calls the hooks of this module.
+static bool s_preload = false;
+
+/// The page size, used to check whether a chunk header can be read.
+static uintptr_t s_page_size = 4096;
+
+/// Non-zero while the current thread is inside the memory module, the
+/// allocations it makes through the interposer are not tracked.
+static __thread unsigned int s_untracked = 0;
+
+/// The number of interposer frames above the tracking functions.
+static __thread unsigned int s_hook_frames = 0;
+
 // --------------------------------------------------------------------------
 //
 // Memory tracking helper functions.
@@ -116,304 +385,1308 @@ typedef struct _iw_memory_loc {
     char         file[32];  ///< The file that the memory was allocated in.
     unsigned int line;      ///< The line that the memory was allocated in.
     size_t       size;      ///< The size of the allocated memory chunk.
+    const iw_memory_stack *stack; ///< The call-stack of the allocation.
 } iw_memory_loc;
 
 // --------------------------------------------------------------------------
 
-/// @brief The memory info structure.
-typedef struct _iw_memory_info {
-    iw_memory_loc loc;      ///< The location of the allocation.
-    void         *address;  ///< The address of the allocated memory.
-} iw_memory_info;
-
-// --------------------------------------------------------------------------
-
 /// @brief The memory report structure.
 typedef struct _iw_memory_report {
-    iw_list_node  node;     ///< The list node.
     iw_memory_loc loc;      ///< The location of the allocation.
     unsigned int  num;      ///< The number of allocations at this location.
 } iw_memory_report;
 
 // --------------------------------------------------------------------------
 
-/// @brief Add a memory chunk to the tracking table.
-/// @param file The file that the memory chunk was allocated at.
-/// @param line The line that the memory chunk was allocated at.
-/// @param address The address of the memory chunk.
-/// @param size The size of the memory chunk.
-static void iw_memory_add_chunk(
-    const char *file,
-    unsigned int line,
-    void *address,
-    size_t size)
-{
-    iw_memory_info *info = (iw_memory_info *)calloc(1, sizeof(iw_memory_info));
-    snprintf(info->loc.file, sizeof(info->loc.file), "%s", file);
-    info->loc.line = line;
-    info->loc.size = size;
-    info->address = address;
-    iw_htable_insert(&s_memory, sizeof(address), &address, info);
-}
+/// @brief A copy of a tracked chunk, taken so that the chunk can be printed
+/// without holding the lock of its shard.
+typedef struct _iw_memory_entry {
+    uintptr_t     addr;     ///< The address of the allocated memory.
+    iw_memory_loc loc;      ///< The location of the allocation.
+    unsigned int  tag;      ///< The memory tag of the allocation.
+} iw_memory_entry;
+
+// --------------------------------------------------------------------------
+
+/// @brief The key identifying an allocation site in a heap profile.
+typedef struct _iw_memory_site_key {
+    const char   *file;     ///< The file that the memory was allocated in.
+    unsigned int  line;     ///< The line that the memory was allocated in.
+    const iw_memory_stack *stack; ///< The call-stack of the allocation.
+} iw_memory_site_key;
+
+// --------------------------------------------------------------------------
+
+/// @brief The live heap of an allocation site in a heap snapshot.
+typedef struct _iw_memory_snap_site {
+    iw_memory_site_key key; ///< The allocation site.
+    unsigned long count;    ///< The estimated number of live allocations.
+    unsigned long bytes;    ///< The estimated number of live bytes.
+} iw_memory_snap_site;
+
+// --------------------------------------------------------------------------
+
+/// @brief A named heap snapshot.
+/// Only the per-site totals are kept, sorted by site so that two snapshots
+/// can be compared in a single pass.
+typedef struct _iw_memory_snap {
+    iw_list_node  node;     ///< The node in the list of snapshots.
+    char          name[IW_MEM_SNAPSHOT_NAME]; ///< The name of the snapshot.
+    time_t        taken;    ///< The time the snapshot was taken.
+    unsigned long bytes;    ///< The estimated live heap.
+    unsigned int  num_sites;///< The number of allocation sites.
+    iw_memory_snap_site sites[]; ///< The allocation sites.
+} iw_memory_snap;
 
 // --------------------------------------------------------------------------
 
-/// @brief Delete the memory block with the given address.
-/// @param address The address of the memory block to delete.
-/// @return The memory info structure or NULL if no match was found.
-static void iw_memory_delete_chunk(void *address) {
-    iw_memory_info *info = (iw_memory_info *)iw_htable_remove(&s_memory,
-                                                              sizeof(address),
-                                                              &address);
-    if(info != NULL) {
-        free(info);
+/// @brief The growth of an allocation site between two heap snapshots.
+typedef struct _iw_memory_growth {
+    const iw_memory_snap_site *site; ///< The site in the later snapshot.
+    long          count;    ///< The growth in live allocations.
+    unsigned long bytes;    ///< The growth in live bytes.
+} iw_memory_growth;
+
+// --------------------------------------------------------------------------
+
+/// @brief An allocation site in a heap profile.
+typedef struct _iw_memory_site {
+    iw_memory_site_key key; ///< The allocation site.
+    unsigned int  samples;  ///< The number of sampled live allocations.
+    unsigned long sampled_bytes; ///< The bytes of the sampled allocations.
+    double        count;    ///< The estimated number of live allocations.
+    double        bytes;    ///< The estimated number of live bytes.
+} iw_memory_site;
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the memory tracking shard of the calling thread.
+/// Threads are assigned shards round-robin the first time they allocate.
+/// @return The shard index.
+static unsigned int iw_memory_shard_id() {
+    if(s_shard_id == 0) {
+        s_shard_id = __atomic_fetch_add(&s_next_shard, 1, __ATOMIC_RELAXED) %
+                     IW_MEM_SHARDS + 1;
     }
+    return s_shard_id - 1;
 }
 
 // --------------------------------------------------------------------------
-//
-// Function API
-//
+
+/// @brief Get the current time in microseconds.
+/// @return The current monotonic time in microseconds.
+static unsigned long iw_memory_now_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+}
+
 // --------------------------------------------------------------------------
 
-void iw_memory_init() {
-    int *enable = iw_val_store_get_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE);
-    iw_memory_tracking = enable != NULL && *enable;
-    if(iw_memory_tracking) {
-        iw_htable_init(&s_memory, 1024, false, NULL);
+/// @brief Get the coarse time in microseconds, used to time allocations.
+/// The coarse clock only advances every few milliseconds but it is much
+/// cheaper to read. An allocation that lives for a fraction of a clock
+/// period is seen to live a whole period with the same probability, so the
+/// average lifetime of many allocations is still right.
+/// @return The current coarse monotonic time in microseconds.
+static unsigned long iw_memory_coarse_us() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the histogram size class of an allocation size.
+/// Class 0 holds sizes up to IW_MEM_HIST_MIN bytes, each following class
+/// holds sizes up to twice those of the class below and the last class
+/// holds all larger sizes.
+/// @param size The size of the allocation.
+/// @return The size class.
+static unsigned int iw_memory_size_class(size_t size) {
+    if(size <= IW_MEM_HIST_MIN) {
+        return 0;
     }
+    // The number of bits of size - 1 beyond those of IW_MEM_HIST_MIN - 1.
+    unsigned int cls = 8 * sizeof(unsigned long) - __builtin_clzl(size - 1) -
+                       __builtin_ctz(IW_MEM_HIST_MIN);
+    return cls < IW_MEM_HIST_CLASSES ? cls : IW_MEM_HIST_CLASSES - 1;
 }
 
 // --------------------------------------------------------------------------
 
-void iw_memory_exit() {
-    if(iw_memory_tracking) {
-        iw_htable_destroy(&s_memory, free);
+/// @brief Get the histogram counters of the CPU the thread is running on.
+/// The thread may be moved to another CPU at any time so the counters are
+/// still updated atomically, but they are rarely shared.
+/// @return The histogram counters.
+static iw_memory_hist_cpu *iw_memory_hist_cpu_get() {
+    int cpu = sched_getcpu();
+    return &s_hist[cpu > 0 ? cpu % IW_MEM_HIST_CPUS : 0];
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Calculate the base-2 logarithm of a positive number.
+/// A fast approximation good to about 0.01 so that the sampling code
+/// doesn't need the math library.
+/// @param val The number to calculate the logarithm of.
+/// @return The logarithm.
+static double iw_memory_log2(double val) {
+    union {
+        double   d;
+        uint64_t i;
+    } bits = { .d = val };
+    int exp = (int)((bits.i >> 52) & 0x7FF) - 1024;
+    bits.i = (bits.i & ((1ULL << 52) - 1)) | (1023ULL << 52);
+    double man = bits.d;
+    return exp + (-0.34484843 * man + 2.02466578) * man - 0.67487759;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the number of bytes to allocate until the next sample.
+/// The distance between samples is exponentially distributed with the
+/// sampling interval as the mean so that the samples form a Poisson process
+/// over the allocated bytes.
+/// @return The number of bytes until the next sample.
+static unsigned long iw_memory_sample_next() {
+    if(s_sample_rand == 0) {
+        s_sample_rand = ((uintptr_t)&s_sample_rand ^ (uintptr_t)pthread_self()) |
+                        1;
     }
+    s_sample_rand ^= s_sample_rand << 13;
+    s_sample_rand ^= s_sample_rand >> 7;
+    s_sample_rand ^= s_sample_rand << 17;
+
+    // -ln(U) * interval with U uniform in (0, 1] using 26 random bits.
+    double q = (double)((s_sample_rand >> 38) + 1);
+    double next = (26.0 - iw_memory_log2(q)) * 0.69314718 * s_sample_interval;
+    return next < 1.0 ? 1 : (unsigned long)next + 1;
 }
 
 // --------------------------------------------------------------------------
 
-void *iw_malloc(const char *file, unsigned int line, size_t size) {
-    if(!iw_memory_tracking) {
-        return malloc(size);
+/// @brief Decide whether an allocation should be sampled.
+/// @param size The size of the allocation.
+/// @return True if the allocation should be tracked.
+static bool iw_memory_sample(size_t size) {
+    if(s_sample_interval == 0) {
+        return true;
     }
+    if(s_sample_rand == 0) {
+        s_sample_left = iw_memory_sample_next();
+    }
+    if(s_sample_left > size) {
+        s_sample_left -= size;
+        return false;
+    }
+    s_sample_left = iw_memory_sample_next();
+    return true;
+}
 
-    int new_size = size + COOKIE_SIZE + LEN_SIZE + PRE_GUARD_SIZE + POST_GUARD_SIZE;
-    void *chunk = malloc(new_size);
+// --------------------------------------------------------------------------
 
-    if(chunk == NULL) {
-        return NULL;
+/// @brief Calculate e^-val for a non-negative value.
+/// The value is halved until the Taylor series converges quickly and the
+/// result is then squared back up.
+/// @param val The value.
+/// @return The result.
+static double iw_memory_exp_neg(double val) {
+    unsigned int halvings = 0;
+    while(val > 0.5 && halvings < 64) {
+        val /= 2.0;
+        halvings++;
+    }
+    double term = 1.0, sum = 1.0;
+    unsigned int cnt;
+    for(cnt=1;cnt < 12;cnt++) {
+        term *= -val / cnt;
+        sum += term;
+    }
+    while(halvings-- > 0) {
+        sum *= sum;
     }
+    return sum;
+}
 
-    *(unsigned int *)(chunk) = htonl(COOKIE);
-    *(unsigned int *)(chunk + COOKIE_SIZE) = htonl(size);
-    *(unsigned int *)(chunk + COOKIE_SIZE + LEN_SIZE) = htonl(PRE_GUARD);
-    *(unsigned int *)(chunk + COOKIE_SIZE + LEN_SIZE + PRE_GUARD_SIZE + size) = htonl(POST_GUARD);
+// --------------------------------------------------------------------------
 
-    void *ptr = chunk + COOKIE_SIZE + LEN_SIZE + PRE_GUARD_SIZE;
+/// @brief Get the number of allocations a sampled allocation stands for.
+/// An allocation of a given size is sampled with the probability
+/// 1 - e^(-size / interval), the inverse of that is its weight.
+/// @param size The size of the allocation.
+/// @return The estimated number of allocations.
+static double iw_memory_sample_weight(size_t size) {
+    if(s_sample_interval == 0) {
+        return 1.0;
+    }
+    double val = (double)size / s_sample_interval;
+    if(val < 1e-3) {
+        // Avoid the cancellation in 1 - e^-val for tiny allocations.
+        return 1.0 / (val - val * val / 2.0);
+    }
+    return 1.0 / (1.0 - iw_memory_exp_neg(val));
+}
 
-    iw_memory_add_chunk(file, line, ptr, size);
+// --------------------------------------------------------------------------
 
-    s_mem_allocs++;
-    s_mem_cur_bytes += size;
-    s_mem_acc_bytes += size;
+/// @brief Capture and intern the call-stack of an allocation.
+/// Most call-stacks have been seen before so the stack table is first
+/// searched with only a read lock on its stripe.
+/// @return The interned call-stack or NULL if it could not be captured.
+static __attribute__((noinline)) iw_memory_stack *iw_memory_stack_capture() {
+    void *frames[IW_MEM_STACK_MAX + IW_MEM_STACK_SKIP + IW_MEM_HOOK_FRAMES];
+    int skip = IW_MEM_STACK_SKIP + s_hook_frames;
+    int depth = backtrace(frames, s_stack_depth + skip);
+    if(depth <= skip) {
+        return NULL;
+    }
+    depth -= skip;
+    unsigned int len = depth * sizeof(void *);
+    void **key = frames + skip;
+    iw_memory_stack *stack = (iw_memory_stack *)iw_chtable_get(&s_stacks, len, key);
+    if(stack != NULL) {
+        return stack;
+    }
 
-    return ptr;
+    // Check again with the stripe write locked in case another thread
+    // interned the same stack in the meantime.
+    iw_chtable_lock lock;
+    stack = (iw_memory_stack *)iw_chtable_get_locked(&s_stacks, len, key,
+                                                     true, &lock);
+    if(stack == NULL) {
+        stack = (iw_memory_stack *)malloc(sizeof(iw_memory_stack) + len);
+        if(stack != NULL) {
+            stack->id    = __atomic_add_fetch(&s_num_stacks, 1, __ATOMIC_RELAXED);
+            stack->depth = depth;
+            memcpy(stack->frames, key, len);
+            if(!iw_htable_insert(&lock.stripe->table, len, stack->frames, stack)) {
+                free(stack);
+                stack = NULL;
+            }
+        }
+    }
+    iw_chtable_unlock(&lock);
+    return stack;
 }
 
 // --------------------------------------------------------------------------
 
-void *iw_calloc(const char *file, unsigned int line, int elems, size_t size) {
-    if(!iw_memory_tracking) {
-        return calloc(elems, size);
+/// @brief Print an interned call-stack.
+/// Each return address is only symbolized once per report, the symbols are
+/// kept in the given cache and shortened to the file name and function.
+/// @param out The output file stream.
+/// @param cache The symbol cache, keyed by return address.
+/// @param stack The call-stack to print.
+static void iw_memory_stack_print(
+    FILE *out,
+    iw_htable *cache,
+    const iw_memory_stack *stack)
+{
+    unsigned int cnt;
+    for(cnt=0;cnt < stack->depth;cnt++) {
+        void *addr = stack->frames[cnt];
+        char *symbol = (char *)iw_htable_get(cache, sizeof(addr), &addr);
+        if(symbol == NULL) {
+            // Symbols are formatted as "/path/to/file(function+0x1a) [0x..]".
+            char **symbols = backtrace_symbols(&addr, 1);
+            const char *str = symbols != NULL ? symbols[0] : "?";
+            const char *end = strstr(str, " [");
+            const char *start = str;
+            const char *ptr;
+            for(ptr=str;ptr < (end != NULL ? end : str + strlen(str)) &&
+                        *ptr != '(';ptr++)
+            {
+                if(*ptr == '/') {
+                    start = ptr + 1;
+                }
+            }
+            int len = end != NULL ? end - start : (int)strlen(start);
+            symbol = (char *)malloc(len + 1);
+            if(symbol != NULL) {
+                memcpy(symbol, start, len);
+                symbol[len] = '\0';
+                if(!iw_htable_insert(cache, sizeof(addr), &addr, symbol)) {
+                    free(symbol);
+                    symbol = NULL;
+                }
+            }
+            free(symbols);
+        }
+        fprintf(out, "    #%-2u %p %s\n", cnt, addr,
+                symbol != NULL ? symbol : "?");
     }
+}
 
-    void *chunk = iw_malloc(file, line, elems * size);
-    if(chunk == NULL) {
-        return NULL;
-    }
+// --------------------------------------------------------------------------
 
-    memset(chunk, 0, size);
-    return chunk;
+/// @brief Add a sampled memory chunk to the list of chunks of its shard.
+/// @param hdr The header of the memory chunk.
+static void iw_memory_link_chunk(iw_memory_hdr *hdr) {
+    iw_memory_shard *shard = &s_shards[hdr->shard];
+    pthread_mutex_lock(&shard->lock);
+    iw_list_add(&shard->chunks, &hdr->node);
+    pthread_mutex_unlock(&shard->lock);
 }
 
 // --------------------------------------------------------------------------
 
-void *iw_realloc(const char *file, unsigned int line, void *ptr, size_t size) {
-    if(!iw_memory_tracking) {
-        return realloc(ptr, size);
+/// @brief Remove a memory chunk from the list of chunks of its shard.
+/// Unsampled chunks aren't in any list.
+/// @param hdr The header of the memory chunk.
+static void iw_memory_unlink_chunk(iw_memory_hdr *hdr) {
+    if(hdr->shard == IW_MEM_UNSAMPLED) {
+        return;
     }
+    iw_memory_shard *shard = &s_shards[hdr->shard];
+    pthread_mutex_lock(&shard->lock);
+    if(shard->scan_next == &hdr->node) {
+        shard->scan_next = hdr->node.next;
+    }
+    iw_list_remove(&shard->chunks, &hdr->node);
+    pthread_mutex_unlock(&shard->lock);
+}
 
-    void *new_chunk = NULL;
+// --------------------------------------------------------------------------
 
-    // TODO: To simplify realloc we just allocate a new memory chunk and free the
-    // old one.
-    if(size != 0) {
-        new_chunk = iw_malloc(file, line, size);
-        if(new_chunk == NULL) {
-            // Realloc does not free or move the old memory if allocation fails.
-            return NULL;
+/// @brief Add a memory chunk to the shard of the calling thread.
+/// All chunks are counted but only sampled chunks are added to the list of
+/// chunks of the shard.
+/// @param hdr The header of the memory chunk.
+/// @param sampled True if the chunk should be tracked.
+static __attribute__((noinline)) void iw_memory_add_chunk(
+    iw_memory_hdr *hdr,
+    bool sampled)
+{
+    unsigned int id = iw_memory_shard_id();
+    iw_memory_shard *shard = &s_shards[id];
+    __atomic_fetch_add(&shard->allocs, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shard->cur_bytes, hdr->size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&shard->acc_bytes, hdr->size, __ATOMIC_RELAXED);
+    hdr->cls = iw_memory_size_class(hdr->size);
+    iw_memory_hist_cpu *hist = iw_memory_hist_cpu_get();
+    __atomic_fetch_add(&hist->allocs[hdr->cls], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->alloc_bytes[hdr->cls], hdr->size,
+                       __ATOMIC_RELAXED);
+    hdr->born = iw_memory_coarse_us();
+    hdr->tag = s_tag;
+    if(hdr->tag != IW_MEM_TAG_NONE) {
+        iw_memory_tag *tag = &s_tags[hdr->tag];
+        __atomic_fetch_add(&tag->allocs, 1, __ATOMIC_RELAXED);
+        unsigned long cur = __atomic_add_fetch(&tag->cur_bytes, hdr->size,
+                                               __ATOMIC_RELAXED);
+        unsigned long peak = __atomic_load_n(&tag->peak_bytes, __ATOMIC_RELAXED);
+        while(cur > peak &&
+              !__atomic_compare_exchange_n(&tag->peak_bytes, &peak, cur, true,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            // The peak was updated by another thread, check it again.
         }
     }
+    if(!sampled) {
+        hdr->shard = IW_MEM_UNSAMPLED;
+        hdr->stack = NULL;
+        return;
+    }
+    hdr->shard = id;
+    hdr->stack = NULL;
+    if(s_stack_depth != 0) {
+        // The stack table allocates memory while a stripe is locked.
+        s_untracked++;
+        hdr->stack = iw_memory_stack_capture();
+        s_untracked--;
+    }
+    iw_memory_link_chunk(hdr);
+}
 
-    if(ptr != NULL) {
-        if(new_chunk != NULL) {
-            void *len_ptr = ptr - PRE_GUARD_SIZE - LEN_SIZE;
-            unsigned int len = ntohl(*(unsigned int *)len_ptr);
-            memcpy(new_chunk, ptr, len);
+// --------------------------------------------------------------------------
+
+/// @brief Remove a memory chunk from the shard it was allocated in.
+/// The chunk is counted as freed in the shard of the calling thread since
+/// only the sum of the counters of all shards is reported.
+/// @param hdr The header of the memory chunk.
+static void iw_memory_delete_chunk(iw_memory_hdr *hdr) {
+    iw_memory_shard *shard = &s_shards[iw_memory_shard_id()];
+    __atomic_fetch_add(&shard->frees, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_sub(&shard->cur_bytes, hdr->size, __ATOMIC_RELAXED);
+    iw_memory_hist_cpu *hist = iw_memory_hist_cpu_get();
+    __atomic_fetch_add(&hist->frees[hdr->cls], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->free_bytes[hdr->cls], hdr->size,
+                       __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->lifetime[hdr->cls],
+                       iw_memory_coarse_us() - hdr->born, __ATOMIC_RELAXED);
+    if(hdr->tag != IW_MEM_TAG_NONE) {
+        iw_memory_tag *tag = &s_tags[hdr->tag];
+        __atomic_fetch_sub(&tag->allocs, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&tag->cur_bytes, hdr->size, __ATOMIC_RELAXED);
+    }
+    iw_memory_unlink_chunk(hdr);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Change the size of a tracked memory chunk.
+/// The chunk keeps its tracking state, only the counters are adjusted by
+/// the change in size. The chunk stays in the histogram size class it was
+/// allocated in so that the class counters still balance when it is freed.
+/// @param hdr The header of the memory chunk.
+/// @param size The new size of the memory.
+static void iw_memory_resize_chunk(iw_memory_hdr *hdr, size_t size) {
+    iw_memory_shard *shard = &s_shards[iw_memory_shard_id()];
+    iw_memory_hist_cpu *hist = iw_memory_hist_cpu_get();
+    iw_memory_tag *tag = hdr->tag != IW_MEM_TAG_NONE ? &s_tags[hdr->tag]
+                                                     : NULL;
+    if(size > hdr->size) {
+        size_t delta = size - hdr->size;
+        __atomic_fetch_add(&shard->cur_bytes, delta, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&shard->acc_bytes, delta, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&hist->alloc_bytes[hdr->cls], delta,
+                           __ATOMIC_RELAXED);
+        if(tag != NULL) {
+            unsigned long cur = __atomic_add_fetch(&tag->cur_bytes, delta,
+                                                   __ATOMIC_RELAXED);
+            unsigned long peak = __atomic_load_n(&tag->peak_bytes,
+                                                 __ATOMIC_RELAXED);
+            while(cur > peak &&
+                  !__atomic_compare_exchange_n(&tag->peak_bytes, &peak, cur,
+                                               true, __ATOMIC_RELAXED,
+                                               __ATOMIC_RELAXED))
+            {
+                // The peak was updated by another thread, check it again.
+            }
+        }
+    } else {
+        size_t delta = hdr->size - size;
+        __atomic_fetch_sub(&shard->cur_bytes, delta, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&hist->free_bytes[hdr->cls], delta,
+                           __ATOMIC_RELAXED);
+        if(tag != NULL) {
+            __atomic_fetch_sub(&tag->cur_bytes, delta, __ATOMIC_RELAXED);
         }
-        iw_free(ptr);
     }
+    hdr->size = size;
+    unsigned int post = POST_GUARD;
+    memcpy((char *)(hdr + 1) + size, &post, POST_GUARD_SIZE);
+}
+
+// --------------------------------------------------------------------------
 
-    return new_chunk;
+/// @brief Compare two memory report entries.
+/// Orders the entries with the highest number of allocations first and
+/// then the largest allocations first.
+/// @param elem1 The first memory report entry.
+/// @param elem2 The second memory report entry.
+/// @return Less than zero, zero, or higher than zero if the first entry
+///         should be listed before, equal to, or after the second entry.
+static int iw_memory_report_compare(const void *elem1, const void *elem2) {
+    const iw_memory_report *report1 = (const iw_memory_report *)elem1;
+    const iw_memory_report *report2 = (const iw_memory_report *)elem2;
+    if(report1->num != report2->num) {
+        return report1->num > report2->num ? -1 : 1;
+    }
+    if(report1->loc.size != report2->loc.size) {
+        return report1->loc.size > report2->loc.size ? -1 : 1;
+    }
+    return 0;
 }
 
 // --------------------------------------------------------------------------
 
-char *iw_strdup(const char *file, unsigned int line, const char *ptr) {
-    if(!iw_memory_tracking) {
-        return strdup(ptr);
+/// @brief Compare two heap profile sites.
+/// Orders the sites with the largest estimated live heap first.
+/// @param elem1 The first site.
+/// @param elem2 The second site.
+/// @return Less than zero, zero, or higher than zero if the first site
+///         should be listed before, equal to, or after the second site.
+static int iw_memory_site_compare(const void *elem1, const void *elem2) {
+    const iw_memory_site *site1 = (const iw_memory_site *)elem1;
+    const iw_memory_site *site2 = (const iw_memory_site *)elem2;
+    if(site1->bytes != site2->bytes) {
+        return site1->bytes > site2->bytes ? -1 : 1;
     }
+    return 0;
+}
 
-    int len = strlen(ptr) + 1;
-    void *chunk = iw_malloc(file, line, len);
-    if(chunk == NULL) {
-        return NULL;
+/// @brief Compare two allocation sites.
+/// Orders the sites of a heap snapshot so that two snapshots can be merged.
+/// @param elem1 The first site.
+/// @param elem2 The second site.
+/// @return Less than zero, zero, or higher than zero if the first site
+///         should be listed before, equal to, or after the second site.
+static int iw_memory_site_key_compare(const void *elem1, const void *elem2) {
+    const iw_memory_site_key *key1 = (const iw_memory_site_key *)elem1;
+    const iw_memory_site_key *key2 = (const iw_memory_site_key *)elem2;
+    if(key1->file != key2->file) {
+        return (uintptr_t)key1->file < (uintptr_t)key2->file ? -1 : 1;
     }
-    memcpy(chunk, ptr, len + 1);
-    return chunk;
+    if(key1->line != key2->line) {
+        return key1->line < key2->line ? -1 : 1;
+    }
+    if(key1->stack != key2->stack) {
+        return (uintptr_t)key1->stack < (uintptr_t)key2->stack ? -1 : 1;
+    }
+    return 0;
 }
 
 // --------------------------------------------------------------------------
 
-void iw_free(void *ptr) {
-    if(!iw_memory_tracking) {
-        free(ptr);
-        return;
+/// @brief Compare the growth of two allocation sites.
+/// Orders the sites with the largest growth in live bytes first.
+/// @param elem1 The first site growth.
+/// @param elem2 The second site growth.
+/// @return Less than zero, zero, or higher than zero if the first site
+///         should be listed before, equal to, or after the second site.
+static int iw_memory_growth_compare(const void *elem1, const void *elem2) {
+    const iw_memory_growth *growth1 = (const iw_memory_growth *)elem1;
+    const iw_memory_growth *growth2 = (const iw_memory_growth *)elem2;
+    if(growth1->bytes != growth2->bytes) {
+        return growth1->bytes > growth2->bytes ? -1 : 1;
     }
+    return 0;
+}
 
-    // Check cookie, pre- and post-guards to ensure no corruption has
-    // occurred.
-    void *pre_ptr    = ptr - PRE_GUARD_SIZE;
-    void *len_ptr    = pre_ptr - LEN_SIZE;
-    void *cookie_ptr = len_ptr - COOKIE_SIZE;
-    void *post_ptr;
+// --------------------------------------------------------------------------
 
-    unsigned int cookie = ntohl(*(unsigned int *)cookie_ptr);
-    unsigned int pre    = ntohl(*(unsigned int *)pre_ptr);
-    unsigned int len    = ntohl(*(unsigned int *)len_ptr);
-    unsigned int post;
+/// @brief Check the cookie of a memory chunk.
+/// @param hdr The header of the memory chunk.
+/// @return True if the header is the header of a valid tracked chunk.
+static bool iw_memory_check_hdr(iw_memory_hdr *hdr) {
+    return hdr->cookie == COOKIE && hdr->tag < IW_MEM_TAGS &&
+           (hdr->shard < IW_MEM_SHARDS || hdr->shard == IW_MEM_UNSAMPLED);
+}
 
-    if(cookie != COOKIE) {
-        LOG(IW_LOG_IW, "Memory corruption detected");
-        s_mem_corrupt++;
+// --------------------------------------------------------------------------
 
-        // Cannot continue memory check. It is possible that this memory has
-        // been allocated outside our normal allocation framework so just
-        // free it as normal.
-        free(ptr);
-        return;
+/// @brief Check the pre- and post-guards of a memory chunk.
+/// Guard corruptions are only counted and logged the first time they are
+/// found in a chunk, whether by the guard scanner or when the chunk is freed.
+/// @param hdr The header of the memory chunk.
+/// @return True if a corruption was found and reported.
+static bool iw_memory_check_guards(iw_memory_hdr *hdr) {
+    unsigned int post;
+
+    if(__atomic_load_n(&hdr->flags, __ATOMIC_RELAXED) & IW_MEM_FLAG_CORRUPT) {
+        return false;
     }
 
-    if(pre != PRE_GUARD) {
-        LOG(IW_LOG_IW, "Pre-guard memory corruption detected");
-        s_pre_corrupt++;
+    bool corrupt = false;
+    if(hdr->pre_guard != PRE_GUARD) {
+        LOG(IW_LOG_IW, "Pre-guard memory corruption detected in memory "
+                       "allocated at %s:%u", hdr->file, hdr->line);
+        __atomic_fetch_add(&s_pre_corrupt, 1, __ATOMIC_RELAXED);
+        corrupt = true;
     }
-    post_ptr = ptr + len;
-    post = ntohl(*(unsigned int *)post_ptr);
+    memcpy(&post, (char *)(hdr + 1) + hdr->size, POST_GUARD_SIZE);
     if(post != POST_GUARD) {
-        LOG(IW_LOG_IW, "Post-guard memory corruption detected");
-        s_post_corrupt++;
+        LOG(IW_LOG_IW, "Post-guard memory corruption detected in memory "
+                       "allocated at %s:%u", hdr->file, hdr->line);
+        __atomic_fetch_add(&s_post_corrupt, 1, __ATOMIC_RELAXED);
+        corrupt = true;
+    }
+    if(corrupt) {
+        __atomic_fetch_or(&hdr->flags, IW_MEM_FLAG_CORRUPT, __ATOMIC_RELAXED);
     }
+    return corrupt;
+}
 
-    // Remove memory chunk from hash table
-    iw_memory_delete_chunk(ptr);
+// --------------------------------------------------------------------------
 
-    int org_size = len - COOKIE_SIZE - LEN_SIZE - PRE_GUARD_SIZE - POST_GUARD_SIZE;
+/// @brief Check the cookie, pre- and post-guards of a memory chunk.
+/// Guard corruptions are counted, the chunk can still be used.
+/// @param hdr The header of the memory chunk.
+/// @return False if the chunk isn't a valid tracked chunk.
+static bool iw_memory_check(iw_memory_hdr *hdr) {
+    if(!iw_memory_check_hdr(hdr)) {
+        LOG(IW_LOG_IW, "Memory corruption detected");
+        __atomic_fetch_add(&s_mem_corrupt, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    iw_memory_check_guards(hdr);
+    return true;
+}
 
-    s_mem_frees++;
-    s_mem_cur_bytes -= org_size;
+// --------------------------------------------------------------------------
 
-    // Free the actual memory pointer.
-    free(cookie_ptr);
+/// @brief Initialize the header and post-guard of a new memory chunk.
+/// @param hdr The header of the memory chunk.
+/// @param file The file that the memory was allocated in.
+/// @param line The line that the memory was allocated in.
+/// @param size The size of the memory.
+/// @param offset The offset of the header from the real allocation.
+static void iw_memory_hdr_init(
+    iw_memory_hdr *hdr,
+    const char *file,
+    unsigned int line,
+    size_t size,
+    size_t offset)
+{
+    hdr->file      = file;
+    hdr->line      = line;
+    hdr->size      = size;
+    hdr->flags     = offset << IW_MEM_FLAG_OFFSET_SHIFT;
+    hdr->cookie    = COOKIE;
+    hdr->pre_guard = PRE_GUARD;
+    unsigned int post = POST_GUARD;
+    memcpy((char *)(hdr + 1) + size, &post, POST_GUARD_SIZE);
 }
 
 // --------------------------------------------------------------------------
 
-char *iw_memory_display_str(unsigned int len, char *buff, unsigned int bytes) {
-    static char *unit[] = { "Bytes", "KBytes", "MBytes", "GBytes" };
-    unsigned int cnt=0;
-    for(;cnt < IW_ARR_LEN(unit);cnt++) {
-        if(bytes < 1024) {
-            snprintf(buff, len, "%d %s", bytes, unit[cnt]);
-            return buff;
-        }
-        bytes = bytes / 1024;
-    }
-    snprintf(buff, len, "%d %s", bytes, unit[cnt-1]);
-    return buff;
+/// @brief Get the offset of a chunk header from the real allocation.
+/// @param hdr The header of the memory chunk.
+/// @return The offset, only non-zero for chunks with a larger alignment.
+static size_t iw_memory_hdr_offset(iw_memory_hdr *hdr) {
+    return __atomic_load_n(&hdr->flags, __ATOMIC_RELAXED) >>
+           IW_MEM_FLAG_OFFSET_SHIFT;
 }
 
 // --------------------------------------------------------------------------
 
-static void iw_memory_dump(FILE *out, IW_MEM_DUMP dump) {
-    char buff1[64];
-    char buff2[64];
-
-    if(!iw_memory_tracking) {
-        fprintf(out, "Memory tracking is disabled.\n");
-        return;
+/// @brief Release a tracked memory chunk to the real allocator.
+/// The chunk is only removed from its shard while tracking is enabled, the
+/// interposer may still free tracked chunks after the module has exited.
+/// @param hdr The header of the memory chunk.
+static void iw_memory_release(iw_memory_hdr *hdr) {
+    if(iw_memory_tracking) {
+        iw_memory_delete_chunk(hdr);
     }
 
-    // Lock the mutex lock
-    pthread_rwlock_rdlock(&s_memory_lock);
+    // Clear the cookie so that a double free is detected, then free the
+    // actual memory pointer.
+    hdr->cookie = 0;
+    s_alloc.free((char *)hdr - iw_memory_hdr_offset(hdr));
+}
 
-    // Print memory statistics
-    fprintf(out,
-            "== Memory summary ==\n"
-            "Number allocations:      %d\n"
-            "Number frees:            %d\n"
-            "Outstanding allocations: %d\n"
-            "Outstanding allocations: %s\n"
-            "Accumulated allocations: %s\n"
-            "Memory corruptions:      %d\n"
-            "Pre-guard corruptions:   %d\n"
-            "Post-guard corruptions:  %d\n"
-            "\n",
-            s_mem_allocs, s_mem_frees,
-            s_mem_allocs - s_mem_frees,
-            iw_memory_display_str(sizeof(buff1), buff1, s_mem_cur_bytes),
-            iw_memory_display_str(sizeof(buff2), buff2, s_mem_acc_bytes),
-            s_mem_corrupt, s_pre_corrupt, s_post_corrupt);
 
-    iw_htable sum;
-    iw_htable_init(&sum, s_memory.size, false, NULL);
+// --------------------------------------------------------------------------
 
-    if(dump == IW_MEM_DUMP_ALL) {
-        // Print out every single memory allocation.
-        unsigned long hash;
-        iw_memory_info *minfo = (iw_memory_info *)iw_htable_get_first(&s_memory,
-                                                                      &hash);
+/// @brief Check the next batch of chunks of the shard being scanned.
+/// @param shard The shard being scanned, must be locked by the caller.
+/// @param found [out] Incremented by the number of corrupted chunks found.
+/// @return The number of chunks checked.
+static unsigned int iw_memory_scan_batch(
+    iw_memory_shard *shard,
+    unsigned int *found)
+{
+    unsigned int cnt;
+    for(cnt=0;cnt < IW_MEM_SCAN_BATCH && shard->scan_next != NULL;cnt++) {
+        iw_memory_hdr *hdr = (iw_memory_hdr *)shard->scan_next;
+        if(!iw_memory_check_hdr(hdr)) {
+            // The list can't be followed past a corrupted header, the rest
+            // of the shard is checked at the next pass.
+            if(hdr != s_scan_bad) {
+                LOG(IW_LOG_IW, "Memory corruption detected in chunk at %p",
+                    (void *)(hdr + 1));
+                __atomic_fetch_add(&s_mem_corrupt, 1, __ATOMIC_RELAXED);
+                s_scan_bad = hdr;
+                (*found)++;
+            }
+            shard->scan_next = NULL;
+            return cnt + 1;
+        }
+        if(iw_memory_check_guards(hdr)) {
+            (*found)++;
+        }
+        shard->scan_next = hdr->node.next;
+    }
+    return cnt;
+}
+
+// --------------------------------------------------------------------------
+//
+// Malloc interposer hooks.
+//
+// --------------------------------------------------------------------------
+
+/// @brief Allocate a tracked memory chunk with a larger alignment.
+/// The header is placed right in front of the aligned memory and its offset
+/// from the real allocation is kept in the chunk flags.
+/// @param file The file that the memory was allocated in.
+/// @param line The line that the memory was allocated in.
+/// @param alignment The alignment, a power of two larger than 16.
+/// @param size The size of the memory.
+/// @return The memory or NULL if no memory could be allocated.
+static __attribute__((noinline)) void *iw_memory_memalign(
+    const char *file,
+    unsigned int line,
+    size_t alignment,
+    size_t size)
+{
+    size_t lead = (sizeof(iw_memory_hdr) + alignment - 1) & ~(alignment - 1);
+    if(size > SIZE_MAX - lead - POST_GUARD_SIZE) {
+        return NULL;
+    }
+    size_t offset = lead - sizeof(iw_memory_hdr);
+    if(offset >> (32 - IW_MEM_FLAG_OFFSET_SHIFT) != 0) {
+        // The offset doesn't fit in the chunk flags, don't track the chunk.
+        return s_alloc.memalign(alignment, size);
+    }
+    char *mem = (char *)s_alloc.memalign(alignment,
+                                         lead + size + POST_GUARD_SIZE);
+    if(mem == NULL) {
+        return NULL;
+    }
+
+    iw_memory_hdr *hdr = (iw_memory_hdr *)(mem + offset);
+    iw_memory_hdr_init(hdr, file, line, size, offset);
+    iw_memory_add_chunk(hdr, iw_memory_sample(size));
+    return hdr + 1;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Check whether memory passed to the interposer is a tracked chunk.
+/// Memory allocated before the hooks were registered, or by the memory
+/// module itself, isn't tracked. The header in front of such memory may be
+/// on a page that isn't mapped, so that page is checked before the header
+/// is read.
+/// @param ptr The memory to check.
+/// @return True if the memory is a tracked chunk.
+static bool iw_memory_hook_tracked(void *ptr) {
+    uintptr_t addr = (uintptr_t)ptr;
+    if((addr & (s_page_size - 1)) < sizeof(iw_memory_hdr)) {
+        unsigned char vec;
+        void *page = (void *)((addr & ~(s_page_size - 1)) - s_page_size);
+        if(mincore(page, s_page_size, &vec) != 0) {
+            return false;
+        }
+    }
+    return iw_memory_check_hdr((iw_memory_hdr *)ptr - 1);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief The malloc() hook of the interposer.
+/// @param size The size of the memory.
+/// @return The memory or NULL if no memory could be allocated.
+static void *iw_memory_hook_malloc(size_t size) {
+    if(!iw_memory_tracking || s_untracked != 0) {
+        return s_alloc.malloc(size);
+    }
+    s_hook_frames = IW_MEM_HOOK_FRAMES;
+    void *ptr = iw_malloc(IW_MEM_PRELOAD_FILE, 0, size);
+    s_hook_frames = 0;
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief The calloc() hook of the interposer.
+/// @param elems The number of elements.
+/// @param size The size of each element.
+/// @return The zeroed memory or NULL if no memory could be allocated.
+static void *iw_memory_hook_calloc(size_t elems, size_t size) {
+    if(!iw_memory_tracking || s_untracked != 0) {
+        return s_alloc.calloc(elems, size);
+    }
+    size_t total;
+    if(__builtin_mul_overflow(elems, size, &total)) {
+        return NULL;
+    }
+    s_hook_frames = IW_MEM_HOOK_FRAMES;
+    void *ptr = iw_malloc(IW_MEM_PRELOAD_FILE, 0, total);
+    s_hook_frames = 0;
+    if(ptr != NULL) {
+        memset(ptr, 0, total);
+    }
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief The realloc() hook of the interposer.
+/// Memory that isn't tracked stays untracked. Tracked memory is moved to
+/// untracked memory if it is reallocated when no new chunks are tracked.
+/// @param ptr The memory to reallocate or NULL.
+/// @param size The new size of the memory.
+/// @return The memory or NULL if no memory could be allocated.
+static void *iw_memory_hook_realloc(void *ptr, size_t size) {
+    if(ptr == NULL && (!iw_memory_tracking || s_untracked != 0)) {
+        return s_alloc.malloc(size);
+    }
+    if(ptr != NULL && !iw_memory_hook_tracked(ptr)) {
+        return s_alloc.realloc(ptr, size);
+    }
+    if(iw_memory_tracking && s_untracked == 0) {
+        s_hook_frames = IW_MEM_HOOK_FRAMES;
+        ptr = ptr == NULL ? iw_malloc(IW_MEM_PRELOAD_FILE, 0, size)
+                          : iw_realloc(IW_MEM_PRELOAD_FILE, 0, ptr, size);
+        s_hook_frames = 0;
+        return ptr;
+    }
+
+    iw_memory_hdr *hdr = (iw_memory_hdr *)ptr - 1;
+    void *new_ptr = NULL;
+    if(size != 0) {
+        new_ptr = s_alloc.malloc(size);
+        if(new_ptr == NULL) {
+            return NULL;
+        }
+        memcpy(new_ptr, ptr, hdr->size < size ? hdr->size : size);
+    }
+    iw_memory_release(hdr);
+    return new_ptr;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief The memalign() hook of the interposer.
+/// @param alignment The alignment, a power of two.
+/// @param size The size of the memory.
+/// @return The memory or NULL if no memory could be allocated.
+static void *iw_memory_hook_memalign(size_t alignment, size_t size) {
+    if(!iw_memory_tracking || s_untracked != 0) {
+        return s_alloc.memalign(alignment, size);
+    }
+    s_hook_frames = IW_MEM_HOOK_FRAMES;
+    // The tracked chunks keep the 16 byte alignment of malloc().
+    void *ptr = alignment <= 16
+              ? iw_malloc(IW_MEM_PRELOAD_FILE, 0, size)
+              : iw_memory_memalign(IW_MEM_PRELOAD_FILE, 0, alignment, size);
+    s_hook_frames = 0;
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief The free() hook of the interposer.
+/// @param ptr The memory to free or NULL.
+static void iw_memory_hook_free(void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    if(!iw_memory_hook_tracked(ptr)) {
+        s_alloc.free(ptr);
+        return;
+    }
+    iw_memory_hdr *hdr = (iw_memory_hdr *)ptr - 1;
+    if(iw_memory_tracking) {
+        iw_memory_check_guards(hdr);
+    }
+    iw_memory_release(hdr);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief The malloc_usable_size() hook of the interposer.
+/// @param ptr The memory to get the size of or NULL.
+/// @return The number of bytes that can be used.
+static size_t iw_memory_hook_usable_size(void *ptr) {
+    if(ptr == NULL) {
+        return 0;
+    }
+    if(!iw_memory_hook_tracked(ptr)) {
+        return s_alloc.usable_size(ptr);
+    }
+    return ((iw_memory_hdr *)ptr - 1)->size;
+}
+
+// --------------------------------------------------------------------------
+
+/// The hooks called by the malloc interposer.
+static const iw_memory_allocator s_hooks = {
+    iw_memory_hook_malloc,
+    iw_memory_hook_calloc,
+    iw_memory_hook_realloc,
+    iw_memory_hook_memalign,
+    iw_memory_hook_free,
+    iw_memory_hook_usable_size
+};
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+void iw_memory_init() {
+    if(s_preload) {
+        // Tracking through the interposer is never stopped.
+        return;
+    }
+    int *enable = iw_val_store_get_number(&iw_cfg, IW_CFG_MEMTRACK_ENABLE);
+    int *sample = iw_val_store_get_number(&iw_cfg, IW_CFG_MEMTRACK_SAMPLE);
+    int *depth = iw_val_store_get_number(&iw_cfg, IW_CFG_MEMTRACK_STACKDEPTH);
+    iw_memory_tracking = enable != NULL && *enable;
+    s_sample_interval  = sample != NULL && *sample > 0 ? *sample : 0;
+    s_stack_depth      = depth != NULL && *depth > 0 ? *depth : 0;
+
+    // The malloc interposer is only present if it was preloaded. All its
+    // allocations are attributed to the same file so they are told apart
+    // by their call-stacks.
+    IW_PRELOAD_REGISTER_FN preload = NULL;
+    if(iw_memory_tracking) {
+        preload = (IW_PRELOAD_REGISTER_FN)dlsym(RTLD_DEFAULT,
+                                                IW_PRELOAD_REGISTER);
+    }
+    if(s_stack_depth == 0 && (s_sample_interval != 0 || preload != NULL)) {
+        s_stack_depth = IW_MEM_STACK_DEPTH;
+    }
+    if(s_stack_depth > IW_MEM_STACK_MAX) {
+        s_stack_depth = IW_MEM_STACK_MAX;
+    }
+    if(iw_memory_tracking) {
+        unsigned int cnt;
+        for(cnt=0;cnt < IW_MEM_SHARDS;cnt++) {
+            memset(&s_shards[cnt], 0, sizeof(s_shards[cnt]));
+            pthread_mutex_init(&s_shards[cnt].lock, NULL);
+        }
+        for(cnt=0;cnt < IW_MEM_TAGS;cnt++) {
+            s_tags[cnt].allocs     = 0;
+            s_tags[cnt].cur_bytes  = 0;
+            s_tags[cnt].peak_bytes = 0;
+        }
+        s_num_stacks   = 0;
+        s_scan_shard   = 0;
+        s_scan_started = false;
+        s_scan_passes  = 0;
+        s_scan_chunks  = 0;
+        s_scan_bad     = NULL;
+        memset(s_hist, 0, sizeof(s_hist));
+        memset(s_hist_rates, 0, sizeof(s_hist_rates));
+        s_hist_start   = iw_memory_now_us();
+        s_hist_tick    = 0;
+        if(s_stack_depth != 0 &&
+           !iw_chtable_init(&s_stacks, 0, IW_MEM_STACK_TABLE, false, NULL,
+                            IW_HTABLE_FLAG_KEYS))
+        {
+            LOG(IW_LOG_IW, "Failed to create call-stack table");
+            s_stack_depth = 0;
+        }
+        if(preload != NULL) {
+            s_page_size = sysconf(_SC_PAGESIZE);
+            s_untracked++;
+            if(s_stack_depth != 0) {
+                // Load the unwinder now rather than from within an allocation.
+                void *frame;
+                backtrace(&frame, 1);
+            }
+            preload(&s_hooks, &s_alloc);
+            s_untracked--;
+            s_preload = true;
+            LOG(IW_LOG_IW, "Tracking all allocations through the interposer");
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+
+void iw_memory_exit() {
+    if(s_preload) {
+        // Other libraries keep allocating and freeing tracked memory through
+        // the interposer until the process exits, so the tracking tables
+        // are kept.
+        return;
+    }
+    if(iw_memory_tracking) {
+        // Outstanding chunks belong to the callers, only the shards are
+        // torn down here.
+        unsigned int cnt;
+        for(cnt=0;cnt < IW_MEM_SHARDS;cnt++) {
+            pthread_mutex_destroy(&s_shards[cnt].lock);
+        }
+        // The snapshots refer to the interned call-stacks.
+        pthread_mutex_lock(&s_snapshot_lock);
+        iw_list_node *node;
+        while((node = s_snapshots.head) != NULL) {
+            iw_list_remove(&s_snapshots, node);
+            free(node);
+        }
+        pthread_mutex_unlock(&s_snapshot_lock);
+        if(s_stack_depth != 0) {
+            iw_chtable_destroy(&s_stacks, free);
+            s_stack_depth = 0;
+        }
+        iw_memory_tracking = false;
+    }
+}
+
+// --------------------------------------------------------------------------
+
+__attribute__((noinline)) void *iw_malloc(
+    const char *file,
+    unsigned int line,
+    size_t size)
+{
+    if(!iw_memory_tracking) {
+        return malloc(size);
+    }
+    if(size > SIZE_MAX - sizeof(iw_memory_hdr) - POST_GUARD_SIZE) {
+        return NULL;
+    }
+
+    iw_memory_hdr *hdr = (iw_memory_hdr *)s_alloc.malloc(sizeof(iw_memory_hdr) +
+                                                         size + POST_GUARD_SIZE);
+    if(hdr == NULL) {
+        return NULL;
+    }
+
+    iw_memory_hdr_init(hdr, file, line, size, 0);
+    iw_memory_add_chunk(hdr, iw_memory_sample(size));
+    return hdr + 1;
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_calloc(const char *file, unsigned int line, int elems, size_t size) {
+    if(!iw_memory_tracking) {
+        return calloc(elems, size);
+    }
+
+    void *chunk = iw_malloc(file, line, elems * size);
+    if(chunk == NULL) {
+        return NULL;
+    }
+
+    memset(chunk, 0, elems * size);
+    return chunk;
+}
+
+// --------------------------------------------------------------------------
+
+__attribute__((noinline)) void *iw_realloc(
+    const char *file,
+    unsigned int line,
+    void *ptr,
+    size_t size)
+{
+    if(!iw_memory_tracking) {
+        return realloc(ptr, size);
+    }
+    if(ptr == NULL) {
+        return iw_malloc(file, line, size);
+    }
+    if(size == 0) {
+        iw_free(ptr);
+        return NULL;
+    }
+
+    iw_memory_hdr *hdr = (iw_memory_hdr *)ptr - 1;
+    if(!iw_memory_check(hdr)) {
+        // Not a tracked chunk, reallocate it as normal.
+        return realloc(ptr, size);
+    }
+    if(size > SIZE_MAX - sizeof(iw_memory_hdr) - POST_GUARD_SIZE) {
+        return NULL;
+    }
+    if(iw_memory_hdr_offset(hdr) != 0) {
+        // The header of an aligned chunk isn't at the start of the real
+        // allocation so the chunk can't be reallocated in place.
+        void *new_ptr = iw_malloc(file, line, size);
+        if(new_ptr != NULL) {
+            memcpy(new_ptr, ptr, hdr->size < size ? hdr->size : size);
+            iw_memory_release(hdr);
+        }
+        return new_ptr;
+    }
+
+    // Let realloc() grow the chunk in place if it can. The chunk keeps its
+    // tracking entry, only its list node is taken out of the shard while it
+    // may move. The cookie is cleared so that a header left behind in the
+    // freed memory isn't mistaken for a tracked chunk by the interposer.
+    iw_memory_unlink_chunk(hdr);
+    hdr->cookie = 0;
+    iw_memory_hdr *new_hdr = (iw_memory_hdr *)s_alloc.realloc(hdr,
+                                sizeof(iw_memory_hdr) + size + POST_GUARD_SIZE);
+    void *new_ptr = NULL;
+    if(new_hdr == NULL) {
+        // Realloc does not free or move the old memory if allocation fails.
+        new_hdr = hdr;
+    } else {
+        iw_memory_resize_chunk(new_hdr, size);
+        new_ptr = new_hdr + 1;
+    }
+    new_hdr->cookie = COOKIE;
+    if(new_hdr->shard != IW_MEM_UNSAMPLED) {
+        iw_memory_link_chunk(new_hdr);
+    }
+    return new_ptr;
+}
+
+// --------------------------------------------------------------------------
+
+char *iw_strdup(const char *file, unsigned int line, const char *ptr) {
+    if(!iw_memory_tracking) {
+        return strdup(ptr);
+    }
+
+    int len = strlen(ptr) + 1;
+    void *chunk = iw_malloc(file, line, len);
+    if(chunk == NULL) {
+        return NULL;
+    }
+    memcpy(chunk, ptr, len);
+    return chunk;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_free(void *ptr) {
+    if(!iw_memory_tracking) {
+        free(ptr);
+        return;
+    }
+    if(ptr == NULL) {
+        return;
+    }
+
+    iw_memory_hdr *hdr = (iw_memory_hdr *)ptr - 1;
+    if(!iw_memory_check(hdr)) {
+        // It is possible that this memory has been allocated outside our
+        // normal allocation framework so just free it as normal.
+        free(ptr);
+        return;
+    }
+
+    iw_memory_release(hdr);
+}
+
+// --------------------------------------------------------------------------
+
+char *iw_memory_display_str(unsigned int len, char *buff, unsigned long bytes) {
+    static char *unit[] = { "Bytes", "KBytes", "MBytes", "GBytes" };
+    unsigned int cnt=0;
+    for(;cnt < IW_ARR_LEN(unit);cnt++) {
+        if(bytes < 1024) {
+            snprintf(buff, len, "%lu %s", bytes, unit[cnt]);
+            return buff;
+        }
+        bytes = bytes / 1024;
+    }
+    snprintf(buff, len, "%lu %s", bytes, unit[cnt-1]);
+    return buff;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Merge the counters of all shards.
+/// The counters are read without locking so the totals may be slightly off
+/// if memory is allocated concurrently.
+/// @param allocs [out] The number of allocations.
+/// @param frees [out] The number of frees.
+/// @param cur_bytes [out] The number of outstanding bytes.
+/// @param acc_bytes [out] The number of bytes allocated so far.
+static void iw_memory_counters(
+    unsigned long *allocs,
+    unsigned long *frees,
+    unsigned long *cur_bytes,
+    unsigned long *acc_bytes)
+{
+    unsigned int cnt;
+    *allocs = *frees = *cur_bytes = *acc_bytes = 0;
+    for(cnt=0;cnt < IW_MEM_SHARDS;cnt++) {
+        iw_memory_shard *shard = &s_shards[cnt];
+        *allocs    += __atomic_load_n(&shard->allocs, __ATOMIC_RELAXED);
+        *frees     += __atomic_load_n(&shard->frees, __ATOMIC_RELAXED);
+        *cur_bytes += __atomic_load_n(&shard->cur_bytes, __ATOMIC_RELAXED);
+        *acc_bytes += __atomic_load_n(&shard->acc_bytes, __ATOMIC_RELAXED);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+static void iw_memory_dump(FILE *out, IW_MEM_DUMP dump) {
+    char buff1[64];
+    char buff2[64];
+
+    if(!iw_memory_tracking) {
+        fprintf(out, "Memory tracking is disabled.\n");
+        return;
+    }
+
+    unsigned long allocs, frees, cur_bytes, acc_bytes;
+    iw_memory_counters(&allocs, &frees, &cur_bytes, &acc_bytes);
+    unsigned int cnt;
+
+    // Print memory statistics
+    fprintf(out,
+            "== Memory summary ==\n"
+            "Number allocations:      %lu\n"
+            "Number frees:            %lu\n"
+            "Outstanding allocations: %lu\n"
+            "Outstanding allocations: %s\n"
+            "Accumulated allocations: %s\n"
+            "Memory corruptions:      %u\n"
+            "Pre-guard corruptions:   %u\n"
+            "Post-guard corruptions:  %u\n"
+            "\n",
+            allocs, frees, allocs - frees,
+            iw_memory_display_str(sizeof(buff1), buff1, cur_bytes),
+            iw_memory_display_str(sizeof(buff2), buff2, acc_bytes),
+            __atomic_load_n(&s_mem_corrupt, __ATOMIC_RELAXED),
+            __atomic_load_n(&s_pre_corrupt, __ATOMIC_RELAXED),
+            __atomic_load_n(&s_post_corrupt, __ATOMIC_RELAXED));
+    if(s_sample_interval != 0) {
+        fprintf(out, "Sampling one allocation per %lu bytes, only sampled "
+                     "allocations are listed.\n\n", s_sample_interval);
+    }
+    if(s_preload) {
+        fprintf(out, "All allocations of the process are tracked through the "
+                     "malloc interposer, see the call-stacks of the %s "
+                     "allocations.\n\n", IW_MEM_PRELOAD_FILE);
+    }
+    unsigned long passes = __atomic_load_n(&s_scan_passes, __ATOMIC_RELAXED);
+    unsigned long chunks = __atomic_load_n(&s_scan_chunks, __ATOMIC_RELAXED);
+    if(chunks != 0) {
+        fprintf(out, "Guard scans completed:   %lu\n"
+                     "Guard scanned chunks:    %lu\n\n", passes, chunks);
+    }
+
+    // Arenas are tracked as one allocation per block, show how much of the
+    // blocks is used.
+    fprintf(out, "== Arenas ==\n");
+    iw_arena_show(out);
+    fprintf(out, "\n");
+
+    iw_htable sum;
+    iw_htable_init(&sum, 1024, false, NULL);
+
+    if(dump == IW_MEM_DUMP_ALL) {
         fprintf(out, "== Allocated Memory ==\n");
-        while(minfo != NULL) {
-            fprintf(out, "Memory[%08" PRIxPTR "]: %s:%d (%s)\n",
-                (uintptr_t)minfo->address,
-                minfo->loc.file, minfo->loc.line,
-                iw_memory_display_str(sizeof(buff1), buff1, minfo->loc.size));
-            minfo = (iw_memory_info *)iw_htable_get_next(&s_memory, &hash);
-        }
-    } else if(dump == IW_MEM_DUMP_SUMMARY || dump == IW_MEM_DUMP_BRIEF) {
-        // Summarize the memory allocations and print out the largest blocks first
-        unsigned long hash;
+    } else {
         fprintf(out, "== Allocated Memory Summary ==\n");
-        iw_memory_info *minfo = (iw_memory_info *)iw_htable_get_first(&s_memory, &hash);
-        while(minfo != NULL) {
+    }
+    for(cnt=0;cnt < IW_MEM_SHARDS;cnt++) {
+        iw_memory_shard *shard = &s_shards[cnt];
+        iw_memory_entry *entries = NULL;
+        unsigned int num = 0;
+        unsigned int idx;
+        // Memory allocated while a shard is locked must not be tracked
+        // since tracking it could lock the same shard.
+        s_untracked++;
+        pthread_mutex_lock(&shard->lock);
+        if(dump == IW_MEM_DUMP_ALL && shard->chunks.num_elems > 0) {
+            // Copy the chunks so that they are printed with the shard
+            // unlocked, a slow client mustn't stall allocating threads.
+            entries = (iw_memory_entry *)calloc(shard->chunks.num_elems,
+                                                sizeof(iw_memory_entry));
+        }
+        iw_list_node *node;
+        for(node=shard->chunks.head;node != NULL;node=node->next) {
+            iw_memory_hdr *hdr = (iw_memory_hdr *)node;
+            if(dump == IW_MEM_DUMP_ALL) {
+                if(entries != NULL && num < shard->chunks.num_elems) {
+                    iw_memory_entry *entry = &entries[num++];
+                    entry->addr = (uintptr_t)(hdr + 1);
+                    snprintf(entry->loc.file, sizeof(entry->loc.file), "%s",
+                             hdr->file);
+                    entry->loc.line  = hdr->line;
+                    entry->loc.size  = hdr->size;
+                    entry->loc.stack = hdr->stack;
+                    entry->tag = hdr->tag;
+                }
+                continue;
+            }
+
             // Use the location info as a hash key into the summary table
+            iw_memory_loc loc;
+            memset(&loc, 0, sizeof(loc));
+            snprintf(loc.file, sizeof(loc.file), "%s", hdr->file);
+            loc.line  = hdr->line;
+            loc.size  = hdr->size;
+            loc.stack = hdr->stack;
             iw_memory_report *report =
-                    (iw_memory_report *)iw_htable_get(&sum,
-                                                      sizeof(iw_memory_loc),
-                                                      &minfo->loc);
+                    (iw_memory_report *)iw_htable_get(&sum, sizeof(loc), &loc);
 
             // If we have an existing entry for this location, then increase
             // the count, otherwise create an entry.
@@ -422,62 +1695,61 @@ static void iw_memory_dump(FILE *out, IW_MEM_DUMP dump) {
             } else {
                 report = (iw_memory_report *)calloc(1, sizeof(iw_memory_report));
                 if(report != NULL) {
-                    memcpy(&report->loc, &minfo->loc, sizeof(iw_memory_loc));
+                    memcpy(&report->loc, &loc, sizeof(iw_memory_loc));
                     report->num = 1;
                     iw_htable_insert(&sum, sizeof(iw_memory_loc), &report->loc, report);
                 }
             }
-
-            minfo = (iw_memory_info *)iw_htable_get_next(&s_memory, &hash);
         }
-    }
+        pthread_mutex_unlock(&shard->lock);
+        s_untracked--;
 
-    // Now we should have a table with all memory allocations summarized.
-    // Go ahead and unlock the mutex lock at this point since we can
-    // work on the summary table from this point on.
-    pthread_rwlock_unlock(&s_memory_lock);
-
-    if(dump == IW_MEM_DUMP_SUMMARY || dump == IW_MEM_DUMP_BRIEF) {
-        // Create a sorted linked list by taking one element at the time and
-        // insert it in the correct position in the list.
-        unsigned long hash;
-        iw_list rlist = IW_LIST_INIT;
-        iw_memory_report *report = (iw_memory_report *)iw_htable_get_first(&sum, &hash);
-        while(report != NULL) {
-            if(rlist.num_elems == 0) {
-                iw_list_add(&rlist, (iw_list_node *)report);
-            } else {
-                iw_list_node *node = rlist.head;
-                iw_memory_report *rnode = (iw_memory_report *)node;
-                while(node->next != NULL &&
-                      (rnode->num > report->num ||
-                       (rnode->num == report->num &&
-                        rnode->loc.size > report->loc.size)))
-                {
-                    node = node->next;
-                }
-
-                // Insert the entry into the list at this point
-                iw_list_insert_before(&rlist, node, (iw_list_node *)report);
+        // Print out every single memory allocation.
+        for(idx=0;idx < num;idx++) {
+            iw_memory_entry *entry = &entries[idx];
+            fprintf(out, "Memory[%08" PRIxPTR "]: %s:%d (%s)",
+                entry->addr, entry->loc.file, entry->loc.line,
+                iw_memory_display_str(sizeof(buff1), buff1, entry->loc.size));
+            if(entry->tag != IW_MEM_TAG_NONE) {
+                fprintf(out, " Tag %s", s_tags[entry->tag].name);
             }
-
-            // Get the next entry
-            report = (iw_memory_report *)iw_htable_get_next(&sum, &hash);
+            if(entry->loc.stack != NULL) {
+                fprintf(out, " Stack #%u", entry->loc.stack->id);
+            }
+            fprintf(out, "\n");
         }
+        free(entries);
+    }
 
-        // Print out the summarized report
-        iw_list_node *node = rlist.head;
-        int cnt;
-        for(cnt=0;node != NULL && (dump != IW_MEM_DUMP_BRIEF || cnt < 20);cnt++) {
-            iw_memory_report *report = (iw_memory_report *)node;
-            fprintf(out, "Memory Allocation: %s:%d (%d * %s => Total %s)\n",
+    // Now we should have a table with all memory allocations summarized
+    // and all shards unlocked, the summary table is private to this call.
+    if(dump == IW_MEM_DUMP_SUMMARY || dump == IW_MEM_DUMP_BRIEF) {
+        // Sort the summary with the most frequent allocations first.
+        iw_htable_view view;
+        iw_htable_view_init(&view, &sum, iw_memory_report_compare);
+
+        // Print out the summarized report, allocations made from different
+        // call-stacks are listed separately.
+        iw_htable symbols;
+        iw_htable_init_ex(&symbols, 256, false, NULL, IW_HTABLE_FLAG_KEYS);
+        iw_memory_report *report = (iw_memory_report *)iw_htable_view_first(&view);
+        for(cnt=0;report != NULL && (dump != IW_MEM_DUMP_BRIEF || cnt < 20);cnt++) {
+            fprintf(out, "Memory Allocation: %s:%d (%d * %s => Total %s)",
                 report->loc.file,
                 report->loc.line,
                 report->num,
                 iw_memory_display_str(sizeof(buff1), buff1, report->loc.size),
                 iw_memory_display_str(sizeof(buff2), buff2, report->num * report->loc.size));
-            node = node->next;
+            if(report->loc.stack != NULL) {
+                fprintf(out, " Stack #%u\n", report->loc.stack->id);
+                iw_memory_stack_print(out, &symbols, report->loc.stack);
+            } else {
+                fprintf(out, "\n");
+            }
+            report = (iw_memory_report *)iw_htable_view_next(&view);
         }
+        iw_htable_view_destroy(&view);
+        iw_htable_destroy(&symbols, free);
     }
 
     // Finally delete all allocated structures.
@@ -486,6 +1758,708 @@ static void iw_memory_dump(FILE *out, IW_MEM_DUMP dump) {
 
 // --------------------------------------------------------------------------
 
+/// @brief Group the tracked chunks by allocation site and call-stack.
+/// The shards are locked one at a time while their chunks are grouped, the
+/// call-stacks are symbolized by the caller afterwards.
+/// @param sites The table to add the sites to, keyed by iw_memory_site_key.
+/// @param total [out] The estimated number of live bytes.
+/// @return The number of tracked chunks.
+static unsigned int iw_memory_sites(iw_htable *sites, double *total) {
+    unsigned int samples = 0, cnt;
+    *total = 0.0;
+    for(cnt=0;cnt < IW_MEM_SHARDS;cnt++) {
+        iw_memory_shard *shard = &s_shards[cnt];
+        s_untracked++;
+        pthread_mutex_lock(&shard->lock);
+        iw_list_node *node;
+        for(node=shard->chunks.head;node != NULL;node=node->next) {
+            iw_memory_hdr *hdr = (iw_memory_hdr *)node;
+            iw_memory_site_key key;
+            memset(&key, 0, sizeof(key));
+            key.file  = hdr->file;
+            key.line  = hdr->line;
+            key.stack = hdr->stack;
+            iw_memory_site *site =
+                    (iw_memory_site *)iw_htable_get(sites, sizeof(key), &key);
+            if(site == NULL) {
+                site = (iw_memory_site *)calloc(1, sizeof(iw_memory_site));
+                if(site == NULL) {
+                    continue;
+                }
+                memcpy(&site->key, &key, sizeof(key));
+                iw_htable_insert(sites, sizeof(key), &site->key, site);
+            }
+            double weight = iw_memory_sample_weight(hdr->size);
+            site->samples++;
+            site->sampled_bytes += hdr->size;
+            site->count += weight;
+            site->bytes += weight * hdr->size;
+            *total += weight * hdr->size;
+            samples++;
+        }
+        pthread_mutex_unlock(&shard->lock);
+        s_untracked--;
+    }
+    return samples;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_memory_profile(FILE *out) {
+    char buff1[64];
+    char buff2[64];
+
+    if(!iw_memory_tracking) {
+        fprintf(out, "Memory tracking is disabled.\n");
+        return;
+    }
+
+    iw_htable sites;
+    iw_htable_init_ex(&sites, 1024, false, NULL, IW_HTABLE_FLAG_KEYS);
+    double total = 0.0;
+    unsigned int samples = iw_memory_sites(&sites, &total);
+
+    unsigned long allocs, frees, cur_bytes, acc_bytes;
+    iw_memory_counters(&allocs, &frees, &cur_bytes, &acc_bytes);
+    fprintf(out,
+            "== Heap profile ==\n"
+            "Sampling interval:       %lu bytes\n"
+            "Sampled allocations:     %u\n"
+            "Estimated live heap:     %s\n"
+            "Outstanding allocations: %s\n"
+            "\n",
+            s_sample_interval, samples,
+            iw_memory_display_str(sizeof(buff1), buff1, (unsigned long)total),
+            iw_memory_display_str(sizeof(buff2), buff2, cur_bytes));
+
+    iw_htable symbols;
+    iw_htable_init_ex(&symbols, 256, false, NULL, IW_HTABLE_FLAG_KEYS);
+    iw_htable_view view;
+    iw_htable_view_init(&view, &sites, iw_memory_site_compare);
+    iw_memory_site *site = (iw_memory_site *)iw_htable_view_first(&view);
+    while(site != NULL) {
+        fprintf(out, "Heap Site: %s:%d (%.0f allocations => Total %s, %u sampled)\n",
+                site->key.file, site->key.line, site->count,
+                iw_memory_display_str(sizeof(buff1), buff1,
+                                      (unsigned long)site->bytes),
+                site->samples);
+        if(site->key.stack != NULL) {
+            iw_memory_stack_print(out, &symbols, site->key.stack);
+        }
+        site = (iw_memory_site *)iw_htable_view_next(&view);
+    }
+    iw_htable_view_destroy(&view);
+    iw_htable_destroy(&symbols, free);
+    iw_htable_destroy(&sites, free);
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_memory_pprof(FILE *out) {
+    if(!iw_memory_tracking) {
+        return false;
+    }
+
+    iw_htable sites;
+    iw_htable_init_ex(&sites, 1024, false, NULL, IW_HTABLE_FLAG_KEYS);
+    double total = 0.0;
+    unsigned int samples = iw_memory_sites(&sites, &total), cnt;
+    unsigned long bytes = 0;
+    iw_memory_site *site;
+    iw_htable_iter iter;
+    for(site=(iw_memory_site *)iw_htable_iter_first(&sites, &iter);
+        site != NULL;
+        site=(iw_memory_site *)iw_htable_iter_next(&iter))
+    {
+        bytes += site->sampled_bytes;
+    }
+
+    // The legacy text format of the gperftools heap profiler. Only live
+    // allocations are tracked per site, so the allocated columns repeat the
+    // in-use columns. Sampled profiles are scaled up by the profile viewer.
+    fprintf(out, "heap profile: %6u: %8lu [%6u: %8lu] @ ",
+            samples, bytes, samples, bytes);
+    if(s_sample_interval != 0) {
+        fprintf(out, "heap_v2/%lu\n", s_sample_interval);
+    } else {
+        fprintf(out, "heapprofile\n");
+    }
+    for(site=(iw_memory_site *)iw_htable_iter_first(&sites, &iter);
+        site != NULL;
+        site=(iw_memory_site *)iw_htable_iter_next(&iter))
+    {
+        fprintf(out, "%6u: %8lu [%6u: %8lu] @",
+                site->samples, site->sampled_bytes,
+                site->samples, site->sampled_bytes);
+        if(site->key.stack != NULL) {
+            for(cnt=0;cnt < site->key.stack->depth;cnt++) {
+                fprintf(out, " 0x%" PRIxPTR,
+                        (uintptr_t)site->key.stack->frames[cnt]);
+            }
+        } else {
+            // Without call-stacks, give each site a frame of its own so that
+            // the profile viewer doesn't merge all sites into one. The frame
+            // is derived from the file and line, so it is the same in every
+            // profile and profiles can be compared.
+            unsigned long frame = iw_hash_data(strlen(site->key.file),
+                                               site->key.file);
+            frame = (frame ^ (site->key.line * 0x9E3779B97F4A7C15UL)) &
+                    IW_MEM_PPROF_SITE_MASK;
+            fprintf(out, " 0x%lx", frame);
+        }
+        fprintf(out, "\n");
+    }
+    iw_htable_destroy(&sites, free);
+
+    // The memory map lets the profile viewer symbolize the addresses.
+    fprintf(out, "\nMAPPED_LIBRARIES:\n");
+    FILE *maps = fopen("/proc/self/maps", "r");
+    if(maps != NULL) {
+        char buff[512];
+        size_t len;
+        while((len = fread(buff, 1, sizeof(buff), maps)) > 0) {
+            fwrite(buff, 1, len, out);
+        }
+        fclose(maps);
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Take a snapshot of the live heap.
+/// @param name The name of the snapshot.
+/// @return The snapshot or NULL if it could not be allocated.
+static iw_memory_snap *iw_memory_snapshot_take(const char *name) {
+    iw_htable sites;
+    iw_htable_init_ex(&sites, 1024, false, NULL, IW_HTABLE_FLAG_KEYS);
+    double total = 0.0;
+    iw_memory_sites(&sites, &total);
+
+    iw_memory_snap *snapshot = (iw_memory_snap *)calloc(1,
+                sizeof(iw_memory_snap) +
+                sites.num_elems * sizeof(iw_memory_snap_site));
+    if(snapshot != NULL) {
+        snprintf(snapshot->name, sizeof(snapshot->name), "%s", name);
+        snapshot->taken = time(NULL);
+        snapshot->bytes = (unsigned long)total;
+        iw_htable_iter iter;
+        iw_memory_site *site;
+        for(site=(iw_memory_site *)iw_htable_iter_first(&sites, &iter);
+            site != NULL;
+            site=(iw_memory_site *)iw_htable_iter_next(&iter))
+        {
+            iw_memory_snap_site *snap = &snapshot->sites[snapshot->num_sites++];
+            memcpy(&snap->key, &site->key, sizeof(snap->key));
+            snap->count = (unsigned long)(site->count + 0.5);
+            snap->bytes = (unsigned long)(site->bytes + 0.5);
+        }
+        qsort(snapshot->sites, snapshot->num_sites,
+              sizeof(iw_memory_snap_site), iw_memory_site_key_compare);
+    }
+    iw_htable_destroy(&sites, free);
+    return snapshot;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Find a heap snapshot by name.
+/// The caller must hold the snapshot lock.
+/// @param name The name of the snapshot.
+/// @return The snapshot or NULL if there is no snapshot with that name.
+static iw_memory_snap *iw_memory_snapshot_find(const char *name) {
+    iw_list_node *node;
+    for(node=s_snapshots.head;node != NULL;node=node->next) {
+        iw_memory_snap *snapshot = (iw_memory_snap *)node;
+        if(strncmp(snapshot->name, name, sizeof(snapshot->name) - 1) == 0) {
+            return snapshot;
+        }
+    }
+    return NULL;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_memory_snapshot(const char *name) {
+    if(!iw_memory_tracking) {
+        return false;
+    }
+
+    iw_memory_snap *snapshot = iw_memory_snapshot_take(name);
+    if(snapshot == NULL) {
+        LOG(IW_LOG_IW, "Failed to allocate heap snapshot");
+        return false;
+    }
+
+    // Replace any snapshot with the same name and drop the oldest snapshot
+    // if too many snapshots have been taken.
+    pthread_mutex_lock(&s_snapshot_lock);
+    iw_memory_snap *old = iw_memory_snapshot_find(name);
+    if(old == NULL && s_snapshots.num_elems >= IW_MEM_SNAPSHOTS) {
+        old = (iw_memory_snap *)s_snapshots.head;
+    }
+    if(old != NULL) {
+        iw_list_remove(&s_snapshots, &old->node);
+        free(old);
+    }
+    iw_list_add(&s_snapshots, &snapshot->node);
+    pthread_mutex_unlock(&s_snapshot_lock);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_memory_snapshots(FILE *out) {
+    char buff[64];
+    char time_buff[32];
+
+    if(!iw_memory_tracking) {
+        fprintf(out, "Memory tracking is disabled.\n");
+        return;
+    }
+
+    fprintf(out, "== Heap snapshots ==\n");
+    pthread_mutex_lock(&s_snapshot_lock);
+    iw_list_node *node;
+    for(node=s_snapshots.head;node != NULL;node=node->next) {
+        iw_memory_snap *snapshot = (iw_memory_snap *)node;
+        struct tm taken;
+        localtime_r(&snapshot->taken, &taken);
+        strftime(time_buff, sizeof(time_buff), "%Y-%m-%d %H:%M:%S", &taken);
+        fprintf(out, "Snapshot: %s (%s, %u sites => Total %s)\n",
+                snapshot->name, time_buff, snapshot->num_sites,
+                iw_memory_display_str(sizeof(buff), buff, snapshot->bytes));
+    }
+    pthread_mutex_unlock(&s_snapshot_lock);
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_memory_diff(FILE *out, const char *from, const char *to) {
+    char buff1[64];
+    char buff2[64];
+    char buff3[64];
+
+    if(!iw_memory_tracking) {
+        fprintf(out, "Memory tracking is disabled.\n");
+        return false;
+    }
+
+    // Compare against the live heap if no later snapshot is given.
+    iw_memory_snap *live = NULL;
+    if(to == NULL) {
+        live = iw_memory_snapshot_take("live heap");
+        if(live == NULL) {
+            fprintf(out, "Failed to take a snapshot of the live heap.\n");
+            return false;
+        }
+    }
+
+    pthread_mutex_lock(&s_snapshot_lock);
+    iw_memory_snap *snap1 = iw_memory_snapshot_find(from);
+    iw_memory_snap *snap2 = live != NULL ? live : iw_memory_snapshot_find(to);
+    iw_memory_growth *growth = NULL;
+    if(snap1 == NULL || snap2 == NULL) {
+        fprintf(out, "No heap snapshot named '%s'.\n",
+                snap1 == NULL ? from : to);
+        goto unlock;
+    }
+    growth = (iw_memory_growth *)calloc(snap2->num_sites + 1,
+                                        sizeof(iw_memory_growth));
+    if(growth == NULL) {
+        fprintf(out, "Failed to allocate memory for the heap diff.\n");
+        goto unlock;
+    }
+
+    // Both snapshots are sorted by site so merge them in a single pass and
+    // keep the sites whose live bytes grew.
+    unsigned int idx1 = 0, idx2, num = 0;
+    unsigned long total = 0;
+    for(idx2=0;idx2 < snap2->num_sites;idx2++) {
+        const iw_memory_snap_site *site = &snap2->sites[idx2];
+        while(idx1 < snap1->num_sites &&
+              iw_memory_site_key_compare(&snap1->sites[idx1].key,
+                                         &site->key) < 0)
+        {
+            idx1++;
+        }
+        unsigned long count = 0, bytes = 0;
+        if(idx1 < snap1->num_sites &&
+           iw_memory_site_key_compare(&snap1->sites[idx1].key, &site->key) == 0)
+        {
+            count = snap1->sites[idx1].count;
+            bytes = snap1->sites[idx1].bytes;
+        }
+        if(site->bytes > bytes) {
+            growth[num].site  = site;
+            growth[num].count = (long)site->count - (long)count;
+            growth[num].bytes = site->bytes - bytes;
+            total += growth[num].bytes;
+            num++;
+        }
+    }
+    qsort(growth, num, sizeof(iw_memory_growth), iw_memory_growth_compare);
+
+    fprintf(out,
+            "== Heap growth from '%s' to '%s' ==\n"
+            "Live heap before:        %s\n"
+            "Live heap after:         %s\n"
+            "Sites grown:             %u\n"
+            "Growth of grown sites:   %s\n"
+            "\n",
+            snap1->name, snap2->name,
+            iw_memory_display_str(sizeof(buff1), buff1, snap1->bytes),
+            iw_memory_display_str(sizeof(buff2), buff2, snap2->bytes),
+            num,
+            iw_memory_display_str(sizeof(buff3), buff3, total));
+
+    iw_htable symbols;
+    iw_htable_init_ex(&symbols, 256, false, NULL, IW_HTABLE_FLAG_KEYS);
+    unsigned int cnt;
+    for(cnt=0;cnt < num;cnt++) {
+        const iw_memory_snap_site *site = growth[cnt].site;
+        fprintf(out, "Heap Growth: %s:%d (%+ld allocations => +%s, now %s)",
+                site->key.file, site->key.line, growth[cnt].count,
+                iw_memory_display_str(sizeof(buff1), buff1, growth[cnt].bytes),
+                iw_memory_display_str(sizeof(buff2), buff2, site->bytes));
+        if(site->key.stack != NULL) {
+            fprintf(out, " Stack #%u\n", site->key.stack->id);
+            iw_memory_stack_print(out, &symbols, site->key.stack);
+        } else {
+            fprintf(out, "\n");
+        }
+    }
+    iw_htable_destroy(&symbols, free);
+
+unlock:
+    pthread_mutex_unlock(&s_snapshot_lock);
+    free(growth);
+    free(live);
+    return growth != NULL;
+}
+
+// --------------------------------------------------------------------------
+
+unsigned int iw_memory_tag_register(const char *name) {
+    unsigned int tag;
+    pthread_mutex_lock(&s_tag_lock);
+    for(tag=1;tag < s_num_tags;tag++) {
+        if(strncmp(s_tags[tag].name, name, sizeof(s_tags[tag].name) - 1) == 0) {
+            pthread_mutex_unlock(&s_tag_lock);
+            return tag;
+        }
+    }
+    if(tag >= IW_MEM_TAGS) {
+        pthread_mutex_unlock(&s_tag_lock);
+        LOG(IW_LOG_IW, "Too many memory tags, '%s' not registered", name);
+        return IW_MEM_TAG_NONE;
+    }
+    snprintf(s_tags[tag].name, sizeof(s_tags[tag].name), "%s", name);
+    __atomic_store_n(&s_num_tags, tag + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&s_tag_lock);
+    return tag;
+}
+
+// --------------------------------------------------------------------------
+
+unsigned int iw_memory_tag_set(unsigned int tag) {
+    unsigned int prev = s_tag;
+    s_tag = tag < __atomic_load_n(&s_num_tags, __ATOMIC_ACQUIRE) ?
+                tag : IW_MEM_TAG_NONE;
+    return prev;
+}
+
+// --------------------------------------------------------------------------
+
+unsigned int iw_memory_tag_get() {
+    return s_tag;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_memory_tag_restore(unsigned int *tag) {
+    s_tag = *tag;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_memory_tag_info_get(unsigned int tag, iw_memory_tag_info *info) {
+    unsigned int num_tags = __atomic_load_n(&s_num_tags, __ATOMIC_ACQUIRE);
+    if(!iw_memory_tracking || tag >= num_tags) {
+        return false;
+    }
+    info->name       = s_tags[tag].name;
+    info->allocs     = __atomic_load_n(&s_tags[tag].allocs, __ATOMIC_RELAXED);
+    info->cur_bytes  = __atomic_load_n(&s_tags[tag].cur_bytes, __ATOMIC_RELAXED);
+    info->peak_bytes = __atomic_load_n(&s_tags[tag].peak_bytes, __ATOMIC_RELAXED);
+    if(tag == IW_MEM_TAG_NONE) {
+        // Untagged memory is whatever isn't accounted to a tag, its peak is
+        // not known.
+        unsigned long allocs, frees, cur_bytes, acc_bytes;
+        iw_memory_counters(&allocs, &frees, &cur_bytes, &acc_bytes);
+        info->allocs    = allocs - frees;
+        info->cur_bytes = cur_bytes;
+        for(tag=1;tag < num_tags;tag++) {
+            info->allocs    -= __atomic_load_n(&s_tags[tag].allocs,
+                                               __ATOMIC_RELAXED);
+            info->cur_bytes -= __atomic_load_n(&s_tags[tag].cur_bytes,
+                                               __ATOMIC_RELAXED);
+        }
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_memory_tags(FILE *out) {
+    char buff1[64];
+    char buff2[64];
+
+    if(!iw_memory_tracking) {
+        fprintf(out, "Memory tracking is disabled.\n");
+        return;
+    }
+
+    fprintf(out, "== Memory tags ==\n");
+    fprintf(out, "%-32s %12s %14s %14s\n",
+            "Tag", "Allocations", "Current", "Peak");
+    iw_memory_tag_info info;
+    unsigned int tag;
+    for(tag=0;iw_memory_tag_info_get(tag, &info);tag++) {
+        fprintf(out, "%-32s %12lu %14s %14s\n",
+                info.name, info.allocs,
+                iw_memory_display_str(sizeof(buff1), buff1, info.cur_bytes),
+                tag == IW_MEM_TAG_NONE ? "-" :
+                    iw_memory_display_str(sizeof(buff2), buff2, info.peak_bytes));
+    }
+}
+
+// --------------------------------------------------------------------------
+
+unsigned int iw_memory_scan(unsigned long budget) {
+    unsigned int found = 0;
+
+    if(!iw_memory_tracking) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&s_scan_lock);
+    unsigned long start = iw_memory_now_us();
+    do {
+        iw_memory_shard *shard = &s_shards[s_scan_shard];
+        s_untracked++;
+        pthread_mutex_lock(&shard->lock);
+        if(!s_scan_started) {
+            shard->scan_next = shard->chunks.head;
+            s_scan_started   = true;
+        }
+        unsigned int checked = iw_memory_scan_batch(shard, &found);
+        bool done = shard->scan_next == NULL;
+        pthread_mutex_unlock(&shard->lock);
+        s_untracked--;
+        __atomic_fetch_add(&s_scan_chunks, checked, __ATOMIC_RELAXED);
+
+        if(done) {
+            s_scan_started = false;
+            if(++s_scan_shard == IW_MEM_SHARDS) {
+                // Don't start over until the next tick once all chunks
+                // have been checked.
+                s_scan_shard = 0;
+                __atomic_fetch_add(&s_scan_passes, 1, __ATOMIC_RELAXED);
+                break;
+            }
+        }
+    } while(iw_memory_now_us() - start < budget);
+    pthread_mutex_unlock(&s_scan_lock);
+    return found;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Sum up the histogram counters of a size class over all CPUs.
+/// @param cls The size class.
+/// @param allocs [out] The number of allocations.
+/// @param frees [out] The number of frees.
+/// @param alloc_bytes [out] The number of bytes allocated.
+/// @param free_bytes [out] The number of bytes freed.
+/// @param lifetime [out] The total lifetime of the freed memory in us.
+static void iw_memory_hist_sum(
+    unsigned int cls,
+    unsigned long *allocs,
+    unsigned long *frees,
+    unsigned long *alloc_bytes,
+    unsigned long *free_bytes,
+    unsigned long *lifetime)
+{
+    unsigned int cpu;
+    *allocs = *frees = *alloc_bytes = *free_bytes = *lifetime = 0;
+    for(cpu=0;cpu < IW_MEM_HIST_CPUS;cpu++) {
+        iw_memory_hist_cpu *hist = &s_hist[cpu];
+        *allocs      += __atomic_load_n(&hist->allocs[cls], __ATOMIC_RELAXED);
+        *frees       += __atomic_load_n(&hist->frees[cls], __ATOMIC_RELAXED);
+        *alloc_bytes += __atomic_load_n(&hist->alloc_bytes[cls],
+                                        __ATOMIC_RELAXED);
+        *free_bytes  += __atomic_load_n(&hist->free_bytes[cls],
+                                        __ATOMIC_RELAXED);
+        *lifetime    += __atomic_load_n(&hist->lifetime[cls], __ATOMIC_RELAXED);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Format a size class limit, e.g. 512, 4K or 2M.
+/// @param len The length of the buffer.
+/// @param buff The buffer to write the string to.
+/// @param size The size to format.
+/// @return The buffer.
+static char *iw_memory_hist_size_str(unsigned int len, char *buff, size_t size) {
+    if(size >= 1024 * 1024) {
+        snprintf(buff, len, "%zuM", size / (1024 * 1024));
+    } else if(size >= 1024) {
+        snprintf(buff, len, "%zuK", size / 1024);
+    } else {
+        snprintf(buff, len, "%zu", size);
+    }
+    return buff;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Format a lifetime in the most suitable unit.
+/// @param len The length of the buffer.
+/// @param buff The buffer to write the string to.
+/// @param us The lifetime in microseconds.
+/// @return The buffer.
+static char *iw_memory_hist_time_str(unsigned int len, char *buff, double us) {
+    if(us >= 1000000.0) {
+        snprintf(buff, len, "%.1f s", us / 1000000.0);
+    } else if(us >= 1000.0) {
+        snprintf(buff, len, "%.1f ms", us / 1000.0);
+    } else {
+        snprintf(buff, len, "%.0f us", us);
+    }
+    return buff;
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_memory_hist_get(unsigned int cls, iw_memory_hist_info *info) {
+    if(!iw_memory_tracking || cls >= IW_MEM_HIST_CLASSES) {
+        return false;
+    }
+
+    unsigned long alloc_bytes, free_bytes, lifetime;
+    memset(info, 0, sizeof(*info));
+    info->min_size = cls == 0 ? 0 : ((size_t)IW_MEM_HIST_MIN << (cls - 1)) + 1;
+    info->max_size = cls == IW_MEM_HIST_CLASSES - 1 ? 0
+                                                   : (size_t)IW_MEM_HIST_MIN << cls;
+    iw_memory_hist_sum(cls, &info->allocs, &info->frees, &alloc_bytes,
+                       &free_bytes, &lifetime);
+    // The counters of the CPUs are read one at a time so a free may be
+    // seen without the matching allocation.
+    info->live       = info->allocs > info->frees ? info->allocs - info->frees
+                                                  : 0;
+    info->live_bytes = alloc_bytes > free_bytes ? alloc_bytes - free_bytes : 0;
+    info->lifetime   = info->frees != 0 ? (double)lifetime / info->frees : 0.0;
+
+    pthread_mutex_lock(&s_hist_lock);
+    if(s_hist_tick != 0) {
+        info->alloc_rate = s_hist_rates[cls].alloc_rate;
+        info->free_rate  = s_hist_rates[cls].free_rate;
+        info->peak_rate  = s_hist_rates[cls].peak_rate;
+    } else {
+        double secs = (iw_memory_now_us() - s_hist_start) / 1000000.0;
+        if(secs > 0.0) {
+            info->alloc_rate = info->allocs / secs;
+            info->free_rate  = info->frees / secs;
+            info->peak_rate  = info->alloc_rate;
+        }
+    }
+    pthread_mutex_unlock(&s_hist_lock);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_memory_hist_tick() {
+    if(!iw_memory_tracking) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_hist_lock);
+    unsigned long now = iw_memory_now_us();
+    unsigned long last = s_hist_tick != 0 ? s_hist_tick : s_hist_start;
+    if(now - last >= IW_MEM_HIST_INTERVAL) {
+        double secs = (now - last) / 1000000.0;
+        unsigned int cls;
+        for(cls=0;cls < IW_MEM_HIST_CLASSES;cls++) {
+            iw_memory_hist_rate *rate = &s_hist_rates[cls];
+            unsigned long allocs, frees, alloc_bytes, free_bytes, lifetime;
+            iw_memory_hist_sum(cls, &allocs, &frees, &alloc_bytes,
+                               &free_bytes, &lifetime);
+            rate->alloc_rate = (allocs - rate->allocs) / secs;
+            rate->free_rate  = (frees - rate->frees) / secs;
+            if(rate->alloc_rate > rate->peak_rate) {
+                rate->peak_rate = rate->alloc_rate;
+            }
+            rate->allocs = allocs;
+            rate->frees  = frees;
+        }
+        s_hist_tick = now;
+    }
+    pthread_mutex_unlock(&s_hist_lock);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_memory_histogram(FILE *out) {
+    char size[16];
+    char buff[64];
+
+    if(!iw_memory_tracking) {
+        fprintf(out, "Memory tracking is disabled.\n");
+        return;
+    }
+
+    fprintf(out, "%-11s %9s %11s %10s %10s %10s %10s %10s %9s\n",
+            "Size", "Live", "Live bytes", "Allocs", "Frees", "Allocs/s",
+            "Frees/s", "Peak/s", "Lifetime");
+    iw_memory_hist_info info;
+    unsigned long live = 0, live_bytes = 0, allocs = 0, frees = 0;
+    double alloc_rate = 0.0, free_rate = 0.0;
+    unsigned int cls;
+    for(cls=0;iw_memory_hist_get(cls, &info);cls++) {
+        if(info.allocs == 0) {
+            continue;
+        }
+        // Each class is labeled by its largest size.
+        if(info.max_size != 0) {
+            snprintf(buff, sizeof(buff), "<=%s",
+                     iw_memory_hist_size_str(sizeof(size), size,
+                                             info.max_size));
+        } else {
+            snprintf(buff, sizeof(buff), ">%s",
+                     iw_memory_hist_size_str(sizeof(size), size,
+                                             info.min_size - 1));
+        }
+        fprintf(out, "%-11s %9lu %11lu %10lu %10lu %10.1f %10.1f %10.1f ",
+                buff, info.live, info.live_bytes, info.allocs, info.frees,
+                info.alloc_rate, info.free_rate, info.peak_rate);
+        fprintf(out, "%9s\n", info.frees == 0 ? "-" :
+                iw_memory_hist_time_str(sizeof(buff), buff, info.lifetime));
+        live       += info.live;
+        live_bytes += info.live_bytes;
+        allocs     += info.allocs;
+        frees      += info.frees;
+        alloc_rate += info.alloc_rate;
+        free_rate  += info.free_rate;
+    }
+    fprintf(out, "%-11s %9lu %11lu %10lu %10lu %10.1f %10.1f\n",
+            "Total", live, live_bytes, allocs, frees, alloc_rate, free_rate);
+}
+
+// --------------------------------------------------------------------------
+
 void iw_memory_show(FILE *out) {
     iw_memory_dump(out, IW_MEM_DUMP_ALL);
 }
@@ -42,6 +42,40 @@ extern "C" {
                                         free(ptr); \
                                     }
 
+// --------------------------------------------------------------------------
+//
+// Malloc interposer interface
+//
+// --------------------------------------------------------------------------
+
+/// The name of the function the malloc interposer provides so that the
+/// memory module can hook into it.
+#define IW_PRELOAD_REGISTER "iw_preload_register"
+
+// --------------------------------------------------------------------------
+
+/// @brief A set of allocation functions.
+/// Used both for the real allocator of the process and for the hooks that
+/// the malloc interposer calls instead of the real allocator.
+typedef struct _iw_memory_allocator {
+    void  *(*malloc)(size_t size);
+    void  *(*calloc)(size_t elems, size_t size);
+    void  *(*realloc)(void *ptr, size_t size);
+    void  *(*memalign)(size_t alignment, size_t size);
+    void   (*free)(void *ptr);
+    size_t (*usable_size)(void *ptr);
+} iw_memory_allocator;
+
+// --------------------------------------------------------------------------
+
+/// @brief The function the memory module calls to hook into the interposer.
+/// @param hooks The functions to call instead of the real allocator, must
+/// stay valid for the life-time of the process.
+/// @param real [out] The real allocator of the process.
+typedef void (*IW_PRELOAD_REGISTER_FN)(
+    const iw_memory_allocator *hooks,
+    iw_memory_allocator *real);
+
 // --------------------------------------------------------------------------
 //
 // Function API
@@ -49,6 +83,8 @@ extern "C" {
 // --------------------------------------------------------------------------
 
 /// @brief Initializes the memory module.
+/// If the process was started with the malloc interposer preloaded, all
+/// allocations of the process are tracked from here on.
 extern void iw_memory_init();
 
 // --------------------------------------------------------------------------
@@ -76,6 +112,135 @@ extern void iw_memory_brief(FILE *out);
 
 // --------------------------------------------------------------------------
 
+/// @brief Show the estimated live heap by allocation site on the given stream.
+/// In sampling mode each sampled allocation is scaled up by the inverse of
+/// its sampling probability, otherwise every tracked allocation is counted.
+/// @param out The file stream to write the response to.
+extern void iw_memory_profile(FILE *out);
+
+// --------------------------------------------------------------------------
+
+/// @brief Write the tracked live heap in the pprof heap profile format.
+/// The live heap is grouped by allocation site and call-stack and written
+/// in the legacy text format of the gperftools heap profiler, followed by
+/// the memory map of the process so that the addresses can be symbolized.
+/// Sites tracked without a call-stack get a synthetic frame derived from
+/// their file and line.
+/// @param out The file stream to write the profile to.
+/// @return False, with nothing written, if memory tracking is disabled.
+extern bool iw_memory_pprof(FILE *out);
+
+// --------------------------------------------------------------------------
+
+/// @brief Take a named snapshot of the live heap.
+/// Only the estimated live allocations and bytes of each allocation site are
+/// kept. A snapshot with the same name is replaced and the oldest snapshot is
+/// dropped if too many snapshots have been taken.
+/// @param name The name of the snapshot.
+/// @return True if the snapshot was taken.
+extern bool iw_memory_snapshot(const char *name);
+
+// --------------------------------------------------------------------------
+
+/// @brief Show the heap snapshots taken on the given file stream.
+/// @param out The file stream to write the response to.
+extern void iw_memory_snapshots(FILE *out);
+
+// --------------------------------------------------------------------------
+
+/// @brief Show the allocation sites whose live bytes grew between two heap
+/// snapshots, sorted by growth.
+/// @param out The file stream to write the response to.
+/// @param from The name of the earlier snapshot.
+/// @param to The name of the later snapshot or NULL for the live heap.
+/// @return True if the snapshots were compared.
+extern bool iw_memory_diff(FILE *out, const char *from, const char *to);
+
+// --------------------------------------------------------------------------
+
+/// @brief The memory use of a memory tag.
+typedef struct _iw_memory_tag_info {
+    const char   *name;         ///< The name of the tag.
+    unsigned long allocs;       ///< The number of outstanding allocations.
+    unsigned long cur_bytes;    ///< The number of outstanding bytes.
+    unsigned long peak_bytes;   ///< The highest number of outstanding bytes.
+} iw_memory_tag_info;
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the memory use of a memory tag.
+/// The memory use of \a IW_MEM_TAG_NONE is the memory not accounted to any
+/// other tag and has no peak.
+/// @param tag The tag to get the memory use of.
+/// @param info [out] The memory use of the tag.
+/// @return True if memory tracking is enabled and the tag is registered.
+extern bool iw_memory_tag_info_get(unsigned int tag, iw_memory_tag_info *info);
+
+// --------------------------------------------------------------------------
+
+/// @brief Show the memory use of each memory tag on the given file stream.
+/// @param out The file stream to write the response to.
+extern void iw_memory_tags(FILE *out);
+
+// --------------------------------------------------------------------------
+
+/// The number of size classes of the allocation histogram.
+#define IW_MEM_HIST_CLASSES 21
+
+// --------------------------------------------------------------------------
+
+/// @brief The allocations of a size class of the allocation histogram.
+typedef struct _iw_memory_hist_info {
+    size_t        min_size;     ///< The smallest size in the class.
+    size_t        max_size;     ///< The largest size in the class, zero if
+                                ///< the class holds all larger sizes.
+    unsigned long allocs;       ///< The number of allocations made so far.
+    unsigned long frees;        ///< The number of frees made so far.
+    unsigned long live;         ///< The number of live allocations.
+    unsigned long live_bytes;   ///< The number of live bytes.
+    double        alloc_rate;   ///< The allocations per second.
+    double        free_rate;    ///< The frees per second.
+    double        peak_rate;    ///< The highest allocations per second.
+    double        lifetime;     ///< The average lifetime of the freed
+                                ///< allocations in microseconds.
+} iw_memory_hist_info;
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the allocations of a size class of the allocation histogram.
+/// All allocations are counted, also in sampling mode. The rates are
+/// measured over the last health check interval, or since memory tracking
+/// was started if there has been no health check yet.
+/// @param cls The size class, from 0 to IW_MEM_HIST_CLASSES - 1.
+/// @param info [out] The allocations of the size class.
+/// @return True if memory tracking is enabled and the size class exists.
+extern bool iw_memory_hist_get(unsigned int cls, iw_memory_hist_info *info);
+
+// --------------------------------------------------------------------------
+
+/// @brief Update the allocation and free rates of the allocation histogram.
+/// Called once per health check interval.
+extern void iw_memory_hist_tick();
+
+// --------------------------------------------------------------------------
+
+/// @brief Show the allocation histogram by size class on the given stream.
+/// @param out The file stream to write the response to.
+extern void iw_memory_histogram(FILE *out);
+
+// --------------------------------------------------------------------------
+
+/// @brief Check the cookie and guards of the tracked chunks for corruption.
+/// The scan continues where the previous scan stopped and checks chunks
+/// until the time budget is used up or all chunks have been checked. The
+/// allocation site of each corrupted chunk is logged when it is found. Only
+/// sampled chunks are checked in sampling mode.
+/// @param budget The time budget of the scan in microseconds.
+/// @return The number of newly found corrupted chunks.
+extern unsigned int iw_memory_scan(unsigned long budget);
+
+// --------------------------------------------------------------------------
+
 #ifdef _cplusplus
 }
 #endif
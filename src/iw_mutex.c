@@ -11,7 +11,7 @@
 #include "iw_mutex.h"
 #include "iw_mutex_int.h"
 
-#include "iw_htable.h"
+#include "iw_chtable.h"
 #include "iw_log.h"
 #include "iw_thread_int.h"
 
@@ -29,11 +29,8 @@
 /// The mutex ID counter.
 static int s_mutex_id = 1;
 
-/// The global mutex hash.
-iw_htable s_mutexes;
-
-/// The internal rwlock for access to the mutex hash.
-static pthread_rwlock_t s_mtx_lock;
+/// The global mutex hash. The table locks each stripe internally.
+iw_chtable s_mutexes;
 
 // --------------------------------------------------------------------------
 
@@ -48,10 +45,13 @@ static void iw_mutex_info_delete(void *info) {
 // --------------------------------------------------------------------------
 
 /// @brief Find the mutex with the given ID.
+/// The mutex info is read locked until the lock is released.
 /// @param mutex The mutex ID to find.
+/// @param lock [out] The lock to release with iw_chtable_unlock().
 /// @return The mutex info structure or NULL if no match was found.
-static iw_mutex_info *iw_mutex_find(IW_MUTEX id) {
-    return (iw_mutex_info *)iw_htable_get(&s_mutexes, sizeof(id), &id);
+static iw_mutex_info *iw_mutex_find(IW_MUTEX id, iw_chtable_lock *lock) {
+    return (iw_mutex_info *)iw_chtable_get_locked(&s_mutexes, sizeof(id), &id,
+                                                  false, lock);
 }
 
 // --------------------------------------------------------------------------
@@ -61,14 +61,13 @@ static iw_mutex_info *iw_mutex_find(IW_MUTEX id) {
 // --------------------------------------------------------------------------
 
 void iw_mutex_init() {
-    iw_htable_init(&s_mutexes, 128, false, NULL);
-    pthread_rwlock_init(&s_mtx_lock, NULL);
+    iw_chtable_init(&s_mutexes, 0, 128, false, iw_hash_int, 0);
 }
 
 // --------------------------------------------------------------------------
 
 void iw_mutex_exit() {
-    iw_htable_destroy(&s_mutexes, iw_mutex_info_delete);
+    iw_chtable_destroy(&s_mutexes, iw_mutex_info_delete);
 }
 
 // --------------------------------------------------------------------------
@@ -86,11 +85,9 @@ IW_MUTEX iw_mutex_create(const char *name) {
     }
 
     // Insert the object into the table.
-    pthread_rwlock_wrlock(&s_mtx_lock);
-    bool retval = iw_htable_insert(&s_mutexes,
-                                   sizeof(minfo->id), &(minfo->id),
-                                   (iw_list_node *)minfo);
-    pthread_rwlock_unlock(&s_mtx_lock);
+    bool retval = iw_chtable_insert(&s_mutexes,
+                                    sizeof(minfo->id), &(minfo->id),
+                                    (iw_list_node *)minfo);
 
     if(!retval) {
         // The insertion failed, let's delete the mutex
@@ -107,11 +104,11 @@ IW_MUTEX iw_mutex_create(const char *name) {
 bool iw_mutex_lock(IW_MUTEX mutex) {
     // Start with doing a readlock on the mutex lock so that we can find
     // the mutex we are trying to lock.
-    pthread_rwlock_rdlock(&s_mtx_lock);
-    iw_mutex_info *minfo = iw_mutex_find(mutex);
+    iw_chtable_lock lock;
+    iw_mutex_info *minfo = iw_mutex_find(mutex, &lock);
     if(minfo == NULL) {
         // Failed to find the mutex, return
-        pthread_rwlock_unlock(&s_mtx_lock);
+        iw_chtable_unlock(&lock);
         return false;
     }
 
@@ -125,7 +122,7 @@ bool iw_mutex_lock(IW_MUTEX mutex) {
         // Failed to immediately take the mutex. Now we must release the
         // mutex lock so we don't block other threads trying to lock or
         // unlock other mutexes.
-        pthread_rwlock_unlock(&s_mtx_lock);
+        iw_chtable_unlock(&lock);
 
         // Try to lock the mutex we want
         pthread_mutex_lock(tmp_mtx);
@@ -133,16 +130,15 @@ bool iw_mutex_lock(IW_MUTEX mutex) {
         // Got the mutex, now we need to re-acquire the mutex lock and find
         // the mutex info again (since it may have been removed since we
         // last had it).
-        pthread_rwlock_rdlock(&s_mtx_lock);
-        iw_mutex_info *minfo = iw_mutex_find(mutex);
+        minfo = iw_mutex_find(mutex, &lock);
         if(minfo == NULL) {
-            pthread_rwlock_unlock(&s_mtx_lock);
+            iw_chtable_unlock(&lock);
             return false;
         }
     }
 
     minfo->thread = tinfo->thread;
-    pthread_rwlock_unlock(&s_mtx_lock);
+    iw_chtable_unlock(&lock);
 
     tinfo->mutex = 0;
 
@@ -152,28 +148,22 @@ bool iw_mutex_lock(IW_MUTEX mutex) {
 // --------------------------------------------------------------------------
 
 void iw_mutex_unlock(IW_MUTEX mutex) {
-    // Lock the mutex lock
-    pthread_rwlock_rdlock(&s_mtx_lock);
-
-    // Find the mutex we want to unlock
-    iw_mutex_info *minfo = iw_mutex_find(mutex);
-    minfo->thread = 0;
-    pthread_mutex_unlock(&minfo->mutex);
+    // Find the mutex we want to unlock, this locks the mutex info
+    iw_chtable_lock lock;
+    iw_mutex_info *minfo = iw_mutex_find(mutex, &lock);
+    if(minfo != NULL) {
+        minfo->thread = 0;
+        pthread_mutex_unlock(&minfo->mutex);
+    }
 
-    // Unlock the mutex lock
-    pthread_rwlock_unlock(&s_mtx_lock);
+    // Unlock the mutex info
+    iw_chtable_unlock(&lock);
 }
 
 // --------------------------------------------------------------------------
 
 void iw_mutex_destroy(IW_MUTEX mutex) {
-    // Lock the mutex lock
-    pthread_rwlock_rdlock(&s_mtx_lock);
-
-    iw_mutex_info *minfo = iw_htable_remove(&s_mutexes, sizeof(mutex), &mutex);
-
-    // Unlock the mutex lock
-    pthread_rwlock_unlock(&s_mtx_lock);
+    iw_mutex_info *minfo = iw_chtable_remove(&s_mutexes, sizeof(mutex), &mutex);
 
     if(minfo != NULL) {
         iw_mutex_info_delete(minfo);
@@ -183,23 +173,23 @@ void iw_mutex_destroy(IW_MUTEX mutex) {
 // --------------------------------------------------------------------------
 
 void iw_mutex_dump(FILE *out) {
-    // Lock the mutex lock
-    pthread_rwlock_rdlock(&s_mtx_lock);
+    // Lock all the mutex info
+    iw_chtable_rdlock_all(&s_mutexes);
 
-    unsigned long hash;
-    iw_mutex_info *minfo = (iw_mutex_info *)iw_htable_get_first(&s_mutexes,
-                                                                &hash);
+    iw_chtable_iter iter;
+    iw_mutex_info *minfo = (iw_mutex_info *)iw_chtable_iter_first(&s_mutexes,
+                                                                  &iter);
     fprintf(out, "== Mutex Information ==\n");
     fprintf(out, "Mutex-ID  Thread-ID  Mutex-name\n");
     fprintf(out, "---------------------------------\n");
     while(minfo != NULL) {
         fprintf(out, "[%04X]    %08X : \"%s\"\n",
             minfo->id, (unsigned int)minfo->thread, minfo->name);
-        minfo = (iw_mutex_info *)iw_htable_get_next(&s_mutexes, &hash);
+        minfo = (iw_mutex_info *)iw_chtable_iter_next(&iter);
     }
 
-    // Unlock the mutex lock
-    pthread_rwlock_unlock(&s_mtx_lock);
+    // Unlock the mutex info
+    iw_chtable_unlock_all(&s_mutexes);
 }
 
 // --------------------------------------------------------------------------
@@ -14,7 +14,7 @@
 extern "C" {
 #endif
 
-#include "iw_htable.h"
+#include "iw_chtable.h"
 #include "iw_mutex.h"
 
 #include <stdbool.h>
@@ -26,7 +26,7 @@ extern "C" {
 //
 // --------------------------------------------------------------------------
 
-extern iw_htable s_mutexes;
+extern iw_chtable s_mutexes;
 
 // --------------------------------------------------------------------------
 
@@ -0,0 +1,537 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_pool.c
+///
+/// The depot of a pool is a stack of batches of free objects. The objects
+/// of a batch are linked through their first word and the first object of
+/// each batch links to the next batch through its second word. The top of
+/// the stack is a pointer paired with a pointer sized counter, updated
+/// together with a double-width compare-and-swap, that is incremented on
+/// each update so that a batch that is popped and pushed back while another
+/// thread is popping it is detected (the ABA problem). Blocks are only freed
+/// when the pool is destroyed so a stale batch can always be read safely.
+///
+/// Each thread has one cache per pool index. The cache remembers the
+/// generation of the pool it belongs to so that a cache left behind by a
+/// destroyed pool is discarded when a new pool reuses the index.
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_pool.h"
+
+#include "iw_list.h"
+#include "iw_log.h"
+#include "iw_memory.h"
+#include "iw_memory_int.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+
+/// The size of the block header, keeps the objects 16 byte aligned.
+#define IW_POOL_HDR_SIZE    16
+
+/// The object alignment.
+#define IW_POOL_ALIGN       16
+
+#if UINTPTR_MAX > 0xFFFFFFFF
+#ifndef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_16
+#error "The pool depot needs a 16 byte compare-and-swap, use -mcx16 on x86-64"
+#endif
+/// The word the depot top is swapped as.
+typedef unsigned __int128 iw_pool_word;
+#else
+/// The word the depot top is swapped as.
+typedef uint64_t iw_pool_word;
+#endif
+
+// --------------------------------------------------------------------------
+
+/// @brief The depot top as a word for the compare-and-swap.
+typedef union _iw_pool_top_word {
+    iw_pool_top  top;   ///< The depot top.
+    iw_pool_word word;  ///< The depot top as a single word.
+} iw_pool_top_word;
+
+// --------------------------------------------------------------------------
+
+/// @brief A free object in the depot.
+typedef struct _iw_pool_obj {
+    struct _iw_pool_obj *next;  ///< The next object of the batch.
+    struct _iw_pool_obj *batch; ///< The next batch (first object only).
+} iw_pool_obj;
+
+// --------------------------------------------------------------------------
+
+/// @brief The cache of free objects of one pool in one thread.
+/// Only the owning thread updates the cache, the counters are read by
+/// other threads to report the pool statistics.
+typedef struct _iw_pool_cache {
+    unsigned int  gen;      ///< The generation of the pool of the cache.
+    unsigned int  count;    ///< The number of cached objects.
+    unsigned long allocs;   ///< The number of allocations made.
+    unsigned long frees;    ///< The number of frees made.
+    void         *objs[IW_POOL_MAG_SIZE];   ///< The cached objects.
+} iw_pool_cache;
+
+// --------------------------------------------------------------------------
+
+/// @brief The pool caches of a thread.
+typedef struct _iw_pool_thread {
+    iw_list_node  node;     ///< The node in the list of threads.
+    iw_pool_cache caches[IW_POOL_MAX];  ///< The caches of each pool index.
+} iw_pool_thread;
+
+// --------------------------------------------------------------------------
+
+/// @brief A copy of the statistics of a pool, taken so that the pool can be
+/// shown without holding the lock of the registered pools.
+typedef struct _iw_pool_info {
+    char          name[32];     ///< The name of the pool.
+    unsigned int  obj_size;     ///< The size of each object.
+    iw_pool_stats stats;        ///< The statistics of the pool.
+} iw_pool_info;
+
+// --------------------------------------------------------------------------
+
+/// The registered pools.
+static iw_pool *s_pools[IW_POOL_MAX];
+
+/// The generation of the most recently initialized pool.
+static unsigned int s_pool_gen = 0;
+
+/// The threads that have used a pool.
+static iw_list s_threads = IW_LIST_INIT;
+
+/// The lock protecting the pools and the list of threads.
+static pthread_mutex_t s_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// The key used to flush the caches of a thread when it exits.
+static pthread_key_t s_pool_key;
+
+/// Makes sure the thread key is only created once.
+static pthread_once_t s_pool_once = PTHREAD_ONCE_INIT;
+
+/// The pool caches of the current thread.
+static __thread iw_pool_thread *s_thread = NULL;
+
+// --------------------------------------------------------------------------
+//
+// Depot functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Read the top of the depot.
+/// The two halves are read separately, a torn read just makes the following
+/// compare-and-swap fail.
+/// @param pool The pool of the depot.
+/// @return The top of the depot.
+static iw_pool_top iw_pool_depot_top(iw_pool *pool) {
+    iw_pool_top top;
+    top.tag   = __atomic_load_n(&pool->depot.tag, __ATOMIC_ACQUIRE);
+    top.batch = __atomic_load_n(&pool->depot.batch, __ATOMIC_ACQUIRE);
+    return top;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Set the top of the depot if it hasn't changed.
+/// @param pool The pool of the depot.
+/// @param top The expected top, updated to the current top on failure.
+/// @param batch The new first batch of the depot.
+/// @return True if the top was set.
+static bool iw_pool_depot_set(
+    iw_pool *pool,
+    iw_pool_top *top,
+    iw_pool_obj *batch)
+{
+    iw_pool_top_word old = { .top = *top };
+    iw_pool_top_word new = { .top = { batch, top->tag + 1 } };
+    iw_pool_top_word cur;
+    cur.word = __sync_val_compare_and_swap((iw_pool_word *)&pool->depot,
+                                           old.word, new.word);
+    if(cur.word == old.word) {
+        return true;
+    }
+    *top = cur.top;
+    return false;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Push a batch of objects onto the depot.
+/// @param pool The pool to return the objects to.
+/// @param batch The first object of the batch.
+/// @param num The number of objects in the batch.
+static void iw_pool_depot_push(iw_pool *pool, iw_pool_obj *batch, unsigned int num) {
+    // Counted before the batch can be popped so that the count never drops
+    // below zero.
+    __atomic_fetch_add(&pool->depot_objs, num, __ATOMIC_RELAXED);
+    iw_pool_top top = iw_pool_depot_top(pool);
+    do {
+        batch->batch = (iw_pool_obj *)top.batch;
+    } while(!iw_pool_depot_set(pool, &top, batch));
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Pop a batch of objects from the depot.
+/// @param pool The pool to get the objects from.
+/// @return The first object of the batch or NULL if the depot is empty.
+static iw_pool_obj *iw_pool_depot_pop(iw_pool *pool) {
+    iw_pool_top top = iw_pool_depot_top(pool);
+    iw_pool_obj *batch;
+    iw_pool_obj *next;
+    do {
+        batch = (iw_pool_obj *)top.batch;
+        if(batch == NULL) {
+            return NULL;
+        }
+        // The batch may already have been taken by another thread, in which
+        // case the tag has changed and the exchange fails.
+        next = __atomic_load_n(&batch->batch, __ATOMIC_RELAXED);
+    } while(!iw_pool_depot_set(pool, &top, next));
+    return batch;
+}
+
+// --------------------------------------------------------------------------
+//
+// Thread cache functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Return the objects cached by an exiting thread to the depots.
+/// @param arg The pool caches of the thread.
+static void iw_pool_thread_exit(void *arg) {
+    iw_pool_thread *thread = (iw_pool_thread *)arg;
+    unsigned int id;
+
+    pthread_mutex_lock(&s_pool_lock);
+    for(id=0;id < IW_POOL_MAX;id++) {
+        iw_pool *pool = s_pools[id];
+        iw_pool_cache *cache = &thread->caches[id];
+        if(pool == NULL || cache->gen != pool->gen) {
+            continue;
+        }
+        __atomic_fetch_add(&pool->allocs, cache->allocs, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&pool->frees, cache->frees, __ATOMIC_RELAXED);
+        if(cache->count > 0) {
+            iw_pool_obj *batch = NULL;
+            unsigned int cnt;
+            for(cnt=0;cnt < cache->count;cnt++) {
+                iw_pool_obj *obj = (iw_pool_obj *)cache->objs[cnt];
+                obj->next = batch;
+                batch = obj;
+            }
+            iw_pool_depot_push(pool, batch, cache->count);
+        }
+    }
+    iw_list_remove(&s_threads, &thread->node);
+    pthread_mutex_unlock(&s_pool_lock);
+
+    s_thread = NULL;
+    free(thread);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Create the thread exit key.
+static void iw_pool_key_create() {
+    pthread_key_create(&s_pool_key, iw_pool_thread_exit);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the cache of a pool for the current thread.
+/// @param pool The pool to get the cache of.
+/// @return The cache or NULL if the thread caches could not be allocated.
+static iw_pool_cache *iw_pool_cache_get(iw_pool *pool) {
+    iw_pool_thread *thread = s_thread;
+    if(thread == NULL) {
+        thread = (iw_pool_thread *)calloc(1, sizeof(iw_pool_thread));
+        if(thread == NULL) {
+            return NULL;
+        }
+        pthread_mutex_lock(&s_pool_lock);
+        iw_list_add(&s_threads, &thread->node);
+        pthread_mutex_unlock(&s_pool_lock);
+        pthread_setspecific(s_pool_key, thread);
+        s_thread = thread;
+    }
+
+    iw_pool_cache *cache = &thread->caches[pool->id];
+    if(cache->gen != pool->gen) {
+        // The cache was left behind by a destroyed pool, its objects were
+        // freed along with the blocks of that pool.
+        __atomic_store_n(&cache->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cache->allocs, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cache->frees, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&cache->gen, pool->gen, __ATOMIC_RELEASE);
+    }
+    return cache;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Allocate a new block of objects.
+/// Must be called with the pool lock held.
+/// @param pool The pool to allocate a block for.
+/// @return True if the block was allocated.
+static bool iw_pool_grow(iw_pool *pool) {
+    unsigned char *mem;
+    INT_CALLOC(pool->iw_mem_alloc, mem,
+               IW_POOL_HDR_SIZE + pool->obj_size * pool->per_block,
+               unsigned char);
+    if(mem == NULL) {
+        LOG(IW_LOG_IW, "Failed to allocate block for pool %s", pool->name);
+        return false;
+    }
+    *(void **)mem   = pool->blocks;
+    pool->blocks    = mem;
+    pool->bump      = mem + IW_POOL_HDR_SIZE;
+    pool->bump_left = pool->per_block;
+    pool->num_blocks++;
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Refill an empty thread cache.
+/// A batch is taken from the depot if there is one, otherwise a batch of
+/// objects is carved out of the blocks of the pool.
+/// @param pool The pool to refill the cache from.
+/// @param cache The empty thread cache.
+/// @return True if any objects were added to the cache.
+static bool iw_pool_refill(iw_pool *pool, iw_pool_cache *cache) {
+    unsigned int count = 0;
+    iw_pool_obj *batch = iw_pool_depot_pop(pool);
+    if(batch != NULL) {
+        for(;batch != NULL;batch=batch->next) {
+            cache->objs[count++] = batch;
+        }
+        __atomic_fetch_sub(&pool->depot_objs, count, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&pool->refills, 1, __ATOMIC_RELAXED);
+    } else {
+        pthread_mutex_lock(&pool->lock);
+        while(count < IW_POOL_BATCH &&
+              (pool->bump_left > 0 || iw_pool_grow(pool)))
+        {
+            cache->objs[count++] = pool->bump;
+            pool->bump += pool->obj_size;
+            pool->bump_left--;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    __atomic_store_n(&cache->count, count, __ATOMIC_RELAXED);
+    return count > 0;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Return the least recently freed batch of a full thread cache to
+/// the depot.
+/// @param pool The pool to return the objects to.
+/// @param cache The full thread cache.
+static void iw_pool_flush(iw_pool *pool, iw_pool_cache *cache) {
+    iw_pool_obj *batch = NULL;
+    unsigned int cnt;
+    for(cnt=0;cnt < IW_POOL_BATCH;cnt++) {
+        iw_pool_obj *obj = (iw_pool_obj *)cache->objs[cnt];
+        obj->next = batch;
+        batch = obj;
+    }
+    memmove(cache->objs, cache->objs + IW_POOL_BATCH,
+            (cache->count - IW_POOL_BATCH) * sizeof(void *));
+    __atomic_store_n(&cache->count, cache->count - IW_POOL_BATCH,
+                     __ATOMIC_RELAXED);
+    iw_pool_depot_push(pool, batch, IW_POOL_BATCH);
+    __atomic_fetch_add(&pool->flushes, 1, __ATOMIC_RELAXED);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Get the statistics of a pool.
+/// Must be called with the lock of the pools held.
+/// @param pool The pool to get the statistics of.
+/// @param stats [out] The statistics of the pool.
+static void iw_pool_stats_locked(iw_pool *pool, iw_pool_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&pool->lock);
+    stats->num_blocks = pool->num_blocks;
+    stats->objects    = (unsigned long)pool->num_blocks * pool->per_block -
+                        pool->bump_left;
+    pthread_mutex_unlock(&pool->lock);
+
+    stats->allocs = __atomic_load_n(&pool->allocs, __ATOMIC_RELAXED);
+    stats->frees  = __atomic_load_n(&pool->frees, __ATOMIC_RELAXED);
+    iw_list_node *node;
+    for(node=s_threads.head;node != NULL;node=node->next) {
+        iw_pool_cache *cache = &((iw_pool_thread *)node)->caches[pool->id];
+        if(__atomic_load_n(&cache->gen, __ATOMIC_ACQUIRE) != pool->gen) {
+            continue;
+        }
+        stats->allocs += __atomic_load_n(&cache->allocs, __ATOMIC_RELAXED);
+        stats->frees  += __atomic_load_n(&cache->frees, __ATOMIC_RELAXED);
+        stats->cached += __atomic_load_n(&cache->count, __ATOMIC_RELAXED);
+    }
+    stats->depot   = __atomic_load_n(&pool->depot_objs, __ATOMIC_RELAXED);
+    stats->refills = __atomic_load_n(&pool->refills, __ATOMIC_RELAXED);
+    stats->flushes = __atomic_load_n(&pool->flushes, __ATOMIC_RELAXED);
+}
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+bool iw_pool_init(
+    iw_pool *pool,
+    const char *name,
+    unsigned int obj_size,
+    bool iw_mem_alloc)
+{
+    unsigned int id;
+
+    pthread_once(&s_pool_once, iw_pool_key_create);
+    memset(pool, 0, sizeof(*pool));
+    pool->name         = name;
+    pool->iw_mem_alloc = iw_mem_alloc;
+    // Free objects store the depot links so they must fit two pointers.
+    if(obj_size < sizeof(iw_pool_obj)) {
+        obj_size = sizeof(iw_pool_obj);
+    }
+    pool->obj_size  = (obj_size + IW_POOL_ALIGN - 1) & ~(IW_POOL_ALIGN - 1);
+    pool->per_block = (IW_POOL_BLOCK_SIZE - IW_POOL_HDR_SIZE) / pool->obj_size;
+    if(pool->per_block < IW_POOL_BATCH) {
+        pool->per_block = IW_POOL_BATCH;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+
+    pthread_mutex_lock(&s_pool_lock);
+    id = 0;
+    while(id < IW_POOL_MAX && s_pools[id] != NULL) {
+        id++;
+    }
+    if(id == IW_POOL_MAX) {
+        pthread_mutex_unlock(&s_pool_lock);
+        LOG(IW_LOG_IW, "Too many pools, failed to create pool %s", name);
+        pthread_mutex_destroy(&pool->lock);
+        return false;
+    }
+    pool->id    = id;
+    pool->gen   = ++s_pool_gen;
+    s_pools[id] = pool;
+    pthread_mutex_unlock(&s_pool_lock);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_pool_alloc(iw_pool *pool) {
+    iw_pool_cache *cache = iw_pool_cache_get(pool);
+    if(cache == NULL) {
+        return NULL;
+    }
+    if(cache->count == 0 && !iw_pool_refill(pool, cache)) {
+        return NULL;
+    }
+    unsigned int count = cache->count - 1;
+    __atomic_store_n(&cache->count, count, __ATOMIC_RELAXED);
+    __atomic_store_n(&cache->allocs, cache->allocs + 1, __ATOMIC_RELAXED);
+    return cache->objs[count];
+}
+
+// --------------------------------------------------------------------------
+
+void iw_pool_free(iw_pool *pool, void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    iw_pool_cache *cache = iw_pool_cache_get(pool);
+    if(cache == NULL) {
+        // Without a cache the object goes straight back to the depot.
+        iw_pool_obj *obj = (iw_pool_obj *)ptr;
+        obj->next = NULL;
+        iw_pool_depot_push(pool, obj, 1);
+        __atomic_fetch_add(&pool->frees, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if(cache->count == IW_POOL_MAG_SIZE) {
+        iw_pool_flush(pool, cache);
+    }
+    cache->objs[cache->count] = ptr;
+    __atomic_store_n(&cache->count, cache->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&cache->frees, cache->frees + 1, __ATOMIC_RELAXED);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_pool_stats_get(iw_pool *pool, iw_pool_stats *stats) {
+    pthread_mutex_lock(&s_pool_lock);
+    iw_pool_stats_locked(pool, stats);
+    pthread_mutex_unlock(&s_pool_lock);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_pool_destroy(iw_pool *pool) {
+    pthread_mutex_lock(&s_pool_lock);
+    s_pools[pool->id] = NULL;
+    pthread_mutex_unlock(&s_pool_lock);
+
+    void *block = pool->blocks;
+    while(block != NULL) {
+        void *next = *(void **)block;
+        INT_FREE(pool->iw_mem_alloc, block);
+        block = next;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pool->blocks     = NULL;
+    pool->bump       = NULL;
+    pool->bump_left  = 0;
+    pool->num_blocks = 0;
+    pool->depot.batch = NULL;
+    pool->depot.tag   = 0;
+    pool->depot_objs = 0;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_pool_show(FILE *out) {
+    iw_pool_info infos[IW_POOL_MAX];
+    unsigned int num = 0, id;
+
+    // Collect the statistics so that they are printed with the pools
+    // unlocked, a slow client mustn't stall threads starting or exiting.
+    pthread_mutex_lock(&s_pool_lock);
+    for(id=0;id < IW_POOL_MAX;id++) {
+        iw_pool *pool = s_pools[id];
+        if(pool == NULL) {
+            continue;
+        }
+        iw_pool_info *info = &infos[num++];
+        snprintf(info->name, sizeof(info->name), "%s", pool->name);
+        info->obj_size = pool->obj_size;
+        iw_pool_stats_locked(pool, &info->stats);
+    }
+    pthread_mutex_unlock(&s_pool_lock);
+
+    fprintf(out, "%-12s %6s %6s %8s %10s %8s %8s %8s %8s %8s\n",
+            "Name", "Size", "Blocks", "Objects", "Allocs", "In use",
+            "Cached", "Depot", "Refills", "Flushes");
+    for(id=0;id < num;id++) {
+        iw_pool_stats *stats = &infos[id].stats;
+        fprintf(out, "%-12s %6u %6u %8lu %10lu %8lu %8lu %8lu %8lu %8lu\n",
+                infos[id].name, infos[id].obj_size, stats->num_blocks,
+                stats->objects, stats->allocs, stats->allocs - stats->frees,
+                stats->cached, stats->depot, stats->refills, stats->flushes);
+    }
+}
+
+// --------------------------------------------------------------------------
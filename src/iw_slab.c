@@ -0,0 +1,216 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_slab.c
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_slab.h"
+
+#include "iw_log.h"
+#include "iw_memory.h"
+#include "iw_memory_int.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+
+/// The size of the block header, keeps the nodes 16 byte aligned.
+#define IW_SLAB_HDR_SIZE    16
+
+/// The node alignment.
+#define IW_SLAB_ALIGN       sizeof(void *)
+
+// --------------------------------------------------------------------------
+
+/// @brief A copy of the occupancy of a slab, taken so that the slab can be
+/// shown without holding the lock of the list of slabs.
+typedef struct _iw_slab_info {
+    char          name[32];     ///< The name of the slab.
+    const void   *slab;         ///< The address of the slab.
+    unsigned int  node_size;    ///< The size of each node.
+    unsigned int  per_block;    ///< The number of nodes in each block.
+    unsigned int  num_blocks;   ///< The number of allocated blocks.
+    unsigned int  in_use;       ///< The number of nodes in use.
+    unsigned int  high_water;   ///< The largest number of nodes in use.
+} iw_slab_info;
+
+// --------------------------------------------------------------------------
+
+/// All slabs, used to report the slab occupancy.
+static iw_list s_slabs = IW_LIST_INIT;
+
+/// The lock protecting the list of slabs.
+static pthread_mutex_t s_slab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// --------------------------------------------------------------------------
+//
+// Helper functions
+//
+// --------------------------------------------------------------------------
+
+/// @brief Allocate a new block of nodes.
+/// @param slab The slab to allocate a block for.
+/// @return True if the block was allocated.
+static bool iw_slab_grow(iw_slab *slab) {
+    unsigned char *mem;
+    INT_CALLOC(slab->iw_mem_alloc, mem,
+               IW_SLAB_HDR_SIZE + slab->node_size * slab->per_block,
+               unsigned char);
+    if(mem == NULL) {
+        LOG(IW_LOG_IW, "Failed to allocate block for slab %s", slab->name);
+        return false;
+    }
+    iw_slab_block *block = (iw_slab_block *)mem;
+    block->next     = slab->blocks;
+    slab->blocks    = block;
+    slab->bump      = mem + IW_SLAB_HDR_SIZE;
+    slab->bump_left = slab->per_block;
+    // The counters are read by iw_slab_show() from other threads.
+    __atomic_store_n(&slab->num_blocks, slab->num_blocks + 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+void iw_slab_init(
+    iw_slab *slab,
+    const char *name,
+    unsigned int node_size,
+    unsigned int per_block,
+    bool iw_mem_alloc)
+{
+    memset(slab, 0, sizeof(*slab));
+    slab->name         = name;
+    slab->iw_mem_alloc = iw_mem_alloc;
+    // Freed nodes store the free list pointer so they must fit a pointer.
+    if(node_size < sizeof(void *)) {
+        node_size = sizeof(void *);
+    }
+    slab->node_size = (node_size + IW_SLAB_ALIGN - 1) & ~(IW_SLAB_ALIGN - 1);
+    if(per_block == 0) {
+        per_block = (IW_SLAB_BLOCK_SIZE - IW_SLAB_HDR_SIZE) / slab->node_size;
+    }
+    slab->per_block = per_block < IW_SLAB_MIN_NODES ? IW_SLAB_MIN_NODES
+                                                    : per_block;
+
+    pthread_mutex_lock(&s_slab_lock);
+    iw_list_add(&s_slabs, &slab->node);
+    pthread_mutex_unlock(&s_slab_lock);
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_slab_alloc(iw_slab *slab) {
+    void *ptr;
+    if(slab->free != NULL) {
+        ptr = slab->free;
+        slab->free = *(void **)ptr;
+        memset(ptr, 0, slab->node_size);
+    } else {
+        if(slab->bump_left == 0 && !iw_slab_grow(slab)) {
+            return NULL;
+        }
+        // Blocks are zeroed when allocated so unused nodes are still zero.
+        ptr = slab->bump;
+        slab->bump += slab->node_size;
+        slab->bump_left--;
+    }
+    // Only the owner of the slab writes the counters, the stores are atomic
+    // since iw_slab_show() reads them from other threads.
+    unsigned int in_use = slab->in_use + 1;
+    __atomic_store_n(&slab->in_use, in_use, __ATOMIC_RELAXED);
+    if(in_use > slab->high_water) {
+        __atomic_store_n(&slab->high_water, in_use, __ATOMIC_RELAXED);
+    }
+    return ptr;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_slab_free(iw_slab *slab, void *ptr) {
+    if(ptr == NULL) {
+        return;
+    }
+    *(void **)ptr = slab->free;
+    slab->free = ptr;
+    __atomic_store_n(&slab->in_use, slab->in_use - 1, __ATOMIC_RELAXED);
+}
+
+// --------------------------------------------------------------------------
+
+void iw_slab_destroy(iw_slab *slab) {
+    pthread_mutex_lock(&s_slab_lock);
+    iw_list_remove(&s_slabs, &slab->node);
+    pthread_mutex_unlock(&s_slab_lock);
+
+    iw_slab_block *block = slab->blocks;
+    while(block != NULL) {
+        iw_slab_block *next = block->next;
+        INT_FREE(slab->iw_mem_alloc, block);
+        block = next;
+    }
+    slab->blocks     = NULL;
+    slab->free       = NULL;
+    slab->bump       = NULL;
+    slab->bump_left  = 0;
+    slab->num_blocks = 0;
+    slab->in_use     = 0;
+}
+
+// --------------------------------------------------------------------------
+
+void iw_slab_show(FILE *out) {
+    unsigned long total = 0, used = 0;
+    unsigned int num = 0, idx;
+
+    // Copy the slabs so that they are printed with the list unlocked, a
+    // slow client mustn't stall the threads creating containers.
+    pthread_mutex_lock(&s_slab_lock);
+    unsigned int num_slabs = s_slabs.num_elems;
+    iw_slab_info *infos = NULL;
+    if(num_slabs > 0) {
+        infos = (iw_slab_info *)calloc(num_slabs, sizeof(iw_slab_info));
+    }
+    iw_list_node *node;
+    for(node=s_slabs.head;infos != NULL && node != NULL;node=node->next) {
+        iw_slab *slab = (iw_slab *)node;
+        iw_slab_info *info = &infos[num++];
+        snprintf(info->name, sizeof(info->name), "%s", slab->name);
+        info->slab       = slab;
+        info->node_size  = slab->node_size;
+        info->per_block  = slab->per_block;
+        info->num_blocks = __atomic_load_n(&slab->num_blocks, __ATOMIC_RELAXED);
+        info->in_use     = __atomic_load_n(&slab->in_use, __ATOMIC_RELAXED);
+        info->high_water = __atomic_load_n(&slab->high_water, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&s_slab_lock);
+
+    fprintf(out, "%-12s %-18s %6s %8s %8s %8s %8s %5s\n",
+            "Name", "Slab", "Size", "Blocks", "Nodes", "In use", "Peak", "Use%");
+    for(idx=0;idx < num;idx++) {
+        iw_slab_info *info = &infos[idx];
+        unsigned int nodes = info->num_blocks * info->per_block;
+        fprintf(out, "%-12s %-18p %6u %8u %8u %8u %8u %5u\n",
+                info->name, info->slab, info->node_size, info->num_blocks,
+                nodes, info->in_use, info->high_water,
+                nodes == 0 ? 0 : info->in_use * 100 / nodes);
+        total += (unsigned long)info->num_blocks *
+                 (IW_SLAB_HDR_SIZE + info->node_size * info->per_block);
+        used  += (unsigned long)info->in_use * info->node_size;
+    }
+    fprintf(out, "Slabs: %u, allocated %lu bytes, in use %lu bytes\n",
+            num_slabs, total, used);
+    free(infos);
+}
+
+// --------------------------------------------------------------------------
@@ -12,8 +12,10 @@
 #include "iw_thread_int.h"
 
 #include "iw_cfg.h"
+#include "iw_chtable.h"
 #include "iw_common.h"
 #include "iw_log.h"
+#include "iw_log_int.h"
 #include "iw_main.h"
 #include "iw_memory.h"
 #include "iw_mutex_int.h"
@@ -78,8 +80,8 @@
 //
 // --------------------------------------------------------------------------
 
-/// The global thread list.
-static iw_htable s_threads;
+/// The global thread list. The table locks each stripe internally.
+static iw_chtable s_threads;
 
 /// The main thread info.
 static iw_thread_info *s_main_tinfo = NULL;
@@ -87,8 +89,17 @@ static iw_thread_info *s_main_tinfo = NULL;
 /// The thread local storage for the threads.
 pthread_key_t s_thread_key;
 
-/// The internal rwlock for access to the mutex hash.
-static pthread_rwlock_t s_thread_lock;
+unsigned int s_thread_log_off = 0;
+
+/// Incremented whenever the log flag of a thread changes so that threads
+/// refresh their cached log flag.
+static unsigned int s_thread_log_gen = 1;
+
+/// The generation of the cached log flag of the calling thread.
+static __thread unsigned int s_log_gen_cached = 0;
+
+/// The cached log flag of the calling thread.
+static __thread bool s_log_cached = true;
 
 /// Counter to track number of SIGINTs received.
 static int s_sigint_cnt = 0;
@@ -106,6 +117,9 @@ static char s_digits[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '
 /// @param node The thread info structure to delete.
 static void iw_thread_info_delete(void *node) {
     iw_thread_info *tinfo = (iw_thread_info *)node;
+    if(!tinfo->log) {
+        __atomic_sub_fetch(&s_thread_log_off, 1, __ATOMIC_RELAXED);
+    }
     free(tinfo->name);
     free(tinfo);
 }
@@ -140,6 +154,28 @@ static iw_thread_info *iw_thread_info_create(
 
 // --------------------------------------------------------------------------
 
+/// @brief Set the log flag of a thread.
+/// The caller must invalidate the cached log flags once all flags are set.
+/// @param tinfo The thread info of the thread.
+/// @param log_on True if logging should be enabled, false for disabled.
+static void iw_thread_log_update(iw_thread_info *tinfo, bool log_on) {
+    bool old = __atomic_exchange_n(&tinfo->log, log_on, __ATOMIC_RELAXED);
+    if(old && !log_on) {
+        __atomic_add_fetch(&s_thread_log_off, 1, __ATOMIC_RELAXED);
+    } else if(!old && log_on) {
+        __atomic_sub_fetch(&s_thread_log_off, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Make threads refresh their cached log flag.
+static void iw_thread_log_invalidate() {
+    __atomic_add_fetch(&s_thread_log_gen, 1, __ATOMIC_RELEASE);
+}
+
+// --------------------------------------------------------------------------
+
 /// @brief The thread signal handler.
 /// @param sig The signal being sent to the thread.
 static void iw_thread_signal(int sig, siginfo_t *si, void *param) {
@@ -182,6 +218,7 @@ static void iw_thread_signal(int sig, siginfo_t *si, void *param) {
             // that the shutdown process deadlocked. Go ahead and
             // forcibly exit the program.
             LOG(IW_LOG_IW, "Received multiple SIGINT, exiting forcefully");
+            iw_log_crash_flush();
             exit(-1);
         }
         } break;
@@ -190,6 +227,10 @@ static void iw_thread_signal(int sig, siginfo_t *si, void *param) {
     case SIGFPE  :
     case SIGBUS  :
     case SIGSEGV : {
+            // Write out the debug logs that are still queued since they
+            // may tell what led up to the crash.
+            iw_log_crash_flush();
+
             // First try to get backtrace and symbols without calling
             // other non-safe functions. These calls aren't safe either
             // but without them we have nothing.
@@ -268,12 +309,11 @@ static void *iw_thread_callback(void *param) {
 
     // Point the thread local storage to the tinfo object
     pthread_setspecific(s_thread_key, tinfo);
+    s_log_gen_cached = 0;
 
     // Insert tinfo object into thread hash table
-    pthread_rwlock_wrlock(&s_thread_lock);
-    iw_htable_insert(&s_threads,
-                     sizeof(tinfo->thread), &(tinfo->thread), tinfo);
-    pthread_rwlock_unlock(&s_thread_lock);
+    iw_chtable_insert(&s_threads,
+                      sizeof(tinfo->thread), &(tinfo->thread), tinfo);
 
     // Install signal handler for the thread
     iw_thread_install_sighandler();
@@ -299,8 +339,7 @@ static void *iw_thread_callback(void *param) {
 
 void iw_thread_init() {
     // Initialize the thread hash table
-    pthread_rwlock_init(&s_thread_lock, NULL);
-    iw_htable_init(&s_threads, 128, false, NULL);
+    iw_chtable_init(&s_threads, 0, 128, false, iw_hash_int, 0);
 }
 
 // --------------------------------------------------------------------------
@@ -308,15 +347,13 @@ void iw_thread_init() {
 void iw_thread_exit() {
     // When exiting, make sure to remove and delete the main thread info
     LOG(IW_LOG_IW, "Terminating thread module");
-    pthread_rwlock_wrlock(&s_thread_lock);
     if(s_main_tinfo != NULL) {
-        iw_htable_delete(&s_threads,
+        iw_chtable_delete(&s_threads,
                      sizeof(s_main_tinfo->thread), &(s_main_tinfo->thread),
                      iw_thread_info_delete);
         s_main_tinfo = NULL;
     }
-    iw_htable_destroy(&s_threads, iw_thread_info_delete);
-    pthread_rwlock_unlock(&s_thread_lock);
+    iw_chtable_destroy(&s_threads, iw_thread_info_delete);
 }
 
 // --------------------------------------------------------------------------
@@ -331,6 +368,7 @@ bool iw_thread_register_main() {
         return false;
     }
 
+    s_log_gen_cached = 0;
     if(pthread_key_create(&s_thread_key, NULL) != 0 ||
        pthread_setspecific(s_thread_key, s_main_tinfo) != 0)
     {
@@ -339,8 +377,8 @@ bool iw_thread_register_main() {
         LOG(IW_LOG_IW, "Failed to create thread local storage");
     }
 
-    // No other thread is created yet, no need to lock thread lock
-    return iw_htable_insert(&s_threads,
+    // No other thread is created yet
+    return iw_chtable_insert(&s_threads,
                      sizeof(s_main_tinfo->thread),
                      &(s_main_tinfo->thread), 
                      s_main_tinfo);
@@ -351,17 +389,18 @@ bool iw_thread_register_main() {
 bool iw_thread_get_log(pthread_t threadid) {
     bool retval = false;
     iw_thread_info *tinfo = NULL;
-    pthread_rwlock_rdlock(&s_thread_lock);
+    iw_chtable_lock lock = { NULL };
     if(threadid == 0) {
         tinfo = (iw_thread_info *)pthread_getspecific(s_thread_key);
     } else {
-        tinfo = (iw_thread_info *)iw_htable_get(&s_threads,
-                                            sizeof(threadid),
-                                            &threadid);
+        tinfo = (iw_thread_info *)iw_chtable_get_locked(&s_threads,
+                                                    sizeof(threadid),
+                                                    &threadid,
+                                                    false, &lock);
     }
 
     retval = tinfo != NULL && tinfo->log;
-    pthread_rwlock_unlock(&s_thread_lock);
+    iw_chtable_unlock(&lock);
 
     return retval;
 }
@@ -369,15 +408,30 @@ bool iw_thread_get_log(pthread_t threadid) {
 // --------------------------------------------------------------------------
 
 void iw_thread_set_log_all(bool log_on) {
-    unsigned long hash;
-    pthread_rwlock_rdlock(&s_thread_lock);
-    iw_thread_info *tinfo = (iw_thread_info *)iw_htable_get_first(&s_threads,
-                                                                   &hash);
+    iw_chtable_iter iter;
+    iw_chtable_rdlock_all(&s_threads);
+    iw_thread_info *tinfo = (iw_thread_info *)iw_chtable_iter_first(&s_threads,
+                                                                     &iter);
     while(tinfo != NULL) {
-        tinfo->log = log_on;
-        tinfo = (iw_thread_info *)iw_htable_get_next(&s_threads, &hash);
+        iw_thread_log_update(tinfo, log_on);
+        tinfo = (iw_thread_info *)iw_chtable_iter_next(&iter);
+    }
+    iw_chtable_unlock_all(&s_threads);
+    iw_thread_log_invalidate();
+}
+
+// --------------------------------------------------------------------------
+
+bool iw_thread_log_on() {
+    unsigned int gen = __atomic_load_n(&s_thread_log_gen, __ATOMIC_ACQUIRE);
+    if(s_log_gen_cached != gen) {
+        iw_thread_info *tinfo = (iw_thread_info *)
+                                pthread_getspecific(s_thread_key);
+        s_log_cached = tinfo == NULL ||
+                       __atomic_load_n(&tinfo->log, __ATOMIC_RELAXED);
+        s_log_gen_cached = gen;
     }
-    pthread_rwlock_unlock(&s_thread_lock);
+    return s_log_cached;
 }
 
 // --------------------------------------------------------------------------
@@ -385,19 +439,21 @@ void iw_thread_set_log_all(bool log_on) {
 bool iw_thread_set_log(pthread_t threadid, bool log_on) {
     bool retval = false;
     iw_thread_info *tinfo = NULL;
-    pthread_rwlock_rdlock(&s_thread_lock);
+    iw_chtable_lock lock = { NULL };
     if(threadid == 0) {
         tinfo = (iw_thread_info *)pthread_getspecific(s_thread_key);
     } else {
-        tinfo = (iw_thread_info *)iw_htable_get(&s_threads,
-                                            sizeof(threadid),
-                                            &threadid);
+        tinfo = (iw_thread_info *)iw_chtable_get_locked(&s_threads,
+                                                    sizeof(threadid),
+                                                    &threadid,
+                                                    false, &lock);
     }
     if(tinfo != NULL) {
-        tinfo->log = log_on;
+        iw_thread_log_update(tinfo, log_on);
         retval = true;
     }
-    pthread_rwlock_unlock(&s_thread_lock);
+    iw_chtable_unlock(&lock);
+    iw_thread_log_invalidate();
     return retval;
 }
 
@@ -433,6 +489,16 @@ bool iw_thread_create_int(
 
 // --------------------------------------------------------------------------
 
+void iw_thread_join_int(pthread_t tid) {
+    pthread_join(tid, NULL);
+
+    // The thread has exited, remove it from the thread list so that the
+    // thread ID can be reused.
+    iw_chtable_delete(&s_threads, sizeof(tid), &tid, iw_thread_info_delete);
+}
+
+// --------------------------------------------------------------------------
+
 bool iw_thread_create(
     pthread_t *tid,
     const char *name,
@@ -446,30 +512,30 @@ bool iw_thread_create(
 
 void iw_thread_wait_all() {
     bool foundClientThread = true;
-    unsigned long hash;
+    iw_chtable_iter iter;
 
     LOG(IW_LOG_IW, "iw_thread_wait_all");
     while(foundClientThread) {
-        pthread_rwlock_rdlock(&s_thread_lock);
-        iw_thread_info *tinfo = (iw_thread_info *)iw_htable_get_first(&s_threads,
-                                                                   &hash);
+        iw_chtable_rdlock_all(&s_threads);
+        iw_thread_info *tinfo = (iw_thread_info *)iw_chtable_iter_first(&s_threads,
+                                                                         &iter);
         while(tinfo != NULL && !tinfo->client) {
-            tinfo = (iw_thread_info *)iw_htable_get_next(&s_threads, &hash);
+            tinfo = (iw_thread_info *)iw_chtable_iter_next(&iter);
         }
         if(tinfo != NULL && tinfo->client) {
             foundClientThread = true;
             LOG(IW_LOG_IW, "Joining thread \"%s\"", tinfo->name);
             pthread_t pid = tinfo->thread;
-            pthread_rwlock_unlock(&s_thread_lock);
+            iw_chtable_unlock_all(&s_threads);
             pthread_join(tinfo->thread, NULL);
 
             // Thread has exited, remove it from the thread list
-            iw_htable_delete(&s_threads,
+            iw_chtable_delete(&s_threads,
                      sizeof(pid), &(pid),
                      iw_thread_info_delete);
         } else {
             foundClientThread = false;
-            pthread_rwlock_unlock(&s_thread_lock);
+            iw_chtable_unlock_all(&s_threads);
         }
     }
     LOG(IW_LOG_IW, "iw_thread_wait_all done");
@@ -478,10 +544,10 @@ void iw_thread_wait_all() {
 // --------------------------------------------------------------------------
 
 void iw_thread_dump(FILE *out) {
-    unsigned long hash;
-    pthread_rwlock_rdlock(&s_thread_lock);
-    iw_thread_info *thread = (iw_thread_info *)iw_htable_get_first(&s_threads,
-                                                                   &hash);
+    iw_chtable_iter iter;
+    iw_chtable_rdlock_all(&s_threads);
+    iw_thread_info *thread = (iw_thread_info *)iw_chtable_iter_first(&s_threads,
+                                                                     &iter);
     fprintf(out, "== Thread Information ==\n");
     fprintf(out, "Thread-ID  Log Mutex Clnt Thread-name\n");
     fprintf(out, "---------------------------------\n");
@@ -492,20 +558,18 @@ void iw_thread_dump(FILE *out) {
             thread->mutex,
             thread->client ? 'Y' : 'N',
             thread->name);
-        thread = (iw_thread_info *)iw_htable_get_next(&s_threads, &hash);
+        thread = (iw_thread_info *)iw_chtable_iter_next(&iter);
     }
-    pthread_rwlock_unlock(&s_thread_lock);
+    iw_chtable_unlock_all(&s_threads);
 }
 
 // --------------------------------------------------------------------------
 
 void iw_thread_callstack(FILE *out, pthread_t threadid) {
-    pthread_rwlock_rdlock(&s_thread_lock);
     iw_thread_info *thread =
-        (iw_thread_info *)iw_htable_get(&s_threads,
-                                        sizeof(threadid),
-                                        &threadid);
-    pthread_rwlock_unlock(&s_thread_lock);
+        (iw_thread_info *)iw_chtable_get(&s_threads,
+                                         sizeof(threadid),
+                                         &threadid);
     if(thread == NULL) {
         fprintf(out, "Error: Thread %08lX does not exist\n",
                 (unsigned long int)threadid);
@@ -520,10 +584,10 @@ void iw_thread_callstack(FILE *out, pthread_t threadid) {
 
 bool iw_thread_deadlock_check(bool log) {
     // Walk through the threads to find the first thread waiting for a mutex
-    unsigned long hash;
-    pthread_rwlock_rdlock(&s_thread_lock);
-    iw_thread_info *curr = (iw_thread_info *)iw_htable_get_first(&s_threads,
-                                                                 &hash);
+    iw_chtable_iter iter;
+    iw_chtable_rdlock_all(&s_threads);
+    iw_thread_info *curr = (iw_thread_info *)iw_chtable_iter_first(&s_threads,
+                                                                   &iter);
 
     while(curr != NULL) {
 
@@ -539,10 +603,18 @@ bool iw_thread_deadlock_check(bool log) {
             }
 
             // First get the mutex this thread is waiting for.
+            iw_chtable_lock lock;
             iw_mutex_info *mutex =
-                (iw_mutex_info *)iw_htable_get(&s_mutexes,
-                                                sizeof(thread->mutex),
-                                                &thread->mutex);
+                (iw_mutex_info *)iw_chtable_get_locked(&s_mutexes,
+                                                       sizeof(thread->mutex),
+                                                       &thread->mutex,
+                                                       false, &lock);
+            pthread_t owner = mutex != NULL ? mutex->thread : 0;
+            if(mutex != NULL && log) {
+                LOG(IW_LOG_IW, "Mutex %d is owned by thread %08lX",
+                    mutex->id, (unsigned long int)owner);
+            }
+            iw_chtable_unlock(&lock);
             if(mutex == NULL) {
                 // This shouldn't happen since this thread was waiting for this
                 // mutex but there may have been a race where this mutex was
@@ -550,16 +622,11 @@ bool iw_thread_deadlock_check(bool log) {
                 continue;
             }
 
-            if(log) {
-                LOG(IW_LOG_IW, "Mutex %d is owned by thread %08lX",
-                    mutex->id, (unsigned long int)mutex->thread);
-            }
-
             // Then get the thread owning this mutex.
             thread =
-                (iw_thread_info *)iw_htable_get(&s_threads,
-                                                sizeof(mutex->thread),
-                                                &(mutex->thread));
+                (iw_thread_info *)iw_chtable_find(&s_threads,
+                                                  sizeof(owner),
+                                                  &owner);
             if(thread == NULL) {
                 // This shouldn't happen since another thread was waiting to
                 // own this mutex, but maybe there was a race where this mutex
@@ -576,15 +643,15 @@ bool iw_thread_deadlock_check(bool log) {
             // with, i.e. if thread == curr. If so, we've found a cycle and
             // detected a deadlock
             if(thread == curr) {
-                pthread_rwlock_unlock(&s_thread_lock);
+                iw_chtable_unlock_all(&s_threads);
                 return true;
             }
         }
 
         // Check the next thread for a deadlock
-        curr = (iw_thread_info *)iw_htable_get_next(&s_threads, &hash);
+        curr = (iw_thread_info *)iw_chtable_iter_next(&iter);
     }
-    pthread_rwlock_unlock(&s_thread_lock);
+    iw_chtable_unlock_all(&s_threads);
 
     // No deadlock detected.
     return false;
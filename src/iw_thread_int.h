@@ -30,6 +30,10 @@ extern "C" {
 /// The thread local storage.
 extern pthread_key_t s_thread_key;
 
+/// The number of threads that have logging turned off. A log message only
+/// has to check the log flag of its thread if this is non-zero.
+extern unsigned int s_thread_log_off;
+
 /// @brief The thread info structure.
 typedef struct _iw_thread_info {
     iw_list_node node;      ///< The list node.
@@ -64,6 +68,15 @@ extern bool iw_thread_register_main();
 
 /// --------------------------------------------------------------------------
 
+/// @brief Check if logging is enabled for the calling thread.
+/// The log flag is cached by the thread until a 'log thread' command
+/// changes the flag of any thread, so no lock is taken. Unlike
+/// iw_thread_get_log(), threads without thread info log.
+/// @return True if logging should be done.
+extern bool iw_thread_log_on();
+
+/// --------------------------------------------------------------------------
+
 /// @brief Internal version of function to create a new thread.
 /// This internal thread creation function allows for differentiation of
 /// internal InstaWork threads and client program threads.
@@ -82,6 +95,12 @@ extern bool iw_thread_create_int(
 
 // --------------------------------------------------------------------------
 
+/// @brief Join an internal thread and forget its thread information.
+/// @param tid The thread-id of the thread to join.
+extern void iw_thread_join_int(pthread_t tid);
+
+// --------------------------------------------------------------------------
+
 /// @brief Dump all thread information on the given file stream.
 /// @param out The file stream to write the response to.
 extern void iw_thread_dump(FILE *out);
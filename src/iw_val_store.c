@@ -139,12 +139,19 @@ static void iw_val_store_destroy_criteria(void *node) {
 // --------------------------------------------------------------------------
 
 bool iw_val_store_initialize(iw_val_store *store, bool controlled) {
-    if(!iw_htable_init(&store->table, 1024, false, NULL)) {
+    // Store the keys so that names with the same hash can't be mistaken
+    // for each other. The names may come from web requests so a seeded hash
+    // is used to keep the names from being chosen to collide.
+    if(!iw_htable_init_ex(&store->table, 1024, false, iw_hash_seeded,
+                          IW_HTABLE_FLAG_KEYS))
+    {
         return false;
     }
     store->controlled = controlled;
     if(controlled) {
-        if(!iw_htable_init(&store->names, 1024, false, NULL)) {
+        if(!iw_htable_init_ex(&store->names, 1024, false, iw_hash_seeded,
+                              IW_HTABLE_FLAG_KEYS))
+        {
             iw_htable_destroy(&store->table, iw_val_destroy_value);
             return false;
         }
@@ -447,6 +454,51 @@ void *iw_val_store_get_next(iw_val_store *store, unsigned long *token) {
     return (iw_val *)iw_htable_get_next(&store->table, token);
 }
 
+// --------------------------------------------------------------------------
+
+void *iw_val_store_iter_first(iw_val_store *store, iw_htable_iter *iter) {
+    return (iw_val *)iw_htable_iter_first(&store->table, iter);
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_val_store_iter_next(iw_htable_iter *iter) {
+    return (iw_val *)iw_htable_iter_next(iter);
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Compare the names of two values.
+/// @param val1 The first value.
+/// @param val2 The second value.
+/// @return Less than zero, zero, or higher than zero if the first value name
+///         is prior to, equal to, or subsequent to the second value name.
+static int iw_val_store_compare(const void *val1, const void *val2) {
+    return strcmp(((const iw_val *)val1)->name, ((const iw_val *)val2)->name);
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_val_store_get_first_ordered(
+    iw_val_store *store,
+    unsigned long *token)
+{
+    return (iw_val *)iw_htable_get_first_ordered(&store->table,
+                                                 iw_val_store_compare,
+                                                 token);
+}
+
+// --------------------------------------------------------------------------
+
+void *iw_val_store_get_next_ordered(
+    iw_val_store *store,
+    unsigned long *token)
+{
+    return (iw_val *)iw_htable_get_next_ordered(&store->table,
+                                                iw_val_store_compare,
+                                                token);
+}
+
 // --------------------------------------------------------------------------
 //
 // Add a pre-defined value to the value store.
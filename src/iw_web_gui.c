@@ -13,8 +13,10 @@
 #include "iw_cfg.h"
 #include "iw_ip.h"
 #include "iw_log.h"
+#include "iw_memory_int.h"
 #include "iw_util.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 // --------------------------------------------------------------------------
@@ -28,7 +30,7 @@ static iw_web_srv *s_web_gui = NULL;
 
 /// The menu structure.
 static char *s_menu[] = {
-    "/About", "/Run-time", "/Configuration"
+    "/About", "/Run-time", "/Configuration", "/Memory"
 };
 
 /// The page to display
@@ -36,7 +38,8 @@ typedef enum {
     PG_NONE    = -1,
     PG_ABOUT   = 0,
     PG_RUNTIME = 1,
-    PG_CONFIG  = 2
+    PG_CONFIG  = 2,
+    PG_MEMORY  = 3
 } PAGE;
 
 // --------------------------------------------------------------------------
@@ -222,7 +225,7 @@ static bool iw_web_gui_construct_config_page(FILE *out) {
     fprintf(out, "<form method='post'>\n");
     fprintf(out, "<table class='data'>\n");
     fprintf(out, "<tr><th>Name</th><th>Value</th></tr>\n");
-    iw_val *value = iw_val_store_get_first(&iw_cfg, &token);
+    iw_val *value = iw_val_store_get_first_ordered(&iw_cfg, &token);
     while(value != NULL) {
         char value_buff[128];
         char output_buff[128];
@@ -234,7 +237,7 @@ static bool iw_web_gui_construct_config_page(FILE *out) {
             "  <td><input type='text' name='%s' value='%s'></td>\n"
             "</tr>\n",
             value->name, value->name, output_buff);
-        value = iw_val_store_get_next(&iw_cfg, &token);
+        value = iw_val_store_get_next_ordered(&iw_cfg, &token);
     }
     fprintf(out, "</table>\n");
     fprintf(out, "<input type='submit' name='Apply'>\n");
@@ -245,12 +248,84 @@ static bool iw_web_gui_construct_config_page(FILE *out) {
 
 // --------------------------------------------------------------------------
 
+/// @brief Display the memory use of each memory tag.
+/// Nothing is displayed if memory tracking is disabled.
+/// @param out The file stream to write the response to.
+static void iw_web_gui_construct_memory_tags(FILE *out) {
+    iw_memory_tag_info info;
+    unsigned int tag;
+    char name[256];
+    char buff1[64];
+    char buff2[64];
+
+    if(!iw_memory_tag_info_get(IW_MEM_TAG_NONE, &info)) {
+        return;
+    }
+    fprintf(out, "<h2>Memory Tags</h2>\n");
+    fprintf(out, "<table class='data'>\n");
+    fprintf(out, "<tr><th>Tag</th><th>Allocations</th><th>Current</th>"
+                 "<th>Peak</th></tr>\n");
+    for(tag=0;iw_memory_tag_info_get(tag, &info);tag++) {
+        iw_web_req_sanitize(info.name, name, sizeof(name));
+        fprintf(out,
+            "<tr><td>%s</td><td>%lu</td><td>%s</td><td>%s</td></tr>\n",
+            name, info.allocs,
+            iw_memory_display_str(sizeof(buff1), buff1, info.cur_bytes),
+            tag == IW_MEM_TAG_NONE ? "-" :
+                iw_memory_display_str(sizeof(buff2), buff2, info.peak_bytes));
+    }
+    fprintf(out, "</table>\n");
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Display the allocations of each size class.
+/// Nothing is displayed if memory tracking is disabled.
+/// @param out The file stream to write the response to.
+static void iw_web_gui_construct_memory_hist(FILE *out) {
+    iw_memory_hist_info info;
+    unsigned int cls;
+    char size[64];
+    char bytes[64];
+
+    if(!iw_memory_hist_get(0, &info)) {
+        return;
+    }
+    fprintf(out, "<h2>Allocations by Size</h2>\n");
+    fprintf(out, "<table class='data'>\n");
+    fprintf(out, "<tr><th>Size</th><th>Live</th><th>Live bytes</th>"
+                 "<th>Allocs/s</th><th>Frees/s</th><th>Peak allocs/s</th>"
+                 "<th>Avg lifetime (us)</th></tr>\n");
+    for(cls=0;iw_memory_hist_get(cls, &info);cls++) {
+        if(info.allocs == 0) {
+            continue;
+        }
+        if(info.max_size != 0) {
+            snprintf(size, sizeof(size), "%zu-%zu", info.min_size,
+                     info.max_size);
+        } else {
+            snprintf(size, sizeof(size), "&gt;%zu", info.min_size - 1);
+        }
+        fprintf(out,
+            "<tr><td>%s</td><td>%lu</td><td>%s</td><td>%.1f</td>"
+            "<td>%.1f</td><td>%.1f</td><td>%.0f</td></tr>\n",
+            size, info.live,
+            iw_memory_display_str(sizeof(bytes), bytes, info.live_bytes),
+            info.alloc_rate, info.free_rate, info.peak_rate, info.lifetime);
+    }
+    fprintf(out, "</table>\n");
+}
+
+// --------------------------------------------------------------------------
+
 /// @brief Create the configuration page.
 /// @param out The file stream to write the response to.
 /// @return True if the response was successfully created.
 static bool iw_web_gui_construct_runtime_page(FILE *out) {
     fprintf(out, "<h1>Run-time Statistics</h1>\n");
 
+    iw_web_gui_construct_memory_tags(out);
+
     if(iw_cb.runtime != NULL) {
         iw_cb.runtime(out);
     }
@@ -260,6 +335,82 @@ static bool iw_web_gui_construct_runtime_page(FILE *out) {
 
 // --------------------------------------------------------------------------
 
+/// @brief Get the value of a request parameter.
+/// @param req The request that was made.
+/// @param name The name of the parameter.
+/// @return The value or NULL if the parameter is missing or empty.
+static const char *iw_web_gui_get_value(iw_web_req *req, const char *name) {
+    iw_web_req_parameter *param = iw_web_req_get_parameter(req, name);
+    if(param == NULL || param->value == NULL || param->value[0] == '\0') {
+        return NULL;
+    }
+    return param->value;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Display the contents of a text report as preformatted text.
+/// @param out The file stream to write the response to.
+/// @param text The text to display.
+static void iw_web_gui_print_text(FILE *out, const char *text) {
+    // Each character is replaced by at most a six character HTML entity.
+    int len = strlen(text) * 6 + 1;
+    char *buff = (char *)malloc(len);
+    if(buff != NULL) {
+        iw_web_req_sanitize(text, buff, len);
+        fprintf(out, "<pre>\n%s</pre>\n", buff);
+        free(buff);
+    }
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief Create the memory page.
+/// Allows heap snapshots to be taken and compared.
+/// @param req The request that was made.
+/// @param out The file stream to write the response to.
+/// @return True if the response was successfully created.
+static bool iw_web_gui_construct_memory_page(iw_web_req *req, FILE *out) {
+    fprintf(out, "<h1>Memory</h1>\n");
+
+    char *ptr = NULL;
+    size_t size = 0;
+    FILE *report = open_memstream(&ptr, &size);
+    if(report == NULL) {
+        return false;
+    }
+    const char *name = iw_web_gui_get_value(req, "snapshot");
+    if(name != NULL && !iw_memory_snapshot(name)) {
+        fprintf(report, "Failed to take heap snapshot.\n\n");
+    }
+    iw_memory_snapshots(report);
+    const char *from = iw_web_gui_get_value(req, "from");
+    if(from != NULL) {
+        fprintf(report, "\n");
+        iw_memory_diff(report, from, iw_web_gui_get_value(req, "to"));
+    }
+    fclose(report);
+
+    fprintf(out,
+        "<form method='get'>\n"
+        "  Snapshot <input type='text' name='snapshot'>\n"
+        "  <input type='submit' value='Take snapshot'>\n"
+        "</form>\n"
+        "<form method='get'>\n"
+        "  Growth from <input type='text' name='from'>\n"
+        "  to <input type='text' name='to' placeholder='live heap'>\n"
+        "  <input type='submit' value='Compare'>\n"
+        "</form>\n");
+    iw_web_gui_print_text(out, ptr);
+    free(ptr);
+
+    iw_web_gui_construct_memory_hist(out);
+
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
 /// @brief Create a web page.
 /// @param req The request that was made.
 /// @param out The file stream to write the response to.
@@ -322,6 +473,9 @@ static bool iw_web_gui_construct_web_page(iw_web_req *req, FILE *out) {
         }
         iw_web_gui_construct_config_page(out);
         break;
+    case PG_MEMORY :
+        iw_web_gui_construct_memory_page(req, out);
+        break;
     default :
         return false;
         break;
@@ -349,6 +503,9 @@ static bool iw_web_gui_construct_response(iw_web_req *req, FILE *out) {
     if(iw_parse_cmp("/style.css", req->buff, &req->path)) {
         LOG(IW_LOG_GUI, "Sending style sheet");
         return iw_web_gui_construct_style_sheet(out);
+    } else if(iw_parse_cmp("/pprof/heap", req->buff, &req->path)) {
+        LOG(IW_LOG_GUI, "Sending heap profile");
+        return iw_memory_pprof(out);
     } else {
         LOG(IW_LOG_GUI, "Sending web page");
         return iw_web_gui_construct_web_page(req, out);
@@ -12,6 +12,7 @@
 
 #include "iw_web_req.h"
 
+#include "iw_common.h"
 #include "iw_log.h"
 #include "iw_memory.h"
 #include "iw_thread.h"
@@ -27,17 +28,22 @@
 
 // --------------------------------------------------------------------------
 //
-// Function API
+// Helper functions
 //
 // --------------------------------------------------------------------------
 
-char *iw_web_req_urldecode(const char *str, unsigned int len) {
+/// @brief URL decodes a given string into the given buffer.
+/// @param str The string to URL decode.
+/// @param len The length of the string.
+/// @param copy The buffer to decode the string into, at least len + 1 bytes.
+/// @return True if the string was successfully decoded.
+static bool iw_web_req_urldecode_buff(
+    const char *str,
+    unsigned int len,
+    char *copy)
+{
     unsigned int str_idx, copy_idx;
     char buff[3] = { 0 };
-    char *copy = IW_MALLOC(len + 1);
-    if(copy == NULL) {
-        return NULL;
-    }
 
     for(str_idx=0, copy_idx=0;str_idx < len;copy_idx++) {
         if(*(str + str_idx) == '%') {
@@ -45,8 +51,7 @@ char *iw_web_req_urldecode(const char *str, unsigned int len) {
             buff[1] = *(str + str_idx + 2);
             long long int ascii;
             if(!iw_util_strtoll(buff, &ascii, 16)) {
-                IW_FREE(copy);
-                return NULL;
+                return false;
             }
             *(copy + copy_idx) = ascii;
             str_idx += 3;
@@ -59,6 +64,44 @@ char *iw_web_req_urldecode(const char *str, unsigned int len) {
         }
     }
     *(copy + copy_idx) = '\0';
+    return true;
+}
+
+// --------------------------------------------------------------------------
+
+/// @brief URL decodes a given string into memory allocated from the arena
+/// of the request.
+/// @param req The request to allocate the decoded string for.
+/// @param str The string to URL decode.
+/// @param len The length of the string.
+/// @return A NUL-terminated URL decoded copy of the given string.
+static char *iw_web_req_urldecode_arena(
+    iw_web_req *req,
+    const char *str,
+    unsigned int len)
+{
+    char *copy = (char *)iw_arena_alloc(&req->arena, len + 1);
+    if(copy == NULL || !iw_web_req_urldecode_buff(str, len, copy)) {
+        return NULL;
+    }
+    return copy;
+}
+
+// --------------------------------------------------------------------------
+//
+// Function API
+//
+// --------------------------------------------------------------------------
+
+char *iw_web_req_urldecode(const char *str, unsigned int len) {
+    char *copy = IW_MALLOC(len + 1);
+    if(copy == NULL) {
+        return NULL;
+    }
+    if(!iw_web_req_urldecode_buff(str, len, copy)) {
+        IW_FREE(copy);
+        return NULL;
+    }
     return copy;
 }
 
@@ -87,6 +130,8 @@ bool iw_web_req_sanitize(const char *value, char *buff, int buff_len) {
 
 void iw_web_req_init(iw_web_req *req) {
     memset(req, 0, sizeof(*req));
+    iw_arena_init(&req->arena, "web request", IW_WEB_REQ_ARENA_BLOCK,
+                  IW_WEB_REQ_ARENA_CAP, true);
 }
 
 // --------------------------------------------------------------------------
@@ -96,8 +141,8 @@ iw_web_req_header *iw_web_req_add_header(
     iw_parse_index *name,
     iw_parse_index *value)
 {
-    iw_web_req_header *hdr =
-            (iw_web_req_header *)IW_CALLOC(1, sizeof(iw_web_req_header));
+    iw_web_req_header *hdr = (iw_web_req_header *)iw_arena_calloc(
+                                    &req->arena, sizeof(iw_web_req_header));
     if(hdr == NULL) {
         return NULL;
     }
@@ -118,13 +163,22 @@ iw_web_req_parameter *iw_web_req_add_parameter(
     iw_parse_index *name,
     iw_parse_index *value)
 {
-    iw_web_req_parameter *param =
-            (iw_web_req_parameter *)IW_CALLOC(1, sizeof(iw_web_req_parameter));
+    iw_web_req_parameter *param = (iw_web_req_parameter *)iw_arena_calloc(
+                                    &req->arena, sizeof(iw_web_req_parameter));
     if(param == NULL) {
         return NULL;
     }
-    param->name  = iw_web_req_urldecode(req->buff + name->start, name->len);
-    param->value = iw_web_req_urldecode(req->buff + value->start, value->len);
+    param->name  = iw_web_req_urldecode_arena(req, req->buff + name->start,
+                                              name->len);
+    if(value != NULL) {
+        param->value = iw_web_req_urldecode_arena(req, req->buff + value->start,
+                                                  value->len);
+    } else {
+        param->value = iw_web_req_urldecode_arena(req, "", 0);
+    }
+    if(param->name == NULL || param->value == NULL) {
+        return NULL;
+    }
     iw_list_add(&req->parameters, (iw_list_node *)param);
     return param;
 }
@@ -132,24 +186,22 @@ iw_web_req_parameter *iw_web_req_add_parameter(
 // --------------------------------------------------------------------------
 
 void iw_web_req_delete_header(iw_list_node *node) {
-    iw_web_req_header *hdr = (iw_web_req_header *)node;
-    IW_FREE(hdr);
+    UNUSED(node);
 }
 
 // --------------------------------------------------------------------------
 
 void iw_web_req_delete_parameter(iw_list_node *node) {
-    iw_web_req_parameter *param = (iw_web_req_parameter *)node;
-    IW_FREE(param->name);
-    IW_FREE(param->value);
-    IW_FREE(param);
+    UNUSED(node);
 }
 
 // --------------------------------------------------------------------------
 
 void iw_web_req_free(iw_web_req *req) {
-    iw_list_destroy(&req->headers, iw_web_req_delete_header);
-    iw_list_destroy(&req->parameters, iw_web_req_delete_parameter);
+    // The list nodes are part of the arena memory.
+    iw_list_init(&req->headers, false);
+    iw_list_init(&req->parameters, false);
+    iw_arena_destroy(&req->arena);
 }
 
 // --------------------------------------------------------------------------
@@ -159,7 +211,8 @@ void iw_web_req_free(iw_web_req *req) {
 /// @param req The HTTP request to parse.
 /// @param start The start of the query to parse.
 /// @param end The end of the query to parse.
-static void iw_web_req_parse_query(
+/// @return False if the parameters didn't fit in the request arena.
+static bool iw_web_req_parse_query(
     iw_web_req *req,
     unsigned int start,
     unsigned int end)
@@ -176,23 +229,30 @@ static void iw_web_req_parse_query(
         if(parse == IW_PARSE_MATCH) {
             // We found a name/value pair, let's add that
             // Create a header index for this header
-            iw_web_req_add_parameter(req, &name, &value);
+            if(iw_web_req_add_parameter(req, &name, &value) == NULL) {
+                return false;
+            }
         } else if(offset < req->parse_point) {
             // We couldn't find another parameter but there are more
             // characters after this equal sign. This means that this
             // is the last parameter and we take the remaining data.
             value.start = offset;
             value.len   = end - offset;
-            iw_web_req_add_parameter(req, &name, &value);
+            if(iw_web_req_add_parameter(req, &name, &value) == NULL) {
+                return false;
+            }
         } else {
             // We found a name without a value, let's add that
             // Create a header index for this header
-             iw_web_req_add_parameter(req, &name, NULL);
-       }
+            if(iw_web_req_add_parameter(req, &name, NULL) == NULL) {
+                return false;
+            }
+        }
         parse = iw_parse_read_to_token(req->buff, end,
                                         &offset, IW_PARSE_EQUAL,
                                         false, &name);
     }
+    return true;
 }
 
 // --------------------------------------------------------------------------
@@ -261,8 +321,11 @@ IW_WEB_PARSE iw_web_req_parse(iw_web_req *req) {
             // the whole URI.
             req->path = req->uri;
         } else {
-            // There is a '?' present. Collect each parameter.
-            iw_web_req_parse_query(req, offset, end);
+            // There is a '?' present. Collect each parameter. Handlers
+            // mustn't see only some of the parameters.
+            if(!iw_web_req_parse_query(req, offset, end)) {
+                return IW_WEB_PARSE_ERROR;
+            }
         }
 
         // Parse the protocol version
@@ -321,7 +384,10 @@ IW_WEB_PARSE iw_web_req_parse(iw_web_req *req) {
         }
 
         // Create a header index for this header
-        iw_web_req_add_header(req, &name, &value);
+        if(iw_web_req_add_header(req, &name, &value) == NULL) {
+            // The headers don't fit in the request arena.
+            return IW_WEB_PARSE_ERROR;
+        }
     }
 
     // The presence of an empty line signifies the end of the request header.
@@ -348,8 +414,11 @@ IW_WEB_PARSE iw_web_req_parse(iw_web_req *req) {
                         req->buff, &hdr->value))
     {
         // Parse the body
-        iw_web_req_parse_query(req, req->content.start,
-                               req->content.start + req->content.len);
+        if(!iw_web_req_parse_query(req, req->content.start,
+                                   req->content.start + req->content.len))
+        {
+            return IW_WEB_PARSE_ERROR;
+        }
     }
 
     // Debug log the request we just received
@@ -101,14 +101,13 @@ static void iw_web_srv_process_request(iw_web_srv *srv, int fd) {
     FILE *out = NULL;
     iw_web_req req;
     iw_buff buff;
-    memset(&req, 0, sizeof(req));
+    iw_web_req_init(&req);
     if(!iw_buff_create(&buff, BUFF_SIZE, 10 * BUFF_SIZE)) {
         LOG(IW_LOG_WEB, "Failed to create command server request buffer");
         goto done;
     }
     out = fdopen(fd, "r+w+");
     int bytes;
-    iw_web_req_init(&req);
     do {
         char *ptr;
         if(!iw_buff_reserve_data(&buff, &ptr, BUFF_SIZE)) {
@@ -163,6 +162,7 @@ static void *iw_web_srv_thread(void *param) {
     if(srv == NULL) {
         return NULL;
     }
+    iw_memory_tag_set(iw_memory_tag_register("Web Server"));
 
     // Entering web server loop.
     LOG(IW_LOG_WEB, "Entering web server loop");
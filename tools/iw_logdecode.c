@@ -0,0 +1,46 @@
+// --------------------------------------------------------------------------
+///
+/// @file iw_logdecode.c
+///
+/// Formats a binary log saved with the 'log dump <file>' command.
+///
+/// Copyright (c) 2014-2018 Mattias Mattsson. All rights reserved.
+/// This source is distributed under the license in LICENSE.txt in the top
+/// InstaWorks directory.
+///
+// --------------------------------------------------------------------------
+
+#include "iw_log_int.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// --------------------------------------------------------------------------
+
+/// @brief The log decoder main entrypoint.
+/// @param argc The argument count.
+/// @param argv The arguments.
+int main(int argc, char **argv) {
+    if(argc != 2) {
+        printf("Usage: iw_logdecode <file>\n"
+               "Formats the messages of a binary log saved with 'log dump <file>'.\n"
+               "Use '-' to read the binary log from standard input.\n");
+        return 1;
+    }
+    FILE *in = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+    if(in == NULL) {
+        fprintf(stderr, "Failed to open \"%s\"\n", argv[1]);
+        return 1;
+    }
+    bool ok = iw_log_bin_decode(in, stdout);
+    if(in != stdin) {
+        fclose(in);
+    }
+    if(!ok) {
+        fprintf(stderr, "\"%s\" is not a valid binary log\n", argv[1]);
+        return 1;
+    }
+    return 0;
+}
+
+// --------------------------------------------------------------------------